@@ -0,0 +1,324 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2020, Google Inc.
+ *
+ * benchmark.cpp - libcamera benchmark harness
+ */
+
+#include "benchmark.h"
+
+#include <algorithm>
+#include <ctime>
+#include <fstream>
+#include <getopt.h>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <sys/utsname.h>
+
+#include <libcamera/camera_manager.h>
+
+using namespace libcamera;
+
+BenchmarkState::BenchmarkState(uint64_t iterations)
+	: iterations_(iterations), remaining_(iterations),
+	  paused_(std::chrono::steady_clock::duration::zero()),
+	  manualTime_(false), items_(0), bytes_(0)
+{
+}
+
+void BenchmarkState::pauseTiming()
+{
+	pauseStart_ = std::chrono::steady_clock::now();
+}
+
+void BenchmarkState::resumeTiming()
+{
+	paused_ += std::chrono::steady_clock::now() - pauseStart_;
+}
+
+void BenchmarkState::setTime(std::chrono::nanoseconds time)
+{
+	start_ = std::chrono::steady_clock::time_point();
+	end_ = start_ + time;
+	paused_ = std::chrono::steady_clock::duration::zero();
+	manualTime_ = true;
+}
+
+std::chrono::nanoseconds BenchmarkState::time() const
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(end_ - start_ - paused_);
+}
+
+Benchmark::Benchmark(const char *name, Function function, Mode mode)
+	: name_(name), function_(function), mode_(mode)
+{
+	benchmarks().push_back(this);
+}
+
+std::vector<Benchmark *> &Benchmark::benchmarks()
+{
+	static std::vector<Benchmark *> benchmarks;
+	return benchmarks;
+}
+
+namespace {
+
+struct Result {
+	std::string name;
+	uint64_t iterations;
+	std::chrono::nanoseconds time;
+	uint64_t items;
+	uint64_t bytes;
+	std::map<std::string, double> counters;
+	std::string skipped;
+
+	double nsPerIteration() const
+	{
+		return iterations ? static_cast<double>(time.count()) / iterations : 0.0;
+	}
+};
+
+Result runBenchmark(const Benchmark *benchmark, std::chrono::nanoseconds minTime)
+{
+	uint64_t iterations = 1;
+
+	while (true) {
+		BenchmarkState state(iterations);
+		benchmark->run(state);
+
+		std::chrono::nanoseconds time = state.time();
+
+		if (benchmark->mode() == Benchmark::SingleShot ||
+		    !state.skipped().empty() || time >= minTime ||
+		    iterations >= 1000000000) {
+			return { benchmark->name(), state.iterations(), time,
+				 state.items(), state.bytes(), state.counters(),
+				 state.skipped() };
+		}
+
+		/*
+		 * Scale the iteration count to reach the minimum time, with
+		 * some margin, growing by at least 2x and at most 10x.
+		 */
+		double scale = time.count()
+			     ? 1.4 * minTime.count() / time.count() : 10.0;
+		scale = std::clamp(scale, 2.0, 10.0);
+		iterations = static_cast<uint64_t>(iterations * scale);
+	}
+}
+
+std::string humanReadable(double value, const char *unit)
+{
+	static const char *prefixes[] = { "", "k", "M", "G", "T" };
+	unsigned int i = 0;
+
+	while (value >= 1000.0 && i < 4) {
+		value /= 1000.0;
+		i++;
+	}
+
+	std::stringstream ss;
+	ss << std::fixed << std::setprecision(2) << value << " "
+	   << prefixes[i] << unit;
+	return ss.str();
+}
+
+void printResult(const Result &result)
+{
+	std::cout << std::left << std::setw(40) << result.name << std::right;
+
+	if (!result.skipped.empty()) {
+		std::cout << " skipped: " << result.skipped << std::endl;
+		return;
+	}
+
+	double seconds = result.time.count() / 1e9;
+
+	std::cout << std::setw(14) << std::fixed << std::setprecision(1)
+		  << result.nsPerIteration() << " ns"
+		  << std::setw(12) << result.iterations;
+
+	if (result.items && seconds > 0)
+		std::cout << "  " << humanReadable(result.items / seconds, "items/s");
+	if (result.bytes && seconds > 0)
+		std::cout << "  " << humanReadable(result.bytes / seconds, "B/s");
+
+	for (const auto &counter : result.counters)
+		std::cout << "  " << counter.first << "="
+			  << std::setprecision(3) << counter.second;
+
+	std::cout << std::endl;
+}
+
+std::string jsonEscape(const std::string &str)
+{
+	std::string escaped;
+
+	for (char c : str) {
+		if (c == '"' || c == '\\')
+			escaped += '\\';
+		escaped += c;
+	}
+
+	return escaped;
+}
+
+void writeJson(std::ostream &out, const std::vector<Result> &results)
+{
+	struct utsname uts;
+	uname(&uts);
+
+	char date[32];
+	time_t now = time(nullptr);
+	strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S%z", localtime(&now));
+
+	out << "{\n"
+	    << "  \"context\": {\n"
+	    << "    \"date\": \"" << date << "\",\n"
+	    << "    \"libcamera_version\": \"" << jsonEscape(CameraManager::version()) << "\",\n"
+	    << "    \"host\": \"" << jsonEscape(uts.nodename) << "\",\n"
+	    << "    \"kernel\": \"" << jsonEscape(uts.release) << "\",\n"
+	    << "    \"machine\": \"" << jsonEscape(uts.machine) << "\"\n"
+	    << "  },\n"
+	    << "  \"benchmarks\": [";
+
+	for (unsigned int i = 0; i < results.size(); i++) {
+		const Result &result = results[i];
+
+		out << (i ? "," : "") << "\n    {\n"
+		    << "      \"name\": \"" << jsonEscape(result.name) << "\",\n";
+
+		if (!result.skipped.empty()) {
+			out << "      \"skipped\": \"" << jsonEscape(result.skipped)
+			    << "\"\n    }";
+			continue;
+		}
+
+		out << "      \"iterations\": " << result.iterations << ",\n"
+		    << "      \"real_time_ns\": " << result.time.count() << ",\n"
+		    << "      \"ns_per_iteration\": " << std::setprecision(6)
+		    << result.nsPerIteration();
+
+		if (result.items)
+			out << ",\n      \"items\": " << result.items;
+		if (result.bytes)
+			out << ",\n      \"bytes\": " << result.bytes;
+
+		if (!result.counters.empty()) {
+			out << ",\n      \"counters\": {";
+
+			unsigned int j = 0;
+			for (const auto &counter : result.counters)
+				out << (j++ ? "," : "") << "\n        \""
+				    << jsonEscape(counter.first) << "\": "
+				    << counter.second;
+
+			out << "\n      }";
+		}
+
+		out << "\n    }";
+	}
+
+	out << "\n  ]\n}\n";
+}
+
+void usage(const char *argv0)
+{
+	std::cout
+		<< "Usage: " << argv0 << " [options]\n\n"
+		<< "Options:\n"
+		<< "  -f, --filter <string>   Only run benchmarks whose name contains <string>\n"
+		<< "  -j, --json <file>       Write results in JSON format to <file> ('-' for stdout)\n"
+		<< "  -l, --list              List the available benchmarks\n"
+		<< "  -t, --min-time <ms>     Minimum run time of iterative benchmarks (default 500)\n"
+		<< "  -h, --help              Display this help message\n";
+}
+
+} /* namespace */
+
+int main(int argc, char *argv[])
+{
+	static const struct option options[] = {
+		{ "filter", required_argument, nullptr, 'f' },
+		{ "json", required_argument, nullptr, 'j' },
+		{ "list", no_argument, nullptr, 'l' },
+		{ "min-time", required_argument, nullptr, 't' },
+		{ "help", no_argument, nullptr, 'h' },
+		{ nullptr, 0, nullptr, 0 },
+	};
+
+	std::chrono::milliseconds minTime(500);
+	std::string filter;
+	std::string json;
+	bool list = false;
+	int opt;
+
+	while ((opt = getopt_long(argc, argv, "f:j:lt:h", options, nullptr)) != -1) {
+		switch (opt) {
+		case 'f':
+			filter = optarg;
+			break;
+		case 'j':
+			json = optarg;
+			break;
+		case 'l':
+			list = true;
+			break;
+		case 't':
+			minTime = std::chrono::milliseconds(atoi(optarg));
+			break;
+		case 'h':
+			usage(argv[0]);
+			return 0;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	std::vector<Benchmark *> benchmarks;
+	for (Benchmark *benchmark : Benchmark::benchmarks()) {
+		if (benchmark->name().find(filter) != std::string::npos)
+			benchmarks.push_back(benchmark);
+	}
+
+	std::sort(benchmarks.begin(), benchmarks.end(),
+		  [](const Benchmark *a, const Benchmark *b) {
+			  return a->name() < b->name();
+		  });
+
+	if (list) {
+		for (const Benchmark *benchmark : benchmarks)
+			std::cout << benchmark->name() << std::endl;
+		return 0;
+	}
+
+	/* Keep stdout clean when writing JSON to it. */
+	bool human = json != "-";
+
+	std::vector<Result> results;
+	for (const Benchmark *benchmark : benchmarks) {
+		results.push_back(runBenchmark(benchmark, minTime));
+		if (human)
+			printResult(results.back());
+	}
+
+	if (json.empty())
+		return 0;
+
+	if (json == "-") {
+		writeJson(std::cout, results);
+		return 0;
+	}
+
+	std::ofstream file(json);
+	if (!file.is_open()) {
+		std::cerr << "Failed to open " << json << std::endl;
+		return 1;
+	}
+
+	writeJson(file, results);
+
+	return 0;
+}
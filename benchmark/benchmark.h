@@ -0,0 +1,105 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2020, Google Inc.
+ *
+ * benchmark.h - libcamera benchmark harness
+ */
+#ifndef __BENCHMARK_BENCHMARK_H__
+#define __BENCHMARK_BENCHMARK_H__
+
+#include <chrono>
+#include <functional>
+#include <map>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+class BenchmarkState
+{
+public:
+	BenchmarkState(uint64_t iterations);
+
+	bool keepRunning()
+	{
+		if (remaining_ == iterations_)
+			start_ = std::chrono::steady_clock::now();
+
+		if (remaining_) {
+			remaining_--;
+			return true;
+		}
+
+		end_ = std::chrono::steady_clock::now();
+		return false;
+	}
+
+	void pauseTiming();
+	void resumeTiming();
+
+	void setIterations(uint64_t iterations) { iterations_ = iterations; }
+	void setTime(std::chrono::nanoseconds time);
+	void setItemsProcessed(uint64_t items) { items_ = items; }
+	void setBytesProcessed(uint64_t bytes) { bytes_ = bytes; }
+	void setCounter(const std::string &name, double value) { counters_[name] = value; }
+	void skip(const std::string &reason) { skipped_ = reason; }
+
+	uint64_t iterations() const { return iterations_; }
+	std::chrono::nanoseconds time() const;
+	uint64_t items() const { return items_; }
+	uint64_t bytes() const { return bytes_; }
+	const std::map<std::string, double> &counters() const { return counters_; }
+	const std::string &skipped() const { return skipped_; }
+
+private:
+	uint64_t iterations_;
+	uint64_t remaining_;
+
+	std::chrono::steady_clock::time_point start_;
+	std::chrono::steady_clock::time_point end_;
+	std::chrono::steady_clock::duration paused_;
+	std::chrono::steady_clock::time_point pauseStart_;
+	bool manualTime_;
+
+	uint64_t items_;
+	uint64_t bytes_;
+	std::map<std::string, double> counters_;
+	std::string skipped_;
+};
+
+class Benchmark
+{
+public:
+	using Function = std::function<void(BenchmarkState &)>;
+
+	enum Mode {
+		/* Repeat the function with a growing iteration count. */
+		Iterative,
+		/* Run the function once, it reports its own time and iterations. */
+		SingleShot,
+	};
+
+	Benchmark(const char *name, Function function, Mode mode = Iterative);
+
+	const std::string &name() const { return name_; }
+	Mode mode() const { return mode_; }
+	void run(BenchmarkState &state) const { function_(state); }
+
+	static std::vector<Benchmark *> &benchmarks();
+
+private:
+	std::string name_;
+	Function function_;
+	Mode mode_;
+};
+
+/* Prevent the compiler from optimizing away a computed value. */
+template<typename T>
+inline void doNotOptimize(const T &value)
+{
+	asm volatile("" : : "r,m"(value) : "memory");
+}
+
+#define BENCHMARK_REGISTER(name, ...)					\
+static Benchmark benchmark_##name(#name, __VA_ARGS__);
+
+#endif /* __BENCHMARK_BENCHMARK_H__ */
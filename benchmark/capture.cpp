@@ -0,0 +1,406 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2020, Google Inc.
+ *
+ * capture.cpp - End-to-end capture and mode switch benchmarks on virtual cameras
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <stdlib.h>
+#include <vector>
+
+#include <libcamera/libcamera.h>
+
+#include "benchmark.h"
+
+using namespace libcamera;
+
+namespace {
+
+using clock = std::chrono::steady_clock;
+
+/*
+ * The virtual cameras used by the benchmarks. The variable isn't overridden
+ * if already set, to allow running the benchmarks with custom cameras
+ * carrying the same IDs.
+ */
+const char *kVirtualCameras =
+	"bench-1080p,size=1920x1080,formats=NV12,fps=120,buffers=8;"
+	"bench-vga,size=640x480,formats=YUYV,fps=1000,buffers=8";
+
+class CaptureSession
+{
+public:
+	CaptureSession(CameraManager *cm, std::shared_ptr<Camera> camera,
+		       unsigned int frames)
+		: cm_(cm), camera_(camera), frames_(frames), completed_(0),
+		  gaps_(0), lastSequence_(0)
+	{
+	}
+
+	int run(BenchmarkState &state, const Size &size);
+
+private:
+	void requestComplete(Request *request);
+
+	CameraManager *cm_;
+	std::shared_ptr<Camera> camera_;
+	unsigned int frames_;
+	std::atomic<unsigned int> completed_;
+	unsigned int gaps_;
+	unsigned int lastSequence_;
+
+	std::map<const FrameBuffer *, clock::time_point> queueTime_;
+	std::vector<double> latencies_;
+	clock::time_point end_;
+};
+
+int CaptureSession::run(BenchmarkState &state, const Size &size)
+{
+	std::unique_ptr<CameraConfiguration> config =
+		camera_->generateConfiguration({ StreamRole::VideoRecording });
+	if (!config)
+		return -EINVAL;
+
+	config->at(0).size = size;
+	config->validate();
+
+	if (camera_->configure(config.get()))
+		return -EINVAL;
+
+	Stream *stream = config->at(0).stream();
+	FrameBufferAllocator allocator(camera_);
+	if (allocator.allocate(stream) < 0)
+		return -ENOMEM;
+
+	camera_->requestCompleted.connect(this, &CaptureSession::requestComplete);
+
+	std::vector<Request *> requests;
+	for (const std::unique_ptr<FrameBuffer> &buffer : allocator.buffers(stream)) {
+		Request *request = camera_->createRequest();
+		request->addBuffer(stream, buffer.get());
+		requests.push_back(request);
+	}
+
+	/*
+	 * Populate the queue time map before starting, as it is updated from
+	 * the camera manager thread when requests are requeued.
+	 */
+	for (const std::unique_ptr<FrameBuffer> &buffer : allocator.buffers(stream))
+		queueTime_[buffer.get()] = clock::time_point();
+
+	if (camera_->start())
+		return -EIO;
+
+	clock::time_point start = clock::now();
+
+	for (Request *request : requests) {
+		queueTime_[request->buffers().begin()->second] = clock::now();
+		camera_->queueRequest(request);
+	}
+
+	/*
+	 * Requests complete in the camera manager thread, which interrupts
+	 * the dispatcher when the last frame has been captured.
+	 */
+	EventDispatcher *dispatcher = cm_->eventDispatcher();
+	Timer timeout;
+	timeout.start(std::chrono::milliseconds(frames_ * 100));
+
+	while (completed_ < frames_ && timeout.isRunning())
+		dispatcher->processEvents();
+
+	camera_->stop();
+	camera_->requestCompleted.disconnect(this, &CaptureSession::requestComplete);
+
+	if (completed_ < frames_) {
+		state.skip("capture timed out");
+		return 0;
+	}
+
+	std::sort(latencies_.begin(), latencies_.end());
+	double elapsed = std::chrono::duration<double>(end_ - start).count();
+	double mean = 0.0;
+	for (double latency : latencies_)
+		mean += latency;
+	mean /= latencies_.size();
+
+	state.setIterations(completed_);
+	state.setTime(std::chrono::duration_cast<std::chrono::nanoseconds>(end_ - start));
+	state.setItemsProcessed(completed_);
+	state.setBytesProcessed(static_cast<uint64_t>(completed_) *
+				config->at(0).frameSize);
+	state.setCounter("fps", completed_ / elapsed);
+	state.setCounter("latency_mean_ms", mean);
+	state.setCounter("latency_p99_ms",
+			 latencies_[latencies_.size() * 99 / 100]);
+	state.setCounter("latency_max_ms", latencies_.back());
+	state.setCounter("sequence_gaps", gaps_);
+
+	return 0;
+}
+
+void CaptureSession::requestComplete(Request *request)
+{
+	if (request->status() != Request::RequestComplete ||
+	    completed_ >= frames_)
+		return;
+
+	clock::time_point now = clock::now();
+	const Stream *stream = request->buffers().begin()->first;
+	FrameBuffer *buffer = request->buffers().begin()->second;
+
+	latencies_.push_back(std::chrono::duration<double, std::milli>(
+		now - queueTime_[buffer]).count());
+
+	unsigned int sequence = buffer->metadata().sequence;
+	if (completed_ && sequence != lastSequence_ + 1)
+		gaps_++;
+	lastSequence_ = sequence;
+
+	if (completed_ + 1 == frames_) {
+		end_ = now;
+		completed_++;
+		cm_->eventDispatcher()->interrupt();
+		return;
+	}
+
+	completed_++;
+
+	Request *next = camera_->createRequest();
+	next->addBuffer(stream, buffer);
+	queueTime_[buffer] = clock::now();
+	camera_->queueRequest(next);
+}
+
+void capture(BenchmarkState &state, const char *id, const Size &size,
+	     unsigned int frames)
+{
+	setenv("LIBCAMERA_VIRTUAL_CAMERAS", kVirtualCameras, 0);
+
+	CameraManager cm;
+	if (cm.start()) {
+		state.skip("failed to start camera manager");
+		return;
+	}
+
+	std::shared_ptr<Camera> camera = cm.get(id);
+	if (!camera) {
+		state.skip(std::string("camera ") + id + " not found");
+		cm.stop();
+		return;
+	}
+
+	camera->acquire();
+
+	CaptureSession session(&cm, camera, frames);
+	if (session.run(state, size) < 0)
+		state.skip("capture failed");
+
+	camera->release();
+	camera.reset();
+	cm.stop();
+}
+
+void captureVirtual1080p(BenchmarkState &state)
+{
+	capture(state, "bench-1080p", { 1920, 1080 }, 240);
+}
+
+/*
+ * Capture small frames at a high frame rate to measure the per-request
+ * overhead of the framework.
+ */
+void captureVirtualHighRate(BenchmarkState &state)
+{
+	capture(state, "bench-vga", { 640, 480 }, 2000);
+}
+
+/*
+ * Measure mode switches between two configurations of the same size, as when
+ * switching between preview and video recording. Every switch stops the
+ * camera, reconfigures it, and restarts capture. The switch time is measured
+ * from stop() to the completion of the first request in the new mode, and the
+ * reconfiguration time from stop() to the return of start().
+ *
+ * When \a reuse is true buffers are only reallocated if the camera reports
+ * that they are not preserved across the reconfiguration, otherwise they are
+ * freed and reallocated on every switch.
+ */
+class ModeSwitchSession
+{
+public:
+	ModeSwitchSession(CameraManager *cm, std::shared_ptr<Camera> camera)
+		: cm_(cm), camera_(camera), completed_(false)
+	{
+	}
+
+	int run(BenchmarkState &state, bool reuse, unsigned int switches);
+
+private:
+	void requestComplete(Request *request);
+
+	CameraManager *cm_;
+	std::shared_ptr<Camera> camera_;
+	std::atomic<bool> completed_;
+	clock::time_point firstFrame_;
+};
+
+int ModeSwitchSession::run(BenchmarkState &state, bool reuse,
+			   unsigned int switches)
+{
+	static const StreamRole roles[] = {
+		StreamRole::Viewfinder,
+		StreamRole::VideoRecording,
+	};
+
+	FrameBufferAllocator allocator(camera_);
+	std::vector<double> switchTimes;
+	std::vector<double> reconfigureTimes;
+	unsigned int allocations = 0;
+
+	camera_->requestCompleted.connect(this, &ModeSwitchSession::requestComplete);
+
+	/* The first iteration configures the camera and isn't measured. */
+	for (unsigned int i = 0; i <= switches; i++) {
+		std::unique_ptr<CameraConfiguration> config =
+			camera_->generateConfiguration({ roles[i % 2] });
+		if (!config)
+			return -EINVAL;
+
+		config->validate();
+
+		clock::time_point start = clock::now();
+
+		if (i)
+			camera_->stop();
+
+		if (camera_->configure(config.get()))
+			return -EINVAL;
+
+		Stream *stream = config->at(0).stream();
+		if (!reuse || !stream->buffersPreserved()) {
+			allocator.free(stream);
+			if (allocator.allocate(stream) < 0)
+				return -ENOMEM;
+			allocations++;
+		}
+
+		std::vector<Request *> requests;
+		for (const std::unique_ptr<FrameBuffer> &buffer : allocator.buffers(stream)) {
+			Request *request = camera_->createRequest();
+			request->addBuffer(stream, buffer.get());
+			requests.push_back(request);
+		}
+
+		completed_ = false;
+
+		if (camera_->start())
+			return -EIO;
+
+		clock::time_point started = clock::now();
+
+		for (Request *request : requests)
+			camera_->queueRequest(request);
+
+		EventDispatcher *dispatcher = cm_->eventDispatcher();
+		Timer timeout;
+		timeout.start(1000);
+
+		while (!completed_ && timeout.isRunning())
+			dispatcher->processEvents();
+
+		if (!completed_) {
+			camera_->stop();
+			state.skip("capture timed out");
+			return 0;
+		}
+
+		if (!i)
+			continue;
+
+		switchTimes.push_back(std::chrono::duration<double, std::milli>(
+			firstFrame_ - start).count());
+		reconfigureTimes.push_back(std::chrono::duration<double, std::milli>(
+			started - start).count());
+	}
+
+	camera_->stop();
+	camera_->requestCompleted.disconnect(this, &ModeSwitchSession::requestComplete);
+
+	std::sort(switchTimes.begin(), switchTimes.end());
+	std::sort(reconfigureTimes.begin(), reconfigureTimes.end());
+
+	double total = 0.0;
+	for (double time : switchTimes)
+		total += time;
+
+	state.setIterations(switches);
+	state.setTime(std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::duration<double, std::milli>(total)));
+	state.setCounter("switch_median_ms", switchTimes[switches / 2]);
+	state.setCounter("switch_max_ms", switchTimes.back());
+	state.setCounter("reconfigure_median_ms", reconfigureTimes[switches / 2]);
+	state.setCounter("reconfigure_max_ms", reconfigureTimes.back());
+	state.setCounter("allocations", allocations);
+
+	return 0;
+}
+
+void ModeSwitchSession::requestComplete(Request *request)
+{
+	if (request->status() != Request::RequestComplete || completed_)
+		return;
+
+	firstFrame_ = clock::now();
+	completed_ = true;
+	cm_->eventDispatcher()->interrupt();
+}
+
+void modeSwitch(BenchmarkState &state, bool reuse)
+{
+	setenv("LIBCAMERA_VIRTUAL_CAMERAS", kVirtualCameras, 0);
+
+	CameraManager cm;
+	if (cm.start()) {
+		state.skip("failed to start camera manager");
+		return;
+	}
+
+	std::shared_ptr<Camera> camera = cm.get("bench-1080p");
+	if (!camera) {
+		state.skip("camera bench-1080p not found");
+		cm.stop();
+		return;
+	}
+
+	camera->acquire();
+
+	ModeSwitchSession session(&cm, camera);
+	if (session.run(state, reuse, 20) < 0)
+		state.skip("mode switch failed");
+
+	camera->release();
+	camera.reset();
+	cm.stop();
+}
+
+void modeSwitchVirtualReallocate(BenchmarkState &state)
+{
+	modeSwitch(state, false);
+}
+
+void modeSwitchVirtualPreserveBuffers(BenchmarkState &state)
+{
+	modeSwitch(state, true);
+}
+
+} /* namespace */
+
+BENCHMARK_REGISTER(captureVirtual1080p, captureVirtual1080p, Benchmark::SingleShot)
+BENCHMARK_REGISTER(captureVirtualHighRate, captureVirtualHighRate, Benchmark::SingleShot)
+BENCHMARK_REGISTER(modeSwitchVirtualReallocate, modeSwitchVirtualReallocate, Benchmark::SingleShot)
+BENCHMARK_REGISTER(modeSwitchVirtualPreserveBuffers, modeSwitchVirtualPreserveBuffers, Benchmark::SingleShot)
@@ -0,0 +1,192 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2020, Google Inc.
+ *
+ * controls.cpp - ControlList and ControlSerializer benchmarks
+ */
+
+#include <vector>
+
+#include <libcamera/control_ids.h>
+#include <libcamera/controls.h>
+
+#include "libcamera/internal/byte_stream_buffer.h"
+#include "libcamera/internal/control_serializer.h"
+
+#include "benchmark.h"
+
+using namespace libcamera;
+
+namespace {
+
+/* A control info map representative of a typical ISP-based camera. */
+const ControlInfoMap &infoMap()
+{
+	static const ControlInfoMap info = {
+		{ &controls::AeEnable, ControlInfo(false, true) },
+		{ &controls::ExposureTime, ControlInfo(0, 66666) },
+		{ &controls::AnalogueGain, ControlInfo(1.0f, 32.0f) },
+		{ &controls::Brightness, ControlInfo(-1.0f, 1.0f) },
+		{ &controls::Contrast, ControlInfo(0.0f, 32.0f) },
+		{ &controls::Saturation, ControlInfo(0.0f, 32.0f) },
+		{ &controls::Sharpness, ControlInfo(0.0f, 16.0f) },
+		{ &controls::AwbEnable, ControlInfo(false, true) },
+		{ &controls::ColourGains, ControlInfo(0.0f, 32.0f) },
+		{ &controls::ColourCorrectionMatrix, ControlInfo(-16.0f, 16.0f) },
+	};
+
+	return info;
+}
+
+void fillList(ControlList &list)
+{
+	list.set(controls::AeEnable, true);
+	list.set(controls::ExposureTime, 10000);
+	list.set(controls::AnalogueGain, 2.0f);
+	list.set(controls::Brightness, 0.5f);
+	list.set(controls::Contrast, 1.2f);
+	list.set(controls::Saturation, 0.8f);
+	list.set(controls::Sharpness, 1.0f);
+	list.set(controls::AwbEnable, false);
+	list.set(controls::ColourGains, { 1.5f, 2.0f });
+	list.set(controls::ColourCorrectionMatrix,
+		 { 1.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 1.0f });
+}
+
+void controlListSetInt(BenchmarkState &state)
+{
+	ControlList list(controls::controls);
+	int32_t value = 0;
+
+	while (state.keepRunning())
+		list.set(controls::ExposureTime, value++);
+
+	state.setItemsProcessed(state.iterations());
+}
+
+void controlListSetArray(BenchmarkState &state)
+{
+	ControlList list(controls::controls);
+	float value = 0.0f;
+
+	while (state.keepRunning()) {
+		list.set(controls::ColourGains, { value, value });
+		value += 1.0f;
+	}
+
+	state.setItemsProcessed(state.iterations());
+}
+
+void controlListGet(BenchmarkState &state)
+{
+	ControlList list(infoMap());
+	fillList(list);
+
+	float sum = 0.0f;
+	while (state.keepRunning())
+		sum += list.get(controls::Brightness);
+
+	doNotOptimize(sum);
+	state.setItemsProcessed(state.iterations());
+}
+
+void controlListContains(BenchmarkState &state)
+{
+	ControlList list(infoMap());
+	fillList(list);
+
+	unsigned int count = 0;
+	while (state.keepRunning())
+		count += list.contains(controls::Lux);
+
+	doNotOptimize(count);
+	state.setItemsProcessed(state.iterations());
+}
+
+void controlListFill(BenchmarkState &state)
+{
+	while (state.keepRunning()) {
+		ControlList list(infoMap());
+		fillList(list);
+		doNotOptimize(list);
+	}
+
+	state.setItemsProcessed(state.iterations() * infoMap().size());
+}
+
+void controlListCopy(BenchmarkState &state)
+{
+	ControlList source(infoMap());
+	fillList(source);
+
+	while (state.keepRunning()) {
+		ControlList list = source;
+		doNotOptimize(list);
+	}
+
+	state.setItemsProcessed(state.iterations() * source.size());
+}
+
+void controlSerializerInfoMap(BenchmarkState &state)
+{
+	const ControlInfoMap &info = infoMap();
+	std::vector<uint8_t> data(ControlSerializer::binarySize(info));
+
+	while (state.keepRunning()) {
+		ControlSerializer serializer;
+		ControlSerializer deserializer;
+
+		ByteStreamBuffer buffer(data.data(), data.size());
+		serializer.serialize(info, buffer);
+
+		buffer = ByteStreamBuffer(const_cast<const uint8_t *>(data.data()),
+					  data.size());
+		ControlInfoMap result = deserializer.deserialize<ControlInfoMap>(buffer);
+		doNotOptimize(result);
+	}
+
+	state.setBytesProcessed(state.iterations() * data.size());
+}
+
+void controlSerializerList(BenchmarkState &state)
+{
+	ControlSerializer serializer;
+	ControlSerializer deserializer;
+
+	/* Share the info map between both ends, as the IPA IPC does. */
+	const ControlInfoMap &info = infoMap();
+	std::vector<uint8_t> infoData(ControlSerializer::binarySize(info));
+	ByteStreamBuffer infoBuffer(infoData.data(), infoData.size());
+	serializer.serialize(info, infoBuffer);
+	infoBuffer = ByteStreamBuffer(const_cast<const uint8_t *>(infoData.data()),
+				      infoData.size());
+	deserializer.deserialize<ControlInfoMap>(infoBuffer);
+
+	ControlList list(info);
+	fillList(list);
+
+	std::vector<uint8_t> data(ControlSerializer::binarySize(list));
+
+	while (state.keepRunning()) {
+		ByteStreamBuffer buffer(data.data(), data.size());
+		serializer.serialize(list, buffer);
+
+		buffer = ByteStreamBuffer(const_cast<const uint8_t *>(data.data()),
+					  data.size());
+		ControlList result = deserializer.deserialize<ControlList>(buffer);
+		doNotOptimize(result);
+	}
+
+	state.setBytesProcessed(state.iterations() * data.size());
+}
+
+} /* namespace */
+
+BENCHMARK_REGISTER(controlListSetInt, controlListSetInt)
+BENCHMARK_REGISTER(controlListSetArray, controlListSetArray)
+BENCHMARK_REGISTER(controlListGet, controlListGet)
+BENCHMARK_REGISTER(controlListContains, controlListContains)
+BENCHMARK_REGISTER(controlListFill, controlListFill)
+BENCHMARK_REGISTER(controlListCopy, controlListCopy)
+BENCHMARK_REGISTER(controlSerializerInfoMap, controlSerializerInfoMap)
+BENCHMARK_REGISTER(controlSerializerList, controlSerializerList)
@@ -0,0 +1,118 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2020, Google Inc.
+ *
+ * pixel_converter.cpp - PixelConverter benchmarks
+ */
+
+#include <algorithm>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include <libcamera/formats.h>
+
+#include "pixel_converter.h"
+
+#include "benchmark.h"
+
+using namespace libcamera;
+
+namespace {
+
+constexpr Size kFrameSize{ 1920, 1080 };
+
+/*
+ * The scalar NV to RGB conversion formerly used by qcam, kept as a reference
+ * for the PixelConverter kernels.
+ */
+void convertNVReference(const uint8_t *src, uint8_t *dst, unsigned int width,
+			unsigned int height)
+{
+	const uint8_t *src_c = src + width * height;
+
+	for (unsigned int y = 0; y < height; y++) {
+		const uint8_t *src_y = src + y * width;
+		const uint8_t *src_cb = src_c + (y / 2) * width;
+		const uint8_t *src_cr = src_cb + 1;
+
+		for (unsigned int x = 0; x < width; x++) {
+			int c = src_y[x] - 16;
+			int d = src_cb[x & ~1] - 128;
+			int e = src_cr[x & ~1] - 128;
+
+			dst[0] = std::clamp((298 * c + 516 * d + 128) >> 8, 0, 255);
+			dst[1] = std::clamp((298 * c - 100 * d - 208 * e + 128) >> 8, 0, 255);
+			dst[2] = std::clamp((298 * c + 409 * e + 128) >> 8, 0, 255);
+			dst[3] = 0xff;
+			dst += 4;
+		}
+	}
+}
+
+void nv12ToARGBReference(BenchmarkState &state)
+{
+	std::vector<uint8_t> input(kFrameSize.width * kFrameSize.height * 3 / 2, 0x80);
+	std::vector<uint8_t> output(kFrameSize.width * kFrameSize.height * 4);
+
+	while (state.keepRunning())
+		convertNVReference(input.data(), output.data(), kFrameSize.width,
+				   kFrameSize.height);
+
+	doNotOptimize(output[0]);
+	state.setItemsProcessed(state.iterations());
+	state.setBytesProcessed(state.iterations() * input.size());
+}
+
+void convert(BenchmarkState &state, const PixelFormat &input,
+	     const PixelFormat &output, PixelConverter::Implementation implementation,
+	     unsigned int threads)
+{
+	if (!PixelConverter::isSupported(implementation)) {
+		state.skip("implementation not supported by the CPU");
+		return;
+	}
+
+	PixelConverter converter;
+	converter.setImplementation(implementation);
+	converter.setThreads(threads);
+
+	if (converter.configure(input, kFrameSize, 0, output)) {
+		state.skip("conversion not supported");
+		return;
+	}
+
+	std::vector<uint8_t> in(converter.inputSize(), 0x80);
+	std::vector<uint8_t> out(converter.outputSize());
+
+	while (state.keepRunning())
+		converter.convert(in, out);
+
+	doNotOptimize(out[0]);
+	state.setItemsProcessed(state.iterations());
+	state.setBytesProcessed(state.iterations() * in.size());
+}
+
+#define CONVERTER_BENCHMARK(name, input, output, implementation, threads)	\
+void name(BenchmarkState &state)						\
+{										\
+	convert(state, formats::input, formats::output,				\
+		PixelConverter::implementation, threads);			\
+}										\
+BENCHMARK_REGISTER(name, name)
+
+} /* namespace */
+
+BENCHMARK_REGISTER(nv12ToARGBReference, nv12ToARGBReference)
+
+CONVERTER_BENCHMARK(nv12ToARGBGeneric, NV12, ARGB8888, Generic, 1)
+CONVERTER_BENCHMARK(nv12ToARGBSSE2, NV12, ARGB8888, SSE2, 1)
+CONVERTER_BENCHMARK(nv12ToARGBAVX2, NV12, ARGB8888, AVX2, 1)
+CONVERTER_BENCHMARK(nv12ToARGBNEON, NV12, ARGB8888, NEON, 1)
+CONVERTER_BENCHMARK(nv12ToARGBBestThreaded, NV12, ARGB8888, bestImplementation(), 4)
+
+CONVERTER_BENCHMARK(yuyvToARGBGeneric, YUYV, ARGB8888, Generic, 1)
+CONVERTER_BENCHMARK(yuyvToARGBBest, YUYV, ARGB8888, bestImplementation(), 1)
+
+CONVERTER_BENCHMARK(csi2p10UnpackGeneric, SBGGR10_CSI2P, SBGGR10, Generic, 1)
+CONVERTER_BENCHMARK(csi2p10UnpackBest, SBGGR10_CSI2P, SBGGR10, bestImplementation(), 1)
@@ -0,0 +1,128 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2020, Google Inc.
+ *
+ * pixel_format.cpp - PixelFormatInfo and V4L2PixelFormat benchmarks
+ */
+
+#include <string>
+#include <vector>
+
+#include <libcamera/formats.h>
+
+#include "libcamera/internal/formats.h"
+#include "libcamera/internal/v4l2_pixelformat.h"
+
+#include "benchmark.h"
+
+using namespace libcamera;
+
+namespace {
+
+/*
+ * Formats commonly looked up by pipeline handlers, ordered to exercise both
+ * ends of the format tables.
+ */
+const std::vector<PixelFormat> &lookupFormats()
+{
+	static const std::vector<PixelFormat> formats = {
+		formats::BGR888,
+		formats::NV12,
+		formats::YUYV,
+		formats::SBGGR10_CSI2P,
+		formats::SRGGB12,
+		formats::MJPEG,
+		formats::R8,
+		formats::SGRBG10_IPU3,
+	};
+
+	return formats;
+}
+
+void pixelFormatInfoByPixelFormat(BenchmarkState &state)
+{
+	const std::vector<PixelFormat> &formats = lookupFormats();
+	unsigned int bpp = 0;
+	unsigned int i = 0;
+
+	while (state.keepRunning())
+		bpp += PixelFormatInfo::info(formats[i++ % formats.size()]).bitsPerPixel;
+
+	doNotOptimize(bpp);
+	state.setItemsProcessed(state.iterations());
+}
+
+void pixelFormatInfoByV4L2PixelFormat(BenchmarkState &state)
+{
+	std::vector<V4L2PixelFormat> formats;
+	for (const PixelFormat &format : lookupFormats())
+		formats.push_back(PixelFormatInfo::info(format).v4l2Format);
+
+	unsigned int bpp = 0;
+	unsigned int i = 0;
+
+	while (state.keepRunning())
+		bpp += PixelFormatInfo::info(formats[i++ % formats.size()]).bitsPerPixel;
+
+	doNotOptimize(bpp);
+	state.setItemsProcessed(state.iterations());
+}
+
+void pixelFormatInfoByName(BenchmarkState &state)
+{
+	std::vector<std::string> names;
+	for (const PixelFormat &format : lookupFormats())
+		names.push_back(PixelFormatInfo::info(format).name);
+
+	unsigned int bpp = 0;
+	unsigned int i = 0;
+
+	while (state.keepRunning())
+		bpp += PixelFormatInfo::info(names[i++ % names.size()]).bitsPerPixel;
+
+	doNotOptimize(bpp);
+	state.setItemsProcessed(state.iterations());
+}
+
+void v4l2PixelFormatToPixelFormat(BenchmarkState &state)
+{
+	/*
+	 * The IPU3 packed format has no V4L2 to PixelFormat mapping, skip it
+	 * to avoid measuring the warning message.
+	 */
+	std::vector<V4L2PixelFormat> formats;
+	for (const PixelFormat &format : lookupFormats()) {
+		if (format != formats::SGRBG10_IPU3)
+			formats.push_back(PixelFormatInfo::info(format).v4l2Format);
+	}
+
+	uint32_t sum = 0;
+	unsigned int i = 0;
+
+	while (state.keepRunning())
+		sum += formats[i++ % formats.size()].toPixelFormat().fourcc();
+
+	doNotOptimize(sum);
+	state.setItemsProcessed(state.iterations());
+}
+
+void pixelFormatFrameSize(BenchmarkState &state)
+{
+	const PixelFormatInfo &info = PixelFormatInfo::info(formats::NV12);
+	unsigned int sum = 0;
+	unsigned int width = 640;
+
+	while (state.keepRunning())
+		sum += info.frameSize({ width++ & 4095, 480 });
+
+	doNotOptimize(sum);
+	state.setItemsProcessed(state.iterations());
+}
+
+} /* namespace */
+
+BENCHMARK_REGISTER(pixelFormatInfoByPixelFormat, pixelFormatInfoByPixelFormat)
+BENCHMARK_REGISTER(pixelFormatInfoByV4L2PixelFormat, pixelFormatInfoByV4L2PixelFormat)
+BENCHMARK_REGISTER(pixelFormatInfoByName, pixelFormatInfoByName)
+BENCHMARK_REGISTER(v4l2PixelFormatToPixelFormat, v4l2PixelFormatToPixelFormat)
+BENCHMARK_REGISTER(pixelFormatFrameSize, pixelFormatFrameSize)
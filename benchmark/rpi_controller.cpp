@@ -0,0 +1,184 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2020, Google Inc.
+ *
+ * rpi_controller.cpp - Raspberry Pi control algorithms benchmarks
+ */
+
+#include <fstream>
+#include <memory>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include <linux/bcm2835-isp.h>
+
+#include "controller.hpp"
+#include "device_status.h"
+#include "metadata.hpp"
+
+#include "benchmark.h"
+
+namespace {
+
+/*
+ * Generate statistics for a uniformly lit, slightly warm grey scene. The
+ * values are perturbed by the frame number to prevent the algorithms from
+ * converging to a steady state where they may skip work.
+ */
+bcm2835_isp_stats syntheticStatistics(unsigned int frame)
+{
+	bcm2835_isp_stats stats;
+	memset(&stats, 0, sizeof(stats));
+
+	stats.version = 1;
+	stats.size = sizeof(stats);
+
+	for (unsigned int h = 0; h < NUM_HISTOGRAMS; h++) {
+		bcm2835_isp_stats_hist &hist = stats.hist[h];
+		for (unsigned int i = 0; i < NUM_HISTOGRAM_BINS; i++) {
+			uint32_t value = 1000 + (i * 37 + frame * 11) % 500;
+			hist.r_hist[i] = value;
+			hist.g_hist[i] = 2 * value;
+			hist.b_hist[i] = value;
+		}
+	}
+
+	auto fillRegions = [frame](bcm2835_isp_stats_region *regions,
+				   unsigned int count, unsigned int counted) {
+		for (unsigned int i = 0; i < count; i++) {
+			uint64_t level = 400 + (i * 13 + frame * 7) % 200;
+			regions[i].counted = counted;
+			regions[i].notcounted = 0;
+			regions[i].r_sum = counted * level * 11 / 10;
+			regions[i].g_sum = counted * level;
+			regions[i].b_sum = counted * level * 9 / 10;
+		}
+	};
+
+	fillRegions(stats.awb_stats, AWB_REGIONS, 6000);
+	fillRegions(stats.floating_stats, FLOATING_REGIONS, 0);
+	fillRegions(stats.agc_stats, AGC_REGIONS, 48000);
+
+	for (unsigned int i = 0; i < FOCUS_REGIONS; i++) {
+		bcm2835_isp_stats_focus &focus = stats.focus_stats[i];
+		for (unsigned int j = 0; j < 2; j++) {
+			for (unsigned int k = 0; k < 2; k++) {
+				focus.contrast_val[j][k] = 100000 + frame * 10 + i;
+				focus.contrast_val_num[j][k] = 4096;
+			}
+		}
+	}
+
+	return stats;
+}
+
+/*
+ * Load recorded statistics, stored as a sequence of raw bcm2835_isp_stats
+ * structures, from the file pointed to by the LIBCAMERA_BENCHMARK_RPI_STATS
+ * environment variable. Synthetic statistics are generated if the variable
+ * isn't set.
+ */
+std::vector<bcm2835_isp_stats> loadStatistics()
+{
+	std::vector<bcm2835_isp_stats> stats;
+
+	const char *path = getenv("LIBCAMERA_BENCHMARK_RPI_STATS");
+	if (path) {
+		std::ifstream file(path, std::ios::binary);
+		bcm2835_isp_stats record;
+
+		while (file.read(reinterpret_cast<char *>(&record), sizeof(record)))
+			stats.push_back(record);
+	}
+
+	if (stats.empty()) {
+		for (unsigned int i = 0; i < 64; i++)
+			stats.push_back(syntheticStatistics(i));
+	}
+
+	return stats;
+}
+
+std::unique_ptr<RPi::Controller> createController()
+{
+	std::unique_ptr<RPi::Controller> controller =
+		std::make_unique<RPi::Controller>();
+	controller->Read(RPI_TUNING_FILE);
+	controller->Initialise();
+
+	/* A 2x2 binned IMX477 mode, as used for video recording. */
+	CameraMode mode = {};
+	mode.bitdepth = 12;
+	mode.width = 2028;
+	mode.height = 1520;
+	mode.sensor_width = 4056;
+	mode.sensor_height = 3040;
+	mode.bin_x = 2;
+	mode.bin_y = 2;
+	mode.scale_x = 2.0;
+	mode.scale_y = 2.0;
+	mode.noise_factor = 1.414;
+	mode.line_length = 21880.0;
+
+	RPi::Metadata metadata;
+	controller->SwitchMode(mode, &metadata);
+
+	return controller;
+}
+
+void rpiControllerFrame(BenchmarkState &state)
+{
+	static const std::vector<bcm2835_isp_stats> stats = loadStatistics();
+	std::unique_ptr<RPi::Controller> controller = createController();
+	RPi::Metadata metadata;
+	unsigned int frame = 0;
+
+	DeviceStatus deviceStatus = {};
+	deviceStatus.shutter_speed = 10000.0;
+	deviceStatus.analogue_gain = 2.0;
+
+	while (state.keepRunning()) {
+		metadata.Clear();
+		metadata.Set("device.status", deviceStatus);
+		controller->Prepare(&metadata);
+
+		RPi::StatisticsPtr statistics =
+			std::make_shared<bcm2835_isp_stats>(stats[frame++ % stats.size()]);
+		controller->Process(statistics, &metadata);
+	}
+
+	state.setItemsProcessed(state.iterations());
+}
+
+/*
+ * Measure the time needed to load the IMX477 tuning file and initialise the
+ * algorithms, as done by the IPA when the camera is opened, from the JSON file
+ * or from the compiled binary file.
+ */
+void rpiControllerInit(BenchmarkState &state, const char *filename)
+{
+	while (state.keepRunning()) {
+		RPi::Controller controller;
+		controller.Read(filename);
+		controller.Initialise();
+	}
+
+	state.setItemsProcessed(state.iterations());
+}
+
+void rpiControllerInitJson(BenchmarkState &state)
+{
+	rpiControllerInit(state, RPI_TUNING_FILE);
+}
+
+void rpiControllerInitCompiled(BenchmarkState &state)
+{
+	rpiControllerInit(state, RPI_COMPILED_TUNING_FILE);
+}
+
+} /* namespace */
+
+BENCHMARK_REGISTER(rpiControllerFrame, rpiControllerFrame)
+BENCHMARK_REGISTER(rpiControllerInitJson, rpiControllerInitJson)
+BENCHMARK_REGISTER(rpiControllerInitCompiled, rpiControllerInitCompiled)
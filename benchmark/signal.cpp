@@ -0,0 +1,179 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2020, Google Inc.
+ *
+ * signal.cpp - Signal and Object::invokeMethod() benchmarks
+ */
+
+#include <atomic>
+#include <thread>
+
+#include <libcamera/object.h>
+#include <libcamera/signal.h>
+
+#include "libcamera/internal/thread.h"
+
+#include "benchmark.h"
+
+using namespace libcamera;
+
+namespace {
+
+/* Number of calls posted before waiting for the receiver to catch up. */
+constexpr unsigned int kBatchSize = 100;
+
+class Receiver
+{
+public:
+	void slot(int value) { sum_ += value; }
+
+	int sum_ = 0;
+};
+
+class ObjectReceiver : public Object
+{
+public:
+	void slot(int value)
+	{
+		sum_.store(sum_.load(std::memory_order_relaxed) + value,
+			   std::memory_order_release);
+	}
+
+	int blockingSlot(int value) { return value + 1; }
+
+	std::atomic<int> sum_{ 0 };
+};
+
+void signalEmit(BenchmarkState &state)
+{
+	Signal<int> signal;
+	Receiver receiver;
+
+	signal.connect(&receiver, &Receiver::slot);
+
+	while (state.keepRunning())
+		signal.emit(1);
+
+	doNotOptimize(receiver.sum_);
+	state.setItemsProcessed(state.iterations());
+}
+
+void signalEmitMultipleSlots(BenchmarkState &state)
+{
+	Signal<int> signal;
+	Receiver receivers[8];
+
+	for (Receiver &receiver : receivers)
+		signal.connect(&receiver, &Receiver::slot);
+
+	while (state.keepRunning())
+		signal.emit(1);
+
+	doNotOptimize(receivers[0].sum_);
+	state.setItemsProcessed(state.iterations() * 8);
+}
+
+void signalEmitObject(BenchmarkState &state)
+{
+	Signal<int> signal;
+	ObjectReceiver receiver;
+
+	signal.connect(&receiver, &ObjectReceiver::slot);
+
+	while (state.keepRunning())
+		signal.emit(1);
+
+	state.setItemsProcessed(state.iterations());
+}
+
+void signalEmitQueued(BenchmarkState &state)
+{
+	Signal<int> signal;
+	ObjectReceiver receiver;
+	Thread thread;
+
+	receiver.moveToThread(&thread);
+	thread.start();
+
+	signal.connect(&receiver, &ObjectReceiver::slot);
+
+	int expected = 0;
+	while (state.keepRunning()) {
+		for (unsigned int i = 0; i < kBatchSize; i++)
+			signal.emit(1);
+
+		expected += kBatchSize;
+		while (receiver.sum_.load(std::memory_order_acquire) != expected)
+			std::this_thread::yield();
+	}
+
+	thread.exit(0);
+	thread.wait();
+
+	state.setItemsProcessed(state.iterations() * kBatchSize);
+}
+
+void invokeMethodDirect(BenchmarkState &state)
+{
+	ObjectReceiver receiver;
+
+	while (state.keepRunning())
+		receiver.invokeMethod(&ObjectReceiver::slot, ConnectionTypeDirect, 1);
+
+	state.setItemsProcessed(state.iterations());
+}
+
+void invokeMethodQueued(BenchmarkState &state)
+{
+	ObjectReceiver receiver;
+	Thread thread;
+
+	receiver.moveToThread(&thread);
+	thread.start();
+
+	int expected = 0;
+	while (state.keepRunning()) {
+		for (unsigned int i = 0; i < kBatchSize; i++)
+			receiver.invokeMethod(&ObjectReceiver::slot,
+					      ConnectionTypeQueued, 1);
+
+		expected += kBatchSize;
+		while (receiver.sum_.load(std::memory_order_acquire) != expected)
+			std::this_thread::yield();
+	}
+
+	thread.exit(0);
+	thread.wait();
+
+	state.setItemsProcessed(state.iterations() * kBatchSize);
+}
+
+void invokeMethodBlocking(BenchmarkState &state)
+{
+	ObjectReceiver receiver;
+	Thread thread;
+
+	receiver.moveToThread(&thread);
+	thread.start();
+
+	int value = 0;
+	while (state.keepRunning())
+		value = receiver.invokeMethod(&ObjectReceiver::blockingSlot,
+					      ConnectionTypeBlocking, value);
+
+	thread.exit(0);
+	thread.wait();
+
+	doNotOptimize(value);
+	state.setItemsProcessed(state.iterations());
+}
+
+} /* namespace */
+
+BENCHMARK_REGISTER(signalEmit, signalEmit)
+BENCHMARK_REGISTER(signalEmitMultipleSlots, signalEmitMultipleSlots)
+BENCHMARK_REGISTER(signalEmitObject, signalEmitObject)
+BENCHMARK_REGISTER(signalEmitQueued, signalEmitQueued)
+BENCHMARK_REGISTER(invokeMethodDirect, invokeMethodDirect)
+BENCHMARK_REGISTER(invokeMethodQueued, invokeMethodQueued)
+BENCHMARK_REGISTER(invokeMethodBlocking, invokeMethodBlocking)
@@ -0,0 +1,111 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2020, Google Inc.
+ *
+ * thread.cpp - Thread message passing benchmarks
+ */
+
+#include <atomic>
+#include <memory>
+#include <thread>
+
+#include <libcamera/object.h>
+
+#include "libcamera/internal/message.h"
+#include "libcamera/internal/thread.h"
+
+#include "benchmark.h"
+
+using namespace libcamera;
+
+namespace {
+
+constexpr unsigned int kBatchSize = 100;
+
+class MessageReceiver : public Object
+{
+public:
+	MessageReceiver()
+		: type_(Message::registerMessageType())
+	{
+	}
+
+	Message::Type type() const { return type_; }
+
+	std::atomic<unsigned int> count_{ 0 };
+
+protected:
+	void message(Message *msg) override
+	{
+		if (msg->type() != type_) {
+			Object::message(msg);
+			return;
+		}
+
+		count_.store(count_.load(std::memory_order_relaxed) + 1,
+			     std::memory_order_release);
+	}
+
+private:
+	Message::Type type_;
+};
+
+void postMessageSameThread(BenchmarkState &state)
+{
+	MessageReceiver receiver;
+	Thread *thread = Thread::current();
+
+	unsigned int expected = 0;
+	while (state.keepRunning()) {
+		for (unsigned int i = 0; i < kBatchSize; i++)
+			receiver.postMessage(std::make_unique<Message>(receiver.type()));
+
+		thread->dispatchMessages(receiver.type());
+		expected += kBatchSize;
+	}
+
+	doNotOptimize(expected);
+	state.setItemsProcessed(state.iterations() * kBatchSize);
+}
+
+void postMessageCrossThread(BenchmarkState &state)
+{
+	MessageReceiver receiver;
+	Thread thread;
+
+	receiver.moveToThread(&thread);
+	thread.start();
+
+	unsigned int expected = 0;
+	while (state.keepRunning()) {
+		for (unsigned int i = 0; i < kBatchSize; i++)
+			receiver.postMessage(std::make_unique<Message>(receiver.type()));
+
+		expected += kBatchSize;
+		while (receiver.count_.load(std::memory_order_acquire) != expected)
+			std::this_thread::yield();
+	}
+
+	thread.exit(0);
+	thread.wait();
+
+	state.setItemsProcessed(state.iterations() * kBatchSize);
+}
+
+void threadStartStop(BenchmarkState &state)
+{
+	while (state.keepRunning()) {
+		Thread thread;
+		thread.start();
+		thread.exit(0);
+		thread.wait();
+	}
+
+	state.setItemsProcessed(state.iterations());
+}
+
+} /* namespace */
+
+BENCHMARK_REGISTER(postMessageSameThread, postMessageSameThread)
+BENCHMARK_REGISTER(postMessageCrossThread, postMessageCrossThread)
+BENCHMARK_REGISTER(threadStartStop, threadStartStop)
@@ -0,0 +1,101 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2020, Google Inc.
+ *
+ * v4l2_buffer_cache.cpp - V4L2BufferCache benchmarks
+ */
+
+#include <fcntl.h>
+#include <memory>
+#include <unistd.h>
+#include <vector>
+
+#include <libcamera/buffer.h>
+#include <libcamera/file_descriptor.h>
+
+#include "libcamera/internal/v4l2_videodevice.h"
+
+#include "benchmark.h"
+
+using namespace libcamera;
+
+namespace {
+
+constexpr unsigned int kNumEntries = 8;
+
+std::vector<std::unique_ptr<FrameBuffer>> createBuffers(unsigned int count)
+{
+	std::vector<std::unique_ptr<FrameBuffer>> buffers;
+
+	for (unsigned int i = 0; i < count; i++) {
+		int fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+
+		FrameBuffer::Plane plane;
+		plane.fd = FileDescriptor(std::move(fd));
+		plane.length = 4096;
+
+		buffers.push_back(std::make_unique<FrameBuffer>(
+			std::vector<FrameBuffer::Plane>{ plane }));
+	}
+
+	return buffers;
+}
+
+/*
+ * Cycle through as many buffers as cache entries, the steady state of a
+ * pipeline using buffers allocated by the FrameBufferAllocator.
+ */
+void v4l2BufferCacheHit(BenchmarkState &state)
+{
+	std::vector<std::unique_ptr<FrameBuffer>> buffers = createBuffers(kNumEntries);
+	V4L2BufferCache cache(buffers);
+	unsigned int i = 0;
+
+	while (state.keepRunning()) {
+		int index = cache.get(*buffers[i++ % buffers.size()]);
+		cache.put(index);
+	}
+
+	state.setItemsProcessed(state.iterations());
+}
+
+/*
+ * Cycle through more buffers than cache entries, forcing a miss on every
+ * lookup.
+ */
+void v4l2BufferCacheMiss(BenchmarkState &state)
+{
+	std::vector<std::unique_ptr<FrameBuffer>> buffers = createBuffers(kNumEntries * 2);
+	V4L2BufferCache cache(kNumEntries);
+	unsigned int i = 0;
+
+	while (state.keepRunning()) {
+		int index = cache.get(*buffers[i++ % buffers.size()]);
+		cache.put(index);
+	}
+
+	state.setItemsProcessed(state.iterations());
+}
+
+/* Keep all entries but one in use, as with a deep request queue. */
+void v4l2BufferCacheFull(BenchmarkState &state)
+{
+	std::vector<std::unique_ptr<FrameBuffer>> buffers = createBuffers(kNumEntries);
+	V4L2BufferCache cache(buffers);
+
+	for (unsigned int i = 0; i < kNumEntries - 1; i++)
+		cache.get(*buffers[i]);
+
+	while (state.keepRunning()) {
+		int index = cache.get(*buffers[kNumEntries - 1]);
+		cache.put(index);
+	}
+
+	state.setItemsProcessed(state.iterations());
+}
+
+} /* namespace */
+
+BENCHMARK_REGISTER(v4l2BufferCacheHit, v4l2BufferCacheHit)
+BENCHMARK_REGISTER(v4l2BufferCacheMiss, v4l2BufferCacheMiss)
+BENCHMARK_REGISTER(v4l2BufferCacheFull, v4l2BufferCacheFull)
@@ -62,6 +62,7 @@ public:
 private:
 	friend class Request; /* Needed to update request_. */
 	friend class V4L2VideoDevice; /* Needed to update metadata_. */
+	friend class FrameBufferMetadata; /* Needed to update metadata_. */
 
 	std::vector<Plane> planes_;
 
@@ -12,6 +12,7 @@
 #include <stdint.h>
 #include <string>
 
+#include <libcamera/camera_statistics.h>
 #include <libcamera/controls.h>
 #include <libcamera/object.h>
 #include <libcamera/request.h>
@@ -20,6 +21,7 @@
 
 namespace libcamera {
 
+class CameraStatisticsRecorder;
 class FrameBuffer;
 class FrameBufferAllocator;
 class PipelineHandler;
@@ -99,6 +101,8 @@ public:
 	int start();
 	int stop();
 
+	CameraStatistics statistics() const;
+
 private:
 	Camera(PipelineHandler *pipe, const std::string &id,
 	       const std::set<Stream *> &streams);
@@ -110,6 +114,7 @@ private:
 	friend class PipelineHandler;
 	void disconnect();
 	void requestComplete(Request *request);
+	CameraStatisticsRecorder *statisticsRecorder();
 
 	friend class FrameBufferAllocator;
 	int exportFrameBuffers(Stream *stream,
@@ -0,0 +1,62 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2020, Google Inc.
+ *
+ * camera_statistics.h - Camera runtime statistics
+ */
+#ifndef __LIBCAMERA_CAMERA_STATISTICS_H__
+#define __LIBCAMERA_CAMERA_STATISTICS_H__
+
+#include <array>
+#include <map>
+#include <stdint.h>
+
+namespace libcamera {
+
+class Stream;
+
+struct CameraStatistics {
+	struct Histogram {
+		static constexpr unsigned int kSubBuckets = 8;
+		static constexpr unsigned int kNumBuckets = 30 * kSubBuckets;
+
+		Histogram();
+
+		static unsigned int bucketIndex(uint64_t value);
+		static uint64_t bucketLowerBound(unsigned int index);
+		static uint64_t bucketUpperBound(unsigned int index);
+
+		double mean() const;
+		uint64_t percentile(double p) const;
+
+		std::array<uint64_t, kNumBuckets> buckets;
+		uint64_t count;
+		uint64_t sum;
+		uint64_t min;
+		uint64_t max;
+	};
+
+	struct StreamStatistics {
+		uint64_t frames;
+		uint64_t errors;
+		uint64_t sequenceGaps;
+		unsigned int queueDepth;
+	};
+
+	CameraStatistics();
+
+	uint64_t requestsQueued;
+	uint64_t requestsCompleted;
+	uint64_t requestsCancelled;
+	unsigned int requestsPending;
+
+	Histogram frameInterval;
+	Histogram requestLatency;
+	Histogram ipaProcessingTime;
+
+	std::map<const Stream *, StreamStatistics> streams;
+};
+
+} /* namespace libcamera */
+
+#endif /* __LIBCAMERA_CAMERA_STATISTICS_H__ */
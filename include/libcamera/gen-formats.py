@@ -47,10 +47,43 @@ class DRMFourCC(object):
     def fourcc(self, name):
         return self.formats[name]
 
+    def fourcc_value(self, name):
+        return fourcc_value(self.formats[name])
+
     def mod(self, name):
         vendor, value = self.mods[name]
         return self.vendors[vendor], value
 
+    def mod_value(self, name):
+        vendor, value = self.mod(name)
+        return (vendor << 56) | value
+
+
+class V4L2FourCC(object):
+    format_regex = re.compile(r"#define (V4L2_PIX_FMT_[A-Z0-9_]+)[ \t]+v4l2_fourcc(_be)?\(('.', '.', '.', '.')\)")
+
+    def __init__(self, filename):
+        self.formats = {}
+
+        for line in open(filename, 'rb').readlines():
+            line = line.decode('utf-8')
+
+            match = V4L2FourCC.format_regex.match(line)
+            if match:
+                format, be, fourcc = match.groups()
+                value = fourcc_value(fourcc)
+                if be:
+                    value |= 1 << 31
+                self.formats[format] = value
+
+    def fourcc_value(self, name):
+        return self.formats[name]
+
+
+def fourcc_value(fourcc):
+    chars = [c.strip()[1] for c in fourcc.split(',')]
+    return sum(ord(c) << (8 * i) for i, c in enumerate(chars))
+
 
 def generate_h(formats, drm_fourcc):
     template = string.Template('constexpr PixelFormat ${name}{ __fourcc(${fourcc}), __mod(${mod}) };')
@@ -75,6 +108,58 @@ def generate_h(formats, drm_fourcc):
     return {'formats': '\n'.join(fmts)}
 
 
+def generate_info(formats, drm_fourcc, v4l2_fourcc):
+    template = string.Template('''\t{
+\t\t.name = "${name}",
+\t\t.format = formats::${name},
+\t\t.v4l2Format = V4L2PixelFormat(${v4l2}),
+\t\t.bitsPerPixel = ${bpp},
+\t\t.colourEncoding = PixelFormatInfo::ColourEncoding${encoding},
+\t\t.packed = ${packed},
+\t\t.pixelsPerGroup = ${pixels_per_group},
+\t\t.planes = {{ ${planes} }},
+\t},''')
+
+    infos = []
+
+    for format in formats:
+        name, format = list(format.items())[0]
+        if 'v4l2' not in format:
+            continue
+
+        planes = format['planes'] + [[0, 0]] * (3 - len(format['planes']))
+        mod = format.get('mod')
+
+        infos.append({
+            'name': name,
+            'v4l2': format['v4l2'],
+            'bpp': format['bpp'],
+            'encoding': format['encoding'],
+            'packed': 'true' if format.get('packed', False) else 'false',
+            'pixels_per_group': format['pixels_per_group'],
+            'planes': ', '.join(['{ %u, %u }' % tuple(plane) for plane in planes]),
+            'key': (drm_fourcc.fourcc_value(format['fourcc']),
+                    drm_fourcc.mod_value(mod) if mod else 0),
+            'v4l2_key': v4l2_fourcc.fourcc_value(format['v4l2']),
+        })
+
+    # Sort the table by pixel format and create the reverse indexes. The sort
+    # is stable, formats sharing a V4L2 fourcc are indexed in pixel format
+    # order.
+    infos.sort(key=lambda info: info['key'])
+    v4l2_index = sorted(range(len(infos)), key=lambda i: infos[i]['v4l2_key'])
+    name_index = sorted(range(len(infos)), key=lambda i: infos[i]['name'])
+
+    return {
+        'count': len(infos),
+        'formats_info': '\n'.join([template.substitute(info) for info in infos]),
+        'v4l2_index': '\n'.join(['\t%u,\t/* %s */' % (i, infos[i]['v4l2'])
+                                 for i in v4l2_index]),
+        'name_index': '\n'.join(['\t%u,\t/* %s */' % (i, infos[i]['name'])
+                                 for i in name_index]),
+    }
+
+
 def fill_template(template, data):
 
     template = open(template, 'rb').read()
@@ -95,13 +180,20 @@ def main(argv):
                         help='Template file name.')
     parser.add_argument('drm_fourcc', type=str,
                         help='Path to drm_fourcc.h.')
+    parser.add_argument('v4l2_fourcc', type=str, nargs='?',
+                        help='Path to videodev2.h. Generates the pixel format information table when specified.')
     args = parser.parse_args(argv[1:])
 
     data = open(args.input, 'rb').read()
     formats = yaml.safe_load(data)['formats']
     drm_fourcc = DRMFourCC(args.drm_fourcc)
 
-    data = generate_h(formats, drm_fourcc)
+    if args.v4l2_fourcc:
+        v4l2_fourcc = V4L2FourCC(args.v4l2_fourcc)
+        data = generate_info(formats, drm_fourcc, v4l2_fourcc)
+    else:
+        data = generate_h(formats, drm_fourcc)
+
     data = fill_template(args.template, data)
 
     if args.output:
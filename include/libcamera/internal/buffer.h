@@ -42,6 +42,12 @@ public:
 	MappedFrameBuffer(const FrameBuffer *buffer, int flags);
 };
 
+class FrameBufferMetadata
+{
+public:
+	static void set(FrameBuffer *buffer, const FrameMetadata &metadata);
+};
+
 } /* namespace libcamera */
 
 #endif /* __LIBCAMERA_INTERNAL_BUFFER_H__ */
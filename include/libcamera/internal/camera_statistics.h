@@ -0,0 +1,89 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2020, Google Inc.
+ *
+ * camera_statistics.h - Camera runtime statistics recording
+ */
+#ifndef __LIBCAMERA_INTERNAL_CAMERA_STATISTICS_H__
+#define __LIBCAMERA_INTERNAL_CAMERA_STATISTICS_H__
+
+#include <array>
+#include <atomic>
+#include <map>
+#include <set>
+#include <stdint.h>
+#include <unordered_map>
+
+#include <libcamera/camera_statistics.h>
+
+#include "libcamera/internal/thread.h"
+#include "libcamera/internal/utils.h"
+
+namespace libcamera {
+
+class FrameBuffer;
+class Request;
+class Stream;
+
+class AtomicHistogram
+{
+public:
+	AtomicHistogram();
+
+	void record(uint64_t value);
+	void reset();
+
+	CameraStatistics::Histogram snapshot() const;
+
+private:
+	std::array<std::atomic<uint64_t>, CameraStatistics::Histogram::kNumBuckets> buckets_;
+	std::atomic<uint64_t> count_;
+	std::atomic<uint64_t> sum_;
+	std::atomic<uint64_t> min_;
+	std::atomic<uint64_t> max_;
+};
+
+class CameraStatisticsRecorder
+{
+public:
+	CameraStatisticsRecorder(const std::set<Stream *> &streams);
+
+	void reset();
+
+	void requestQueued(const Request *request);
+	void requestQueueFailed(const Request *request);
+	void bufferCompleted(const Stream *stream, const FrameBuffer *buffer);
+	void requestCompleted(const Request *request);
+	void ipaProcessed(const utils::duration &duration);
+
+	CameraStatistics snapshot() const;
+
+private:
+	struct StreamCounters {
+		std::atomic<uint64_t> frames;
+		std::atomic<uint64_t> errors;
+		std::atomic<uint64_t> sequenceGaps;
+		std::atomic<unsigned int> queueDepth;
+		std::atomic<int64_t> lastSequence;
+	};
+
+	std::atomic<uint64_t> requestsQueued_;
+	std::atomic<uint64_t> requestsCompleted_;
+	std::atomic<uint64_t> requestsCancelled_;
+	std::atomic<unsigned int> requestsPending_;
+
+	AtomicHistogram frameInterval_;
+	AtomicHistogram requestLatency_;
+	AtomicHistogram ipaProcessingTime_;
+
+	uint64_t lastTimestamp_;
+
+	Mutex mutex_;
+	std::unordered_map<const Request *, utils::time_point> queueTimes_;
+
+	std::map<const Stream *, StreamCounters> streams_;
+};
+
+} /* namespace libcamera */
+
+#endif /* __LIBCAMERA_INTERNAL_CAMERA_STATISTICS_H__ */
@@ -0,0 +1,125 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2020, Google Inc.
+ *
+ * capability_cache.h - Persistent cache of device capabilities
+ */
+#ifndef __LIBCAMERA_INTERNAL_CAPABILITY_CACHE_H__
+#define __LIBCAMERA_INTERNAL_CAPABILITY_CACHE_H__
+
+#include <map>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include <libcamera/geometry.h>
+
+#include "libcamera/internal/byte_stream_buffer.h"
+
+namespace libcamera {
+
+class CapabilityCache
+{
+public:
+	CapabilityCache(const std::string &id, const std::string &key);
+	~CapabilityCache();
+
+	static const std::string &directory();
+	static void flushAll();
+
+	const std::string &fileName() const { return fileName_; }
+
+	bool lookup(const std::string &name, std::vector<uint8_t> *data) const;
+	int store(const std::string &name, std::vector<uint8_t> data);
+	int flush();
+
+	template<typename Key>
+	bool lookupFormats(const std::string &name,
+			   std::map<Key, std::vector<SizeRange>> *formats) const
+	{
+		std::vector<uint8_t> data;
+		if (!lookup(name, &data))
+			return false;
+
+		ByteStreamBuffer buffer(const_cast<const uint8_t *>(data.data()),
+					data.size());
+		std::map<Key, std::vector<SizeRange>> result;
+		uint32_t count = 0;
+
+		buffer.read(&count);
+		for (uint32_t i = 0; i < count && !buffer.overflow(); ++i) {
+			uint32_t key = 0;
+			uint32_t numSizes = 0;
+
+			buffer.read(&key);
+			buffer.read(&numSizes);
+
+			size_t numValues = static_cast<size_t>(numSizes) * 6;
+			const uint32_t *values = buffer.read<uint32_t>(numValues);
+			if (!values)
+				return false;
+
+			std::vector<SizeRange> sizes;
+			for (uint32_t j = 0; j < numSizes; ++j, values += 6)
+				sizes.emplace_back(Size(values[0], values[1]),
+						   Size(values[2], values[3]),
+						   values[4], values[5]);
+
+			result.emplace(Key(key), std::move(sizes));
+		}
+
+		if (buffer.overflow() || buffer.offset() != data.size())
+			return false;
+
+		*formats = std::move(result);
+		return true;
+	}
+
+	template<typename Key>
+	int storeFormats(const std::string &name,
+			 const std::map<Key, std::vector<SizeRange>> &formats)
+	{
+		size_t size = sizeof(uint32_t);
+		for (const auto &format : formats)
+			size += sizeof(uint32_t) * (2 + format.second.size() * 6);
+
+		std::vector<uint8_t> data(size);
+		ByteStreamBuffer buffer(data.data(), data.size());
+
+		uint32_t count = formats.size();
+		buffer.write(&count);
+
+		for (const auto &format : formats) {
+			uint32_t key = static_cast<uint32_t>(format.first);
+			uint32_t numSizes = format.second.size();
+
+			buffer.write(&key);
+			buffer.write(&numSizes);
+
+			for (const SizeRange &range : format.second) {
+				const uint32_t values[6] = {
+					range.min.width, range.min.height,
+					range.max.width, range.max.height,
+					range.hStep, range.vStep,
+				};
+				buffer.write(&values);
+			}
+		}
+
+		return store(name, std::move(data));
+	}
+
+private:
+	int load();
+	int save() const;
+	int flushLocked();
+
+	std::string fileName_;
+	std::string key_;
+	std::map<std::string, std::vector<uint8_t>> sections_;
+	bool dirty_;
+};
+
+} /* namespace libcamera */
+
+#endif /* __LIBCAMERA_INTERNAL_CAPABILITY_CACHE_H__ */
@@ -0,0 +1,76 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2020, Raspberry Pi (Trading) Ltd.
+ *
+ * delayed_controls.h - Helper to deal with controls that take effect with a delay
+ */
+#ifndef __LIBCAMERA_INTERNAL_DELAYED_CONTROLS_H__
+#define __LIBCAMERA_INTERNAL_DELAYED_CONTROLS_H__
+
+#include <array>
+#include <stdint.h>
+#include <unordered_map>
+#include <vector>
+
+#include <libcamera/controls.h>
+
+namespace libcamera {
+
+class V4L2Device;
+
+class DelayedControls
+{
+public:
+	DelayedControls(V4L2Device *device,
+			const std::unordered_map<uint32_t, unsigned int> &delays);
+
+	int reset();
+
+	bool push(const ControlList &controls);
+	ControlList get(uint32_t sequence) const;
+
+	int applyControls(uint32_t sequence);
+
+	unsigned int maxDelay() const { return maxDelay_; }
+
+private:
+	/* The history size must be a power of 2. */
+	static constexpr unsigned int kHistorySize = 16;
+
+	struct Info {
+		ControlValue value;
+		bool updated;
+	};
+
+	struct Control {
+		uint32_t id;
+		unsigned int delay;
+		std::array<Info, kHistorySize> history;
+
+		Info &operator[](unsigned int index)
+		{
+			return history[index & (kHistorySize - 1)];
+		}
+
+		const Info &operator[](unsigned int index) const
+		{
+			return history[index & (kHistorySize - 1)];
+		}
+	};
+
+	void queue();
+
+	V4L2Device *device_;
+	std::vector<Control> controls_;
+	unsigned int maxDelay_;
+
+	bool running_;
+	uint32_t firstSequence_;
+
+	unsigned int queueCount_;
+	unsigned int writeCount_;
+};
+
+} /* namespace libcamera */
+
+#endif /* __LIBCAMERA_INTERNAL_DELAYED_CONTROLS_H__ */
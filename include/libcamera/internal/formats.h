@@ -34,7 +34,7 @@ public:
 		ColourEncodingRAW,
 	};
 
-	bool isValid() const { return format.isValid(); }
+	constexpr bool isValid() const { return format.isValid(); }
 
 	static const PixelFormatInfo &info(const PixelFormat &format);
 	static const PixelFormatInfo &info(const V4L2PixelFormat &format);
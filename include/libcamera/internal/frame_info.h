@@ -0,0 +1,166 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2020, Google Inc.
+ *
+ * frame_info.h - Per-frame information tracking for pipeline handlers
+ */
+#ifndef __LIBCAMERA_INTERNAL_FRAME_INFO_H__
+#define __LIBCAMERA_INTERNAL_FRAME_INFO_H__
+
+#include <errno.h>
+#include <utility>
+#include <vector>
+
+namespace libcamera {
+
+class FrameBuffer;
+class Request;
+
+class FrameInfoIndex
+{
+public:
+	FrameInfoIndex(unsigned int size);
+
+	int insert(const void *key, unsigned int value);
+	void remove(const void *key);
+	int find(const void *key) const;
+	void clear();
+
+private:
+	unsigned int hash(const void *key) const;
+
+	std::vector<std::pair<const void *, unsigned int>> entries_;
+	unsigned int mask_;
+	unsigned int count_;
+};
+
+template<typename Info>
+class FrameInfoTable
+{
+public:
+	FrameInfoTable(unsigned int depth, unsigned int buffersPerFrame)
+		: slots_(depth), index_(depth * (buffersPerFrame + 1))
+	{
+		for (Slot &slot : slots_)
+			slot.buffers.reserve(buffersPerFrame);
+	}
+
+	Info *create(unsigned int frame, Request *request)
+	{
+		unsigned int index = frame % slots_.size();
+		Slot &slot = slots_[index];
+		if (slot.used)
+			return nullptr;
+
+		if (index_.insert(request, index) < 0)
+			return nullptr;
+
+		slot.frame = frame;
+		slot.used = true;
+		slot.request = request;
+		slot.info = Info{};
+
+		return &slot.info;
+	}
+
+	int addBuffer(unsigned int frame, FrameBuffer *buffer)
+	{
+		Slot *slot = findSlot(frame);
+		if (!slot)
+			return -ENOENT;
+
+		int ret = index_.insert(buffer, slot - slots_.data());
+		if (ret < 0)
+			return ret;
+
+		slot->buffers.push_back(buffer);
+		return 0;
+	}
+
+	int destroy(unsigned int frame)
+	{
+		Slot *slot = findSlot(frame);
+		if (!slot)
+			return -ENOENT;
+
+		index_.remove(slot->request);
+		for (FrameBuffer *buffer : slot->buffers)
+			index_.remove(buffer);
+
+		slot->buffers.clear();
+		slot->used = false;
+
+		return 0;
+	}
+
+	void clear()
+	{
+		for (Slot &slot : slots_) {
+			slot.buffers.clear();
+			slot.used = false;
+		}
+
+		index_.clear();
+	}
+
+	template<typename Func>
+	void forEach(Func func)
+	{
+		for (Slot &slot : slots_) {
+			if (slot.used)
+				func(&slot.info);
+		}
+	}
+
+	Info *find(unsigned int frame)
+	{
+		Slot *slot = findSlot(frame);
+		return slot ? &slot->info : nullptr;
+	}
+
+	Info *find(const Request *request)
+	{
+		return findKey(request);
+	}
+
+	Info *find(const FrameBuffer *buffer)
+	{
+		return findKey(buffer);
+	}
+
+	unsigned int depth() const { return slots_.size(); }
+
+private:
+	struct Slot {
+		unsigned int frame = 0;
+		bool used = false;
+		Request *request = nullptr;
+		std::vector<FrameBuffer *> buffers;
+		Info info{};
+	};
+
+	Slot *findSlot(unsigned int frame)
+	{
+		Slot &slot = slots_[frame % slots_.size()];
+		if (!slot.used || slot.frame != frame)
+			return nullptr;
+
+		return &slot;
+	}
+
+	Info *findKey(const void *key)
+	{
+		int index = index_.find(key);
+		if (index < 0)
+			return nullptr;
+
+		return &slots_[index].info;
+	}
+
+	std::vector<Slot> slots_;
+	FrameInfoIndex index_;
+};
+
+} /* namespace libcamera */
+
+#endif /* __LIBCAMERA_INTERNAL_FRAME_INFO_H__ */
@@ -15,6 +15,7 @@
 
 namespace libcamera {
 
+class CameraStatisticsRecorder;
 class IPAModule;
 
 class IPAProxy : public IPAInterface
@@ -29,10 +30,13 @@ public:
 
 	void stop() override = 0;
 
+	virtual void setStatisticsRecorder(CameraStatisticsRecorder *stats);
+
 protected:
 	std::string resolvePath(const std::string &file) const;
 
 	bool valid_;
+	CameraStatisticsRecorder *stats_;
 
 private:
 	IPAModule *ipam_;
@@ -8,6 +8,7 @@
 #define __LIBCAMERA_INTERNAL_MEDIA_DEVICE_H__
 
 #include <map>
+#include <memory>
 #include <sstream>
 #include <string>
 #include <vector>
@@ -18,6 +19,7 @@
 
 #include "libcamera/internal/log.h"
 #include "libcamera/internal/media_object.h"
+#include "libcamera/internal/media_request.h"
 
 namespace libcamera {
 
@@ -52,6 +54,9 @@ public:
 	MediaLink *link(const MediaPad *source, const MediaPad *sink);
 	int disableLinks();
 
+	int allocateRequests(unsigned int count,
+			     std::vector<std::unique_ptr<MediaRequest>> *requests);
+
 	Signal<MediaDevice *> disconnected;
 
 protected:
@@ -0,0 +1,82 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2020, Google Inc.
+ *
+ * media_request.h - Media Controller request
+ */
+#ifndef __LIBCAMERA_INTERNAL_MEDIA_REQUEST_H__
+#define __LIBCAMERA_INTERNAL_MEDIA_REQUEST_H__
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <libcamera/signal.h>
+
+#include "libcamera/internal/log.h"
+
+namespace libcamera {
+
+class EventNotifier;
+class MediaDevice;
+
+class MediaRequest : protected Loggable
+{
+public:
+	enum Status {
+		Idle,
+		Queued,
+		Complete,
+	};
+
+	~MediaRequest();
+
+	int fd() const { return fd_; }
+	unsigned int index() const { return index_; }
+	Status status() const { return status_; }
+
+	int queue();
+	int reinit();
+
+	Signal<MediaRequest *> completed;
+
+protected:
+	std::string logPrefix() const override;
+
+private:
+	friend class MediaDevice;
+
+	MediaRequest(int fd, unsigned int index);
+
+	void requestCompleted(EventNotifier *notifier);
+
+	int fd_;
+	unsigned int index_;
+	Status status_;
+	EventNotifier *notifier_;
+};
+
+class MediaRequestPool
+{
+public:
+	MediaRequestPool();
+
+	int allocate(MediaDevice *media, unsigned int count);
+	void release();
+
+	MediaRequest *get();
+	int put(MediaRequest *request);
+
+	unsigned int size() const { return requests_.size(); }
+	unsigned int available() const { return available_.size(); }
+
+	Signal<MediaRequest *> requestCompleted;
+
+private:
+	std::vector<std::unique_ptr<MediaRequest>> requests_;
+	std::vector<MediaRequest *> available_;
+};
+
+} /* namespace libcamera */
+
+#endif /* __LIBCAMERA_INTERNAL_MEDIA_REQUEST_H__ */
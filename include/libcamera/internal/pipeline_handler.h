@@ -74,12 +74,16 @@ public:
 	virtual CameraConfiguration *generateConfiguration(Camera *camera,
 		const StreamRoles &roles) = 0;
 	virtual int configure(Camera *camera, CameraConfiguration *config) = 0;
+	virtual bool buffersCompatible(Camera *camera,
+				       const StreamConfiguration &previous,
+				       const StreamConfiguration &current);
 
 	virtual int exportFrameBuffers(Camera *camera, Stream *stream,
 				       std::vector<std::unique_ptr<FrameBuffer>> *buffers) = 0;
 
 	virtual int start(Camera *camera) = 0;
 	virtual void stop(Camera *camera) = 0;
+	virtual void releaseDevice(Camera *camera);
 
 	int queueRequest(Camera *camera, Request *request);
 
@@ -0,0 +1,114 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2020, Google Inc.
+ *
+ * tracer.h - Lightweight event tracing
+ */
+#ifndef __LIBCAMERA_INTERNAL_TRACER_H__
+#define __LIBCAMERA_INTERNAL_TRACER_H__
+
+#include <atomic>
+#include <memory>
+#include <ostream>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "libcamera/internal/thread.h"
+
+namespace libcamera {
+
+class TraceBuffer;
+
+class Tracer
+{
+public:
+	enum EventType {
+		Instant,
+		Begin,
+		End,
+		AsyncBegin,
+		AsyncEnd,
+	};
+
+	static Tracer *instance();
+
+	static bool enabled()
+	{
+		return enabled_.load(std::memory_order_relaxed);
+	}
+
+	void enable();
+	void disable();
+
+	void record(EventType type, const char *category, const char *name,
+		    uint64_t id);
+
+	void dump(std::ostream &stream);
+	int dump(const std::string &path);
+
+private:
+	class ThreadBuffer;
+
+	Tracer();
+	~Tracer();
+
+	TraceBuffer *threadBuffer();
+	void releaseBuffer(TraceBuffer *buffer);
+
+	static std::atomic<bool> enabled_;
+	static thread_local ThreadBuffer currentBuffer_;
+
+	Mutex mutex_;
+	std::vector<std::unique_ptr<TraceBuffer>> buffers_;
+	std::vector<TraceBuffer *> freeBuffers_;
+	std::string file_;
+};
+
+class TraceScope
+{
+public:
+	TraceScope(const char *category, const char *name, uint64_t id)
+		: category_(category), name_(name), id_(id),
+		  active_(Tracer::enabled())
+	{
+		if (active_)
+			Tracer::instance()->record(Tracer::Begin, category_,
+						   name_, id_);
+	}
+
+	~TraceScope()
+	{
+		if (active_)
+			Tracer::instance()->record(Tracer::End, category_,
+						   name_, id_);
+	}
+
+private:
+	const char *category_;
+	const char *name_;
+	uint64_t id_;
+	bool active_;
+};
+
+#define TRACE_EVENT(type, category, name, id)				\
+	do {								\
+		if (Tracer::enabled())					\
+			Tracer::instance()->record(Tracer::type, category, \
+						   name, (id));		\
+	} while (0)
+
+#define _TRACE_SCOPE_NAME(line) _traceScope##line
+#define _TRACE_SCOPE(line, category, name, id)				\
+	TraceScope _TRACE_SCOPE_NAME(line)(category, name, (id))
+#define TRACE_SCOPE(category, name, id)					\
+	_TRACE_SCOPE(__LINE__, category, name, id)
+
+static inline uint64_t traceId(const void *ptr)
+{
+	return reinterpret_cast<uintptr_t>(ptr);
+}
+
+} /* namespace libcamera */
+
+#endif /* __LIBCAMERA_INTERNAL_TRACER_H__ */
@@ -18,6 +18,9 @@
 
 namespace libcamera {
 
+class CapabilityCache;
+class MediaRequest;
+
 class V4L2Device : protected Loggable
 {
 public:
@@ -26,8 +29,9 @@ public:
 
 	const ControlInfoMap &controls() const { return controls_; }
 
-	ControlList getControls(const std::vector<uint32_t> &ids);
-	int setControls(ControlList *ctrls);
+	ControlList getControls(const std::vector<uint32_t> &ids,
+				MediaRequest *request = nullptr);
+	int setControls(ControlList *ctrls, MediaRequest *request = nullptr);
 
 	const std::string &deviceNode() const { return deviceNode_; }
 	std::string devicePath() const;
@@ -43,7 +47,10 @@ protected:
 
 	int fd() { return fd_; }
 
+	CapabilityCache *capabilityCache() const { return cache_.get(); }
+
 private:
+	std::string capabilityKey(const std::string &id);
 	void listControls();
 	void updateControls(ControlList *ctrls,
 			    const struct v4l2_ext_control *v4l2Ctrls,
@@ -54,6 +61,8 @@ private:
 	ControlInfoMap controls_;
 	std::string deviceNode_;
 	int fd_;
+
+	std::unique_ptr<CapabilityCache> cache_;
 };
 
 } /* namespace libcamera */
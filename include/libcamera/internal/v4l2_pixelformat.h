@@ -20,19 +20,19 @@ namespace libcamera {
 class V4L2PixelFormat
 {
 public:
-	V4L2PixelFormat()
+	constexpr V4L2PixelFormat()
 		: fourcc_(0)
 	{
 	}
 
-	explicit V4L2PixelFormat(uint32_t fourcc)
+	explicit constexpr V4L2PixelFormat(uint32_t fourcc)
 		: fourcc_(fourcc)
 	{
 	}
 
-	bool isValid() const { return fourcc_ != 0; }
-	uint32_t fourcc() const { return fourcc_; }
-	operator uint32_t() const { return fourcc_; }
+	constexpr bool isValid() const { return fourcc_ != 0; }
+	constexpr uint32_t fourcc() const { return fourcc_; }
+	constexpr operator uint32_t() const { return fourcc_; }
 
 	std::string toString() const;
 
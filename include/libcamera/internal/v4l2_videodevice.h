@@ -118,6 +118,8 @@ public:
 	int get(const FrameBuffer &buffer);
 	void put(unsigned int index);
 
+	unsigned int size() const { return cache_.size(); }
+
 private:
 	class Entry
 	{
@@ -200,8 +202,10 @@ public:
 			  std::vector<std::unique_ptr<FrameBuffer>> *buffers);
 	int importBuffers(unsigned int count);
 	int releaseBuffers();
+	unsigned int bufferCount() const;
 
-	int queueBuffer(FrameBuffer *buffer);
+	bool supportsRequests() const { return supportsRequests_; }
+	int queueBuffer(FrameBuffer *buffer, MediaRequest *request = nullptr);
 	Signal<FrameBuffer *> bufferReady;
 
 	int setFrameStartEnabled(bool enable);
@@ -254,6 +258,7 @@ private:
 	EventNotifier *fdEventNotifier_;
 
 	bool frameStartEnabled_;
+	bool supportsRequests_;
 };
 
 class V4L2M2MDevice
@@ -73,11 +73,13 @@ public:
 	Stream();
 
 	const StreamConfiguration &configuration() const { return configuration_; }
+	bool buffersPreserved() const { return buffersPreserved_; }
 
 protected:
 	friend class Camera;
 
 	StreamConfiguration configuration_;
+	bool buffersPreserved_;
 };
 
 } /* namespace libcamera */
@@ -8,7 +8,10 @@
 #include "camera_device.h"
 #include "camera_ops.h"
 
+#include <algorithm>
 #include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
 #include <tuple>
 #include <vector>
 
@@ -16,6 +19,7 @@
 #include <libcamera/formats.h>
 #include <libcamera/property_ids.h>
 
+#include "libcamera/internal/buffer.h"
 #include "libcamera/internal/formats.h"
 #include "libcamera/internal/log.h"
 #include "libcamera/internal/utils.h"
@@ -169,15 +173,10 @@ MappedCamera3Buffer::MappedCamera3Buffer(const buffer_handle_t camera3buffer,
 }
 
 CameraStream::CameraStream(PixelFormat f, Size s)
-	: index(-1), format(f), size(s), jpeg(nullptr)
+	: index(-1), format(f), size(s), maxCachedBuffers(0)
 {
 }
 
-CameraStream::~CameraStream()
-{
-	delete jpeg;
-};
-
 /*
  * \struct Camera3RequestDescriptor
  *
@@ -187,10 +186,10 @@ CameraStream::~CameraStream()
 
 CameraDevice::Camera3RequestDescriptor::Camera3RequestDescriptor(
 		unsigned int frameNumber, unsigned int numBuffers)
-	: frameNumber(frameNumber), numBuffers(numBuffers)
+	: frameNumber(frameNumber), numBuffers(numBuffers), pendingEncodes(0),
+	  deferred(numBuffers, false)
 {
 	buffers = new camera3_stream_buffer_t[numBuffers];
-	frameBuffers.reserve(numBuffers);
 }
 
 CameraDevice::Camera3RequestDescriptor::~Camera3RequestDescriptor()
@@ -213,7 +212,7 @@ CameraDevice::Camera3RequestDescriptor::~Camera3RequestDescriptor()
 
 CameraDevice::CameraDevice(unsigned int id, const std::shared_ptr<Camera> &camera)
 	: id_(id), running_(false), camera_(camera), staticMetadata_(nullptr),
-	  facing_(CAMERA_FACING_FRONT), orientation_(0)
+	  facing_(CAMERA_FACING_FRONT), orientation_(0), sendingResults_(false)
 {
 	camera_->requestCompleted.connect(this, &CameraDevice::requestComplete);
 
@@ -459,12 +458,34 @@ int CameraDevice::open(const hw_module_t *hardwareModule)
 	camera3Device_.ops = &hal_dev_ops;
 	camera3Device_.priv = this;
 
+	/*
+	 * Create the JPEG encoding workers. A few workers allow encoding
+	 * consecutive still captures in parallel, while more would only
+	 * compete with the rest of the system for little benefit.
+	 */
+	unsigned int numWorkers =
+		std::clamp(std::thread::hardware_concurrency(), 1U, 4U);
+	encoders_ = std::make_unique<WorkerPool>(numWorkers);
+
 	return 0;
 }
 
 void CameraDevice::close()
 {
 	camera_->stop();
+
+	/* Complete all pending encodes and deliver their results. */
+	encoders_.reset();
+
+	/*
+	 * Release the FrameBuffer instances wrapping the framework buffers,
+	 * which are not valid anymore once the device is closed.
+	 */
+	for (CameraStream &cameraStream : streams_) {
+		cameraStream.frameBufferIndex.clear();
+		cameraStream.frameBuffers.clear();
+	}
+
 	camera_->release();
 
 	running_ = false;
@@ -1113,8 +1134,11 @@ int CameraDevice::configureStreams(camera3_stream_configuration_t *stream_list)
 	/*
 	 * Clear and remove any existing configuration from previous calls, and
 	 * ensure the required entries are available without further
-	 * re-allcoation.
+	 * re-allcoation. This also drops the FrameBuffers cached for the
+	 * previous streams. The encoders of the existing streams may still be
+	 * in use by the workers, wait for them to complete first.
 	 */
+	encoders_->flush();
 	streams_.clear();
 	streams_.reserve(stream_list->num_streams);
 
@@ -1232,19 +1256,26 @@ int CameraDevice::configureStreams(camera3_stream_configuration_t *stream_list)
 
 		/* Use the bufferCount confirmed by the validation process. */
 		stream->max_buffers = cfg.bufferCount;
+		cameraStream->maxCachedBuffers = cfg.bufferCount * 2;
 
 		/*
 		 * Construct a software encoder for MJPEG streams from the
 		 * chosen libcamera source stream.
 		 */
-		if (cameraStream->format == formats::MJPEG) {
-			cameraStream->jpeg = new EncoderLibJpeg();
-			int ret = cameraStream->jpeg->configure(cfg);
+		if (cameraStream->format != formats::MJPEG)
+			continue;
+
+		for (unsigned int j = 0; j < encoders_->size(); ++j) {
+			std::unique_ptr<Encoder> encoder =
+				std::make_unique<EncoderLibJpeg>();
+			int ret = encoder->configure(cfg);
 			if (ret) {
 				LOG(HAL, Error)
 					<< "Failed to configure encoder";
 				return ret;
 			}
+
+			cameraStream->jpeg.push_back(std::move(encoder));
 		}
 	}
 
@@ -1292,6 +1323,63 @@ FrameBuffer *CameraDevice::createFrameBuffer(const buffer_handle_t camera3buffer
 	return new FrameBuffer(std::move(planes));
 }
 
+/*
+ * Retrieve the FrameBuffer for a gralloc buffer of a stream, creating it on
+ * first use. Reusing the same FrameBuffer for a gralloc buffer avoids
+ * duplicating and querying the file descriptors for every request, and keeps
+ * the buffer's dmabufs stable to allow the V4L2 buffer cache to hit.
+ */
+FrameBuffer *CameraDevice::getFrameBuffer(CameraStream *cameraStream,
+					  const buffer_handle_t camera3buffer)
+{
+	CameraStream::BufferKey key;
+
+	for (int i = 0; i < camera3buffer->numFds; i++) {
+		if (camera3buffer->data[i] == -1)
+			break;
+
+		struct stat st;
+		if (fstat(camera3buffer->data[i], &st) < 0) {
+			LOG(HAL, Error) << "Invalid file descriptor ("
+					<< camera3buffer->data[i] << ") "
+					<< " on plane " << i;
+			return nullptr;
+		}
+
+		key.emplace_back(st.st_dev, st.st_ino);
+	}
+
+	auto &frameBuffers = cameraStream->frameBuffers;
+	auto &index = cameraStream->frameBufferIndex;
+
+	auto iter = index.find(key);
+	if (iter != index.end()) {
+		frameBuffers.splice(frameBuffers.begin(), frameBuffers,
+				    iter->second);
+		return iter->second->frameBuffer.get();
+	}
+
+	FrameBuffer *buffer = createFrameBuffer(camera3buffer);
+	if (!buffer)
+		return nullptr;
+
+	/*
+	 * Buffers in use by in-flight requests are among the most recently
+	 * used ones, and are thus never evicted as long as the cache can hold
+	 * more buffers than the stream's maximum number of buffers.
+	 */
+	if (!frameBuffers.empty() &&
+	    frameBuffers.size() >= cameraStream->maxCachedBuffers) {
+		index.erase(frameBuffers.back().key);
+		frameBuffers.pop_back();
+	}
+
+	frameBuffers.push_front({ key, std::unique_ptr<FrameBuffer>(buffer) });
+	index[std::move(key)] = frameBuffers.begin();
+
+	return buffer;
+}
+
 int CameraDevice::processCaptureRequest(camera3_capture_request_t *camera3Request)
 {
 	if (!camera3Request->num_output_buffers) {
@@ -1345,19 +1433,18 @@ int CameraDevice::processCaptureRequest(camera3_capture_request_t *camera3Reques
 			continue;
 
 		/*
-		 * Create a libcamera buffer using the dmabuf descriptors of
-		 * the camera3Buffer for each stream. The FrameBuffer is
-		 * directly associated with the Camera3RequestDescriptor for
-		 * lifetime management only.
+		 * Retrieve the libcamera buffer wrapping the dmabuf descriptors
+		 * of the camera3Buffer for each stream. The FrameBuffer is
+		 * owned by the CameraStream and reused across requests.
 		 */
-		FrameBuffer *buffer = createFrameBuffer(*camera3Buffers[i].buffer);
+		FrameBuffer *buffer = getFrameBuffer(cameraStream,
+						     *camera3Buffers[i].buffer);
 		if (!buffer) {
 			LOG(HAL, Error) << "Failed to create buffer";
 			delete request;
 			delete descriptor;
 			return -ENOMEM;
 		}
-		descriptor->frameBuffers.emplace_back(buffer);
 
 		StreamConfiguration *streamConfiguration = &config_->at(cameraStream->index);
 		Stream *stream = streamConfiguration->stream();
@@ -1380,7 +1467,6 @@ void CameraDevice::requestComplete(Request *request)
 {
 	const Request::BufferMap &buffers = request->buffers();
 	camera3_buffer_status status = CAMERA3_BUFFER_STATUS_OK;
-	std::unique_ptr<CameraMetadata> resultMetadata;
 	Camera3RequestDescriptor *descriptor =
 		reinterpret_cast<Camera3RequestDescriptor *>(request->cookie());
 
@@ -1397,50 +1483,145 @@ void CameraDevice::requestComplete(Request *request)
 	 * pipeline handlers) timestamp in the Request itself.
 	 */
 	FrameBuffer *buffer = buffers.begin()->second;
-	resultMetadata = getResultMetadata(descriptor->frameNumber,
-					   buffer->metadata().timestamp);
+	descriptor->resultMetadata = getResultMetadata(descriptor->frameNumber,
+						       buffer->metadata().timestamp);
+
+	if (status == CAMERA3_BUFFER_STATUS_OK)
+		notifyShutter(descriptor->frameNumber,
+			      buffer->metadata().timestamp);
+
+	if (status == CAMERA3_BUFFER_STATUS_ERROR ||
+	    !descriptor->resultMetadata->get()) {
+		/* \todo Improve error handling. In case we notify an error
+		 * because the metadata generation fails, a shutter event has
+		 * already been notified for this frame number before the error
+		 * is here signalled. Make sure the error path plays well with
+		 * the camera stack state machine.
+		 */
+		notifyError(descriptor->frameNumber,
+			    descriptor->buffers[0].stream);
+		descriptor->resultMetadata.reset();
+	}
+
+	/*
+	 * Buffers of hardware streams are returned immediately, while JPEG
+	 * buffers are returned with the result metadata once encoded. The
+	 * source buffers of the JPEG encodes are held until the encoding
+	 * completes, and so are buffers of streams that have buffers held by
+	 * previous requests, to return the buffers of each stream in order.
+	 */
+	std::vector<camera3_stream_buffer_t> completedBuffers;
+	std::vector<WorkerPool::Task> encodes;
+
+	MutexLocker locker(resultsMutex_);
 
-	/* Handle any JPEG compression. */
 	for (unsigned int i = 0; i < descriptor->numBuffers; ++i) {
+		camera3_stream_buffer_t &camera3Buffer = descriptor->buffers[i];
 		CameraStream *cameraStream =
-			static_cast<CameraStream *>(descriptor->buffers[i].stream->priv);
+			static_cast<CameraStream *>(camera3Buffer.stream->priv);
+
+		camera3Buffer.acquire_fence = -1;
+		camera3Buffer.release_fence = -1;
+		camera3Buffer.status = status;
 
 		if (cameraStream->format != formats::MJPEG)
 			continue;
 
-		Encoder *encoder = cameraStream->jpeg;
-		if (!encoder) {
-			LOG(HAL, Error) << "Failed to identify encoder";
+		descriptor->deferred[i] = true;
+
+		if (status != CAMERA3_BUFFER_STATUS_OK)
 			continue;
+
+		unsigned int source;
+		for (source = 0; source < descriptor->numBuffers; ++source) {
+			CameraStream *sourceStream = static_cast<CameraStream *>(
+				descriptor->buffers[source].stream->priv);
+
+			if (sourceStream->format != formats::MJPEG &&
+			    sourceStream->index == cameraStream->index)
+				break;
 		}
 
-		StreamConfiguration *streamConfiguration = &config_->at(cameraStream->index);
-		Stream *stream = streamConfiguration->stream();
-		FrameBuffer *buffer = request->findBuffer(stream);
-		if (!buffer) {
+		if (source == descriptor->numBuffers) {
 			LOG(HAL, Error) << "Failed to find a source stream buffer";
+			camera3Buffer.status = CAMERA3_BUFFER_STATUS_ERROR;
 			continue;
 		}
 
-		/*
-		 * \todo Buffer mapping and compression should be moved to a
-		 * separate thread.
-		 */
+		descriptor->deferred[source] = true;
+
+		encodes.push_back([this, descriptor, i, source](unsigned int worker) {
+			encodeJpeg(descriptor, i, source, worker);
+		});
+	}
 
-		MappedCamera3Buffer mapped(*descriptor->buffers[i].buffer,
-					   PROT_READ | PROT_WRITE);
-		if (!mapped.isValid()) {
-			LOG(HAL, Error) << "Failed to mmap android blob buffer";
+	/*
+	 * Without any encoding to wait for, the whole result can be sent at
+	 * once, unless the results of previous requests are still pending.
+	 */
+	bool immediate = encodes.empty() && pendingResults_.empty();
+
+	for (unsigned int i = 0; i < descriptor->numBuffers; ++i) {
+		const camera3_stream_buffer_t &camera3Buffer = descriptor->buffers[i];
+
+		if (descriptor->deferred[i])
 			continue;
-		}
 
-		int jpeg_size = encoder->encode(buffer, mapped.maps()[0]);
-		if (jpeg_size < 0) {
+		if (immediate || isStreamDeferred(camera3Buffer.stream))
+			descriptor->deferred[i] = true;
+		else
+			completedBuffers.push_back(camera3Buffer);
+	}
+
+	if (!completedBuffers.empty())
+		readyResults_.push_back({ descriptor->frameNumber,
+					  std::move(completedBuffers), nullptr });
+
+	descriptor->pendingEncodes = encodes.size();
+	pendingResults_.push_back(descriptor);
+
+	for (WorkerPool::Task &encode : encodes)
+		encoders_->queue(std::move(encode));
+
+	completeReadyResults();
+	sendReadyResults(locker);
+}
+
+/*
+ * Encode the JPEG buffer at \a index in the \a descriptor from the buffer at
+ * \a source. This is called from the encoding workers.
+ */
+void CameraDevice::encodeJpeg(Camera3RequestDescriptor *descriptor,
+			      unsigned int index, unsigned int source,
+			      unsigned int worker)
+{
+	camera3_stream_buffer_t &camera3Buffer = descriptor->buffers[index];
+	CameraStream *cameraStream =
+		static_cast<CameraStream *>(camera3Buffer.stream->priv);
+	Encoder *encoder = cameraStream->jpeg[worker].get();
+
+	int jpeg_size = -EINVAL;
+
+	/*
+	 * The source buffer is held until the encoding completes, map it
+	 * directly instead of copying the frame.
+	 */
+	MappedCamera3Buffer sourceMapped(*descriptor->buffers[source].buffer,
+					 PROT_READ);
+	MappedCamera3Buffer mapped(*camera3Buffer.buffer,
+				   PROT_READ | PROT_WRITE);
+	if (!sourceMapped.isValid() || sourceMapped.maps().empty()) {
+		LOG(HAL, Error) << "Failed to mmap source stream buffer";
+	} else if (!mapped.isValid()) {
+		LOG(HAL, Error) << "Failed to mmap android blob buffer";
+	} else {
+		jpeg_size = encoder->encode(sourceMapped.maps()[0],
+					    mapped.maps()[0]);
+		if (jpeg_size < 0)
 			LOG(HAL, Error) << "Failed to encode stream image";
-			status = CAMERA3_BUFFER_STATUS_ERROR;
-			continue;
-		}
+	}
 
+	if (jpeg_size >= 0) {
 		/*
 		 * Fill in the JPEG blob header.
 		 *
@@ -1459,6 +1640,14 @@ void CameraDevice::requestComplete(Request *request)
 		auto *blob = reinterpret_cast<struct camera3_jpeg_blob *>(resultPtr);
 		blob->jpeg_blob_id = CAMERA3_JPEG_BLOB_ID;
 		blob->jpeg_size = jpeg_size;
+	}
+
+	MutexLocker locker(resultsMutex_);
+
+	if (jpeg_size < 0) {
+		camera3Buffer.status = CAMERA3_BUFFER_STATUS_ERROR;
+	} else if (descriptor->resultMetadata) {
+		CameraMetadata *resultMetadata = descriptor->resultMetadata.get();
 
 		/* Update the JPEG result Metadata. */
 		resultMetadata->addEntry(ANDROID_JPEG_SIZE,
@@ -1473,41 +1662,101 @@ void CameraDevice::requestComplete(Request *request)
 					 &jpeg_orientation, 1);
 	}
 
-	/* Prepare to call back the Android camera stack. */
-	camera3_capture_result_t captureResult = {};
-	captureResult.frame_number = descriptor->frameNumber;
-	captureResult.num_output_buffers = descriptor->numBuffers;
-	for (unsigned int i = 0; i < descriptor->numBuffers; ++i) {
-		descriptor->buffers[i].acquire_fence = -1;
-		descriptor->buffers[i].release_fence = -1;
-		descriptor->buffers[i].status = status;
+	descriptor->pendingEncodes--;
+
+	completeReadyResults();
+	sendReadyResults(locker);
+}
+
+/*
+ * Check if buffers of \a stream are held by pending requests. The caller shall
+ * hold the resultsMutex_ lock.
+ */
+bool CameraDevice::isStreamDeferred(const camera3_stream_t *stream) const
+{
+	for (const Camera3RequestDescriptor *descriptor : pendingResults_) {
+		for (unsigned int i = 0; i < descriptor->numBuffers; ++i) {
+			if (descriptor->deferred[i] &&
+			    descriptor->buffers[i].stream == stream)
+				return true;
+		}
+	}
+
+	return false;
+}
+
+/*
+ * Move the result metadata and deferred buffers of all pending requests whose
+ * encoding has completed to the ready results, in frame order. The caller
+ * shall hold the resultsMutex_ lock.
+ */
+void CameraDevice::completeReadyResults()
+{
+	while (!pendingResults_.empty()) {
+		Camera3RequestDescriptor *descriptor = pendingResults_.front();
+		if (descriptor->pendingEncodes)
+			break;
+
+		std::vector<camera3_stream_buffer_t> camera3Buffers;
+		for (unsigned int i = 0; i < descriptor->numBuffers; ++i) {
+			if (descriptor->deferred[i])
+				camera3Buffers.push_back(descriptor->buffers[i]);
+		}
+
+		readyResults_.push_back({ descriptor->frameNumber,
+					  std::move(camera3Buffers),
+					  std::move(descriptor->resultMetadata) });
+
+		pendingResults_.pop_front();
+		delete descriptor;
 	}
-	captureResult.output_buffers =
-		const_cast<const camera3_stream_buffer_t *>(descriptor->buffers);
+}
 
+/*
+ * Send the ready results to the framework. The resultsMutex_ lock held by
+ * \a locker is released while calling the framework, and results queued in
+ * the meantime are sent by the thread already sending results, to preserve
+ * their order.
+ */
+void CameraDevice::sendReadyResults(MutexLocker &locker)
+{
+	if (sendingResults_)
+		return;
 
-	if (status == CAMERA3_BUFFER_STATUS_OK) {
-		notifyShutter(descriptor->frameNumber,
-			      buffer->metadata().timestamp);
+	sendingResults_ = true;
 
-		captureResult.partial_result = 1;
-		captureResult.result = resultMetadata->get();
+	while (!readyResults_.empty()) {
+		CaptureResult result = std::move(readyResults_.front());
+		readyResults_.pop_front();
+
+		locker.unlock();
+		sendCaptureResult(result.frameNumber, result.buffers,
+				  result.metadata.get());
+		locker.lock();
 	}
 
-	if (status == CAMERA3_BUFFER_STATUS_ERROR || !captureResult.result) {
-		/* \todo Improve error handling. In case we notify an error
-		 * because the metadata generation fails, a shutter event has
-		 * already been notified for this frame number before the error
-		 * is here signalled. Make sure the error path plays well with
-		 * the camera stack state machine.
-		 */
-		notifyError(descriptor->frameNumber,
-			    descriptor->buffers[0].stream);
+	sendingResults_ = false;
+}
+
+void CameraDevice::sendCaptureResult(uint32_t frameNumber,
+				     const std::vector<camera3_stream_buffer_t> &buffers,
+				     const CameraMetadata *metadata)
+{
+	if (buffers.empty() && !metadata)
+		return;
+
+	camera3_capture_result_t captureResult = {};
+	captureResult.frame_number = frameNumber;
+	captureResult.num_output_buffers = buffers.size();
+	captureResult.output_buffers = buffers.data();
+
+	/* Results that only carry buffers must not set the partial result. */
+	if (metadata) {
+		captureResult.partial_result = 1;
+		captureResult.result = metadata->get();
 	}
 
 	callbacks_->process_capture_result(callbacks_, &captureResult);
-
-	delete descriptor;
 }
 
 std::string CameraDevice::logPrefix() const
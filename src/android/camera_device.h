@@ -7,9 +7,13 @@
 #ifndef __ANDROID_CAMERA_DEVICE_H__
 #define __ANDROID_CAMERA_DEVICE_H__
 
+#include <deque>
+#include <list>
 #include <map>
 #include <memory>
+#include <sys/types.h>
 #include <tuple>
+#include <utility>
 #include <vector>
 
 #include <hardware/camera3.h>
@@ -22,14 +26,15 @@
 
 #include "libcamera/internal/log.h"
 #include "libcamera/internal/message.h"
+#include "libcamera/internal/thread.h"
 
 #include "jpeg/encoder.h"
+#include "worker_pool.h"
 
 class CameraMetadata;
 
 struct CameraStream {
 	CameraStream(libcamera::PixelFormat, libcamera::Size);
-	~CameraStream();
 
 	/*
 	 * The index of the libcamera StreamConfiguration as added during
@@ -41,7 +46,33 @@ struct CameraStream {
 	libcamera::PixelFormat format;
 	libcamera::Size size;
 
-	Encoder *jpeg;
+	/*
+	 * The JPEG encoders, one per encoding worker, as encoders can't be
+	 * used by multiple threads concurrently.
+	 */
+	std::vector<std::unique_ptr<Encoder>> jpeg;
+
+	/*
+	 * The FrameBuffers wrapping the gralloc buffers of the stream, to reuse
+	 * them in subsequent requests. Buffers are identified by the device
+	 * and inode numbers of the dmabufs of their planes, as buffer handles
+	 * and file descriptor numbers can both be reused for different buffers
+	 * once freed. The dmabufs of cached buffers are kept alive by the
+	 * FrameBuffer, which guarantees that their identity can't be reused.
+	 *
+	 * The cache is kept in least recently used order, with the most
+	 * recently used buffer first, and the least recently used entry is
+	 * evicted when the cache grows beyond maxCachedBuffers, to release
+	 * buffers the framework has freed.
+	 */
+	using BufferKey = std::vector<std::pair<dev_t, ino_t>>;
+	struct CachedBuffer {
+		BufferKey key;
+		std::unique_ptr<libcamera::FrameBuffer> frameBuffer;
+	};
+	std::list<CachedBuffer> frameBuffers;
+	std::map<BufferKey, std::list<CachedBuffer>::iterator> frameBufferIndex;
+	unsigned int maxCachedBuffers;
 };
 
 class CameraDevice : protected libcamera::Loggable
@@ -84,7 +115,22 @@ private:
 		uint32_t frameNumber;
 		uint32_t numBuffers;
 		camera3_stream_buffer_t *buffers;
-		std::vector<std::unique_ptr<libcamera::FrameBuffer>> frameBuffers;
+
+		std::unique_ptr<CameraMetadata> resultMetadata;
+		unsigned int pendingEncodes;
+
+		/*
+		 * Buffers returned with the result metadata instead of as soon
+		 * as the request completes, such as JPEG buffers and their
+		 * source buffers.
+		 */
+		std::vector<bool> deferred;
+	};
+
+	struct CaptureResult {
+		uint32_t frameNumber;
+		std::vector<camera3_stream_buffer_t> buffers;
+		std::unique_ptr<CameraMetadata> metadata;
 	};
 
 	struct Camera3StreamConfiguration {
@@ -95,8 +141,18 @@ private:
 	int initializeStreamConfigurations();
 	std::tuple<uint32_t, uint32_t> calculateStaticMetadataSize();
 	libcamera::FrameBuffer *createFrameBuffer(const buffer_handle_t camera3buffer);
+	libcamera::FrameBuffer *getFrameBuffer(CameraStream *cameraStream,
+					       const buffer_handle_t camera3buffer);
 	void notifyShutter(uint32_t frameNumber, uint64_t timestamp);
 	void notifyError(uint32_t frameNumber, camera3_stream_t *stream);
+	void sendCaptureResult(uint32_t frameNumber,
+			       const std::vector<camera3_stream_buffer_t> &buffers,
+			       const CameraMetadata *metadata);
+	void encodeJpeg(Camera3RequestDescriptor *descriptor, unsigned int index,
+			unsigned int source, unsigned int worker);
+	bool isStreamDeferred(const camera3_stream_t *stream) const;
+	void completeReadyResults();
+	void sendReadyResults(libcamera::MutexLocker &locker);
 	CameraMetadata *requestTemplatePreview();
 	libcamera::PixelFormat toPixelFormat(int format);
 	std::unique_ptr<CameraMetadata> getResultMetadata(int frame_number,
@@ -121,6 +177,20 @@ private:
 	int orientation_;
 
 	unsigned int maxJpegBufferSize_;
+
+	/*
+	 * Requests that have completed in libcamera, but whose result metadata
+	 * and JPEG buffers haven't been sent to the framework yet, and results
+	 * ready to be sent. Results are sent in frame order, as required by the
+	 * Android camera stack, by one thread at a time and without holding the
+	 * resultsMutex_ lock.
+	 */
+	libcamera::Mutex resultsMutex_;
+	std::deque<Camera3RequestDescriptor *> pendingResults_;
+	std::deque<CaptureResult> readyResults_;
+	bool sendingResults_;
+
+	std::unique_ptr<WorkerPool> encoders_;
 };
 
 #endif /* __ANDROID_CAMERA_DEVICE_H__ */
@@ -7,7 +7,6 @@
 #ifndef __ANDROID_JPEG_ENCODER_H__
 #define __ANDROID_JPEG_ENCODER_H__
 
-#include <libcamera/buffer.h>
 #include <libcamera/span.h>
 #include <libcamera/stream.h>
 
@@ -17,7 +16,7 @@ public:
 	virtual ~Encoder() {};
 
 	virtual int configure(const libcamera::StreamConfiguration &cfg) = 0;
-	virtual int encode(const libcamera::FrameBuffer *source,
+	virtual int encode(const libcamera::Span<const uint8_t> &source,
 			   const libcamera::Span<uint8_t> &destination) = 0;
 };
 
@@ -7,6 +7,7 @@
 
 #include "encoder_libjpeg.h"
 
+#include <algorithm>
 #include <fcntl.h>
 #include <iomanip>
 #include <iostream>
@@ -16,6 +17,12 @@
 #include <unistd.h>
 #include <vector>
 
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 #include <libcamera/camera.h>
 #include <libcamera/formats.h>
 #include <libcamera/pixel_format.h>
@@ -65,6 +72,78 @@ const struct JPEGPixelFormatInfo &findPixelInfo(const PixelFormat &format)
 	return iter->second;
 }
 
+/*
+ * A libjpeg destination manager that writes the compressed data directly to
+ * the destination buffer. Unlike jpeg_mem_dest(), the buffer is never
+ * reallocated when the data doesn't fit, the overflow is reported instead.
+ */
+struct JPEGDestination {
+	struct jpeg_destination_mgr mgr;
+	Span<uint8_t> buffer;
+	bool overflow;
+};
+
+void initDestination([[maybe_unused]] j_compress_ptr cinfo)
+{
+}
+
+boolean emptyOutputBuffer(j_compress_ptr cinfo)
+{
+	JPEGDestination *dest = reinterpret_cast<JPEGDestination *>(cinfo->dest);
+
+	/*
+	 * The buffer is full. Wrap around to let compression complete, the
+	 * error is reported once done.
+	 */
+	dest->overflow = true;
+	dest->mgr.next_output_byte = dest->buffer.data();
+	dest->mgr.free_in_buffer = dest->buffer.size();
+
+	return TRUE;
+}
+
+void termDestination([[maybe_unused]] j_compress_ptr cinfo)
+{
+}
+
+/*
+ * Split the interleaved chroma samples of a semi-planar line to separate Cb
+ * and Cr lines.
+ */
+void deinterleave(const uint8_t *src, uint8_t *cb, uint8_t *cr,
+		  unsigned int width)
+{
+	unsigned int x = 0;
+
+#if defined(__ARM_NEON)
+	for (; x + 16 <= width; x += 16) {
+		uint8x16x2_t samples = vld2q_u8(src + x * 2);
+		vst1q_u8(cb + x, samples.val[0]);
+		vst1q_u8(cr + x, samples.val[1]);
+	}
+#elif defined(__SSE2__)
+	const __m128i mask = _mm_set1_epi16(0x00ff);
+
+	for (; x + 16 <= width; x += 16) {
+		__m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + x * 2));
+		__m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + x * 2 + 16));
+
+		__m128i first = _mm_packus_epi16(_mm_and_si128(lo, mask),
+						 _mm_and_si128(hi, mask));
+		__m128i second = _mm_packus_epi16(_mm_srli_epi16(lo, 8),
+						  _mm_srli_epi16(hi, 8));
+
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(cb + x), first);
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(cr + x), second);
+	}
+#endif
+
+	for (; x < width; x++) {
+		cb[x] = src[x * 2];
+		cr[x] = src[x * 2 + 1];
+	}
+}
+
 } /* namespace */
 
 EncoderLibJpeg::EncoderLibJpeg()
@@ -101,12 +180,32 @@ int EncoderLibJpeg::configure(const StreamConfiguration &cfg)
 	nv_ = pixelFormatInfo_->numPlanes() == 2;
 	nvSwap_ = info.nvSwap;
 
+	/*
+	 * Semi-planar formats are compressed from raw downsampled data, with
+	 * the sampling factors of the luma component matching the chroma
+	 * subsampling of the format.
+	 */
+	if (nv_) {
+		unsigned int c_stride = pixelFormatInfo_->stride(compress_.image_width, 1);
+
+		horzSubSample_ = 2 * compress_.image_width / c_stride;
+		vertSubSample_ = pixelFormatInfo_->planes[1].verticalSubSampling;
+
+		compress_.raw_data_in = TRUE;
+		compress_.comp_info[0].h_samp_factor = horzSubSample_;
+		compress_.comp_info[0].v_samp_factor = vertSubSample_;
+		compress_.comp_info[1].h_samp_factor = 1;
+		compress_.comp_info[1].v_samp_factor = 1;
+		compress_.comp_info[2].h_samp_factor = 1;
+		compress_.comp_info[2].v_samp_factor = 1;
+	}
+
 	return 0;
 }
 
-void EncoderLibJpeg::compressRGB(const libcamera::MappedBuffer *frame)
+void EncoderLibJpeg::compressRGB(const libcamera::Span<const uint8_t> &frame)
 {
-	unsigned char *src = static_cast<unsigned char *>(frame->maps()[0].data());
+	unsigned char *src = const_cast<unsigned char *>(frame.data());
 	/* \todo Stride information should come from buffer configuration. */
 	unsigned int stride = pixelFormatInfo_->stride(compress_.image_width, 0);
 
@@ -120,87 +219,95 @@ void EncoderLibJpeg::compressRGB(const libcamera::MappedBuffer *frame)
 
 /*
  * Compress the incoming buffer from a supported NV format.
- * This naively unpacks the semi-planar NV12 to a YUV888 format for libjpeg.
+ *
+ * The luma plane is passed to libjpeg in place, and the chroma plane is split
+ * into separate Cb and Cr lines, one iMCU row at a time. libjpeg reads full
+ * DCT blocks, the lines past the bottom of the image thus duplicate the last
+ * line, and lines are padded to a multiple of the block size by replicating
+ * their last sample. Luma lines are only copied when padding is needed.
  */
-void EncoderLibJpeg::compressNV(const libcamera::MappedBuffer *frame)
+void EncoderLibJpeg::compressNV(const libcamera::Span<const uint8_t> &frame)
 {
-	uint8_t tmprowbuf[compress_.image_width * 3];
+	unsigned int width = compress_.image_width;
+	unsigned int height = compress_.image_height;
 
-	/*
-	 * \todo Use the raw api, and only unpack the cb/cr samples to new line
-	 * buffers. If possible, see if we can set appropriate pixel strides
-	 * too to save even that copy.
-	 *
-	 * Possible hints at:
-	 * https://sourceforge.net/p/libjpeg/mailman/message/30815123/
-	 */
-	unsigned int y_stride = pixelFormatInfo_->stride(compress_.image_width, 0);
-	unsigned int c_stride = pixelFormatInfo_->stride(compress_.image_width, 1);
+	unsigned int y_stride = pixelFormatInfo_->stride(width, 0);
+	unsigned int c_stride = pixelFormatInfo_->stride(width, 1);
 
-	unsigned int horzSubSample = 2 * compress_.image_width / c_stride;
-	unsigned int vertSubSample = pixelFormatInfo_->planes[1].verticalSubSampling;
+	unsigned int c_width = (width + horzSubSample_ - 1) / horzSubSample_;
+	unsigned int c_height = (height + vertSubSample_ - 1) / vertSubSample_;
+	unsigned int y_padded = compress_.comp_info[0].width_in_blocks * DCTSIZE;
+	unsigned int c_padded = compress_.comp_info[1].width_in_blocks * DCTSIZE;
 
-	unsigned int c_inc = horzSubSample == 1 ? 2 : 0;
-	unsigned int cb_pos = nvSwap_ ? 1 : 0;
-	unsigned int cr_pos = nvSwap_ ? 0 : 1;
+	unsigned int lines = vertSubSample_ * DCTSIZE;
 
-	const unsigned char *src = static_cast<unsigned char *>(frame->maps()[0].data());
-	const unsigned char *src_c = src + y_stride * compress_.image_height;
+	const unsigned char *src = frame.data();
+	const unsigned char *src_c = src + y_stride * height;
 
-	JSAMPROW row_pointer[1];
-	row_pointer[0] = &tmprowbuf[0];
-
-	for (unsigned int y = 0; y < compress_.image_height; y++) {
-		unsigned char *dst = &tmprowbuf[0];
-
-		const unsigned char *src_y = src + y * compress_.image_width;
-		const unsigned char *src_cb = src_c + (y / vertSubSample) * c_stride + cb_pos;
-		const unsigned char *src_cr = src_c + (y / vertSubSample) * c_stride + cr_pos;
-
-		for (unsigned int x = 0; x < compress_.image_width; x += 2) {
-			dst[0] = *src_y;
-			dst[1] = *src_cb;
-			dst[2] = *src_cr;
-			src_y++;
-			src_cb += c_inc;
-			src_cr += c_inc;
-			dst += 3;
-
-			dst[0] = *src_y;
-			dst[1] = *src_cb;
-			dst[2] = *src_cr;
-			src_y++;
-			src_cb += 2;
-			src_cr += 2;
-			dst += 3;
+	bool copyLuma = y_padded != width;
+
+	lines_.resize(c_padded * DCTSIZE * 2 + (copyLuma ? y_padded * lines : 0));
+	unsigned char *cb = lines_.data();
+	unsigned char *cr = cb + c_padded * DCTSIZE;
+	unsigned char *luma = cr + c_padded * DCTSIZE;
+
+	JSAMPROW y_rows[2 * DCTSIZE];
+	JSAMPROW cb_rows[DCTSIZE];
+	JSAMPROW cr_rows[DCTSIZE];
+	JSAMPARRAY planes[3] = { y_rows, nvSwap_ ? cr_rows : cb_rows,
+				 nvSwap_ ? cb_rows : cr_rows };
+
+	for (unsigned int i = 0; i < DCTSIZE; i++) {
+		cb_rows[i] = &cb[i * c_padded];
+		cr_rows[i] = &cr[i * c_padded];
+	}
+
+	for (unsigned int y = 0; y < height; y += lines) {
+		for (unsigned int i = 0; i < lines; i++) {
+			unsigned int line = std::min(y + i, height - 1);
+			const unsigned char *src_y = &src[line * y_stride];
+
+			if (!copyLuma) {
+				y_rows[i] = const_cast<JSAMPROW>(src_y);
+				continue;
+			}
+
+			y_rows[i] = &luma[i * y_padded];
+			std::copy(src_y, src_y + width, y_rows[i]);
+			std::fill(y_rows[i] + width, y_rows[i] + y_padded,
+				  src_y[width - 1]);
 		}
 
-		jpeg_write_scanlines(&compress_, row_pointer, 1);
+		for (unsigned int i = 0; i < DCTSIZE; i++) {
+			unsigned int line = std::min(y / vertSubSample_ + i,
+						     c_height - 1);
+
+			deinterleave(&src_c[line * c_stride], cb_rows[i],
+				     cr_rows[i], c_width);
+
+			std::fill(cb_rows[i] + c_width, cb_rows[i] + c_padded,
+				  cb_rows[i][c_width - 1]);
+			std::fill(cr_rows[i] + c_width, cr_rows[i] + c_padded,
+				  cr_rows[i][c_width - 1]);
+		}
+
+		jpeg_write_raw_data(&compress_, planes, lines);
 	}
 }
 
-int EncoderLibJpeg::encode(const FrameBuffer *source,
+int EncoderLibJpeg::encode(const libcamera::Span<const uint8_t> &frame,
 			   const libcamera::Span<uint8_t> &dest)
 {
-	MappedFrameBuffer frame(source, PROT_READ);
-	if (!frame.isValid()) {
-		LOG(JPEG, Error) << "Failed to map FrameBuffer : "
-				 << strerror(frame.error());
-		return frame.error();
-	}
-
-	unsigned char *destination = dest.data();
-	unsigned long size = dest.size();
+	JPEGDestination destination;
+	destination.mgr.init_destination = initDestination;
+	destination.mgr.empty_output_buffer = emptyOutputBuffer;
+	destination.mgr.term_destination = termDestination;
+	destination.mgr.next_output_byte = dest.data();
+	destination.mgr.free_in_buffer = dest.size();
+	destination.buffer = dest;
+	destination.overflow = false;
 
-	/*
-	 * The jpeg_mem_dest will reallocate if the required size is not
-	 * sufficient. That means the output won't be written to the correct
-	 * buffers.
-	 *
-	 * \todo Implement our own custom memory destination to prevent
-	 * reallocation and prefer failure with correct reporting.
-	 */
-	jpeg_mem_dest(&compress_, &destination, &size);
+	compress_.dest = &destination.mgr;
 
 	jpeg_start_compress(&compress_, TRUE);
 
@@ -208,11 +315,19 @@ int EncoderLibJpeg::encode(const FrameBuffer *source,
 			 << "x" << compress_.image_height;
 
 	if (nv_)
-		compressNV(&frame);
+		compressNV(frame);
 	else
-		compressRGB(&frame);
+		compressRGB(frame);
 
 	jpeg_finish_compress(&compress_);
 
-	return size;
+	compress_.dest = nullptr;
+
+	if (destination.overflow) {
+		LOG(JPEG, Error) << "JPEG destination buffer too small ("
+				 << dest.size() << " bytes)";
+		return -ENOSPC;
+	}
+
+	return dest.size() - destination.mgr.free_in_buffer;
 }
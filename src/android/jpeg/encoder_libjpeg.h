@@ -9,7 +9,8 @@
 
 #include "encoder.h"
 
-#include "libcamera/internal/buffer.h"
+#include <vector>
+
 #include "libcamera/internal/formats.h"
 
 #include <jpeglib.h>
@@ -21,12 +22,12 @@ public:
 	~EncoderLibJpeg();
 
 	int configure(const libcamera::StreamConfiguration &cfg) override;
-	int encode(const libcamera::FrameBuffer *source,
+	int encode(const libcamera::Span<const uint8_t> &source,
 		   const libcamera::Span<uint8_t> &destination) override;
 
 private:
-	void compressRGB(const libcamera::MappedBuffer *frame);
-	void compressNV(const libcamera::MappedBuffer *frame);
+	void compressRGB(const libcamera::Span<const uint8_t> &frame);
+	void compressNV(const libcamera::Span<const uint8_t> &frame);
 
 	struct jpeg_compress_struct compress_;
 	struct jpeg_error_mgr jerr_;
@@ -37,6 +38,10 @@ private:
 
 	bool nv_;
 	bool nvSwap_;
+	unsigned int horzSubSample_;
+	unsigned int vertSubSample_;
+
+	std::vector<unsigned char> lines_;
 };
 
 #endif /* __ANDROID_JPEG_ENCODER_LIBJPEG_H__ */
@@ -0,0 +1,89 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2020, Google Inc.
+ *
+ * worker_pool.cpp - Pool of worker threads for the Android camera HAL
+ */
+
+#include "worker_pool.h"
+
+using namespace libcamera;
+
+/*
+ * \class WorkerPool
+ *
+ * A fixed set of threads that run tasks from a shared FIFO queue. Tasks are
+ * started in the order they are queued, but may complete in any order.
+ */
+
+WorkerPool::WorkerPool(unsigned int size)
+	: busy_(0), stopping_(false)
+{
+	for (unsigned int i = 0; i < size; ++i) {
+		workers_.emplace_back(std::make_unique<Worker>(this, i));
+		workers_.back()->start();
+	}
+}
+
+/*
+ * Tasks still queued at destruction time are run before the workers are
+ * stopped.
+ */
+WorkerPool::~WorkerPool()
+{
+	{
+		MutexLocker locker(mutex_);
+		stopping_ = true;
+	}
+
+	taskAvailable_.notify_all();
+
+	for (std::unique_ptr<Worker> &worker : workers_)
+		worker->wait();
+}
+
+void WorkerPool::queue(Task task)
+{
+	{
+		MutexLocker locker(mutex_);
+		tasks_.push(std::move(task));
+	}
+
+	taskAvailable_.notify_one();
+}
+
+/*
+ * Wait until all queued tasks have completed. This must not be called from a
+ * task.
+ */
+void WorkerPool::flush()
+{
+	MutexLocker locker(mutex_);
+	idle_.wait(locker, [&] { return tasks_.empty() && !busy_; });
+}
+
+void WorkerPool::process(unsigned int worker)
+{
+	MutexLocker locker(mutex_);
+
+	while (true) {
+		taskAvailable_.wait(locker, [&] {
+			return stopping_ || !tasks_.empty();
+		});
+
+		if (tasks_.empty())
+			return;
+
+		Task task = std::move(tasks_.front());
+		tasks_.pop();
+		busy_++;
+
+		locker.unlock();
+		task(worker);
+		locker.lock();
+
+		busy_--;
+		if (tasks_.empty() && !busy_)
+			idle_.notify_all();
+	}
+}
@@ -0,0 +1,64 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2020, Google Inc.
+ *
+ * worker_pool.h - Pool of worker threads for the Android camera HAL
+ */
+#ifndef __ANDROID_WORKER_POOL_H__
+#define __ANDROID_WORKER_POOL_H__
+
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <queue>
+#include <vector>
+
+#include "libcamera/internal/thread.h"
+
+class WorkerPool
+{
+public:
+	/*
+	 * Tasks receive the index of the worker that runs them, to let them
+	 * use per-worker resources without locking.
+	 */
+	using Task = std::function<void(unsigned int worker)>;
+
+	WorkerPool(unsigned int size);
+	~WorkerPool();
+
+	unsigned int size() const { return workers_.size(); }
+
+	void queue(Task task);
+	void flush();
+
+private:
+	class Worker : public libcamera::Thread
+	{
+	public:
+		Worker(WorkerPool *pool, unsigned int index)
+			: pool_(pool), index_(index)
+		{
+		}
+
+	protected:
+		void run() override { pool_->process(index_); }
+
+	private:
+		WorkerPool *pool_;
+		unsigned int index_;
+	};
+
+	void process(unsigned int worker);
+
+	std::vector<std::unique_ptr<Worker>> workers_;
+
+	libcamera::Mutex mutex_;
+	std::condition_variable taskAvailable_;
+	std::condition_variable idle_;
+	std::queue<Task> tasks_;
+	unsigned int busy_;
+	bool stopping_;
+};
+
+#endif /* __ANDROID_WORKER_POOL_H__ */
@@ -0,0 +1,302 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2020, Google Inc.
+ *
+ * benchmark.cpp - cam - Benchmark and soak test report
+ */
+
+#include <algorithm>
+#include <dirent.h>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include "benchmark.h"
+
+using namespace libcamera;
+
+namespace {
+
+uint64_t toMicroseconds(const struct timeval &tv)
+{
+	return tv.tv_sec * 1000000ULL + tv.tv_usec;
+}
+
+/* Parse a "Name:   value kB" line from /proc/self/status. */
+uint64_t statusValue(const std::string &status, const std::string &name)
+{
+	size_t pos = status.find("\n" + name + ":");
+	if (pos == std::string::npos)
+		return 0;
+
+	std::istringstream line(status.substr(pos + name.size() + 2));
+	uint64_t value = 0;
+	line >> value;
+	return value;
+}
+
+std::string escapeJSON(const std::string &str)
+{
+	std::ostringstream out;
+
+	for (char c : str) {
+		switch (c) {
+		case '"':
+		case '\\':
+			out << '\\' << c;
+			break;
+		default:
+			if (static_cast<unsigned char>(c) < 0x20)
+				out << "\\u" << std::hex << std::setw(4)
+				    << std::setfill('0') << static_cast<int>(c)
+				    << std::dec;
+			else
+				out << c;
+			break;
+		}
+	}
+
+	return out.str();
+}
+
+void printHistogramJSON(std::ostream &out, const char *name,
+			const CameraStatistics::Histogram &histogram)
+{
+	out << "  \"" << name << "\": { "
+	    << "\"count\": " << histogram.count << ", "
+	    << "\"mean\": " << histogram.mean() << ", "
+	    << "\"min\": " << (histogram.count ? histogram.min : 0) << ", "
+	    << "\"p50\": " << histogram.percentile(50) << ", "
+	    << "\"p99\": " << histogram.percentile(99) << ", "
+	    << "\"p99.9\": " << histogram.percentile(99.9) << ", "
+	    << "\"max\": " << histogram.max << " },\n";
+}
+
+void printHistogram(std::ostream &out, const char *name,
+		    const CameraStatistics::Histogram &histogram)
+{
+	if (!histogram.count)
+		return;
+
+	out << "  " << name << ": " << histogram.count << " samples, mean "
+	    << histogram.mean() / 1000.0
+	    << " ms, p50 " << histogram.percentile(50) / 1000.0
+	    << " ms, p99 " << histogram.percentile(99) / 1000.0
+	    << " ms, p99.9 " << histogram.percentile(99.9) / 1000.0
+	    << " ms, max " << histogram.max / 1000.0 << " ms" << std::endl;
+}
+
+} /* namespace */
+
+/*
+ * The benchmark measures the CPU time consumed by each thread of the process
+ * and the resident memory between start() and stop(). Frame timing
+ * statistics are gathered by the camera itself.
+ */
+Benchmark::Snapshot Benchmark::snapshot()
+{
+	Snapshot snapshot{};
+	snapshot.time = std::chrono::steady_clock::now();
+
+	long ticks = sysconf(_SC_CLK_TCK);
+
+	DIR *dir = opendir("/proc/self/task");
+	if (dir) {
+		struct dirent *entry;
+
+		while ((entry = readdir(dir))) {
+			if (entry->d_name[0] == '.')
+				continue;
+
+			std::string path = std::string("/proc/self/task/") + entry->d_name;
+			std::ifstream stat(path + "/stat");
+			std::string line;
+			if (!std::getline(stat, line))
+				continue;
+
+			/*
+			 * The thread name is enclosed in parentheses and may
+			 * contain spaces. utime and stime are the 12th and 13th
+			 * fields after it.
+			 */
+			size_t open = line.find('(');
+			size_t close = line.rfind(')');
+			if (open == std::string::npos || close == std::string::npos)
+				continue;
+
+			std::istringstream fields(line.substr(close + 1));
+			std::string field;
+			uint64_t utime = 0, stime = 0;
+			for (unsigned int i = 0; i < 13 && fields >> field; ++i) {
+				if (i == 11)
+					utime = std::stoull(field);
+				else if (i == 12)
+					stime = std::stoull(field);
+			}
+
+			ThreadTimes &times = snapshot.threads[std::stoi(entry->d_name)];
+			times.name = line.substr(open + 1, close - open - 1);
+			times.user = utime * 1000000 / ticks;
+			times.system = stime * 1000000 / ticks;
+		}
+
+		closedir(dir);
+	}
+
+	struct rusage usage;
+	if (!getrusage(RUSAGE_SELF, &usage)) {
+		snapshot.user = toMicroseconds(usage.ru_utime);
+		snapshot.system = toMicroseconds(usage.ru_stime);
+	}
+
+	std::ifstream file("/proc/self/status");
+	std::string status = "\n" + std::string(std::istreambuf_iterator<char>(file),
+						std::istreambuf_iterator<char>());
+	snapshot.rss = statusValue(status, "VmRSS");
+	snapshot.peakRss = statusValue(status, "VmHWM");
+
+	return snapshot;
+}
+
+void Benchmark::start()
+{
+	start_ = snapshot();
+	end_ = start_;
+}
+
+void Benchmark::stop()
+{
+	end_ = snapshot();
+}
+
+std::vector<Benchmark::ThreadUsage> Benchmark::threadUsage() const
+{
+	std::vector<ThreadUsage> usage;
+
+	for (const auto &[tid, end] : end_.threads) {
+		ThreadTimes start{};
+		auto it = start_.threads.find(tid);
+		if (it != start_.threads.end())
+			start = it->second;
+
+		usage.push_back({ tid, end.name,
+				  (end.user - start.user) / 1000000.0,
+				  (end.system - start.system) / 1000000.0 });
+	}
+
+	std::sort(usage.begin(), usage.end(),
+		  [](const ThreadUsage &a, const ThreadUsage &b) {
+			  return a.user + a.system > b.user + b.system;
+		  });
+
+	return usage;
+}
+
+void Benchmark::print(const CameraStatistics &stats,
+		      const std::map<const Stream *, std::string> &streams,
+		      std::ostream &out) const
+{
+	double duration = std::chrono::duration<double>(end_.time - start_.time).count();
+
+	out << std::fixed << std::setprecision(3)
+	    << "Benchmark: " << duration << " s" << std::endl
+	    << "  requests: " << stats.requestsQueued << " queued, "
+	    << stats.requestsCompleted << " completed, "
+	    << stats.requestsCancelled << " cancelled" << std::endl;
+
+	printHistogram(out, "frame interval", stats.frameInterval);
+	printHistogram(out, "request latency", stats.requestLatency);
+	printHistogram(out, "IPA processing", stats.ipaProcessingTime);
+
+	for (const auto &[stream, streamStats] : stats.streams) {
+		auto name = streams.find(stream);
+		if (name == streams.end())
+			continue;
+
+		out << "  " << name->second << ": " << streamStats.frames
+		    << " frames, " << streamStats.errors << " errors, "
+		    << streamStats.sequenceGaps << " sequence gaps" << std::endl;
+	}
+
+	double user = (end_.user - start_.user) / 1000000.0;
+	double system = (end_.system - start_.system) / 1000000.0;
+
+	out << "  CPU time: " << user << " s user, " << system << " s system";
+	if (duration > 0)
+		out << " (" << std::setprecision(1)
+		    << (user + system) * 100 / duration << "%)"
+		    << std::setprecision(3);
+	out << std::endl;
+
+	for (const ThreadUsage &thread : threadUsage())
+		out << "    " << thread.name << " [" << thread.tid << "]: "
+		    << thread.user << " s user, " << thread.system
+		    << " s system" << std::endl;
+
+	out << "  RSS: " << start_.rss << " kB at start, " << end_.rss
+	    << " kB at end (" << std::showpos
+	    << static_cast<int64_t>(end_.rss - start_.rss) << std::noshowpos
+	    << " kB), peak " << end_.peakRss << " kB" << std::endl;
+}
+
+void Benchmark::printJSON(const std::string &camera,
+			  const CameraStatistics &stats,
+			  const std::map<const Stream *, std::string> &streams,
+			  std::ostream &out) const
+{
+	double duration = std::chrono::duration<double>(end_.time - start_.time).count();
+
+	out << std::fixed << std::setprecision(6)
+	    << "{\n"
+	    << "  \"camera\": \"" << escapeJSON(camera) << "\",\n"
+	    << "  \"duration\": " << duration << ",\n"
+	    << "  \"requests\": { "
+	    << "\"queued\": " << stats.requestsQueued << ", "
+	    << "\"completed\": " << stats.requestsCompleted << ", "
+	    << "\"cancelled\": " << stats.requestsCancelled << " },\n";
+
+	/* Durations are expressed in microseconds. */
+	printHistogramJSON(out, "frame_interval", stats.frameInterval);
+	printHistogramJSON(out, "request_latency", stats.requestLatency);
+	printHistogramJSON(out, "ipa_processing", stats.ipaProcessingTime);
+
+	out << "  \"streams\": [";
+	bool first = true;
+	for (const auto &[stream, streamStats] : stats.streams) {
+		auto name = streams.find(stream);
+		if (name == streams.end())
+			continue;
+
+		out << (first ? "\n" : ",\n")
+		    << "    { \"name\": \"" << escapeJSON(name->second) << "\", "
+		    << "\"frames\": " << streamStats.frames << ", "
+		    << "\"errors\": " << streamStats.errors << ", "
+		    << "\"sequence_gaps\": " << streamStats.sequenceGaps << " }";
+		first = false;
+	}
+	out << "\n  ],\n";
+
+	out << "  \"cpu\": {\n"
+	    << "    \"user\": " << (end_.user - start_.user) / 1000000.0 << ",\n"
+	    << "    \"system\": " << (end_.system - start_.system) / 1000000.0 << ",\n"
+	    << "    \"threads\": [";
+	first = true;
+	for (const ThreadUsage &thread : threadUsage()) {
+		out << (first ? "\n" : ",\n")
+		    << "      { \"tid\": " << thread.tid << ", "
+		    << "\"name\": \"" << escapeJSON(thread.name) << "\", "
+		    << "\"user\": " << thread.user << ", "
+		    << "\"system\": " << thread.system << " }";
+		first = false;
+	}
+	out << "\n    ]\n  },\n";
+
+	out << "  \"memory\": { "
+	    << "\"rss_start\": " << start_.rss << ", "
+	    << "\"rss_end\": " << end_.rss << ", "
+	    << "\"rss_growth\": " << static_cast<int64_t>(end_.rss - start_.rss) << ", "
+	    << "\"rss_peak\": " << end_.peakRss << " }\n"
+	    << "}" << std::endl;
+}
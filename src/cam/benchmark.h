@@ -0,0 +1,65 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2020, Google Inc.
+ *
+ * benchmark.h - cam - Benchmark and soak test report
+ */
+#ifndef __CAM_BENCHMARK_H__
+#define __CAM_BENCHMARK_H__
+
+#include <chrono>
+#include <map>
+#include <ostream>
+#include <stdint.h>
+#include <string>
+#include <sys/types.h>
+#include <vector>
+
+#include <libcamera/camera_statistics.h>
+#include <libcamera/stream.h>
+
+class Benchmark
+{
+public:
+	void start();
+	void stop();
+
+	void print(const libcamera::CameraStatistics &stats,
+		   const std::map<const libcamera::Stream *, std::string> &streams,
+		   std::ostream &out) const;
+	void printJSON(const std::string &camera,
+		       const libcamera::CameraStatistics &stats,
+		       const std::map<const libcamera::Stream *, std::string> &streams,
+		       std::ostream &out) const;
+
+private:
+	struct ThreadTimes {
+		std::string name;
+		uint64_t user;
+		uint64_t system;
+	};
+
+	struct Snapshot {
+		std::chrono::steady_clock::time_point time;
+		std::map<pid_t, ThreadTimes> threads;
+		uint64_t user;
+		uint64_t system;
+		uint64_t rss;
+		uint64_t peakRss;
+	};
+
+	struct ThreadUsage {
+		pid_t tid;
+		std::string name;
+		double user;
+		double system;
+	};
+
+	static Snapshot snapshot();
+	std::vector<ThreadUsage> threadUsage() const;
+
+	Snapshot start_;
+	Snapshot end_;
+};
+
+#endif /* __CAM_BENCHMARK_H__ */
@@ -5,25 +5,172 @@
  * buffer_writer.cpp - Buffer writer
  */
 
+#include <algorithm>
+#include <climits>
 #include <fcntl.h>
 #include <iomanip>
 #include <iostream>
 #include <sstream>
+#include <stdint.h>
 #include <string.h>
+#include <strings.h>
+#include <sys/eventfd.h>
 #include <sys/mman.h>
 #include <unistd.h>
 
+#include <libcamera/control_ids.h>
+
 #include "buffer_writer.h"
 
 using namespace libcamera;
 
-BufferWriter::BufferWriter(const std::string &pattern)
-	: pattern_(pattern)
+/* Number of threads writing frames concurrently. */
+static constexpr unsigned int kWriterThreads = 4;
+
+/* Frames smaller than this are always written through the page cache. */
+static constexpr size_t kDirectIOThreshold = 1024 * 1024;
+static constexpr size_t kDirectIOAlignment = 4096;
+/* Size of the aligned buffer used to bounce direct I/O writes. */
+static constexpr size_t kBounceBufferSize = 1024 * 1024;
+
+static constexpr mode_t kFileMode = S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP |
+				    S_IROTH | S_IWOTH;
+
+static bool hasExtension(const std::string &pattern, const std::string &extension)
+{
+	return pattern.size() >= extension.size() &&
+	       strcasecmp(pattern.c_str() + pattern.size() - extension.size(),
+			  extension.c_str()) == 0;
+}
+
+static size_t alignUp(size_t size)
+{
+	return (size + kDirectIOAlignment - 1) & ~(kDirectIOAlignment - 1);
+}
+
+static int writeAll(int fd, const uint8_t *data, size_t length, off_t offset)
+{
+	while (length) {
+		ssize_t ret = pwrite(fd, data, length, offset);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			return -errno;
+		}
+
+		data += ret;
+		length -= ret;
+		offset += ret;
+	}
+
+	return 0;
+}
+
+/*
+ * Write an aligned range of a file opened with O_DIRECT. Direct I/O needs an
+ * aligned source buffer, and fails with EFAULT when the source pages can't be
+ * pinned, as for dmabufs mapped with VM_PFNMAP. Bounce the data through an
+ * aligned buffer in those cases, and if the file system still rejects the
+ * write, clear O_DIRECT and write through the page cache.
+ */
+static int writeDirect(int fd, const uint8_t *data, size_t length, off_t offset)
+{
+	int ret = -EINVAL;
+
+	if (reinterpret_cast<uintptr_t>(data) % kDirectIOAlignment == 0) {
+		ret = writeAll(fd, data, length, offset);
+		if (ret != -EFAULT && ret != -EINVAL)
+			return ret;
+	}
+
+	thread_local std::unique_ptr<uint8_t, void (*)(void *)> bounce{
+		static_cast<uint8_t *>(aligned_alloc(kDirectIOAlignment,
+						     kBounceBufferSize)),
+		free
+	};
+
+	if (bounce) {
+		for (size_t done = 0; done < length; ) {
+			size_t size = std::min(length - done, kBounceBufferSize);
+
+			memcpy(bounce.get(), data + done, size);
+			ret = writeAll(fd, bounce.get(), size, offset + done);
+			if (ret < 0)
+				break;
+
+			done += size;
+		}
+
+		if (ret != -EINVAL)
+			return ret;
+	}
+
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_DIRECT);
+	return writeAll(fd, data, length, offset);
+}
+
+/*
+ * Frames are written by a pool of threads, and bufferWritten is emitted from
+ * the event loop once a frame has been written to disk. The buffers are not
+ * copied, the caller shall not requeue them before they are signalled as
+ * written. When the pattern contains no '#', all frames are appended to a
+ * single file at offsets reserved in the order of the write() calls. A
+ * pattern ending in ".lcr" stores all frames with their metadata in a raw
+ * container file, described in raw_container.h.
+ */
+BufferWriter::BufferWriter(const Camera *camera, const std::string &pattern)
+	: camera_(camera), pattern_(pattern), format_(Raw), directIO_(false),
+	  maxPending_(UINT_MAX), fd_(-1), offset_(0), pending_(0), stop_(false),
+	  stats_{}
 {
+	if (hasExtension(pattern_, ".lcr")) {
+		format_ = Container;
+	} else if (hasExtension(pattern_, ".dng")) {
+#ifdef HAVE_DNG
+		dngWriter_ = std::make_unique<DNGWriter>();
+		format_ = DNG;
+#else
+		std::cerr << "DNG support not available, writing raw frames to "
+			  << pattern_ << std::endl;
+#endif
+	}
+
+	eventfd_ = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (eventfd_ < 0) {
+		std::cerr << "Failed to create eventfd: " << strerror(errno)
+			  << std::endl;
+		return;
+	}
+
+	notifier_ = std::make_unique<EventNotifier>(eventfd_, EventNotifier::Read);
+	notifier_->activated.connect(this, &BufferWriter::writeCompleted);
+
+	for (unsigned int i = 0; i < kWriterThreads; i++)
+		threads_.emplace_back(&BufferWriter::run, this);
 }
 
 BufferWriter::~BufferWriter()
 {
+	flush();
+
+	{
+		std::lock_guard<std::mutex> locker(mutex_);
+		stop_ = true;
+	}
+	cv_.notify_all();
+
+	for (std::thread &thread : threads_)
+		thread.join();
+
+	if (format_ == Container && fd_ >= 0)
+		writeIndex();
+
+	notifier_.reset();
+	if (eventfd_ >= 0)
+		close(eventfd_);
+	if (fd_ >= 0)
+		close(fd_);
+
 	for (auto &iter : mappedBuffers_) {
 		void *memory = iter.second.first;
 		unsigned int length = iter.second.second;
@@ -43,27 +190,189 @@ void BufferWriter::mapBuffer(FrameBuffer *buffer)
 	}
 }
 
-int BufferWriter::write(FrameBuffer *buffer, const std::string &streamName)
+/*
+ * Prepare the output for the streams of \a config. This writes the header of
+ * container files, and is a no-op for the other formats.
+ */
+int BufferWriter::configure(const CameraConfiguration &config,
+			    const std::map<const Stream *, std::string> &names)
 {
-	std::string filename;
-	size_t pos;
-	int fd, ret = 0;
+	if (format_ != Container)
+		return 0;
 
-	filename = pattern_;
-	pos = filename.find_first_of('#');
+	int flags = O_CREAT | O_WRONLY | O_TRUNC | O_CLOEXEC;
+	fd_ = open(pattern_.c_str(), flags | (directIO_ ? O_DIRECT : 0),
+		   kFileMode);
+	if (fd_ == -1 && directIO_)
+		fd_ = open(pattern_.c_str(), flags, kFileMode);
+	if (fd_ == -1) {
+		int ret = -errno;
+		std::cerr << "failed to open " << pattern_ << ": "
+			  << strerror(-ret) << std::endl;
+		return ret;
+	}
+
+	std::vector<const ControlId *> ids;
+	for (const auto &[id, control] : controls::controls)
+		ids.push_back(control);
+	std::sort(ids.begin(), ids.end(),
+		  [](const ControlId *a, const ControlId *b) {
+			  return a->id() < b->id();
+		  });
+
+	size_t size = sizeof(lcr_header) + config.size() * sizeof(lcr_stream) +
+		      ids.size() * sizeof(lcr_control);
+	std::vector<uint8_t> data(alignUp(size) + kDirectIOAlignment);
+	uint8_t *header = data.data() + kDirectIOAlignment -
+			  reinterpret_cast<uintptr_t>(data.data()) % kDirectIOAlignment;
+
+	lcr_header *hdr = reinterpret_cast<lcr_header *>(header);
+	memcpy(hdr->magic, LCR_HEADER_MAGIC, sizeof(hdr->magic));
+	hdr->version = LCR_VERSION;
+	hdr->alignment = kDirectIOAlignment;
+	hdr->header_size = alignUp(size);
+	hdr->num_streams = config.size();
+	hdr->num_controls = ids.size();
+
+	lcr_stream *streams = reinterpret_cast<lcr_stream *>(hdr + 1);
+	for (unsigned int i = 0; i < config.size(); ++i) {
+		const StreamConfiguration &cfg = config.at(i);
+		lcr_stream &stream = streams[i];
+
+		auto name = names.find(cfg.stream());
+		if (name != names.end())
+			strncpy(stream.name, name->second.c_str(),
+				sizeof(stream.name) - 1);
+
+		stream.fourcc = cfg.pixelFormat.fourcc();
+		stream.modifier = cfg.pixelFormat.modifier();
+		stream.width = cfg.size.width;
+		stream.height = cfg.size.height;
+		stream.stride = cfg.stride;
+		stream.frame_size = cfg.frameSize;
+
+		streamIndex_[cfg.stream()] = i;
+	}
+
+	lcr_control *table = reinterpret_cast<lcr_control *>(streams + config.size());
+	for (const ControlId *id : ids) {
+		table->id = id->id();
+		table->type = id->type();
+		strncpy(table->name, id->name().c_str(), sizeof(table->name) - 1);
+		table++;
+	}
+
+	int ret = writeAll(fd_, header, hdr->header_size, 0);
+	if (ret < 0) {
+		std::cerr << "failed to write container header: "
+			  << strerror(-ret) << std::endl;
+		return ret;
+	}
+
+	offset_ = hdr->header_size;
+	index_.clear();
+
+	return 0;
+}
+
+/*
+ * Fill the container record header and metadata for \a job, and allocate the
+ * blocks used to pad the planes tails. Return the record size, or 0 if the
+ * frame can't be stored.
+ */
+size_t BufferWriter::prepareRecord(Job &job, unsigned int stream,
+				   const ControlList &metadata)
+{
+	if (job.planes.size() > LCR_MAX_PLANES)
+		return 0;
+
+	size_t blocksSize = (job.planes.size() + 1) * kDirectIOAlignment;
+	job.blocks.reset(static_cast<uint8_t *>(aligned_alloc(kDirectIOAlignment,
+							      blocksSize)));
+	if (!job.blocks)
+		return 0;
+
+	uint8_t *blocks = job.blocks.get();
+	memset(blocks, 0, blocksSize);
+
+	const FrameMetadata &info = job.buffer->metadata();
+	lcr_frame *frame = reinterpret_cast<lcr_frame *>(blocks);
+	frame->magic = LCR_FRAME_MAGIC;
+	frame->stream = stream;
+	frame->sequence = info.sequence;
+	frame->num_planes = job.planes.size();
+	frame->timestamp = info.timestamp;
+	frame->record_size = kDirectIOAlignment;
+
+	for (unsigned int i = 0; i < job.planes.size(); ++i) {
+		frame->bytesused[i] = job.planes[i].second;
+		frame->record_size += alignUp(job.planes[i].second);
+	}
+
+	/* Store all numerical metadata that fits in the record header. */
+	uint8_t *entries = blocks + sizeof(*frame);
+	size_t available = kDirectIOAlignment - sizeof(*frame);
+	size_t used = 0;
+
+	for (const auto &[id, value] : metadata) {
+		switch (value.type()) {
+		case ControlTypeBool:
+		case ControlTypeByte:
+		case ControlTypeInteger32:
+		case ControlTypeInteger64:
+		case ControlTypeFloat:
+			break;
+		default:
+			continue;
+		}
+
+		Span<const uint8_t> data = value.data();
+		size_t length = sizeof(lcr_metadata) + ((data.size() + 3) & ~3);
+		if (used + length > available || value.numElements() > UINT16_MAX)
+			continue;
+
+		lcr_metadata entry = {};
+		entry.id = id;
+		entry.type = value.type();
+		entry.count = value.numElements();
+
+		memcpy(entries + used, &entry, sizeof(entry));
+		memcpy(entries + used + sizeof(entry), data.data(), data.size());
+		used += length;
+	}
+
+	frame->metadata_size = used;
+
+	return frame->record_size;
+}
+
+/*
+ * Queue \a buffer for writing. Return 0 if the buffer has been queued, in
+ * which case bufferWritten will be emitted once it has been written, or a
+ * negative error code otherwise. -EBUSY is returned when the frame is dropped
+ * because too many frames are already waiting to be written.
+ */
+int BufferWriter::write(FrameBuffer *buffer, const std::string &streamName,
+			const StreamConfiguration &config,
+			const ControlList &metadata)
+{
+	if (threads_.empty())
+		return -ENODEV;
+
+	Job job;
+	job.buffer = buffer;
+	job.offset = 0;
+	job.size = 0;
+
+	job.filename = pattern_;
+	size_t pos = job.filename.find_first_of('#');
 	if (pos != std::string::npos) {
 		std::stringstream ss;
 		ss << streamName << "-" << std::setw(6)
 		   << std::setfill('0') << buffer->metadata().sequence;
-		filename.replace(pos, 1, ss.str());
+		job.filename.replace(pos, 1, ss.str());
 	}
 
-	fd = open(filename.c_str(), O_CREAT | O_WRONLY |
-		  (pos == std::string::npos ? O_APPEND : O_TRUNC),
-		  S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH);
-	if (fd == -1)
-		return -errno;
-
 	for (unsigned int i = 0; i < buffer->planes().size(); ++i) {
 		const FrameBuffer::Plane &plane = buffer->planes()[i];
 		const FrameMetadata::Plane &meta = buffer->metadata().planes[i];
@@ -76,21 +385,315 @@ int BufferWriter::write(FrameBuffer *buffer, const std::string &streamName)
 				  << " larger than plane size " << plane.length
 				  << std::endl;
 
-		ret = ::write(fd, data, length);
+		job.planes.emplace_back(static_cast<const uint8_t *>(data), length);
+		job.size += length;
+	}
+
+	size_t recordSize = 0;
+	unsigned int stream = 0;
+
+	if (format_ == DNG) {
+		job.config = config;
+		job.metadata = metadata;
+	} else if (format_ == Container) {
+		auto index = streamIndex_.find(config.stream());
+		if (fd_ < 0 || index == streamIndex_.end())
+			return -EINVAL;
+
+		stream = index->second;
+		recordSize = prepareRecord(job, stream, metadata);
+		if (!recordSize)
+			return -ENOMEM;
+	}
+
+	std::lock_guard<std::mutex> locker(mutex_);
+
+	if (pending_ >= maxPending_) {
+		stats_.dropped++;
+		return -EBUSY;
+	}
+
+	if (format_ == Container) {
+		job.index = {};
+		job.index.offset = offset_;
+		job.index.timestamp = buffer->metadata().timestamp;
+		job.index.stream = stream;
+		job.index.sequence = buffer->metadata().sequence;
+
+		job.filename.clear();
+		job.offset = offset_;
+		offset_ += recordSize;
+	} else if (pos == std::string::npos && format_ == Raw) {
+		if (fd_ < 0) {
+			fd_ = open(job.filename.c_str(),
+				   O_CREAT | O_WRONLY | O_CLOEXEC, kFileMode);
+			if (fd_ == -1)
+				return -errno;
+
+			offset_ = lseek(fd_, 0, SEEK_END);
+		}
+
+		job.filename.clear();
+		job.offset = offset_;
+		offset_ += job.size;
+	}
+
+	if (!stats_.frames && !stats_.errors && !pending_)
+		start_ = std::chrono::steady_clock::now();
+
+	jobs_.push_back(std::move(job));
+	pending_++;
+	cv_.notify_all();
+
+	return 0;
+}
+
+/*
+ * Wait until all queued frames have been written. The bufferWritten signal is
+ * emitted for them the next time the event loop runs.
+ */
+void BufferWriter::flush()
+{
+	{
+		std::unique_lock<std::mutex> locker(mutex_);
+		cv_.wait(locker, [&] { return !pending_; });
+	}
+
+#ifdef HAVE_DNG
+	if (dngWriter_ && dngWriter_->flush() < 0) {
+		std::lock_guard<std::mutex> locker(mutex_);
+		stats_.errors++;
+	}
+#endif
+}
+
+BufferWriter::Statistics BufferWriter::statistics() const
+{
+	std::lock_guard<std::mutex> locker(mutex_);
+	return stats_;
+}
+
+void BufferWriter::run()
+{
+	std::unique_lock<std::mutex> locker(mutex_);
+
+	while (true) {
+		cv_.wait(locker, [&] { return stop_ || !jobs_.empty(); });
+		if (jobs_.empty())
+			return;
+
+		Job job = std::move(jobs_.front());
+		jobs_.pop_front();
+
+		locker.unlock();
+		int ret;
+		switch (format_) {
+		case DNG:
+			ret = writeDNG(job);
+			break;
+		case Container:
+			ret = writeRecord(job);
+			break;
+		case Raw:
+		default:
+			ret = writeFile(job);
+			break;
+		}
+		locker.lock();
+
 		if (ret < 0) {
+			stats_.errors++;
+		} else {
+			stats_.frames++;
+			stats_.bytes += job.size;
+
+			/* Only index records that have been written fully. */
+			if (format_ == Container)
+				index_.push_back(job.index);
+		}
+		stats_.duration = std::chrono::steady_clock::now() - start_;
+
+		completed_.push_back(job.buffer);
+		pending_--;
+		cv_.notify_all();
+
+		uint64_t value = 1;
+		[[maybe_unused]] ssize_t size = ::write(eventfd_, &value, sizeof(value));
+	}
+}
+
+int BufferWriter::writeFile(const Job &job)
+{
+	int fd = fd_;
+	off_t offset = job.offset;
+	bool direct = false;
+	int ret = 0;
+
+	if (!job.filename.empty()) {
+		direct = directIO_ && job.size >= kDirectIOThreshold;
+
+		int flags = O_CREAT | O_WRONLY | O_TRUNC | O_CLOEXEC;
+		fd = open(job.filename.c_str(), flags | (direct ? O_DIRECT : 0),
+			  kFileMode);
+		if (fd == -1 && direct) {
+			/* Not all file systems support direct I/O. */
+			direct = false;
+			fd = open(job.filename.c_str(), flags, kFileMode);
+		}
+		if (fd == -1) {
 			ret = -errno;
+			std::cerr << "failed to open " << job.filename << ": "
+				  << strerror(-ret) << std::endl;
+			return ret;
+		}
+	}
+
+	/*
+	 * Reserve space for the whole frame upfront to limit fragmentation.
+	 * This is an optimization only, failures are ignored.
+	 */
+	if (job.size)
+		fallocate(fd, 0, offset, job.size);
+
+	for (const auto &[data, length] : job.planes) {
+		size_t done = 0;
+
+		/*
+		 * Direct I/O requires aligned offsets and sizes. Write the
+		 * aligned part of the plane directly, and fall back to the page
+		 * cache for the remainder of the frame.
+		 */
+		if (direct) {
+			if (offset % kDirectIOAlignment == 0) {
+				done = length & ~(kDirectIOAlignment - 1);
+				ret = writeDirect(fd, data, done, offset);
+			}
+
+			if (!ret && done < length) {
+				fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_DIRECT);
+				direct = false;
+			}
+		}
+
+		if (!ret)
+			ret = writeAll(fd, data + done, length - done, offset + done);
+
+		if (ret < 0) {
 			std::cerr << "write error: " << strerror(-ret)
 				  << std::endl;
 			break;
-		} else if (ret != (int)length) {
-			std::cerr << "write error: only " << ret
-				  << " bytes written instead of "
-				  << length << std::endl;
-			break;
 		}
+
+		offset += length;
 	}
 
-	close(fd);
+	if (!job.filename.empty())
+		close(fd);
+
+	return ret;
+}
+
+int BufferWriter::writeDNG([[maybe_unused]] const Job &job)
+{
+#ifdef HAVE_DNG
+	std::lock_guard<std::mutex> locker(dngMutex_);
+
+	int ret = dngWriter_->write(job.filename.c_str(), camera_, job.config,
+				    job.metadata, job.buffer,
+				    job.planes[0].first);
+	if (ret < 0)
+		std::cerr << "DNG write error: " << strerror(-ret)
+			  << std::endl;
 
 	return ret;
+#else
+	return -ENOTSUP;
+#endif
+}
+
+/*
+ * Write a container record. All writes are aligned and padded, so that they
+ * can bypass the page cache when direct I/O is enabled.
+ */
+int BufferWriter::writeRecord(const Job &job)
+{
+	uint8_t *blocks = job.blocks.get();
+	const lcr_frame *frame = reinterpret_cast<const lcr_frame *>(blocks);
+	off_t offset = job.offset;
+
+	fallocate(fd_, 0, offset, frame->record_size);
+
+	int ret = writeAll(fd_, blocks, kDirectIOAlignment, offset);
+	offset += kDirectIOAlignment;
+
+	for (unsigned int i = 0; i < job.planes.size() && !ret; ++i) {
+		const auto &[data, length] = job.planes[i];
+		size_t aligned = length & ~(kDirectIOAlignment - 1);
+
+		ret = directIO_ ? writeDirect(fd_, data, aligned, offset)
+				: writeAll(fd_, data, aligned, offset);
+		if (!ret && aligned < length) {
+			uint8_t *tail = blocks + (i + 1) * kDirectIOAlignment;
+			memcpy(tail, data + aligned, length - aligned);
+			ret = writeAll(fd_, tail, kDirectIOAlignment,
+				       offset + aligned);
+		}
+
+		offset += alignUp(length);
+	}
+
+	if (ret < 0)
+		std::cerr << "write error: " << strerror(-ret) << std::endl;
+
+	return ret;
+}
+
+/* Append the frame index and the trailer to a container file. */
+int BufferWriter::writeIndex()
+{
+	fcntl(fd_, F_SETFL, fcntl(fd_, F_GETFL) & ~O_DIRECT);
+
+	/*
+	 * Records are written by multiple threads and indexed as they
+	 * complete. Sort the index back in file order.
+	 */
+	std::sort(index_.begin(), index_.end(),
+		  [](const lcr_index &a, const lcr_index &b) {
+			  return a.offset < b.offset;
+		  });
+
+	lcr_trailer trailer = {};
+	memcpy(trailer.magic, LCR_TRAILER_MAGIC, sizeof(trailer.magic));
+	trailer.index_offset = offset_;
+	trailer.num_entries = index_.size();
+
+	size_t size = index_.size() * sizeof(lcr_index);
+	int ret = writeAll(fd_, reinterpret_cast<const uint8_t *>(index_.data()),
+			   size, offset_);
+	if (!ret)
+		ret = writeAll(fd_, reinterpret_cast<const uint8_t *>(&trailer),
+			       sizeof(trailer), offset_ + size);
+	if (!ret && ftruncate(fd_, offset_ + size + sizeof(trailer)) < 0)
+		ret = -errno;
+
+	if (ret < 0)
+		std::cerr << "failed to write container index: "
+			  << strerror(-ret) << std::endl;
+
+	return ret;
+}
+
+void BufferWriter::writeCompleted([[maybe_unused]] EventNotifier *notifier)
+{
+	uint64_t value;
+	[[maybe_unused]] ssize_t size = read(eventfd_, &value, sizeof(value));
+
+	std::vector<FrameBuffer *> completed;
+	{
+		std::lock_guard<std::mutex> locker(mutex_);
+		completed.swap(completed_);
+	}
+
+	for (FrameBuffer *buffer : completed)
+		bufferWritten.emit(buffer);
 }
@@ -7,25 +7,123 @@
 #ifndef __CAM_BUFFER_WRITER_H__
 #define __CAM_BUFFER_WRITER_H__
 
+#include <chrono>
+#include <condition_variable>
+#include <deque>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <sys/types.h>
+#include <thread>
+#include <vector>
 
 #include <libcamera/buffer.h>
+#include <libcamera/camera.h>
+#include <libcamera/controls.h>
+#include <libcamera/event_notifier.h>
+#include <libcamera/signal.h>
+#include <libcamera/stream.h>
+
+#include "dng_writer.h"
+#include "raw_container.h"
 
 class BufferWriter
 {
 public:
-	BufferWriter(const std::string &pattern = "frame-#.bin");
+	struct Statistics {
+		uint64_t frames;
+		uint64_t bytes;
+		uint64_t dropped;
+		uint64_t errors;
+		std::chrono::steady_clock::duration duration;
+	};
+
+	BufferWriter(const libcamera::Camera *camera,
+		     const std::string &pattern = "frame-#.bin");
 	~BufferWriter();
 
+	void setDirectIO(bool enable) { directIO_ = enable; }
+	void setMaxPending(unsigned int count) { maxPending_ = count; }
+
+	int configure(const libcamera::CameraConfiguration &config,
+		      const std::map<const libcamera::Stream *, std::string> &names);
+
 	void mapBuffer(libcamera::FrameBuffer *buffer);
 
 	int write(libcamera::FrameBuffer *buffer,
-		  const std::string &streamName);
+		  const std::string &streamName,
+		  const libcamera::StreamConfiguration &config,
+		  const libcamera::ControlList &metadata);
+	void flush();
+
+	Statistics statistics() const;
+
+	libcamera::Signal<libcamera::FrameBuffer *> bufferWritten;
 
 private:
+	enum Format {
+		Raw,
+		DNG,
+		Container,
+	};
+
+	struct Job {
+		libcamera::FrameBuffer *buffer;
+		std::string filename;
+		off_t offset;
+		std::vector<std::pair<const uint8_t *, size_t>> planes;
+		size_t size;
+		libcamera::StreamConfiguration config;
+		libcamera::ControlList metadata;
+		/* Container record header followed by plane tail blocks. */
+		std::unique_ptr<uint8_t, void (*)(void *)> blocks{ nullptr, free };
+		/* Container index entry, added once the record is written. */
+		lcr_index index;
+	};
+
+	size_t prepareRecord(Job &job, unsigned int stream,
+			     const libcamera::ControlList &metadata);
+
+	void run();
+	int writeFile(const Job &job);
+	int writeDNG(const Job &job);
+	int writeRecord(const Job &job);
+	int writeIndex();
+	void writeCompleted(libcamera::EventNotifier *notifier);
+
+	const libcamera::Camera *camera_;
 	std::string pattern_;
 	std::map<int, std::pair<void *, unsigned int>> mappedBuffers_;
+#ifdef HAVE_DNG
+	std::unique_ptr<DNGWriter> dngWriter_;
+	std::mutex dngMutex_;
+#endif
+	Format format_;
+
+	bool directIO_;
+	unsigned int maxPending_;
+
+	/* Output file and next write offset when all frames are appended. */
+	int fd_;
+	off_t offset_;
+
+	std::map<const libcamera::Stream *, unsigned int> streamIndex_;
+	std::vector<lcr_index> index_;
+
+	std::vector<std::thread> threads_;
+	std::unique_ptr<libcamera::EventNotifier> notifier_;
+	int eventfd_;
+
+	mutable std::mutex mutex_;
+	std::condition_variable cv_;
+	std::deque<Job> jobs_;
+	std::vector<libcamera::FrameBuffer *> completed_;
+	unsigned int pending_;
+	bool stop_;
+
+	Statistics stats_;
+	std::chrono::steady_clock::time_point start_;
 };
 
 #endif /* __CAM_BUFFER_WRITER_H__ */
@@ -5,6 +5,8 @@
  * capture.cpp - Cam capture
  */
 
+#include <chrono>
+#include <fstream>
 #include <iomanip>
 #include <iostream>
 #include <limits.h>
@@ -18,7 +20,7 @@ using namespace libcamera;
 Capture::Capture(std::shared_ptr<Camera> camera, CameraConfiguration *config,
 		 EventLoop *loop)
 	: camera_(camera), config_(config), writer_(nullptr), loop_(loop),
-	  captureCount_(0), captureLimit_(0)
+	  captureCount_(0), captureLimit_(0), benchmarkDuration_(0)
 {
 }
 
@@ -29,6 +31,13 @@ int Capture::run(const OptionsParser::Options &options)
 	captureCount_ = 0;
 	captureLimit_ = options[OptCapture].toInteger();
 
+	if (options.isSet(OptBenchmark)) {
+		benchmark_ = std::make_unique<Benchmark>();
+		benchmarkDuration_ = options[OptBenchmark].toInteger();
+		if (options.isSet(OptJSON))
+			jsonFile_ = options[OptJSON].toString();
+	}
+
 	if (!camera_) {
 		std::cout << "Can't capture without a camera" << std::endl;
 		return -ENODEV;
@@ -46,15 +55,26 @@ int Capture::run(const OptionsParser::Options &options)
 		streamName_[cfg.stream()] = "stream" + std::to_string(index);
 	}
 
-	camera_->requestCompleted.connect(this, &Capture::requestComplete);
-
 	if (options.isSet(OptFile)) {
 		if (!options[OptFile].toString().empty())
-			writer_ = new BufferWriter(options[OptFile]);
+			writer_ = new BufferWriter(camera_.get(),
+						   options[OptFile]);
 		else
-			writer_ = new BufferWriter();
+			writer_ = new BufferWriter(camera_.get());
+
+		writer_->setDirectIO(options.isSet(OptDirectIO));
+		writer_->bufferWritten.connect(this, &Capture::bufferWritten);
+
+		ret = writer_->configure(*config_, streamName_);
+		if (ret < 0) {
+			std::cout << "Failed to configure frame writer" << std::endl;
+			delete writer_;
+			writer_ = nullptr;
+			return ret;
+		}
 	}
 
+	camera_->requestCompleted.connect(this, &Capture::requestComplete);
 
 	FrameBufferAllocator *allocator = new FrameBufferAllocator(camera_);
 
@@ -65,6 +85,11 @@ int Capture::run(const OptionsParser::Options &options)
 		writer_ = nullptr;
 	}
 
+	for (auto &it : pendingWrites_)
+		delete it.first;
+	pendingWrites_.clear();
+	writeRequests_.clear();
+
 	delete allocator;
 
 	return ret;
@@ -87,6 +112,14 @@ int Capture::capture(FrameBufferAllocator *allocator)
 		nbuffers = std::min(nbuffers, allocated);
 	}
 
+	/*
+	 * Keep at least half of the buffers with the camera, frames that
+	 * complete while the writer holds the other half are not saved.
+	 */
+	if (writer_)
+		writer_->setMaxPending(std::max(nbuffers / 2, 1U) *
+				       config_->size());
+
 	/*
 	 * TODO: make cam tool smarter to support still capture by for
 	 * example pushing a button. For now run all streams all the time.
@@ -135,10 +168,27 @@ int Capture::capture(FrameBufferAllocator *allocator)
 		}
 	}
 
-	if (captureLimit_)
-		std::cout << "Capture " << captureLimit_ << " frames" << std::endl;
-	else
-		std::cout << "Capture until user interrupts by SIGINT" << std::endl;
+	Timer timer;
+	if (benchmarkDuration_) {
+		timer.timeout.connect(this, &Capture::benchmarkTimeout);
+		timer.start(std::chrono::seconds(benchmarkDuration_));
+	}
+
+	/* Keep standard output valid JSON when the report is printed there. */
+	if (jsonFile_ != "-") {
+		if (benchmarkDuration_)
+			std::cout << "Benchmark for " << benchmarkDuration_
+				  << " seconds" << std::endl;
+		else if (captureLimit_)
+			std::cout << "Capture " << captureLimit_ << " frames"
+				  << std::endl;
+		else
+			std::cout << "Capture until user interrupts by SIGINT"
+				  << std::endl;
+	}
+
+	if (benchmark_)
+		benchmark_->start();
 
 	ret = loop_->exec();
 	if (ret)
@@ -148,14 +198,91 @@ int Capture::capture(FrameBufferAllocator *allocator)
 	if (ret)
 		std::cout << "Failed to stop capture" << std::endl;
 
+	if (benchmark_)
+		benchmark_->stop();
+
+	if (writer_)
+		writer_->flush();
+
+	printStatistics();
+
 	return ret;
 }
 
-void Capture::requestComplete(Request *request)
+static void printHistogram(const char *name,
+			   const CameraStatistics::Histogram &histogram)
 {
-	if (request->status() == Request::RequestCancelled)
+	if (!histogram.count)
+		return;
+
+	std::cout << "  " << name << ": mean " << std::fixed
+		  << std::setprecision(3) << histogram.mean() / 1000.0
+		  << " ms, p50 " << histogram.percentile(50) / 1000.0
+		  << " ms, p99 " << histogram.percentile(99) / 1000.0
+		  << " ms, min " << histogram.min / 1000.0
+		  << " ms, max " << histogram.max / 1000.0 << " ms"
+		  << std::endl;
+}
+
+void Capture::printStatistics()
+{
+	CameraStatistics stats = camera_->statistics();
+
+	if (benchmark_) {
+		if (jsonFile_ == "-") {
+			benchmark_->printJSON(camera_->id(), stats, streamName_,
+					      std::cout);
+			return;
+		}
+
+		benchmark_->print(stats, streamName_, std::cout);
+
+		if (!jsonFile_.empty()) {
+			std::ofstream json(jsonFile_);
+			benchmark_->printJSON(camera_->id(), stats, streamName_,
+					      json);
+			if (!json)
+				std::cerr << "Failed to write benchmark report to "
+					  << jsonFile_ << std::endl;
+		}
+	} else {
+		std::cout << "Statistics:" << std::endl
+			  << "  requests: " << stats.requestsQueued << " queued, "
+			  << stats.requestsCompleted << " completed, "
+			  << stats.requestsCancelled << " cancelled" << std::endl;
+
+		printHistogram("frame interval", stats.frameInterval);
+		printHistogram("request latency", stats.requestLatency);
+		printHistogram("IPA processing", stats.ipaProcessingTime);
+
+		for (const auto &it : stats.streams) {
+			auto name = streamName_.find(it.first);
+			if (name == streamName_.end())
+				continue;
+
+			const CameraStatistics::StreamStatistics &stream = it.second;
+			std::cout << "  " << name->second << ": " << stream.frames
+				  << " frames, " << stream.errors << " errors, "
+				  << stream.sequenceGaps << " dropped" << std::endl;
+		}
+	}
+
+	if (!writer_)
 		return;
 
+	BufferWriter::Statistics written = writer_->statistics();
+	double seconds = std::chrono::duration<double>(written.duration).count();
+	double rate = seconds > 0 ? written.bytes / seconds / 1000000 : 0.0;
+
+	std::cout << "  writer: " << written.frames << " frames, "
+		  << std::fixed << std::setprecision(1)
+		  << written.bytes / 1000000.0 << " MB, " << rate << " MB/s, "
+		  << written.dropped << " dropped, " << written.errors
+		  << " errors" << std::endl;
+}
+
+void Capture::printRequest(Request *request)
+{
 	const Request::BufferMap &buffers = request->buffers();
 
 	/*
@@ -189,35 +316,100 @@ void Capture::requestComplete(Request *request)
 			if (++nplane < metadata.planes.size())
 				info << "/";
 		}
-
-		if (writer_)
-			writer_->write(buffer, name);
 	}
 
 	std::cout << info.str() << std::endl;
+}
 
-	captureCount_++;
-	if (captureLimit_ && captureCount_ >= captureLimit_) {
-		loop_->exit(0);
+void Capture::requestComplete(Request *request)
+{
+	if (request->status() == Request::RequestCancelled)
 		return;
-	}
+
+	const Request::BufferMap &buffers = request->buffers();
+
+	/* Skip the per-frame report in benchmark mode to avoid skewing it. */
+	if (!benchmark_)
+		printRequest(request);
+
+	captureCount_++;
+	bool done = captureLimit_ && captureCount_ >= captureLimit_;
 
 	/*
 	 * Create a new request and populate it with one buffer for each
 	 * stream.
 	 */
-	request = camera_->createRequest();
-	if (!request) {
-		std::cerr << "Can't create request" << std::endl;
-		return;
+	Request *next = nullptr;
+	if (!done) {
+		next = camera_->createRequest();
+		if (!next)
+			std::cerr << "Can't create request" << std::endl;
 	}
 
-	for (auto it = buffers.begin(); it != buffers.end(); ++it) {
-		const Stream *stream = it->first;
-		FrameBuffer *buffer = it->second;
+	if (next) {
+		for (auto it = buffers.begin(); it != buffers.end(); ++it) {
+			const Stream *stream = it->first;
+			FrameBuffer *buffer = it->second;
+
+			next->addBuffer(stream, buffer);
+		}
+	}
+
+	/*
+	 * Requeue the request only once all its buffers have been written.
+	 * Writes complete in the event loop thread, register them before
+	 * queuing the writes to avoid racing with bufferWritten().
+	 */
+	if (writer_) {
+		std::lock_guard<std::mutex> locker(writeLock_);
+		unsigned int pending = 0;
+
+		for (auto it = buffers.begin(); it != buffers.end(); ++it) {
+			const Stream *stream = it->first;
+			FrameBuffer *buffer = it->second;
+
+			if (writer_->write(buffer, streamName_[stream],
+					   stream->configuration(),
+					   request->metadata()))
+				continue;
+
+			if (next)
+				writeRequests_[buffer] = next;
+			pending++;
+		}
 
-		request->addBuffer(stream, buffer);
+		if (next && pending) {
+			pendingWrites_[next] = pending;
+			next = nullptr;
+		}
 	}
 
+	if (next)
+		camera_->queueRequest(next);
+
+	if (done)
+		loop_->exit(0);
+}
+
+void Capture::bufferWritten(FrameBuffer *buffer)
+{
+	std::lock_guard<std::mutex> locker(writeLock_);
+
+	auto it = writeRequests_.find(buffer);
+	if (it == writeRequests_.end())
+		return;
+
+	Request *request = it->second;
+	writeRequests_.erase(it);
+
+	if (--pendingWrites_[request])
+		return;
+
+	pendingWrites_.erase(request);
 	camera_->queueRequest(request);
 }
+
+void Capture::benchmarkTimeout([[maybe_unused]] Timer *timer)
+{
+	loop_->exit(0);
+}
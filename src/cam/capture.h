@@ -8,14 +8,18 @@
 #define __CAM_CAPTURE_H__
 
 #include <memory>
+#include <mutex>
 #include <stdint.h>
+#include <string>
 
 #include <libcamera/buffer.h>
 #include <libcamera/camera.h>
 #include <libcamera/framebuffer_allocator.h>
 #include <libcamera/request.h>
 #include <libcamera/stream.h>
+#include <libcamera/timer.h>
 
+#include "benchmark.h"
 #include "buffer_writer.h"
 #include "event_loop.h"
 #include "options.h"
@@ -31,18 +35,30 @@ public:
 private:
 	int capture(libcamera::FrameBufferAllocator *allocator);
 
+	void printRequest(libcamera::Request *request);
 	void requestComplete(libcamera::Request *request);
+	void bufferWritten(libcamera::FrameBuffer *buffer);
+	void benchmarkTimeout(libcamera::Timer *timer);
+	void printStatistics();
 
 	std::shared_ptr<libcamera::Camera> camera_;
 	libcamera::CameraConfiguration *config_;
 
 	std::map<const libcamera::Stream *, std::string> streamName_;
 	BufferWriter *writer_;
+	/* Requests waiting for their buffers to be written before requeue. */
+	std::mutex writeLock_;
+	std::map<libcamera::FrameBuffer *, libcamera::Request *> writeRequests_;
+	std::map<libcamera::Request *, unsigned int> pendingWrites_;
 	uint64_t last_;
 
 	EventLoop *loop_;
 	unsigned int captureCount_;
 	unsigned int captureLimit_;
+
+	std::unique_ptr<Benchmark> benchmark_;
+	unsigned int benchmarkDuration_;
+	std::string jsonFile_;
 };
 
 #endif /* __CAM_CAPTURE_H__ */
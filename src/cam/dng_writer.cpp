@@ -0,0 +1,841 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2020, Raspberry Pi (Trading) Ltd.
+ *
+ * dng_writer.cpp - DNG writer
+ */
+
+#include "dng_writer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <errno.h>
+#include <iostream>
+#include <map>
+#include <optional>
+#include <time.h>
+
+#include <tiffio.h>
+
+#include <libcamera/control_ids.h>
+#include <libcamera/formats.h>
+
+#include "pixel_converter.h"
+
+using namespace libcamera;
+
+enum CFAPatternColour : uint8_t {
+	CFAPatternRed = 0,
+	CFAPatternGreen = 1,
+	CFAPatternBlue = 2,
+};
+
+struct FormatInfo {
+	uint8_t bitsPerSample;
+	CFAPatternColour pattern[4];
+	void (*packRow)(uint8_t *output, const uint16_t *input,
+			unsigned int width);
+};
+
+struct Matrix3d {
+	Matrix3d()
+	{
+	}
+
+	Matrix3d(float m0, float m1, float m2,
+		 float m3, float m4, float m5,
+		 float m6, float m7, float m8)
+	{
+		m[0] = m0, m[1] = m1, m[2] = m2;
+		m[3] = m3, m[4] = m4, m[5] = m5;
+		m[6] = m6, m[7] = m7, m[8] = m8;
+	}
+
+	Matrix3d(const Span<const float> &span)
+		: Matrix3d(span[0], span[1], span[2],
+			   span[3], span[4], span[5],
+			   span[6], span[7], span[8])
+	{
+	}
+
+	static Matrix3d diag(float diag0, float diag1, float diag2)
+	{
+		return Matrix3d(diag0, 0, 0, 0, diag1, 0, 0, 0, diag2);
+	}
+
+	static Matrix3d identity()
+	{
+		return Matrix3d(1, 0, 0, 0, 1, 0, 0, 0, 1);
+	}
+
+	Matrix3d transpose() const
+	{
+		return { m[0], m[3], m[6], m[1], m[4], m[7], m[2], m[5], m[8] };
+	}
+
+	Matrix3d cofactors() const
+	{
+		return { m[4] * m[8] - m[5] * m[7],
+			 -(m[3] * m[8] - m[5] * m[6]),
+			 m[3] * m[7] - m[4] * m[6],
+			 -(m[1] * m[8] - m[2] * m[7]),
+			 m[0] * m[8] - m[2] * m[6],
+			 -(m[0] * m[7] - m[1] * m[6]),
+			 m[1] * m[5] - m[2] * m[4],
+			 -(m[0] * m[5] - m[2] * m[3]),
+			 m[0] * m[4] - m[1] * m[3] };
+	}
+
+	Matrix3d adjugate() const
+	{
+		return cofactors().transpose();
+	}
+
+	float determinant() const
+	{
+		return m[0] * (m[4] * m[8] - m[5] * m[7]) -
+		       m[1] * (m[3] * m[8] - m[5] * m[6]) +
+		       m[2] * (m[3] * m[7] - m[4] * m[6]);
+	}
+
+	Matrix3d inverse() const
+	{
+		return adjugate() * (1.0 / determinant());
+	}
+
+	Matrix3d operator*(const Matrix3d &other) const
+	{
+		Matrix3d result;
+		for (unsigned int i = 0; i < 3; i++) {
+			for (unsigned int j = 0; j < 3; j++) {
+				result.m[i * 3 + j] =
+					m[i * 3 + 0] * other.m[0 + j] +
+					m[i * 3 + 1] * other.m[3 + j] +
+					m[i * 3 + 2] * other.m[6 + j];
+			}
+		}
+		return result;
+	}
+
+	Matrix3d operator*(float f) const
+	{
+		Matrix3d result;
+		for (unsigned int i = 0; i < 9; i++)
+			result.m[i] = m[i] * f;
+		return result;
+	}
+
+	float m[9];
+};
+
+/*
+ * Pack a row of 16-bit samples to the MSB-first bit stream stored in TIFF
+ * files. Four samples are assembled in a 64-bit word and written as Bits / 2
+ * bytes, the remaining samples are packed one by one and the last byte is
+ * padded with zeros.
+ */
+template<unsigned int Bits>
+void packRow(uint8_t *output, const uint16_t *input, unsigned int width)
+{
+	static_assert(Bits % 2 == 0 && Bits < 16, "Unsupported sample size");
+
+	unsigned int x = 0;
+
+	for (; x + 4 <= width; x += 4) {
+		uint64_t word = static_cast<uint64_t>(input[x]) << (3 * Bits) |
+				static_cast<uint64_t>(input[x + 1]) << (2 * Bits) |
+				static_cast<uint64_t>(input[x + 2]) << Bits |
+				input[x + 3];
+
+		for (int i = Bits / 2 - 1; i >= 0; i--)
+			*output++ = word >> (i * 8);
+	}
+
+	uint32_t bits = 0;
+	unsigned int count = 0;
+
+	for (; x < width; x++) {
+		bits = bits << Bits | input[x];
+		count += Bits;
+
+		while (count >= 8) {
+			count -= 8;
+			*output++ = bits >> count;
+		}
+	}
+
+	if (count)
+		*output = bits << (8 - count);
+}
+
+static const std::map<PixelFormat, FormatInfo> formatInfo = {
+	{ formats::SBGGR10_CSI2P, {
+		.bitsPerSample = 10,
+		.pattern = { CFAPatternBlue, CFAPatternGreen, CFAPatternGreen, CFAPatternRed },
+		.packRow = packRow<10>,
+	} },
+	{ formats::SGBRG10_CSI2P, {
+		.bitsPerSample = 10,
+		.pattern = { CFAPatternGreen, CFAPatternBlue, CFAPatternRed, CFAPatternGreen },
+		.packRow = packRow<10>,
+	} },
+	{ formats::SGRBG10_CSI2P, {
+		.bitsPerSample = 10,
+		.pattern = { CFAPatternGreen, CFAPatternRed, CFAPatternBlue, CFAPatternGreen },
+		.packRow = packRow<10>,
+	} },
+	{ formats::SRGGB10_CSI2P, {
+		.bitsPerSample = 10,
+		.pattern = { CFAPatternRed, CFAPatternGreen, CFAPatternGreen, CFAPatternBlue },
+		.packRow = packRow<10>,
+	} },
+	{ formats::SBGGR12_CSI2P, {
+		.bitsPerSample = 12,
+		.pattern = { CFAPatternBlue, CFAPatternGreen, CFAPatternGreen, CFAPatternRed },
+		.packRow = packRow<12>,
+	} },
+	{ formats::SGBRG12_CSI2P, {
+		.bitsPerSample = 12,
+		.pattern = { CFAPatternGreen, CFAPatternBlue, CFAPatternRed, CFAPatternGreen },
+		.packRow = packRow<12>,
+	} },
+	{ formats::SGRBG12_CSI2P, {
+		.bitsPerSample = 12,
+		.pattern = { CFAPatternGreen, CFAPatternRed, CFAPatternBlue, CFAPatternGreen },
+		.packRow = packRow<12>,
+	} },
+	{ formats::SRGGB12_CSI2P, {
+		.bitsPerSample = 12,
+		.pattern = { CFAPatternRed, CFAPatternGreen, CFAPatternGreen, CFAPatternBlue },
+		.packRow = packRow<12>,
+	} },
+	{ formats::SBGGR10_IPU3, {
+		.bitsPerSample = 10,
+		.pattern = { CFAPatternBlue, CFAPatternGreen, CFAPatternGreen, CFAPatternRed },
+		.packRow = packRow<10>,
+	} },
+	{ formats::SGBRG10_IPU3, {
+		.bitsPerSample = 10,
+		.pattern = { CFAPatternGreen, CFAPatternBlue, CFAPatternRed, CFAPatternGreen },
+		.packRow = packRow<10>,
+	} },
+	{ formats::SGRBG10_IPU3, {
+		.bitsPerSample = 10,
+		.pattern = { CFAPatternGreen, CFAPatternRed, CFAPatternBlue, CFAPatternGreen },
+		.packRow = packRow<10>,
+	} },
+	{ formats::SRGGB10_IPU3, {
+		.bitsPerSample = 10,
+		.pattern = { CFAPatternRed, CFAPatternGreen, CFAPatternGreen, CFAPatternBlue },
+		.packRow = packRow<10>,
+	} },
+};
+
+/* Number of rows per strip, also the thumbnail downscaling factor. */
+static constexpr unsigned int kStripRows = 16;
+
+/*
+ * The thumbnail is at least one pixel wide and high, frames smaller than a
+ * strip produce a thumbnail from their first rows and columns.
+ */
+static Size thumbnailSize(const Size &size)
+{
+	return { std::max(size.width / kStripRows, 1U),
+		 std::max(size.height / kStripRows, 1U) };
+}
+
+/* Number of frames queued for I/O before write() blocks. */
+static constexpr unsigned int kMaxPendingJobs = 4;
+
+struct DNGWriter::Worker {
+	PixelConverter strip;
+	PixelConverter tail;
+	std::vector<uint8_t> samples;
+};
+
+struct DNGWriter::Job {
+	TIFF *tif;
+	std::string model;
+	const FormatInfo *info;
+	Size size;
+	unsigned int stride;
+	unsigned int rowBytes;
+	std::atomic<int> error;
+
+	std::vector<uint8_t> raw;
+	std::vector<uint8_t> thumbnail;
+
+	Matrix3d colorMatrix;
+	float neutral[3];
+	float blackLevel[4];
+	std::optional<uint16_t> iso;
+	std::optional<float> exposureTime;
+	char time[20];
+};
+
+/*
+ * The DNG writer packs frames on \a threads threads (defaulting to the number
+ * of CPUs): the calling thread and a pool of worker threads started once for
+ * the lifetime of the writer. Frames are packed one strip of kStripRows rows
+ * at a time. Each strip is unpacked to 16-bit samples, repacked to the TIFF
+ * bit stream and downscaled to the matching thumbnail row in a single pass.
+ * The packed frames are then written to disk by a background thread,
+ * allowing the caller to reuse the frame buffer as soon as write() returns.
+ */
+DNGWriter::DNGWriter(unsigned int threads)
+	: stride_(0), packJob_(nullptr), packData_(nullptr),
+	  packStripCount_(0), packNextStrip_(0), packSequence_(0),
+	  packActive_(0), packStop_(false), pending_(0), stop_(false),
+	  error_(0)
+{
+	if (!threads)
+		threads = std::max(std::thread::hardware_concurrency(), 1U);
+
+	for (unsigned int i = 0; i < threads; i++) {
+		workers_.emplace_back(std::make_unique<Worker>());
+		workers_.back()->strip.setThreads(1);
+		workers_.back()->tail.setThreads(1);
+	}
+
+	/* The first worker is used by the calling thread. */
+	for (unsigned int i = 1; i < threads; i++)
+		packThreads_.emplace_back(&DNGWriter::packThread, this,
+					  workers_[i].get());
+
+	thread_ = std::thread(&DNGWriter::run, this);
+}
+
+DNGWriter::~DNGWriter()
+{
+	flush();
+
+	{
+		std::lock_guard<std::mutex> locker(packMutex_);
+		packStop_ = true;
+	}
+	packCv_.notify_all();
+
+	for (std::thread &thread : packThreads_)
+		thread.join();
+
+	{
+		std::lock_guard<std::mutex> locker(mutex_);
+		stop_ = true;
+	}
+	cv_.notify_all();
+
+	thread_.join();
+}
+
+int DNGWriter::configure(const StreamConfiguration &config)
+{
+	if (config.pixelFormat == pixelFormat_ && config.size == size_ &&
+	    config.stride == stride_)
+		return 0;
+
+	pixelFormat_ = PixelFormat();
+
+	if (!formatInfo.count(config.pixelFormat)) {
+		std::cerr << "Unsupported pixel format" << std::endl;
+		return -EINVAL;
+	}
+
+	const PixelFormat unpacked =
+		PixelConverter::outputFormats(config.pixelFormat).front();
+	unsigned int rows = std::min(config.size.height, kStripRows);
+	unsigned int tailRows = config.size.height > kStripRows
+			      ? config.size.height % kStripRows : 0;
+
+	for (std::unique_ptr<Worker> &worker : workers_) {
+		int ret = worker->strip.configure(config.pixelFormat,
+						  { config.size.width, rows },
+						  config.stride, unpacked);
+		if (!ret && tailRows)
+			ret = worker->tail.configure(config.pixelFormat,
+						     { config.size.width, tailRows },
+						     config.stride, unpacked);
+		if (ret) {
+			std::cerr << "Failed to configure unpacking" << std::endl;
+			return ret;
+		}
+
+		worker->samples.resize(worker->strip.outputSize());
+	}
+
+	pixelFormat_ = config.pixelFormat;
+	size_ = config.size;
+	stride_ = config.stride;
+
+	return 0;
+}
+
+void DNGWriter::packStrip(Worker &worker, Job *job, const uint8_t *data,
+			  unsigned int strip)
+{
+	const Size &size = job->size;
+	unsigned int first = strip * kStripRows;
+	unsigned int rows = std::min(size.height - first, kStripRows);
+	PixelConverter &converter = !strip || rows == kStripRows
+				  ? worker.strip : worker.tail;
+
+	int ret = converter.convert({ data + first * job->stride,
+				      converter.inputSize() },
+				    worker.samples);
+	if (ret) {
+		job->error = ret;
+		return;
+	}
+
+	const uint16_t *samples =
+		reinterpret_cast<const uint16_t *>(worker.samples.data());
+	unsigned int samplesStride = converter.outputStride() / 2;
+
+	uint8_t *output = job->raw.data() + first * job->rowBytes;
+	for (unsigned int y = 0; y < rows; y++)
+		job->info->packRow(output + y * job->rowBytes,
+				   samples + y * samplesStride, size.width);
+
+	/*
+	 * Each full strip produces one thumbnail row, by averaging the top-left
+	 * 2x2 block of every 16x16 block and scaling it to 8 bits.
+	 */
+	const Size thumbSize = thumbnailSize(size);
+	if (strip >= thumbSize.height)
+		return;
+
+	unsigned int width = thumbSize.width;
+	unsigned int shift = 2 + job->info->bitsPerSample - 8;
+	uint8_t *thumb = job->thumbnail.data() + strip * width * 3;
+
+	for (unsigned int x = 0; x < width; x++) {
+		const uint16_t *in = samples + x * kStripRows;
+		uint8_t value = (in[0] + in[1] + in[samplesStride] +
+				 in[samplesStride + 1]) >> shift;
+		*thumb++ = value;
+		*thumb++ = value;
+		*thumb++ = value;
+	}
+}
+
+void DNGWriter::packStrips(Worker *worker)
+{
+	for (unsigned int strip = packNextStrip_++; strip < packStripCount_;
+	     strip = packNextStrip_++)
+		packStrip(*worker, packJob_, packData_, strip);
+}
+
+void DNGWriter::packThread(Worker *worker)
+{
+	/*
+	 * Start from the initial sequence number, not the current one, as the
+	 * first frame may have been published before this thread started.
+	 */
+	std::unique_lock<std::mutex> locker(packMutex_);
+	unsigned int sequence = 0;
+
+	while (true) {
+		packCv_.wait(locker, [&] {
+			return packStop_ || packSequence_ != sequence;
+		});
+		if (packStop_)
+			return;
+
+		sequence = packSequence_;
+
+		locker.unlock();
+		packStrips(worker);
+		locker.lock();
+
+		if (!--packActive_)
+			packCv_.notify_all();
+	}
+}
+
+/*
+ * Pack the frame on the calling thread and all worker threads, which pick the
+ * strips to pack from a shared counter. The job and frame data are published
+ * to the workers under packMutex_, and pack() returns once all workers are
+ * done with them.
+ */
+void DNGWriter::pack(Job *job, const uint8_t *data)
+{
+	{
+		std::lock_guard<std::mutex> locker(packMutex_);
+		packJob_ = job;
+		packData_ = data;
+		packStripCount_ = (job->size.height + kStripRows - 1) / kStripRows;
+		packNextStrip_ = 0;
+		packActive_ = packThreads_.size();
+		packSequence_++;
+	}
+	packCv_.notify_all();
+
+	packStrips(workers_[0].get());
+
+	std::unique_lock<std::mutex> locker(packMutex_);
+	packCv_.wait(locker, [&] { return !packActive_; });
+}
+
+/*
+ * Pack the frame and queue it for writing to \a filename. The function returns
+ * once \a data isn't accessed anymore, but blocks first if too many frames
+ * are waiting to be written. Errors that occur while writing the file are
+ * reported by flush().
+ */
+int DNGWriter::write(const char *filename, const Camera *camera,
+		     const StreamConfiguration &config,
+		     const ControlList &metadata,
+		     [[maybe_unused]] const FrameBuffer *buffer,
+		     const void *data)
+{
+	int ret = configure(config);
+	if (ret)
+		return ret;
+
+	const FormatInfo *info = &formatInfo.at(config.pixelFormat);
+
+	TIFF *tif = TIFFOpen(filename, "w");
+	if (!tif) {
+		std::cerr << "Failed to open tiff file" << std::endl;
+		return -EINVAL;
+	}
+
+	std::unique_ptr<Job> job;
+	{
+		std::unique_lock<std::mutex> locker(mutex_);
+		cv_.wait(locker, [&] { return pending_ < kMaxPendingJobs; });
+
+		if (!freeJobs_.empty()) {
+			job = std::move(freeJobs_.back());
+			freeJobs_.pop_back();
+		}
+	}
+
+	if (!job)
+		job = std::make_unique<Job>();
+
+	job->tif = tif;
+	job->model = camera->id();
+	job->info = info;
+	job->size = config.size;
+	job->stride = config.stride;
+	job->rowBytes = (config.size.width * info->bitsPerSample + 7) / 8;
+	job->error = 0;
+	job->raw.resize(job->rowBytes * config.size.height);
+	const Size thumbSize = thumbnailSize(config.size);
+	job->thumbnail.resize(thumbSize.width * thumbSize.height * 3);
+
+	/*
+	 * Fill in some reasonable colour information in the DNG. We supply
+	 * the "neutral" colour values which determine the white balance, and the
+	 * "ColorMatrix1" which converts XYZ to (un-white-balanced) camera RGB.
+	 * Note that this is not a "proper" colour calibration for the DNG,
+	 * nonetheless, many tools should be able to render the colours better.
+	 */
+	float *neutral = job->neutral;
+	neutral[0] = neutral[1] = neutral[2] = 1;
+	Matrix3d wbGain = Matrix3d::identity();
+	/* From http://www.brucelindbloom.com/index.html?Eqn_RGB_XYZ_Matrix.html */
+	const Matrix3d rgb2xyz(0.4124564, 0.3575761, 0.1804375,
+			       0.2126729, 0.7151522, 0.0721750,
+			       0.0193339, 0.1191920, 0.9503041);
+	Matrix3d ccm = Matrix3d::identity();
+	/*
+	 * Pick a reasonable number eps to protect against singularities. It
+	 * should be comfortably larger than the point at which we run into
+	 * numerical trouble, yet smaller than any plausible gain that we might
+	 * apply to a colour, either explicitly or as part of the colour matrix.
+	 */
+	const double eps = 1e-2;
+
+	if (metadata.contains(controls::ColourGains)) {
+		Span<const float> const &colourGains = metadata.get(controls::ColourGains);
+		if (colourGains[0] > eps && colourGains[1] > eps) {
+			wbGain = Matrix3d::diag(colourGains[0], 1, colourGains[1]);
+			neutral[0] = 1.0 / colourGains[0]; /* red */
+			neutral[2] = 1.0 / colourGains[1]; /* blue */
+		}
+	}
+	if (metadata.contains(controls::ColourCorrectionMatrix)) {
+		Span<const float> const &coeffs = metadata.get(controls::ColourCorrectionMatrix);
+		Matrix3d ccmSupplied(coeffs);
+		if (ccmSupplied.determinant() > eps)
+			ccm = ccmSupplied;
+	}
+
+	/*
+	 * rgb2xyz is known to be invertible, and we've ensured above that both
+	 * the ccm and wbGain matrices are non-singular, so the product of all
+	 * three is guaranteed to be invertible too.
+	 */
+	job->colorMatrix = (rgb2xyz * ccm * wbGain).inverse();
+
+	float *blackLevel = job->blackLevel;
+	std::fill(blackLevel, blackLevel + 4, 0.0f);
+
+	if (metadata.contains(controls::SensorBlackLevels)) {
+		Span<const int32_t> levels = metadata.get(controls::SensorBlackLevels);
+
+		/*
+		 * The black levels control is specified in R, Gr, Gb, B order.
+		 * Map it to the TIFF tag that is specified in CFA pattern
+		 * order.
+		 */
+		unsigned int green = (info->pattern[0] == CFAPatternRed ||
+				      info->pattern[1] == CFAPatternRed)
+				   ? 0 : 1;
+
+		for (unsigned int i = 0; i < 4; ++i) {
+			unsigned int level;
+
+			switch (info->pattern[i]) {
+			case CFAPatternRed:
+				level = levels[0];
+				break;
+			case CFAPatternGreen:
+				level = levels[green + 1];
+				green = (green + 1) % 2;
+				break;
+			case CFAPatternBlue:
+			default:
+				level = levels[3];
+				break;
+			}
+
+			/* Map the 16-bit value to the bits per sample range. */
+			blackLevel[i] = level >> (16 - info->bitsPerSample);
+		}
+	}
+
+	job->iso.reset();
+	if (metadata.contains(controls::AnalogueGain)) {
+		float gain = metadata.get(controls::AnalogueGain);
+		job->iso = std::min(std::max(gain * 100, 0.0f), 65535.0f);
+	}
+
+	job->exposureTime.reset();
+	if (metadata.contains(controls::ExposureTime))
+		job->exposureTime = metadata.get(controls::ExposureTime) / 1e6;
+
+	/* Store creation time. */
+	time_t rawtime;
+	struct tm *timeinfo;
+
+	time(&rawtime);
+	timeinfo = localtime(&rawtime);
+	strftime(job->time, sizeof(job->time), "%Y:%m:%d %H:%M:%S", timeinfo);
+
+	pack(job.get(), static_cast<const uint8_t *>(data));
+
+	if (job->error) {
+		ret = job->error;
+		TIFFClose(tif);
+
+		std::lock_guard<std::mutex> locker(mutex_);
+		freeJobs_.push_back(std::move(job));
+		return ret;
+	}
+
+	{
+		std::lock_guard<std::mutex> locker(mutex_);
+		jobs_.push_back(std::move(job));
+		pending_++;
+	}
+	cv_.notify_all();
+
+	return 0;
+}
+
+/*
+ * Wait for all queued frames to be written, and return the first error that
+ * occurred since the previous call, if any.
+ */
+int DNGWriter::flush()
+{
+	std::unique_lock<std::mutex> locker(mutex_);
+	cv_.wait(locker, [&] { return !pending_; });
+
+	int ret = error_;
+	error_ = 0;
+	return ret;
+}
+
+void DNGWriter::run()
+{
+	std::unique_lock<std::mutex> locker(mutex_);
+
+	while (true) {
+		cv_.wait(locker, [&] { return stop_ || !jobs_.empty(); });
+		if (jobs_.empty())
+			return;
+
+		std::unique_ptr<Job> job = std::move(jobs_.front());
+		jobs_.pop_front();
+
+		locker.unlock();
+		int ret = writeFile(job.get());
+		locker.lock();
+
+		if (ret && !error_)
+			error_ = ret;
+
+		freeJobs_.push_back(std::move(job));
+		pending_--;
+		cv_.notify_all();
+	}
+}
+
+int DNGWriter::writeFile(Job *job)
+{
+	TIFF *tif = job->tif;
+	const FormatInfo *info = job->info;
+	const Size &size = job->size;
+
+	toff_t rawIFDOffset = 0;
+	toff_t exifIFDOffset = 0;
+
+	/*
+	 * Start with a thumbnail in IFD 0 for compatibility with TIFF baseline
+	 * readers, as required by the TIFF/EP specification. Tags that apply to
+	 * the whole file are stored here.
+	 */
+	const uint8_t version[] = { 1, 2, 0, 0 };
+
+	TIFFSetField(tif, TIFFTAG_DNGVERSION, version);
+	TIFFSetField(tif, TIFFTAG_DNGBACKWARDVERSION, version);
+	TIFFSetField(tif, TIFFTAG_FILLORDER, FILLORDER_MSB2LSB);
+	TIFFSetField(tif, TIFFTAG_MAKE, "libcamera");
+	/* \todo Report a real model string instead of id. */
+	TIFFSetField(tif, TIFFTAG_MODEL, job->model.c_str());
+	TIFFSetField(tif, TIFFTAG_UNIQUECAMERAMODEL, job->model.c_str());
+	TIFFSetField(tif, TIFFTAG_SOFTWARE, program_invocation_short_name);
+	TIFFSetField(tif, TIFFTAG_ORIENTATION, ORIENTATION_TOPLEFT);
+
+	/*
+	 * Thumbnail-specific tags. The thumbnail is stored as an RGB image
+	 * with 1/16 of the raw image resolution. Greyscale would save space,
+	 * but doesn't seem well supported by RawTherapee.
+	 */
+	const Size thumbSize = thumbnailSize(size);
+	unsigned int thumbWidth = thumbSize.width;
+	unsigned int thumbHeight = thumbSize.height;
+
+	TIFFSetField(tif, TIFFTAG_SUBFILETYPE, FILETYPE_REDUCEDIMAGE);
+	TIFFSetField(tif, TIFFTAG_IMAGEWIDTH, thumbWidth);
+	TIFFSetField(tif, TIFFTAG_IMAGELENGTH, thumbHeight);
+	TIFFSetField(tif, TIFFTAG_BITSPERSAMPLE, 8);
+	TIFFSetField(tif, TIFFTAG_COMPRESSION, COMPRESSION_NONE);
+	TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_RGB);
+	TIFFSetField(tif, TIFFTAG_SAMPLESPERPIXEL, 3);
+	TIFFSetField(tif, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);
+	TIFFSetField(tif, TIFFTAG_SAMPLEFORMAT, SAMPLEFORMAT_UINT);
+
+	TIFFSetField(tif, TIFFTAG_COLORMATRIX1, 9, job->colorMatrix.m);
+	TIFFSetField(tif, TIFFTAG_ASSHOTNEUTRAL, 3, job->neutral);
+
+	/*
+	 * Reserve space for the SubIFD and ExifIFD tags, pointing to the IFD
+	 * for the raw image and EXIF data respectively. The real offsets will
+	 * be set later.
+	 */
+	TIFFSetField(tif, TIFFTAG_SUBIFD, 1, &rawIFDOffset);
+	TIFFSetField(tif, TIFFTAG_EXIFIFD, exifIFDOffset);
+
+	/* Write the thumbnail. */
+	for (unsigned int y = 0; y < thumbHeight; y++) {
+		uint8_t *row = job->thumbnail.data() + y * thumbWidth * 3;
+
+		if (TIFFWriteScanline(tif, row, y, 0) != 1) {
+			std::cerr << "Failed to write thumbnail scanline"
+				  << std::endl;
+			TIFFClose(tif);
+			return -EIO;
+		}
+	}
+
+	TIFFWriteDirectory(tif);
+
+	/* Create a new IFD for the RAW image. */
+	const uint16_t cfaRepeatPatternDim[] = { 2, 2 };
+	const uint8_t cfaPlaneColor[] = {
+		CFAPatternRed,
+		CFAPatternGreen,
+		CFAPatternBlue
+	};
+
+	TIFFSetField(tif, TIFFTAG_SUBFILETYPE, 0);
+	TIFFSetField(tif, TIFFTAG_IMAGEWIDTH, size.width);
+	TIFFSetField(tif, TIFFTAG_IMAGELENGTH, size.height);
+	TIFFSetField(tif, TIFFTAG_BITSPERSAMPLE, info->bitsPerSample);
+	TIFFSetField(tif, TIFFTAG_COMPRESSION, COMPRESSION_NONE);
+	TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_CFA);
+	TIFFSetField(tif, TIFFTAG_SAMPLESPERPIXEL, 1);
+	TIFFSetField(tif, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);
+	TIFFSetField(tif, TIFFTAG_SAMPLEFORMAT, SAMPLEFORMAT_UINT);
+	TIFFSetField(tif, TIFFTAG_ROWSPERSTRIP, kStripRows);
+	TIFFSetField(tif, TIFFTAG_CFAREPEATPATTERNDIM, cfaRepeatPatternDim);
+	/* libtiff 4.2.0 changed the CFAPattern tag to take a count. */
+	if (TIFFLIB_VERSION < 20201219)
+		TIFFSetField(tif, TIFFTAG_CFAPATTERN, info->pattern);
+	else
+		TIFFSetField(tif, TIFFTAG_CFAPATTERN, 4, info->pattern);
+	TIFFSetField(tif, TIFFTAG_CFAPLANECOLOR, 3, cfaPlaneColor);
+	TIFFSetField(tif, TIFFTAG_CFALAYOUT, 1);
+
+	const uint16_t blackLevelRepeatDim[] = { 2, 2 };
+	uint32_t whiteLevel = (1 << info->bitsPerSample) - 1;
+
+	TIFFSetField(tif, TIFFTAG_BLACKLEVELREPEATDIM, &blackLevelRepeatDim);
+	TIFFSetField(tif, TIFFTAG_BLACKLEVEL, 4, job->blackLevel);
+	TIFFSetField(tif, TIFFTAG_WHITELEVEL, 1, &whiteLevel);
+
+	/* Write RAW content, one strip at a time. */
+	unsigned int strips = (size.height + kStripRows - 1) / kStripRows;
+	for (unsigned int strip = 0; strip < strips; strip++) {
+		unsigned int first = strip * kStripRows;
+		unsigned int rows = std::min(size.height - first, kStripRows);
+		uint8_t *data = job->raw.data() + first * job->rowBytes;
+
+		if (TIFFWriteRawStrip(tif, strip, data, rows * job->rowBytes) < 0) {
+			std::cerr << "Failed to write RAW strip" << std::endl;
+			TIFFClose(tif);
+			return -EIO;
+		}
+	}
+
+	/* Checkpoint the IFD to retrieve its offset, and write it out. */
+	TIFFCheckpointDirectory(tif);
+	rawIFDOffset = TIFFCurrentDirOffset(tif);
+	TIFFWriteDirectory(tif);
+
+	/* Create a new IFD for the EXIF data and fill it. */
+	TIFFCreateEXIFDirectory(tif);
+
+	/*
+	 * \todo Handle timezone information by setting OffsetTimeOriginal and
+	 * OffsetTimeDigitized once libtiff catches up to the specification and
+	 * has EXIFTAG_ defines to handle them.
+	 */
+	TIFFSetField(tif, EXIFTAG_DATETIMEORIGINAL, job->time);
+	TIFFSetField(tif, EXIFTAG_DATETIMEDIGITIZED, job->time);
+
+	if (job->iso) {
+		uint16_t iso = *job->iso;
+		TIFFSetField(tif, EXIFTAG_ISOSPEEDRATINGS, 1, &iso);
+	}
+
+	if (job->exposureTime)
+		TIFFSetField(tif, EXIFTAG_EXPOSURETIME, *job->exposureTime);
+
+	TIFFWriteCustomDirectory(tif, &exifIFDOffset);
+
+	/* Update the IFD offsets and close the file. */
+	TIFFSetDirectory(tif, 0);
+	TIFFSetField(tif, TIFFTAG_SUBIFD, 1, &rawIFDOffset);
+	TIFFSetField(tif, TIFFTAG_EXIFIFD, exifIFDOffset);
+	TIFFWriteDirectory(tif);
+
+	TIFFClose(tif);
+
+	return 0;
+}
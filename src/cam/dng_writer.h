@@ -0,0 +1,82 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2020, Raspberry Pi (Trading) Ltd.
+ *
+ * dng_writer.h - DNG writer
+ */
+#ifndef __CAM_DNG_WRITER_H__
+#define __CAM_DNG_WRITER_H__
+
+#ifdef HAVE_TIFF
+#define HAVE_DNG
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <libcamera/buffer.h>
+#include <libcamera/camera.h>
+#include <libcamera/controls.h>
+#include <libcamera/stream.h>
+
+using namespace libcamera;
+
+class DNGWriter
+{
+public:
+	DNGWriter(unsigned int threads = 0);
+	~DNGWriter();
+
+	int write(const char *filename, const Camera *camera,
+		  const StreamConfiguration &config,
+		  const ControlList &metadata,
+		  const FrameBuffer *buffer, const void *data);
+	int flush();
+
+private:
+	struct Job;
+	struct Worker;
+
+	int configure(const StreamConfiguration &config);
+	void pack(Job *job, const uint8_t *data);
+	void packStrip(Worker &worker, Job *job, const uint8_t *data,
+		       unsigned int strip);
+	void packStrips(Worker *worker);
+	void packThread(Worker *worker);
+
+	void run();
+	static int writeFile(Job *job);
+
+	std::vector<std::unique_ptr<Worker>> workers_;
+	PixelFormat pixelFormat_;
+	Size size_;
+	unsigned int stride_;
+
+	std::vector<std::thread> packThreads_;
+	std::mutex packMutex_;
+	std::condition_variable packCv_;
+	Job *packJob_;
+	const uint8_t *packData_;
+	unsigned int packStripCount_;
+	std::atomic<unsigned int> packNextStrip_;
+	unsigned int packSequence_;
+	unsigned int packActive_;
+	bool packStop_;
+
+	std::thread thread_;
+	std::mutex mutex_;
+	std::condition_variable cv_;
+	std::deque<std::unique_ptr<Job>> jobs_;
+	std::vector<std::unique_ptr<Job>> freeJobs_;
+	unsigned int pending_;
+	bool stop_;
+	int error_;
+};
+
+#endif /* HAVE_TIFF */
+
+#endif /* __CAM_DNG_WRITER_H__ */
@@ -117,7 +117,9 @@ int CamApp::init(int argc, char **argv)
 			return -EINVAL;
 		}
 
-		std::cout << "Using camera " << camera_->id() << std::endl;
+		if (!options_.isSet(OptJSON) ||
+		    options_[OptJSON].toString() != "-")
+			std::cout << "Using camera " << camera_->id() << std::endl;
 
 		ret = prepareConfig();
 		if (ret) {
@@ -182,8 +184,19 @@ int CamApp::parseOptions(int argc, char *argv[])
 	parser.addOption(OptFile, OptionString,
 			 "Write captured frames to disk\n"
 			 "The first '#' character in the file name is expanded to the stream name and frame sequence number.\n"
-			 "The default file name is 'frame-#.bin'.",
+			 "The default file name is 'frame-#.bin'.\n"
+			 "Raw Bayer frames are written in the DNG format when the file name ends with '.dng'.\n"
+			 "All frames and their metadata are stored in a single raw container file when the file name ends with '.lcr'.",
 			 "file", ArgumentOptional, "filename");
+	parser.addOption(OptDirectIO, OptionNone,
+			 "Bypass the page cache when writing large frames to disk",
+			 "direct-io");
+	parser.addOption(OptBenchmark, OptionInteger,
+			 "Capture without per-frame output for <seconds>, or until the --capture count is reached, and print a performance report",
+			 "benchmark", ArgumentOptional, "seconds");
+	parser.addOption(OptJSON, OptionString,
+			 "Write the benchmark report in JSON format to <file>, '-' for standard output",
+			 "json", ArgumentRequired, "file");
 	parser.addOption(OptStream, &streamKeyValue,
 			 "Set configuration of a camera stream", "stream", true);
 	parser.addOption(OptHelp, OptionNone, "Display this help message",
@@ -363,7 +376,7 @@ int CamApp::run()
 			return ret;
 	}
 
-	if (options_.isSet(OptCapture)) {
+	if (options_.isSet(OptCapture) || options_.isSet(OptBenchmark)) {
 		Capture capture(camera_, config_.get(), loop_);
 		return capture.run(options_);
 	}
@@ -19,6 +19,9 @@ enum {
 	OptStream = 's',
 	OptListControls = 256,
 	OptStrictFormats = 257,
+	OptDirectIO = 258,
+	OptBenchmark = 259,
+	OptJSON = 260,
 };
 
 #endif /* __CAM_MAIN_H__ */
@@ -0,0 +1,1227 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2020, Google Inc.
+ *
+ * pixel_converter.cpp - Pixel format conversion
+ */
+
+#include "pixel_converter.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <errno.h>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <set>
+#include <thread>
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86_KERNELS 1
+#define TARGET_SSE2 __attribute__((target("sse2")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+#include <libcamera/formats.h>
+
+using namespace libcamera;
+
+/*
+ * Frames smaller than this number of pixels per stripe are not worth the cost
+ * of dispatching work to other threads.
+ */
+static constexpr unsigned int kMinStripePixels = 256 * 1024;
+
+/*
+ * The row kernels. The YUV kernels operate on full resolution luma and chroma
+ * lines, chroma is upsampled or split from the input format first. Kernels
+ * process as many pixels as their vector width allows, and let the generic
+ * kernels handle the remaining pixels.
+ */
+struct PixelConverter::Kernels {
+	/* Convert to 32-bit pixels in B, G, R, A order, or R, G, B, A if swapped. */
+	void (*yuvToRgb)(const uint8_t *y, const uint8_t *u, const uint8_t *v,
+			 uint8_t *dst, unsigned int width, bool swapRB);
+	/* Split and upsample a line of horizontally subsampled NV chroma. */
+	void (*upsampleChroma)(const uint8_t *src, uint8_t *u, uint8_t *v,
+			       unsigned int width);
+	/* Split a line of non-subsampled NV chroma. */
+	void (*splitChroma)(const uint8_t *src, uint8_t *u, uint8_t *v,
+			    unsigned int width);
+	/* Split and upsample a line of packed YUV 4:2:2. */
+	void (*splitPacked)(const uint8_t *src, uint8_t *y, uint8_t *u,
+			    uint8_t *v, unsigned int width, unsigned int yPos,
+			    unsigned int cbPos);
+	/* Unpack a line of 10-bit CSI-2 packed raw data to 16-bit samples. */
+	void (*unpackCSI2P10)(const uint8_t *src, uint16_t *dst,
+			      unsigned int width);
+};
+
+namespace {
+
+/* -----------------------------------------------------------------------------
+ * Generic kernels
+ */
+
+inline uint8_t clip(int value)
+{
+	return std::clamp(value, 0, 255);
+}
+
+void yuvToRgbGeneric(const uint8_t *y, const uint8_t *u, const uint8_t *v,
+		     uint8_t *dst, unsigned int width, bool swapRB)
+{
+	unsigned int rPos = swapRB ? 0 : 2;
+	unsigned int bPos = swapRB ? 2 : 0;
+
+	for (unsigned int x = 0; x < width; x++) {
+		int c = y[x] - 16;
+		int d = u[x] - 128;
+		int e = v[x] - 128;
+
+		dst[rPos] = clip((298 * c           + 409 * e + 128) >> 8);
+		dst[1]    = clip((298 * c - 100 * d - 208 * e + 128) >> 8);
+		dst[bPos] = clip((298 * c + 516 * d           + 128) >> 8);
+		dst[3] = 0xff;
+		dst += 4;
+	}
+}
+
+void upsampleChromaGeneric(const uint8_t *src, uint8_t *u, uint8_t *v,
+			   unsigned int width)
+{
+	for (unsigned int x = 0; x < width; x++) {
+		u[x] = src[x & ~1];
+		v[x] = src[(x & ~1) + 1];
+	}
+}
+
+void splitChromaGeneric(const uint8_t *src, uint8_t *u, uint8_t *v,
+			unsigned int width)
+{
+	for (unsigned int x = 0; x < width; x++) {
+		u[x] = src[x * 2];
+		v[x] = src[x * 2 + 1];
+	}
+}
+
+void splitPackedGeneric(const uint8_t *src, uint8_t *y, uint8_t *u, uint8_t *v,
+			unsigned int width, unsigned int yPos, unsigned int cbPos)
+{
+	unsigned int crPos = (cbPos + 2) % 4;
+
+	for (unsigned int x = 0; x < width; x++) {
+		const uint8_t *group = src + (x / 2) * 4;
+
+		y[x] = group[yPos + (x & 1) * 2];
+		u[x] = group[cbPos];
+		v[x] = group[crPos];
+	}
+}
+
+void unpackCSI2P10Generic(const uint8_t *src, uint16_t *dst, unsigned int width)
+{
+	for (unsigned int x = 0; x < width; x++) {
+		const uint8_t *group = src + (x / 4) * 5;
+		unsigned int shift = (x % 4) * 2;
+
+		dst[x] = group[x % 4] << 2 | ((group[4] >> shift) & 0x03);
+	}
+}
+
+void unpackCSI2P12(const uint8_t *src, uint16_t *dst, unsigned int width)
+{
+	for (unsigned int x = 0; x < width; x++) {
+		const uint8_t *group = src + (x / 2) * 3;
+
+		if (x & 1)
+			dst[x] = group[1] << 4 | group[2] >> 4;
+		else
+			dst[x] = group[0] << 4 | (group[2] & 0x0f);
+	}
+}
+
+void unpackIPU3(const uint8_t *src, uint16_t *dst, unsigned int width)
+{
+	/* 25 pixels are stored in 32 bytes blocks, as a little-endian bit stream. */
+	for (unsigned int x = 0; x < width; x++) {
+		const uint8_t *block = src + (x / 25) * 32;
+		unsigned int bit = (x % 25) * 10;
+		unsigned int word = block[bit / 8] | block[bit / 8 + 1] << 8;
+
+		dst[x] = (word >> (bit % 8)) & 0x3ff;
+	}
+}
+
+const PixelConverter::Kernels genericKernels = {
+	.yuvToRgb = yuvToRgbGeneric,
+	.upsampleChroma = upsampleChromaGeneric,
+	.splitChroma = splitChromaGeneric,
+	.splitPacked = splitPackedGeneric,
+	.unpackCSI2P10 = unpackCSI2P10Generic,
+};
+
+#if HAVE_X86_KERNELS
+
+/* -----------------------------------------------------------------------------
+ * SSE2 kernels
+ */
+
+/* Coefficients for _mm_madd_epi16() on interleaved (a, b) pairs. */
+TARGET_SSE2 inline __m128i coeffs128(int16_t a, int16_t b)
+{
+	return _mm_set_epi16(b, a, b, a, b, a, b, a);
+}
+
+/*
+ * Compute (a * ca + b * cb + c * cc + 128) >> 8 in 32-bit precision for 8
+ * pixels, and clamp the result to [0, 255] in 16-bit lanes.
+ */
+TARGET_SSE2 inline __m128i channelSSE2(__m128i a, __m128i b, __m128i coeffsAB,
+				       __m128i c, __m128i coeffsC1)
+{
+	const __m128i one = _mm_set1_epi16(1);
+
+	__m128i lo = _mm_add_epi32(_mm_madd_epi16(_mm_unpacklo_epi16(a, b), coeffsAB),
+				   _mm_madd_epi16(_mm_unpacklo_epi16(c, one), coeffsC1));
+	__m128i hi = _mm_add_epi32(_mm_madd_epi16(_mm_unpackhi_epi16(a, b), coeffsAB),
+				   _mm_madd_epi16(_mm_unpackhi_epi16(c, one), coeffsC1));
+
+	__m128i value = _mm_packs_epi32(_mm_srai_epi32(lo, 8), _mm_srai_epi32(hi, 8));
+	return _mm_max_epi16(_mm_min_epi16(value, _mm_set1_epi16(255)),
+			     _mm_setzero_si128());
+}
+
+TARGET_SSE2 void yuvToRgbSSE2(const uint8_t *y, const uint8_t *u,
+			      const uint8_t *v, uint8_t *dst,
+			      unsigned int width, bool swapRB)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i alpha = _mm_set1_epi16(static_cast<int16_t>(0xff00));
+	unsigned int x = 0;
+
+	for (; x + 8 <= width; x += 8) {
+		__m128i y8 = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(y + x));
+		__m128i u8 = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(u + x));
+		__m128i v8 = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(v + x));
+
+		__m128i c = _mm_sub_epi16(_mm_unpacklo_epi8(y8, zero), _mm_set1_epi16(16));
+		__m128i d = _mm_sub_epi16(_mm_unpacklo_epi8(u8, zero), _mm_set1_epi16(128));
+		__m128i e = _mm_sub_epi16(_mm_unpacklo_epi8(v8, zero), _mm_set1_epi16(128));
+
+		__m128i r = channelSSE2(c, e, coeffs128(298, 409), zero, coeffs128(0, 128));
+		__m128i g = channelSSE2(c, d, coeffs128(298, -100), e, coeffs128(-208, 128));
+		__m128i b = channelSSE2(c, d, coeffs128(298, 516), zero, coeffs128(0, 128));
+
+		if (swapRB)
+			std::swap(r, b);
+
+		__m128i bg = _mm_or_si128(b, _mm_slli_epi16(g, 8));
+		__m128i ra = _mm_or_si128(r, alpha);
+
+		__m128i *out = reinterpret_cast<__m128i *>(dst + x * 4);
+		_mm_storeu_si128(out, _mm_unpacklo_epi16(bg, ra));
+		_mm_storeu_si128(out + 1, _mm_unpackhi_epi16(bg, ra));
+	}
+
+	yuvToRgbGeneric(y + x, u + x, v + x, dst + x * 4, width - x, swapRB);
+}
+
+TARGET_SSE2 void upsampleChromaSSE2(const uint8_t *src, uint8_t *u, uint8_t *v,
+				    unsigned int width)
+{
+	const __m128i mask = _mm_set1_epi16(0x00ff);
+	unsigned int x = 0;
+
+	for (; x + 16 <= width; x += 16) {
+		__m128i uv = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + x));
+		__m128i u16 = _mm_and_si128(uv, mask);
+		__m128i v16 = _mm_srli_epi16(uv, 8);
+
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(u + x),
+				 _mm_or_si128(u16, _mm_slli_epi16(u16, 8)));
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(v + x),
+				 _mm_or_si128(v16, _mm_slli_epi16(v16, 8)));
+	}
+
+	upsampleChromaGeneric(src + x, u + x, v + x, width - x);
+}
+
+TARGET_SSE2 void splitChromaSSE2(const uint8_t *src, uint8_t *u, uint8_t *v,
+				 unsigned int width)
+{
+	const __m128i mask = _mm_set1_epi16(0x00ff);
+	unsigned int x = 0;
+
+	for (; x + 16 <= width; x += 16) {
+		__m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + x * 2));
+		__m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + x * 2 + 16));
+
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(u + x),
+				 _mm_packus_epi16(_mm_and_si128(lo, mask),
+						  _mm_and_si128(hi, mask)));
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(v + x),
+				 _mm_packus_epi16(_mm_srli_epi16(lo, 8),
+						  _mm_srli_epi16(hi, 8)));
+	}
+
+	splitChromaGeneric(src + x * 2, u + x, v + x, width - x);
+}
+
+TARGET_SSE2 void splitPackedSSE2(const uint8_t *src, uint8_t *y, uint8_t *u,
+				 uint8_t *v, unsigned int width,
+				 unsigned int yPos, unsigned int cbPos)
+{
+	const __m128i mask16 = _mm_set1_epi16(0x00ff);
+	const __m128i mask32 = _mm_set1_epi32(0x0000ffff);
+	bool cbFirst = cbPos < 2;
+	unsigned int x = 0;
+
+	for (; x + 8 <= width; x += 8) {
+		__m128i in = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + x * 2));
+		__m128i even = _mm_and_si128(in, mask16);
+		__m128i odd = _mm_srli_epi16(in, 8);
+
+		__m128i y16 = yPos ? odd : even;
+		__m128i c16 = yPos ? even : odd;
+
+		/* Each 32-bit lane holds the two chroma samples of a pixel pair. */
+		__m128i first = _mm_packs_epi32(_mm_and_si128(c16, mask32), c16);
+		__m128i second = _mm_packs_epi32(_mm_srli_epi32(c16, 16), c16);
+		first = _mm_or_si128(first, _mm_slli_epi16(first, 8));
+		second = _mm_or_si128(second, _mm_slli_epi16(second, 8));
+
+		_mm_storel_epi64(reinterpret_cast<__m128i *>(y + x),
+				 _mm_packus_epi16(y16, y16));
+		_mm_storel_epi64(reinterpret_cast<__m128i *>(u + x),
+				 cbFirst ? first : second);
+		_mm_storel_epi64(reinterpret_cast<__m128i *>(v + x),
+				 cbFirst ? second : first);
+	}
+
+	splitPackedGeneric(src + x * 2, y + x, u + x, v + x, width - x, yPos, cbPos);
+}
+
+const PixelConverter::Kernels sse2Kernels = {
+	.yuvToRgb = yuvToRgbSSE2,
+	.upsampleChroma = upsampleChromaSSE2,
+	.splitChroma = splitChromaSSE2,
+	.splitPacked = splitPackedSSE2,
+	.unpackCSI2P10 = unpackCSI2P10Generic,
+};
+
+/* -----------------------------------------------------------------------------
+ * AVX2 kernels
+ */
+
+TARGET_AVX2 inline __m256i coeffs256(int16_t a, int16_t b)
+{
+	return _mm256_set1_epi32(static_cast<uint16_t>(b) << 16 | static_cast<uint16_t>(a));
+}
+
+/*
+ * The AVX2 equivalent of channelSSE2() for 16 pixels. The unpack and pack
+ * operations work within 128-bit lanes, and cancel each other, the pixels are
+ * thus kept in order.
+ */
+TARGET_AVX2 inline __m256i channelAVX2(__m256i a, __m256i b, __m256i coeffsAB,
+				       __m256i c, __m256i coeffsC1)
+{
+	const __m256i one = _mm256_set1_epi16(1);
+
+	__m256i lo = _mm256_add_epi32(_mm256_madd_epi16(_mm256_unpacklo_epi16(a, b), coeffsAB),
+				      _mm256_madd_epi16(_mm256_unpacklo_epi16(c, one), coeffsC1));
+	__m256i hi = _mm256_add_epi32(_mm256_madd_epi16(_mm256_unpackhi_epi16(a, b), coeffsAB),
+				      _mm256_madd_epi16(_mm256_unpackhi_epi16(c, one), coeffsC1));
+
+	__m256i value = _mm256_packs_epi32(_mm256_srai_epi32(lo, 8),
+					   _mm256_srai_epi32(hi, 8));
+	return _mm256_max_epi16(_mm256_min_epi16(value, _mm256_set1_epi16(255)),
+				_mm256_setzero_si256());
+}
+
+TARGET_AVX2 void yuvToRgbAVX2(const uint8_t *y, const uint8_t *u,
+			      const uint8_t *v, uint8_t *dst,
+			      unsigned int width, bool swapRB)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i alpha = _mm256_set1_epi16(static_cast<int16_t>(0xff00));
+	unsigned int x = 0;
+
+	for (; x + 16 <= width; x += 16) {
+		__m256i c = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(y + x)));
+		__m256i d = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(u + x)));
+		__m256i e = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(v + x)));
+
+		c = _mm256_sub_epi16(c, _mm256_set1_epi16(16));
+		d = _mm256_sub_epi16(d, _mm256_set1_epi16(128));
+		e = _mm256_sub_epi16(e, _mm256_set1_epi16(128));
+
+		__m256i r = channelAVX2(c, e, coeffs256(298, 409), zero, coeffs256(0, 128));
+		__m256i g = channelAVX2(c, d, coeffs256(298, -100), e, coeffs256(-208, 128));
+		__m256i b = channelAVX2(c, d, coeffs256(298, 516), zero, coeffs256(0, 128));
+
+		if (swapRB)
+			std::swap(r, b);
+
+		__m256i bg = _mm256_or_si256(b, _mm256_slli_epi16(g, 8));
+		__m256i ra = _mm256_or_si256(r, alpha);
+
+		/* Pixels 0-3 and 8-11, and 4-7 and 12-15. */
+		__m256i lo = _mm256_unpacklo_epi16(bg, ra);
+		__m256i hi = _mm256_unpackhi_epi16(bg, ra);
+
+		__m256i *out = reinterpret_cast<__m256i *>(dst + x * 4);
+		_mm256_storeu_si256(out, _mm256_permute2x128_si256(lo, hi, 0x20));
+		_mm256_storeu_si256(out + 1, _mm256_permute2x128_si256(lo, hi, 0x31));
+	}
+
+	yuvToRgbSSE2(y + x, u + x, v + x, dst + x * 4, width - x, swapRB);
+}
+
+TARGET_AVX2 void upsampleChromaAVX2(const uint8_t *src, uint8_t *u, uint8_t *v,
+				    unsigned int width)
+{
+	const __m256i mask = _mm256_set1_epi16(0x00ff);
+	unsigned int x = 0;
+
+	for (; x + 32 <= width; x += 32) {
+		__m256i uv = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + x));
+		__m256i u16 = _mm256_and_si256(uv, mask);
+		__m256i v16 = _mm256_srli_epi16(uv, 8);
+
+		_mm256_storeu_si256(reinterpret_cast<__m256i *>(u + x),
+				    _mm256_or_si256(u16, _mm256_slli_epi16(u16, 8)));
+		_mm256_storeu_si256(reinterpret_cast<__m256i *>(v + x),
+				    _mm256_or_si256(v16, _mm256_slli_epi16(v16, 8)));
+	}
+
+	upsampleChromaSSE2(src + x, u + x, v + x, width - x);
+}
+
+TARGET_AVX2 void splitChromaAVX2(const uint8_t *src, uint8_t *u, uint8_t *v,
+				 unsigned int width)
+{
+	const __m256i mask = _mm256_set1_epi16(0x00ff);
+	unsigned int x = 0;
+
+	for (; x + 32 <= width; x += 32) {
+		__m256i lo = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + x * 2));
+		__m256i hi = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + x * 2 + 32));
+
+		/* Packing interleaves the 64-bit halves of the lanes, reorder them. */
+		__m256i u8 = _mm256_packus_epi16(_mm256_and_si256(lo, mask),
+						 _mm256_and_si256(hi, mask));
+		__m256i v8 = _mm256_packus_epi16(_mm256_srli_epi16(lo, 8),
+						 _mm256_srli_epi16(hi, 8));
+
+		_mm256_storeu_si256(reinterpret_cast<__m256i *>(u + x),
+				    _mm256_permute4x64_epi64(u8, 0xd8));
+		_mm256_storeu_si256(reinterpret_cast<__m256i *>(v + x),
+				    _mm256_permute4x64_epi64(v8, 0xd8));
+	}
+
+	splitChromaSSE2(src + x * 2, u + x, v + x, width - x);
+}
+
+TARGET_AVX2 void splitPackedAVX2(const uint8_t *src, uint8_t *y, uint8_t *u,
+				 uint8_t *v, unsigned int width,
+				 unsigned int yPos, unsigned int cbPos)
+{
+	const __m256i mask16 = _mm256_set1_epi16(0x00ff);
+	const __m256i mask32 = _mm256_set1_epi32(0x0000ffff);
+	bool cbFirst = cbPos < 2;
+	unsigned int x = 0;
+
+	for (; x + 16 <= width; x += 16) {
+		__m256i in = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + x * 2));
+		__m256i even = _mm256_and_si256(in, mask16);
+		__m256i odd = _mm256_srli_epi16(in, 8);
+
+		__m256i y16 = yPos ? odd : even;
+		__m256i c16 = yPos ? even : odd;
+
+		__m256i first = _mm256_packs_epi32(_mm256_and_si256(c16, mask32), c16);
+		__m256i second = _mm256_packs_epi32(_mm256_srli_epi32(c16, 16), c16);
+		first = _mm256_or_si256(first, _mm256_slli_epi16(first, 8));
+		second = _mm256_or_si256(second, _mm256_slli_epi16(second, 8));
+
+		/* The results are in the low 64 bits of each lane. */
+		__m256i y8 = _mm256_permute4x64_epi64(_mm256_packus_epi16(y16, y16), 0xd8);
+		first = _mm256_permute4x64_epi64(first, 0xd8);
+		second = _mm256_permute4x64_epi64(second, 0xd8);
+
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(y + x),
+				 _mm256_castsi256_si128(y8));
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(u + x),
+				 _mm256_castsi256_si128(cbFirst ? first : second));
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(v + x),
+				 _mm256_castsi256_si128(cbFirst ? second : first));
+	}
+
+	splitPackedSSE2(src + x * 2, y + x, u + x, v + x, width - x, yPos, cbPos);
+}
+
+TARGET_AVX2 void unpackCSI2P10AVX2(const uint8_t *src, uint16_t *dst,
+				   unsigned int width)
+{
+	/*
+	 * Each lane unpacks two 5 bytes groups to 8 pixels. The high bits of
+	 * pixel k of a group are in byte k, and its low bits are in bits
+	 * [2k+1:2k] of byte 4. The low bits are moved to bits [7:6] with a
+	 * multiplication, as AVX2 has no per-lane variable 16-bit shift.
+	 */
+	const __m256i high = _mm256_setr_epi8(0, -1, 1, -1, 2, -1, 3, -1,
+					      5, -1, 6, -1, 7, -1, 8, -1,
+					      0, -1, 1, -1, 2, -1, 3, -1,
+					      5, -1, 6, -1, 7, -1, 8, -1);
+	const __m256i low = _mm256_setr_epi8(4, -1, 4, -1, 4, -1, 4, -1,
+					     9, -1, 9, -1, 9, -1, 9, -1,
+					     4, -1, 4, -1, 4, -1, 4, -1,
+					     9, -1, 9, -1, 9, -1, 9, -1);
+	const __m256i shift = _mm256_setr_epi16(64, 16, 4, 1, 64, 16, 4, 1,
+						64, 16, 4, 1, 64, 16, 4, 1);
+	const __m256i mask = _mm256_set1_epi16(0x0003);
+	unsigned int x = 0;
+
+	/* Each iteration reads 26 bytes, keep the loads within the line. */
+	for (; x + 24 <= width; x += 16) {
+		const uint8_t *in = src + x / 4 * 5;
+		__m256i packed = _mm256_inserti128_si256(
+			_mm256_castsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i *>(in))),
+			_mm_loadu_si128(reinterpret_cast<const __m128i *>(in + 10)), 1);
+
+		__m256i h = _mm256_slli_epi16(_mm256_shuffle_epi8(packed, high), 2);
+		__m256i l = _mm256_mullo_epi16(_mm256_shuffle_epi8(packed, low), shift);
+		l = _mm256_and_si256(_mm256_srli_epi16(l, 6), mask);
+
+		_mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + x),
+				    _mm256_or_si256(h, l));
+	}
+
+	unpackCSI2P10Generic(src + x / 4 * 5, dst + x, width - x);
+}
+
+const PixelConverter::Kernels avx2Kernels = {
+	.yuvToRgb = yuvToRgbAVX2,
+	.upsampleChroma = upsampleChromaAVX2,
+	.splitChroma = splitChromaAVX2,
+	.splitPacked = splitPackedAVX2,
+	.unpackCSI2P10 = unpackCSI2P10AVX2,
+};
+
+#endif /* HAVE_X86_KERNELS */
+
+#if defined(__ARM_NEON)
+
+/* -----------------------------------------------------------------------------
+ * NEON kernels
+ */
+
+/* Compute (a * ca + b * cb + c * cc + 128) >> 8 and saturate to 8 bits. */
+inline uint8x8_t channelNEON(int16x8_t a, int16_t ca, int16x8_t b, int16_t cb,
+			     int16x8_t c, int16_t cc)
+{
+	int32x4_t lo = vdupq_n_s32(128);
+	int32x4_t hi = vdupq_n_s32(128);
+
+	lo = vmlal_n_s16(lo, vget_low_s16(a), ca);
+	hi = vmlal_n_s16(hi, vget_high_s16(a), ca);
+	lo = vmlal_n_s16(lo, vget_low_s16(b), cb);
+	hi = vmlal_n_s16(hi, vget_high_s16(b), cb);
+	lo = vmlal_n_s16(lo, vget_low_s16(c), cc);
+	hi = vmlal_n_s16(hi, vget_high_s16(c), cc);
+
+	return vqmovun_s16(vcombine_s16(vshrn_n_s32(lo, 8), vshrn_n_s32(hi, 8)));
+}
+
+void yuvToRgbNEON(const uint8_t *y, const uint8_t *u, const uint8_t *v,
+		  uint8_t *dst, unsigned int width, bool swapRB)
+{
+	unsigned int x = 0;
+
+	for (; x + 8 <= width; x += 8) {
+		int16x8_t c = vreinterpretq_s16_u16(vsubl_u8(vld1_u8(y + x), vdup_n_u8(16)));
+		int16x8_t d = vreinterpretq_s16_u16(vsubl_u8(vld1_u8(u + x), vdup_n_u8(128)));
+		int16x8_t e = vreinterpretq_s16_u16(vsubl_u8(vld1_u8(v + x), vdup_n_u8(128)));
+
+		uint8x8_t r = channelNEON(c, 298, e, 409, d, 0);
+		uint8x8_t g = channelNEON(c, 298, d, -100, e, -208);
+		uint8x8_t b = channelNEON(c, 298, d, 516, e, 0);
+
+		uint8x8x4_t pixels;
+		pixels.val[0] = swapRB ? r : b;
+		pixels.val[1] = g;
+		pixels.val[2] = swapRB ? b : r;
+		pixels.val[3] = vdup_n_u8(0xff);
+		vst4_u8(dst + x * 4, pixels);
+	}
+
+	yuvToRgbGeneric(y + x, u + x, v + x, dst + x * 4, width - x, swapRB);
+}
+
+void upsampleChromaNEON(const uint8_t *src, uint8_t *u, uint8_t *v,
+			unsigned int width)
+{
+	unsigned int x = 0;
+
+	for (; x + 16 <= width; x += 16) {
+		uint8x8x2_t uv = vld2_u8(src + x);
+		uint8x8x2_t uu = { { uv.val[0], uv.val[0] } };
+		uint8x8x2_t vv = { { uv.val[1], uv.val[1] } };
+
+		vst2_u8(u + x, uu);
+		vst2_u8(v + x, vv);
+	}
+
+	upsampleChromaGeneric(src + x, u + x, v + x, width - x);
+}
+
+void splitChromaNEON(const uint8_t *src, uint8_t *u, uint8_t *v,
+		     unsigned int width)
+{
+	unsigned int x = 0;
+
+	for (; x + 16 <= width; x += 16) {
+		uint8x16x2_t uv = vld2q_u8(src + x * 2);
+		vst1q_u8(u + x, uv.val[0]);
+		vst1q_u8(v + x, uv.val[1]);
+	}
+
+	splitChromaGeneric(src + x * 2, u + x, v + x, width - x);
+}
+
+void splitPackedNEON(const uint8_t *src, uint8_t *y, uint8_t *u, uint8_t *v,
+		     unsigned int width, unsigned int yPos, unsigned int cbPos)
+{
+	unsigned int crPos = (cbPos + 2) % 4;
+	unsigned int x = 0;
+
+	for (; x + 16 <= width; x += 16) {
+		uint8x8x4_t in = vld4_u8(src + x * 2);
+		uint8x8x2_t yy = { { in.val[yPos], in.val[yPos + 2] } };
+		uint8x8x2_t uu = { { in.val[cbPos], in.val[cbPos] } };
+		uint8x8x2_t vv = { { in.val[crPos], in.val[crPos] } };
+
+		vst2_u8(y + x, yy);
+		vst2_u8(u + x, uu);
+		vst2_u8(v + x, vv);
+	}
+
+	splitPackedGeneric(src + x * 2, y + x, u + x, v + x, width - x, yPos, cbPos);
+}
+
+const PixelConverter::Kernels neonKernels = {
+	.yuvToRgb = yuvToRgbNEON,
+	.upsampleChroma = upsampleChromaNEON,
+	.splitChroma = splitChromaNEON,
+	.splitPacked = splitPackedNEON,
+	.unpackCSI2P10 = unpackCSI2P10Generic,
+};
+
+#endif /* __ARM_NEON */
+
+const PixelConverter::Kernels *kernelsFor(PixelConverter::Implementation implementation)
+{
+	switch (implementation) {
+#if HAVE_X86_KERNELS
+	case PixelConverter::SSE2:
+		return &sse2Kernels;
+	case PixelConverter::AVX2:
+		return &avx2Kernels;
+#endif
+#if defined(__ARM_NEON)
+	case PixelConverter::NEON:
+		return &neonKernels;
+#endif
+	default:
+		return &genericKernels;
+	}
+}
+
+/* -----------------------------------------------------------------------------
+ * Format descriptions
+ */
+
+struct RGBLayout {
+	unsigned int bpp;
+	unsigned int r;
+	unsigned int g;
+	unsigned int b;
+	int a;
+};
+
+/* Output formats for YUV and RGB inputs, with alpha set to 0xff. */
+const std::map<PixelFormat, RGBLayout> outputLayouts = {
+	{ formats::ARGB8888, { 4, 2, 1, 0, 3 } },
+	{ formats::ABGR8888, { 4, 0, 1, 2, 3 } },
+	{ formats::RGB888, { 3, 2, 1, 0, -1 } },
+	{ formats::BGR888, { 3, 0, 1, 2, -1 } },
+};
+
+const std::map<PixelFormat, RGBLayout> inputLayouts = {
+	{ formats::RGB888, { 3, 2, 1, 0, -1 } },
+	{ formats::BGR888, { 3, 0, 1, 2, -1 } },
+	{ formats::ARGB8888, { 4, 2, 1, 0, 3 } },
+	{ formats::ABGR8888, { 4, 0, 1, 2, 3 } },
+	{ formats::RGBA8888, { 4, 3, 2, 1, 0 } },
+	{ formats::BGRA8888, { 4, 1, 2, 3, 0 } },
+};
+
+struct NVLayout {
+	unsigned int horzSubSample;
+	unsigned int vertSubSample;
+	bool swap;
+};
+
+const std::map<PixelFormat, NVLayout> nvLayouts = {
+	{ formats::NV12, { 2, 2, false } },
+	{ formats::NV21, { 2, 2, true } },
+	{ formats::NV16, { 2, 1, false } },
+	{ formats::NV61, { 2, 1, true } },
+	{ formats::NV24, { 1, 1, false } },
+	{ formats::NV42, { 1, 1, true } },
+};
+
+struct PackedLayout {
+	unsigned int yPos;
+	unsigned int cbPos;
+};
+
+const std::map<PixelFormat, PackedLayout> packedLayouts = {
+	{ formats::YUYV, { 0, 1 } },
+	{ formats::YVYU, { 0, 3 } },
+	{ formats::UYVY, { 1, 0 } },
+	{ formats::VYUY, { 1, 2 } },
+};
+
+/* Packed raw formats, unpacked to 16-bit samples. */
+struct RawLayout {
+	unsigned int bitsPerPixel;
+	unsigned int pixelsPerGroup;
+	unsigned int bytesPerGroup;
+};
+
+const std::map<PixelFormat, RawLayout> rawLayouts = {
+	{ formats::SBGGR10_CSI2P, { 10, 4, 5 } },
+	{ formats::SGBRG10_CSI2P, { 10, 4, 5 } },
+	{ formats::SGRBG10_CSI2P, { 10, 4, 5 } },
+	{ formats::SRGGB10_CSI2P, { 10, 4, 5 } },
+	{ formats::SBGGR12_CSI2P, { 12, 2, 3 } },
+	{ formats::SGBRG12_CSI2P, { 12, 2, 3 } },
+	{ formats::SGRBG12_CSI2P, { 12, 2, 3 } },
+	{ formats::SRGGB12_CSI2P, { 12, 2, 3 } },
+	{ formats::SBGGR10_IPU3, { 10, 25, 32 } },
+	{ formats::SGBRG10_IPU3, { 10, 25, 32 } },
+	{ formats::SGRBG10_IPU3, { 10, 25, 32 } },
+	{ formats::SRGGB10_IPU3, { 10, 25, 32 } },
+};
+
+} /* namespace */
+
+/* -----------------------------------------------------------------------------
+ * Stripe workers
+ */
+
+/*
+ * A set of threads that process the stripes of a frame along with the thread
+ * calling run().
+ */
+class StripeWorkers
+{
+public:
+	StripeWorkers(unsigned int count);
+	~StripeWorkers();
+
+	unsigned int count() const { return threads_.size(); }
+
+	void run(unsigned int stripes, const std::function<void(unsigned int)> &func);
+
+private:
+	void process();
+
+	std::vector<std::thread> threads_;
+
+	std::mutex mutex_;
+	std::condition_variable work_;
+	std::condition_variable done_;
+	const std::function<void(unsigned int)> *func_;
+	unsigned int next_;
+	unsigned int stripes_;
+	unsigned int pending_;
+	bool stopping_;
+};
+
+StripeWorkers::StripeWorkers(unsigned int count)
+	: func_(nullptr), next_(0), stripes_(0), pending_(0), stopping_(false)
+{
+	for (unsigned int i = 0; i < count; i++)
+		threads_.emplace_back(&StripeWorkers::process, this);
+}
+
+StripeWorkers::~StripeWorkers()
+{
+	{
+		std::unique_lock<std::mutex> locker(mutex_);
+		stopping_ = true;
+	}
+
+	work_.notify_all();
+
+	for (std::thread &thread : threads_)
+		thread.join();
+}
+
+void StripeWorkers::run(unsigned int stripes,
+			const std::function<void(unsigned int)> &func)
+{
+	std::unique_lock<std::mutex> locker(mutex_);
+
+	func_ = &func;
+	next_ = 0;
+	stripes_ = stripes;
+	pending_ = stripes;
+
+	work_.notify_all();
+
+	while (next_ < stripes_) {
+		unsigned int stripe = next_++;
+
+		locker.unlock();
+		func(stripe);
+		locker.lock();
+
+		pending_--;
+	}
+
+	done_.wait(locker, [&] { return !pending_; });
+	func_ = nullptr;
+}
+
+void StripeWorkers::process()
+{
+	std::unique_lock<std::mutex> locker(mutex_);
+
+	while (true) {
+		work_.wait(locker, [&] {
+			return stopping_ || next_ < stripes_;
+		});
+
+		if (stopping_)
+			return;
+
+		const std::function<void(unsigned int)> &func = *func_;
+		unsigned int stripe = next_++;
+
+		locker.unlock();
+		func(stripe);
+		locker.lock();
+
+		if (!--pending_)
+			done_.notify_one();
+	}
+}
+
+/* -----------------------------------------------------------------------------
+ * PixelConverter
+ */
+
+/*
+ * The PixelConverter converts frames from YUV (NV12, NV21, NV16, NV61, NV24,
+ * NV42, YUYV, YVYU, UYVY and VYUY) and RGB formats to 24-bit and 32-bit RGB
+ * formats, using BT.601 limited range coefficients, and unpacks CSI-2 and
+ * IPU3 packed Bayer formats to 16-bit samples.
+ *
+ * Conversion is implemented by row kernels, with vectorised implementations
+ * for NEON, SSE2 and AVX2. The best implementation supported by the CPU is
+ * selected at runtime, and all implementations produce identical results.
+ * Large frames are split in stripes of lines converted concurrently by a set
+ * of worker threads.
+ *
+ * A PixelConverter instance must not be used to convert multiple frames
+ * concurrently.
+ */
+
+/*
+ * The converter uses the best implementation supported by the CPU, and the
+ * number of threads defaults to the number of CPUs, up to 4.
+ */
+PixelConverter::PixelConverter()
+	: configured_(false), family_(RGB), stride_(0), outputStride_(0)
+{
+	setImplementation(bestImplementation());
+
+	unsigned int cpus = std::thread::hardware_concurrency();
+	setThreads(std::clamp(cpus, 1U, 4U));
+}
+
+PixelConverter::~PixelConverter()
+{
+}
+
+/*
+ * Retrieve the output formats supported for an \a input format, or an empty
+ * list if the \a input format is not supported.
+ */
+std::vector<PixelFormat> PixelConverter::outputFormats(const PixelFormat &input)
+{
+	if (nvLayouts.count(input) || packedLayouts.count(input) ||
+	    inputLayouts.count(input)) {
+		std::vector<PixelFormat> formats;
+		for (const auto &layout : outputLayouts)
+			formats.push_back(layout.first);
+		return formats;
+	}
+
+	if (rawLayouts.count(input))
+		return { PixelFormat(input.fourcc()) };
+
+	return {};
+}
+
+bool PixelConverter::isSupported(Implementation implementation)
+{
+	switch (implementation) {
+	case Generic:
+		return true;
+#if HAVE_X86_KERNELS
+	case SSE2:
+		__builtin_cpu_init();
+		return __builtin_cpu_supports("sse2");
+	case AVX2:
+		__builtin_cpu_init();
+		return __builtin_cpu_supports("avx2");
+#endif
+#if defined(__ARM_NEON)
+	case NEON:
+		return true;
+#endif
+	default:
+		return false;
+	}
+}
+
+PixelConverter::Implementation PixelConverter::bestImplementation()
+{
+	for (Implementation implementation : { AVX2, NEON, SSE2 }) {
+		if (isSupported(implementation))
+			return implementation;
+	}
+
+	return Generic;
+}
+
+/*
+ * Configure the conversion. A \a stride or \a outputStride of 0 selects the
+ * minimum stride.
+ *
+ * Semi-planar input frames store their chroma plane right after the luma
+ * plane, with a stride equal to the luma stride for horizontally subsampled
+ * formats, and twice the luma stride otherwise.
+ */
+int PixelConverter::configure(const PixelFormat &input, const Size &size,
+			      unsigned int stride, const PixelFormat &output,
+			      unsigned int outputStride)
+{
+	std::vector<PixelFormat> outputs = outputFormats(input);
+	if (std::find(outputs.begin(), outputs.end(), output) == outputs.end()) {
+		std::cerr << "Unsupported conversion from " << input.toString()
+			  << " to " << output.toString() << std::endl;
+		return -EINVAL;
+	}
+
+	if (size.isNull()) {
+		std::cerr << "Invalid frame size " << size.toString()
+			  << std::endl;
+		return -EINVAL;
+	}
+
+	auto nv = nvLayouts.find(input);
+	auto packed = packedLayouts.find(input);
+	auto rgb = inputLayouts.find(input);
+	auto raw = rawLayouts.find(input);
+	auto layout = outputLayouts.find(output);
+
+	unsigned int minStride;
+	if (nv != nvLayouts.end())
+		minStride = size.width;
+	else if (packed != packedLayouts.end())
+		minStride = size.width * 2;
+	else if (rgb != inputLayouts.end())
+		minStride = size.width * rgb->second.bpp;
+	else
+		minStride = (size.width + raw->second.pixelsPerGroup - 1)
+			  / raw->second.pixelsPerGroup * raw->second.bytesPerGroup;
+
+	unsigned int outputBpp = layout != outputLayouts.end()
+			       ? layout->second.bpp : 2;
+	unsigned int minOutputStride = size.width * outputBpp;
+
+	if (!stride)
+		stride = minStride;
+	if (!outputStride)
+		outputStride = minOutputStride;
+
+	if (stride < minStride || outputStride < minOutputStride) {
+		std::cerr << "Stride too small for " << size.toString()
+			  << std::endl;
+		return -EINVAL;
+	}
+
+	if (nv != nvLayouts.end()) {
+		family_ = NV;
+		horzSubSample_ = nv->second.horzSubSample;
+		vertSubSample_ = nv->second.vertSubSample;
+		nvSwap_ = nv->second.swap;
+	} else if (packed != packedLayouts.end()) {
+		family_ = YUVPacked;
+		yPos_ = packed->second.yPos;
+		cbPos_ = packed->second.cbPos;
+	} else if (rgb != inputLayouts.end()) {
+		family_ = RGB;
+		inputBpp_ = rgb->second.bpp;
+		inputR_ = rgb->second.r;
+		inputG_ = rgb->second.g;
+		inputB_ = rgb->second.b;
+	} else if (input.modifier() == formats::SBGGR10_IPU3.modifier()) {
+		family_ = RawIPU3;
+	} else {
+		family_ = raw->second.bitsPerPixel == 10 ? RawCSI2P10 : RawCSI2P12;
+	}
+
+	outputBpp_ = outputBpp;
+	if (layout != outputLayouts.end()) {
+		outputR_ = layout->second.r;
+		outputG_ = layout->second.g;
+		outputB_ = layout->second.b;
+		outputA_ = layout->second.a;
+	}
+
+	configured_ = true;
+	size_ = size;
+	stride_ = stride;
+	outputStride_ = outputStride;
+
+	for (Scratch &scratch : scratch_) {
+		scratch.y.resize(size.width);
+		scratch.u.resize(size.width);
+		scratch.v.resize(size.width);
+		scratch.rgb.resize(size.width * 4);
+	}
+
+	return 0;
+}
+
+/*
+ * Implementations not supported by the CPU are replaced by the generic
+ * implementation. This is mostly useful to compare implementations.
+ */
+void PixelConverter::setImplementation(Implementation implementation)
+{
+	if (!isSupported(implementation))
+		implementation = Generic;
+
+	implementation_ = implementation;
+	kernels_ = kernelsFor(implementation);
+}
+
+/*
+ * Set the maximum number of threads converting a frame, including the calling
+ * thread. Frames are split in stripes of at least 256k pixels, small frames
+ * are thus converted by the calling thread only.
+ */
+void PixelConverter::setThreads(unsigned int threads)
+{
+	threads_ = std::max(threads, 1U);
+
+	if (workers_ && workers_->count() != threads_ - 1)
+		workers_.reset();
+
+	scratch_.resize(threads_);
+	for (Scratch &scratch : scratch_) {
+		scratch.y.resize(size_.width);
+		scratch.u.resize(size_.width);
+		scratch.v.resize(size_.width);
+		scratch.rgb.resize(size_.width * 4);
+	}
+}
+
+size_t PixelConverter::inputSize() const
+{
+	size_t size = static_cast<size_t>(stride_) * size_.height;
+
+	if (family_ == NV) {
+		unsigned int chromaStride = stride_ * 2 / horzSubSample_;
+		unsigned int chromaLines = (size_.height + vertSubSample_ - 1)
+					 / vertSubSample_;
+		size += static_cast<size_t>(chromaStride) * chromaLines;
+	}
+
+	return size;
+}
+
+size_t PixelConverter::outputSize() const
+{
+	return static_cast<size_t>(outputStride_) * size_.height;
+}
+
+int PixelConverter::convert(Span<const uint8_t> input, Span<uint8_t> output)
+{
+	if (!configured_) {
+		std::cerr << "Converter not configured" << std::endl;
+		return -EINVAL;
+	}
+
+	if (input.size() < inputSize() || output.size() < outputSize()) {
+		std::cerr << "Frame buffer too small" << std::endl;
+		return -EINVAL;
+	}
+
+	unsigned int pixels = size_.width * size_.height;
+	unsigned int stripes = std::clamp(pixels / kMinStripePixels, 1U, threads_);
+
+	/* Keep chroma lines shared by two luma lines in the same stripe. */
+	unsigned int align = family_ == NV ? vertSubSample_ : 1;
+	unsigned int lines = (size_.height + stripes - 1) / stripes;
+	lines = (lines + align - 1) / align * align;
+
+	auto convertStripe = [&](unsigned int stripe) {
+		unsigned int start = std::min(stripe * lines, size_.height);
+		unsigned int end = std::min(start + lines, size_.height);
+
+		convertLines(input.data(), output.data(), start, end,
+			     scratch_[stripe]);
+	};
+
+	if (stripes == 1) {
+		convertStripe(0);
+		return 0;
+	}
+
+	if (!workers_)
+		workers_ = std::make_unique<StripeWorkers>(threads_ - 1);
+
+	workers_->run(stripes, convertStripe);
+
+	return 0;
+}
+
+void PixelConverter::convertLines(const uint8_t *input, uint8_t *output,
+				  unsigned int start, unsigned int end,
+				  Scratch &scratch) const
+{
+	scratch.chromaLine = -1;
+
+	for (unsigned int line = start; line < end; line++) {
+		uint8_t *dst = output + static_cast<size_t>(line) * outputStride_;
+
+		switch (family_) {
+		case NV:
+		case YUVPacked:
+			convertYUVLine(input, dst, line, scratch);
+			break;
+		case RGB:
+			convertRGBLine(input + static_cast<size_t>(line) * stride_, dst);
+			break;
+		case RawCSI2P10:
+		case RawCSI2P12:
+		case RawIPU3:
+			convertRawLine(input + static_cast<size_t>(line) * stride_, dst);
+			break;
+		}
+	}
+}
+
+void PixelConverter::convertYUVLine(const uint8_t *input, uint8_t *output,
+				    unsigned int line, Scratch &scratch) const
+{
+	const uint8_t *src = input + static_cast<size_t>(line) * stride_;
+	uint8_t *u = nvSwap_ && family_ == NV ? scratch.v.data() : scratch.u.data();
+	uint8_t *v = nvSwap_ && family_ == NV ? scratch.u.data() : scratch.v.data();
+
+	if (family_ == YUVPacked) {
+		kernels_->splitPacked(src, scratch.y.data(), u, v, size_.width,
+				      yPos_, cbPos_);
+		writeRGB(scratch.y.data(), u, v, output, scratch);
+		return;
+	}
+
+	int chromaLine = line / vertSubSample_;
+	if (chromaLine != scratch.chromaLine) {
+		unsigned int chromaStride = stride_ * 2 / horzSubSample_;
+		const uint8_t *chroma = input + static_cast<size_t>(stride_) * size_.height
+				      + static_cast<size_t>(chromaLine) * chromaStride;
+
+		if (horzSubSample_ == 2)
+			kernels_->upsampleChroma(chroma, u, v, size_.width);
+		else
+			kernels_->splitChroma(chroma, u, v, size_.width);
+
+		scratch.chromaLine = chromaLine;
+	}
+
+	writeRGB(src, u, v, output, scratch);
+}
+
+void PixelConverter::writeRGB(const uint8_t *y, const uint8_t *u,
+			      const uint8_t *v, uint8_t *output,
+			      Scratch &scratch) const
+{
+	if (outputBpp_ == 4) {
+		kernels_->yuvToRgb(y, u, v, output, size_.width, outputR_ == 0);
+		return;
+	}
+
+	kernels_->yuvToRgb(y, u, v, scratch.rgb.data(), size_.width, false);
+
+	const uint8_t *rgb = scratch.rgb.data();
+	for (unsigned int x = 0; x < size_.width; x++) {
+		output[outputB_] = rgb[0];
+		output[outputG_] = rgb[1];
+		output[outputR_] = rgb[2];
+		output += 3;
+		rgb += 4;
+	}
+}
+
+void PixelConverter::convertRGBLine(const uint8_t *input, uint8_t *output) const
+{
+	for (unsigned int x = 0; x < size_.width; x++) {
+		uint8_t r = input[inputR_];
+		uint8_t g = input[inputG_];
+		uint8_t b = input[inputB_];
+
+		output[outputR_] = r;
+		output[outputG_] = g;
+		output[outputB_] = b;
+		if (outputA_ >= 0)
+			output[outputA_] = 0xff;
+
+		input += inputBpp_;
+		output += outputBpp_;
+	}
+}
+
+void PixelConverter::convertRawLine(const uint8_t *input, uint8_t *output) const
+{
+	uint16_t *dst = reinterpret_cast<uint16_t *>(output);
+
+	switch (family_) {
+	case RawCSI2P10:
+		kernels_->unpackCSI2P10(input, dst, size_.width);
+		break;
+	case RawCSI2P12:
+		unpackCSI2P12(input, dst, size_.width);
+		break;
+	case RawIPU3:
+		unpackIPU3(input, dst, size_.width);
+		break;
+	default:
+		break;
+	}
+}
+
@@ -0,0 +1,120 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2020, Google Inc.
+ *
+ * pixel_converter.h - Pixel format conversion
+ */
+#ifndef __CAM_PIXEL_CONVERTER_H__
+#define __CAM_PIXEL_CONVERTER_H__
+
+#include <memory>
+#include <stdint.h>
+#include <vector>
+
+#include <libcamera/geometry.h>
+#include <libcamera/pixel_format.h>
+#include <libcamera/span.h>
+
+class StripeWorkers;
+
+class PixelConverter
+{
+public:
+	enum Implementation {
+		Generic,
+		SSE2,
+		AVX2,
+		NEON,
+	};
+
+	struct Kernels;
+
+	PixelConverter();
+	~PixelConverter();
+
+	static std::vector<libcamera::PixelFormat>
+	outputFormats(const libcamera::PixelFormat &input);
+	static bool isSupported(Implementation implementation);
+	static Implementation bestImplementation();
+
+	int configure(const libcamera::PixelFormat &input,
+		      const libcamera::Size &size, unsigned int stride,
+		      const libcamera::PixelFormat &output,
+		      unsigned int outputStride = 0);
+
+	void setImplementation(Implementation implementation);
+	Implementation implementation() const { return implementation_; }
+
+	void setThreads(unsigned int threads);
+	unsigned int threads() const { return threads_; }
+
+	unsigned int outputStride() const { return outputStride_; }
+	size_t inputSize() const;
+	size_t outputSize() const;
+
+	int convert(libcamera::Span<const uint8_t> input,
+		    libcamera::Span<uint8_t> output);
+
+private:
+	enum Family {
+		NV,
+		YUVPacked,
+		RGB,
+		RawCSI2P10,
+		RawCSI2P12,
+		RawIPU3,
+	};
+
+	struct Scratch {
+		std::vector<uint8_t> y;
+		std::vector<uint8_t> u;
+		std::vector<uint8_t> v;
+		std::vector<uint8_t> rgb;
+		int chromaLine;
+	};
+
+	void convertLines(const uint8_t *input, uint8_t *output,
+			  unsigned int start, unsigned int end,
+			  Scratch &scratch) const;
+	void convertYUVLine(const uint8_t *input, uint8_t *output,
+			    unsigned int line, Scratch &scratch) const;
+	void convertRGBLine(const uint8_t *input, uint8_t *output) const;
+	void convertRawLine(const uint8_t *input, uint8_t *output) const;
+
+	void writeRGB(const uint8_t *y, const uint8_t *u, const uint8_t *v,
+		      uint8_t *output, Scratch &scratch) const;
+
+	Implementation implementation_;
+	const Kernels *kernels_;
+	unsigned int threads_;
+	std::unique_ptr<StripeWorkers> workers_;
+	std::vector<Scratch> scratch_;
+
+	bool configured_;
+	Family family_;
+	libcamera::Size size_;
+	unsigned int stride_;
+	unsigned int outputStride_;
+
+	/* Output layout, as byte offsets in an output pixel. */
+	unsigned int outputBpp_;
+	unsigned int outputR_;
+	unsigned int outputG_;
+	unsigned int outputB_;
+	int outputA_;
+
+	/* NV and packed YUV parameters. */
+	unsigned int horzSubSample_;
+	unsigned int vertSubSample_;
+	bool nvSwap_;
+	unsigned int yPos_;
+	unsigned int cbPos_;
+
+	/* RGB input layout. */
+	unsigned int inputBpp_;
+	unsigned int inputR_;
+	unsigned int inputG_;
+	unsigned int inputB_;
+};
+
+#endif /* __CAM_PIXEL_CONVERTER_H__ */
@@ -0,0 +1,110 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2020, Google Inc.
+ *
+ * raw_container.h - Raw video container format
+ *
+ * This header is shared with the utils/lcr reader and must remain valid C.
+ */
+#ifndef __CAM_RAW_CONTAINER_H__
+#define __CAM_RAW_CONTAINER_H__
+
+#include <stdint.h>
+
+/*
+ * A raw container file stores frames from one or more streams along with
+ * their metadata. All fields are little-endian, and all records start at a
+ * multiple of the alignment stored in the header.
+ *
+ *   +---------------------------------+ 0
+ *   | struct lcr_header               |
+ *   | struct lcr_stream[num_streams]  |
+ *   | struct lcr_control[num_controls]|
+ *   +---------------------------------+ header_size
+ *   | struct lcr_frame                |
+ *   | struct lcr_metadata entries     |
+ *   +---------------------------------+ + alignment
+ *   | plane 0 data, padded            |
+ *   | plane 1 data, padded            |
+ *   | ...                             |
+ *   +---------------------------------+ + record_size
+ *   | next frame record               |
+ *   | ...                             |
+ *   +---------------------------------+ index_offset
+ *   | struct lcr_index[num_entries]   |
+ *   | struct lcr_trailer              |
+ *   +---------------------------------+ end of file
+ *
+ * The control table lists the name and type of all controls that may appear
+ * in frame metadata. Metadata entries contain count values of the control
+ * type, using the libcamera ControlType numbering (1: bool, 2: byte,
+ * 3: int32, 4: int64, 5: float), each entry padded to 4 bytes.
+ *
+ * The index and trailer are written when the recording stops. Readers shall
+ * fall back to walking the frame records when the trailer is missing.
+ */
+
+#define LCR_HEADER_MAGIC	"LCRAWHDR"
+#define LCR_TRAILER_MAGIC	"LCRAWIDX"
+#define LCR_FRAME_MAGIC		0x454d5246 /* 'FRME' */
+#define LCR_VERSION		1
+#define LCR_MAX_PLANES		4
+
+struct lcr_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t alignment;
+	uint64_t header_size;
+	uint32_t num_streams;
+	uint32_t num_controls;
+};
+
+struct lcr_stream {
+	char name[32];
+	uint32_t fourcc;
+	uint32_t reserved;
+	uint64_t modifier;
+	uint32_t width;
+	uint32_t height;
+	uint32_t stride;
+	uint32_t frame_size;
+};
+
+struct lcr_control {
+	uint32_t id;
+	uint32_t type;
+	char name[56];
+};
+
+struct lcr_frame {
+	uint32_t magic;
+	uint32_t stream;
+	uint32_t sequence;
+	uint32_t num_planes;
+	uint64_t timestamp;
+	uint64_t record_size;
+	uint32_t bytesused[LCR_MAX_PLANES];
+	uint32_t metadata_size;
+	uint32_t reserved;
+};
+
+struct lcr_metadata {
+	uint32_t id;
+	uint16_t type;
+	uint16_t count;
+};
+
+struct lcr_index {
+	uint64_t offset;
+	uint64_t timestamp;
+	uint32_t stream;
+	uint32_t sequence;
+};
+
+struct lcr_trailer {
+	char magic[8];
+	uint64_t index_offset;
+	uint64_t num_entries;
+};
+
+#endif /* __CAM_RAW_CONTAINER_H__ */
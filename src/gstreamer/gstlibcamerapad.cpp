@@ -8,17 +8,34 @@
 
 #include "gstlibcamerapad.h"
 
+#include <algorithm>
+
 #include <libcamera/stream.h>
 
 #include "gstlibcamera-utils.h"
 
 using namespace libcamera;
 
+/* Number of frames over which the reported latency is measured. */
+static constexpr guint kLatencySamples = 32;
+
+/*
+ * Latency reported until it is measured, one frame at 30fps. The frame rate
+ * isn't negotiated yet, and a live source must not report a zero latency.
+ */
+static constexpr GstClockTime kDefaultLatency = GST_SECOND / 30;
+
+/* Latency increase that triggers a new latency computation by the pipeline. */
+static constexpr GstClockTime kLatencyThreshold = GST_MSECOND;
+
 struct _GstLibcameraPad {
 	GstPad parent;
 	StreamRole role;
 	GstLibcameraPool *pool;
 	GQueue pending_buffers;
+
+	GstClockTime latency_samples[kLatencySamples];
+	guint latency_index;
 	GstClockTime latency;
 };
 
@@ -71,9 +88,15 @@ gst_libcamera_pad_query(GstPad *pad, GstObject *parent, GstQuery *query)
 	if (query->type != GST_QUERY_LATENCY)
 		return gst_pad_query_default(pad, parent, query);
 
+	GstClockTime latency;
+	{
+		GLibLocker lock(GST_OBJECT(self));
+		latency = self->latency;
+	}
+
 	/* TRUE here means live, we assumes that max latency is the same as min
 	 * as we have no idea that duration of frames. */
-	gst_query_set_latency(query, TRUE, self->latency, self->latency);
+	gst_query_set_latency(query, TRUE, latency, latency);
 	return TRUE;
 }
 
@@ -81,6 +104,11 @@ static void
 gst_libcamera_pad_init(GstLibcameraPad *self)
 {
 	GST_PAD_QUERYFUNC(self) = gst_libcamera_pad_query;
+
+	/* The samples are replaced by measurements as frames are pushed. */
+	for (GstClockTime &sample : self->latency_samples)
+		sample = kDefaultLatency;
+	self->latency = kDefaultLatency;
 }
 
 static GType
@@ -127,27 +155,41 @@ gst_libcamera_pad_get_role(GstPad *pad)
 	return self->role;
 }
 
+/* Return a new reference to the pool of the pad, or nullptr if it has none. */
 GstLibcameraPool *
 gst_libcamera_pad_get_pool(GstPad *pad)
 {
 	auto *self = GST_LIBCAMERA_PAD(pad);
-	return self->pool;
+	GLibLocker lock(GST_OBJECT(self));
+
+	if (!self->pool)
+		return nullptr;
+
+	return GST_LIBCAMERA_POOL(g_object_ref(self->pool));
 }
 
+/* Set the pool of the pad, taking ownership of \a pool. */
 void
 gst_libcamera_pad_set_pool(GstPad *pad, GstLibcameraPool *pool)
 {
 	auto *self = GST_LIBCAMERA_PAD(pad);
+	GstLibcameraPool *old;
 
-	if (self->pool)
-		g_object_unref(self->pool);
-	self->pool = pool;
+	{
+		GLibLocker lock(GST_OBJECT(self));
+		old = self->pool;
+		self->pool = pool;
+	}
+
+	if (old)
+		g_object_unref(old);
 }
 
 Stream *
 gst_libcamera_pad_get_stream(GstPad *pad)
 {
 	auto *self = GST_LIBCAMERA_PAD(pad);
+	GLibLocker lock(GST_OBJECT(self));
 
 	if (self->pool)
 		return gst_libcamera_pool_get_stream(self->pool);
@@ -164,6 +206,51 @@ gst_libcamera_pad_queue_buffer(GstPad *pad, GstBuffer *buffer)
 	g_queue_push_head(&self->pending_buffers, buffer);
 }
 
+/*
+ * Measure the latency between capture and push of a buffer, and report the
+ * maximum over the last kLatencySamples frames. The pipeline is asked to
+ * recompute its latency when the measurement exceeds the reported value.
+ */
+static void
+gst_libcamera_pad_update_latency(GstLibcameraPad *self, GstBuffer *buffer)
+{
+	if (!GST_BUFFER_PTS_IS_VALID(buffer))
+		return;
+
+	g_autoptr(GstElement) element = gst_pad_get_parent_element(GST_PAD(self));
+	if (!element)
+		return;
+
+	g_autoptr(GstClock) clock = gst_element_get_clock(element);
+	if (!clock)
+		return;
+
+	GstClockTime running_time = gst_clock_get_time(clock)
+				  - gst_element_get_base_time(element);
+	if (running_time < GST_BUFFER_PTS(buffer))
+		return;
+
+	bool changed;
+	{
+		GLibLocker lock(GST_OBJECT(self));
+
+		self->latency_samples[self->latency_index] =
+			running_time - GST_BUFFER_PTS(buffer);
+		self->latency_index = (self->latency_index + 1) % kLatencySamples;
+
+		GstClockTime latency = 0;
+		for (GstClockTime sample : self->latency_samples)
+			latency = std::max(latency, sample);
+
+		changed = latency > self->latency + kLatencyThreshold;
+		self->latency = latency;
+	}
+
+	if (changed)
+		gst_element_post_message(element,
+					 gst_message_new_latency(GST_OBJECT(element)));
+}
+
 GstFlowReturn
 gst_libcamera_pad_push_pending(GstPad *pad)
 {
@@ -178,6 +265,8 @@ gst_libcamera_pad_push_pending(GstPad *pad)
 	if (!buffer)
 		return GST_FLOW_OK;
 
+	gst_libcamera_pad_update_latency(self, buffer);
+
 	return gst_pad_push(pad, buffer);
 }
 
@@ -188,11 +277,3 @@ gst_libcamera_pad_has_pending(GstPad *pad)
 	GLibLocker lock(GST_OBJECT(self));
 	return self->pending_buffers.length > 0;
 }
-
-void
-gst_libcamera_pad_set_latency(GstPad *pad, GstClockTime latency)
-{
-	auto *self = GST_LIBCAMERA_PAD(pad);
-	GLibLocker lock(GST_OBJECT(self));
-	self->latency = latency;
-}
@@ -32,6 +32,4 @@ GstFlowReturn gst_libcamera_pad_push_pending(GstPad *pad);
 
 bool gst_libcamera_pad_has_pending(GstPad *pad);
 
-void gst_libcamera_pad_set_latency(GstPad *pad, GstClockTime latency);
-
 #endif /* __GST_LIBCAMERA_PAD_H__ */
@@ -8,6 +8,12 @@
 
 #include "gstlibcamerapool.h"
 
+#include <memory>
+#include <sys/stat.h>
+#include <utility>
+#include <vector>
+
+#include <libcamera/buffer.h>
 #include <libcamera/stream.h>
 
 #include "gstlibcamera-utils.h"
@@ -26,9 +32,192 @@ struct _GstLibcameraPool {
 
 	GstAtomicQueue *queue;
 	GstLibcameraAllocator *allocator;
+	GstBufferPool *downstream;
 	Stream *stream;
+
+	/* Downstream buffers notified as released and not acquired since. */
+	gint released;
+};
+
+/**
+ * \struct ImportedFrame
+ * \brief The FrameBuffer created for a buffer of a downstream pool
+ *
+ * The ImportedFrame is attached to the first memory of the GstBuffer, and is
+ * thus reused every time the downstream pool recycles the buffer with the same
+ * memory, and destroyed with the memory when the pool frees it. Memory and
+ * file descriptor numbers can be recycled for different dmabufs once freed,
+ * the dmabufs are thus identified by their device and inode numbers to detect
+ * pools that replace the memory of their buffers.
+ */
+struct ImportedFrame {
+	static GQuark getQuark();
+
+	std::vector<std::pair<dev_t, ino_t>> dmabufs_;
+	std::unique_ptr<FrameBuffer> buffer_;
+};
+
+GQuark ImportedFrame::getQuark()
+{
+	static gsize frame_quark = 0;
+
+	if (g_once_init_enter(&frame_quark)) {
+		GQuark quark = g_quark_from_string("GstLibcameraImportedFrame");
+		g_once_init_leave(&frame_quark, quark);
+	}
+
+	return frame_quark;
+}
+
+static void
+gst_libcamera_imported_frame_free(gpointer data)
+{
+	delete reinterpret_cast<ImportedFrame *>(data);
+}
+
+static ImportedFrame *
+gst_libcamera_imported_frame_get(GstBuffer *buffer)
+{
+	if (!gst_buffer_n_memory(buffer))
+		return nullptr;
+
+	GstMemory *mem = gst_buffer_peek_memory(buffer, 0);
+	return reinterpret_cast<ImportedFrame *>(gst_mini_object_get_qdata(GST_MINI_OBJECT_CAST(mem),
+									   ImportedFrame::getQuark()));
+}
+
+/*
+ * Create the FrameBuffer for a buffer of a downstream pool, with one plane
+ * per dmabuf memory, or reuse the one created when the buffer was last
+ * acquired with the same dmabufs.
+ */
+static bool
+gst_libcamera_buffer_import(GstBuffer *buffer)
+{
+	guint n_memory = gst_buffer_n_memory(buffer);
+	std::vector<std::pair<dev_t, ino_t>> dmabufs;
+
+	if (!n_memory)
+		return false;
+
+	for (guint i = 0; i < n_memory; i++) {
+		GstMemory *mem = gst_buffer_peek_memory(buffer, i);
+		if (!gst_is_dmabuf_memory(mem) || mem->offset)
+			return false;
+
+		struct stat st;
+		if (fstat(gst_dmabuf_memory_get_fd(mem), &st) < 0)
+			return false;
+
+		dmabufs.emplace_back(st.st_dev, st.st_ino);
+	}
+
+	ImportedFrame *frame = gst_libcamera_imported_frame_get(buffer);
+	if (frame && frame->dmabufs_ == dmabufs)
+		return true;
+
+	auto imported = std::make_unique<ImportedFrame>();
+	std::vector<FrameBuffer::Plane> planes;
+
+	for (guint i = 0; i < n_memory; i++) {
+		GstMemory *mem = gst_buffer_peek_memory(buffer, i);
+
+		FrameBuffer::Plane plane;
+		plane.fd = FileDescriptor(gst_dmabuf_memory_get_fd(mem));
+		plane.length = mem->size;
+		planes.push_back(std::move(plane));
+	}
+
+	imported->dmabufs_ = std::move(dmabufs);
+	imported->buffer_ = std::make_unique<FrameBuffer>(planes);
+
+	/* Replacing the qdata destroys the stale ImportedFrame, if any. */
+	GstMemory *mem = gst_buffer_peek_memory(buffer, 0);
+	gst_mini_object_set_qdata(GST_MINI_OBJECT_CAST(mem), ImportedFrame::getQuark(),
+				  imported.release(), gst_libcamera_imported_frame_free);
+
+	return true;
+}
+
+/**
+ * \struct GstLibcameraReleaseMeta
+ * \brief Notify the pool that a downstream buffer has been released
+ *
+ * Downstream pools don't signal when buffers return to them. The meta is added
+ * to the downstream buffers handed out by the pool, without the
+ * GST_META_FLAG_POOLED flag, and is thus freed when the downstream pool resets
+ * the buffer upon release. Freeing the meta emits the buffer-notify signal of
+ * the pool.
+ */
+struct GstLibcameraReleaseMeta {
+	GstMeta meta;
+	GstLibcameraPool *pool;
 };
 
+static GType
+gst_libcamera_release_meta_api_get_type()
+{
+	static gsize type = 0;
+	static const gchar *tags[] = { nullptr };
+
+	if (g_once_init_enter(&type)) {
+		GType api = gst_meta_api_type_register("GstLibcameraReleaseMetaAPI", tags);
+		g_once_init_leave(&type, api);
+	}
+
+	return type;
+}
+
+static gboolean
+gst_libcamera_release_meta_init(GstMeta *meta, [[maybe_unused]] gpointer params,
+				[[maybe_unused]] GstBuffer *buffer)
+{
+	reinterpret_cast<GstLibcameraReleaseMeta *>(meta)->pool = nullptr;
+	return TRUE;
+}
+
+static void
+gst_libcamera_release_meta_free(GstMeta *meta, [[maybe_unused]] GstBuffer *buffer)
+{
+	GstLibcameraPool *pool = reinterpret_cast<GstLibcameraReleaseMeta *>(meta)->pool;
+	if (!pool)
+		return;
+
+	g_atomic_int_inc(&pool->released);
+	g_signal_emit(pool, signals[SIGNAL_BUFFER_NOTIFY], 0);
+	g_object_unref(pool);
+}
+
+static const GstMetaInfo *
+gst_libcamera_release_meta_get_info()
+{
+	static gsize info = 0;
+
+	if (g_once_init_enter(&info)) {
+		const GstMetaInfo *meta =
+			gst_meta_register(gst_libcamera_release_meta_api_get_type(),
+					  "GstLibcameraReleaseMeta",
+					  sizeof(GstLibcameraReleaseMeta),
+					  gst_libcamera_release_meta_init,
+					  gst_libcamera_release_meta_free,
+					  nullptr);
+		g_once_init_leave(&info, reinterpret_cast<gsize>(meta));
+	}
+
+	return reinterpret_cast<const GstMetaInfo *>(info);
+}
+
+static void
+gst_libcamera_release_meta_add(GstBuffer *buffer, GstLibcameraPool *pool)
+{
+	if (gst_buffer_get_meta(buffer, gst_libcamera_release_meta_api_get_type()))
+		return;
+
+	auto *meta = reinterpret_cast<GstLibcameraReleaseMeta *>(
+		gst_buffer_add_meta(buffer, gst_libcamera_release_meta_get_info(), nullptr));
+	meta->pool = GST_LIBCAMERA_POOL(g_object_ref(pool));
+}
+
 G_DEFINE_TYPE(GstLibcameraPool, gst_libcamera_pool, GST_TYPE_BUFFER_POOL);
 
 static GstFlowReturn
@@ -86,7 +275,12 @@ gst_libcamera_pool_finalize(GObject *object)
 		gst_buffer_unref(buf);
 
 	gst_atomic_queue_unref(self->queue);
-	g_object_unref(self->allocator);
+	g_clear_object(&self->allocator);
+
+	if (self->downstream) {
+		gst_buffer_pool_set_active(self->downstream, FALSE);
+		gst_object_unref(self->downstream);
+	}
 
 	G_OBJECT_CLASS(gst_libcamera_pool_parent_class)->finalize(object);
 }
@@ -126,22 +320,92 @@ gst_libcamera_pool_new(GstLibcameraAllocator *allocator, Stream *stream)
 	return pool;
 }
 
+/*
+ * Create a pool handing out the buffers of the active \a downstream pool. The
+ * buffers are pushed downstream as-is, and their dmabuf memory is imported in
+ * libcamera.
+ */
+GstLibcameraPool *
+gst_libcamera_pool_new_imported(GstBufferPool *downstream, Stream *stream)
+{
+	auto *pool = GST_LIBCAMERA_POOL(g_object_new(GST_TYPE_LIBCAMERA_POOL, nullptr));
+
+	pool->downstream = GST_BUFFER_POOL(gst_object_ref(downstream));
+	pool->stream = stream;
+
+	return pool;
+}
+
 Stream *
 gst_libcamera_pool_get_stream(GstLibcameraPool *self)
 {
 	return self->stream;
 }
 
-Stream *
-gst_libcamera_buffer_get_stream(GstBuffer *buffer)
+/*
+ * Acquire a buffer to capture to, without waiting. Buffers are signalled with
+ * buffer-notify when they return to the pool, for both the internal and the
+ * downstream pools.
+ */
+GstFlowReturn
+gst_libcamera_pool_acquire(GstLibcameraPool *self, GstBuffer **buffer)
 {
-	auto *self = (GstLibcameraPool *)buffer->pool;
-	return self->stream;
+	if (!self->downstream)
+		return gst_buffer_pool_acquire_buffer(GST_BUFFER_POOL(self), buffer,
+						      nullptr);
+
+	GstBufferPoolAcquireParams params = {};
+	params.flags = GST_BUFFER_POOL_ACQUIRE_FLAG_DONTWAIT;
+
+	GstFlowReturn ret = gst_buffer_pool_acquire_buffer(self->downstream, buffer,
+							   &params);
+
+	/*
+	 * The downstream pool resets a released buffer, which frees the release
+	 * meta and emits buffer-notify, right before queuing it. A buffer that
+	 * has been notified but isn't available yet is thus about to be, wait
+	 * for it to avoid missing the notification.
+	 */
+	if (ret == GST_FLOW_EOS && g_atomic_int_get(&self->released) > 0) {
+		params.flags = GST_BUFFER_POOL_ACQUIRE_FLAG_NONE;
+		ret = gst_buffer_pool_acquire_buffer(self->downstream, buffer,
+						     &params);
+	}
+
+	if (ret != GST_FLOW_OK)
+		return ret;
+
+	gint released = g_atomic_int_get(&self->released);
+	while (released > 0 &&
+	       !g_atomic_int_compare_and_exchange(&self->released, released,
+						  released - 1))
+		released = g_atomic_int_get(&self->released);
+
+	if (!gst_libcamera_buffer_import(*buffer)) {
+		gst_buffer_unref(*buffer);
+		*buffer = nullptr;
+		return GST_FLOW_ERROR;
+	}
+
+	gst_libcamera_release_meta_add(*buffer, self);
+
+	return GST_FLOW_OK;
+}
+
+void
+gst_libcamera_pool_set_flushing(GstLibcameraPool *self, bool flushing)
+{
+	if (self->downstream)
+		gst_buffer_pool_set_flushing(self->downstream, flushing);
 }
 
 FrameBuffer *
 gst_libcamera_buffer_get_frame_buffer(GstBuffer *buffer)
 {
+	ImportedFrame *frame = gst_libcamera_imported_frame_get(buffer);
+	if (frame)
+		return frame->buffer_.get();
+
 	GstMemory *mem = gst_buffer_peek_memory(buffer, 0);
 	return gst_libcamera_memory_get_frame_buffer(mem);
 }
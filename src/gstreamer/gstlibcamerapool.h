@@ -7,6 +7,9 @@
  *
  * This is a partial implementation of GstBufferPool intended for internal use
  * only. This pool cannot be configured or activated.
+ *
+ * The pool either hands out buffers backed by the libcamera allocator, or
+ * buffers acquired from a downstream pool and imported as FrameBuffers.
  */
 
 #ifndef __GST_LIBCAMERA_POOL_H__
@@ -24,11 +27,15 @@ G_DECLARE_FINAL_TYPE(GstLibcameraPool, gst_libcamera_pool, GST_LIBCAMERA, POOL,
 GstLibcameraPool *gst_libcamera_pool_new(GstLibcameraAllocator *allocator,
 					 libcamera::Stream *stream);
 
+GstLibcameraPool *gst_libcamera_pool_new_imported(GstBufferPool *downstream,
+						  libcamera::Stream *stream);
+
 libcamera::Stream *gst_libcamera_pool_get_stream(GstLibcameraPool *self);
 
-libcamera::Stream *gst_libcamera_buffer_get_stream(GstBuffer *buffer);
+GstFlowReturn gst_libcamera_pool_acquire(GstLibcameraPool *self, GstBuffer **buffer);
 
-libcamera::FrameBuffer *gst_libcamera_buffer_get_frame_buffer(GstBuffer *buffer);
+void gst_libcamera_pool_set_flushing(GstLibcameraPool *self, bool flushing);
 
+libcamera::FrameBuffer *gst_libcamera_buffer_get_frame_buffer(GstBuffer *buffer);
 
 #endif /* __GST_LIBCAMERA_POOL_H__ */
@@ -17,7 +17,6 @@
  *    + Evaluate if a single streaming thread is fine
  *  - Add application driven request (snapshot)
  *  - Add framerate control
- *  - Add buffer importation support
  *
  *  Requires new libcamera API:
  *  - Add framerate negotiation support
@@ -33,6 +32,8 @@
 
 #include "gstlibcamerasrc.h"
 
+#include <algorithm>
+#include <errno.h>
 #include <queue>
 #include <vector>
 
@@ -55,7 +56,7 @@ struct RequestWrap {
 	RequestWrap(Request *request);
 	~RequestWrap();
 
-	void attachBuffer(GstBuffer *buffer);
+	void attachBuffer(Stream *stream, GstBuffer *buffer);
 	GstBuffer *detachBuffer(Stream *stream);
 
 	/* For ptr comparison only. */
@@ -76,10 +77,9 @@ RequestWrap::~RequestWrap()
 	}
 }
 
-void RequestWrap::attachBuffer(GstBuffer *buffer)
+void RequestWrap::attachBuffer(Stream *stream, GstBuffer *buffer)
 {
 	FrameBuffer *fb = gst_libcamera_buffer_get_frame_buffer(buffer);
-	Stream *stream = gst_libcamera_buffer_get_stream(buffer);
 
 	request_->addBuffer(stream, fb);
 
@@ -107,15 +107,30 @@ GstBuffer *RequestWrap::detachBuffer(Stream *stream)
 
 /* Used for C++ object with destructors. */
 struct GstLibcameraSrcState {
+	GstLibcameraSrcState();
+	~GstLibcameraSrcState();
+
 	GstLibcameraSrc *src_;
 
 	std::unique_ptr<CameraManager> cm_;
 	std::shared_ptr<Camera> cam_;
 	std::unique_ptr<CameraConfiguration> config_;
 	std::vector<GstPad *> srcpads_;
+
+	/*
+	 * Protects requests_ and wakeup_, and serialises pausing the task with
+	 * resuming it from the request completion and buffer notification
+	 * handlers. The wakeup_ flag records that the task was resumed while
+	 * running, to prevent it from pausing and missing the event.
+	 */
+	GMutex lock_;
 	std::queue<std::unique_ptr<RequestWrap>> requests_;
+	guint maxRequests_;
+	bool wakeup_;
 
+	int queueRequest();
 	void requestCompleted(Request *request);
+	void wakeup();
 };
 
 struct _GstLibcameraSrc {
@@ -125,6 +140,7 @@ struct _GstLibcameraSrc {
 	GstTask *task;
 
 	gchar *camera_name;
+	guint max_requests;
 
 	GstLibcameraSrcState *state;
 	GstLibcameraAllocator *allocator;
@@ -133,7 +149,8 @@ struct _GstLibcameraSrc {
 
 enum {
 	PROP_0,
-	PROP_CAMERA_NAME
+	PROP_CAMERA_NAME,
+	PROP_MAX_REQUESTS,
 };
 
 G_DEFINE_TYPE_WITH_CODE(GstLibcameraSrc, gst_libcamera_src, GST_TYPE_ELEMENT,
@@ -152,14 +169,82 @@ GstStaticPadTemplate request_src_template = {
 	"src_%s", GST_PAD_SRC, GST_PAD_REQUEST, TEMPLATE_CAPS
 };
 
+GstLibcameraSrcState::GstLibcameraSrcState()
+	: src_(nullptr), maxRequests_(0), wakeup_(false)
+{
+	g_mutex_init(&lock_);
+}
+
+GstLibcameraSrcState::~GstLibcameraSrcState()
+{
+	g_mutex_clear(&lock_);
+}
+
+/*
+ * Queue a request with a buffer for every pad that has one available. Pads
+ * whose pool is exhausted are left out of the request instead of holding the
+ * other pads back, which lets each stream run at the pace of its downstream.
+ *
+ * Return 0 if a request was queued, -EBUSY if the maximum number of requests
+ * are in flight, -ENOBUFS if no pad has a buffer available, or the error
+ * returned by Camera::queueRequest().
+ */
+int GstLibcameraSrcState::queueRequest()
+{
+	{
+		GLibLocker lock(&lock_);
+		if (maxRequests_ && requests_.size() >= maxRequests_)
+			return -EBUSY;
+	}
+
+	Request *request = cam_->createRequest();
+	auto wrap = std::make_unique<RequestWrap>(request);
+	bool empty = true;
+
+	for (GstPad *srcpad : srcpads_) {
+		g_autoptr(GstLibcameraPool) pool = gst_libcamera_pad_get_pool(srcpad);
+		GstBuffer *buffer;
+
+		if (gst_libcamera_pool_acquire(pool, &buffer) != GST_FLOW_OK)
+			continue;
+
+		wrap->attachBuffer(gst_libcamera_pool_get_stream(pool), buffer);
+		empty = false;
+	}
+
+	if (empty) {
+		/* RequestWrap does not take ownership of the request. */
+		delete request;
+		return -ENOBUFS;
+	}
+
+	GLibLocker lock(&lock_);
+	GST_TRACE_OBJECT(src_, "Requesting buffers");
+
+	int ret = cam_->queueRequest(request);
+	if (ret) {
+		/* The request is only owned by the camera once queued. */
+		delete request;
+		return ret;
+	}
+
+	requests_.push(std::move(wrap));
+	return 0;
+}
+
 void
 GstLibcameraSrcState::requestCompleted(Request *request)
 {
-	GLibLocker lock(GST_OBJECT(src_));
+	/*
+	 * Buffers left in the wrap return to their pool when it is destroyed,
+	 * which calls wakeup(). Destroy it after releasing the lock.
+	 */
+	std::unique_ptr<RequestWrap> wrap;
+	GLibLocker lock(&lock_);
 
 	GST_DEBUG_OBJECT(src_, "buffers are ready");
 
-	std::unique_ptr<RequestWrap> wrap = std::move(requests_.front());
+	wrap = std::move(requests_.front());
 	requests_.pop();
 
 	g_return_if_fail(wrap->request_ == request);
@@ -169,23 +254,27 @@ GstLibcameraSrcState::requestCompleted(Request *request)
 		return;
 	}
 
-	GstBuffer *buffer;
+	g_autoptr(GstClock) clock = gst_element_get_clock(GST_ELEMENT(src_));
+	GstClockTime gst_base_time = gst_element_get_base_time(GST_ELEMENT(src_));
+
 	for (GstPad *srcpad : srcpads_) {
 		Stream *stream = gst_libcamera_pad_get_stream(srcpad);
-		buffer = wrap->detachBuffer(stream);
+		GstBuffer *buffer = wrap->detachBuffer(stream);
+
+		/* The pad had no buffer available when the request was queued. */
+		if (!buffer)
+			continue;
 
 		FrameBuffer *fb = gst_libcamera_buffer_get_frame_buffer(buffer);
 
-		if (GST_ELEMENT_CLOCK(src_)) {
-			GstClockTime gst_base_time = GST_ELEMENT(src_)->base_time;
-			GstClockTime gst_now = gst_clock_get_time(GST_ELEMENT_CLOCK(src_));
+		if (clock) {
+			GstClockTime gst_now = gst_clock_get_time(clock);
 			/* \todo Need to expose which reference clock the timestamp relates to. */
 			GstClockTime sys_now = g_get_monotonic_time() * 1000;
 
 			/* Deduced from: sys_now - sys_base_time == gst_now - gst_base_time */
 			GstClockTime sys_base_time = sys_now - (gst_now - gst_base_time);
 			GST_BUFFER_PTS(buffer) = fb->metadata().timestamp - sys_base_time;
-			gst_libcamera_pad_set_latency(srcpad, sys_now - fb->metadata().timestamp);
 		} else {
 			GST_BUFFER_PTS(buffer) = 0;
 		}
@@ -196,9 +285,25 @@ GstLibcameraSrcState::requestCompleted(Request *request)
 		gst_libcamera_pad_queue_buffer(srcpad, buffer);
 	}
 
+	wakeup_ = true;
 	gst_libcamera_resume_task(this->src_->task);
 }
 
+/* Resume the task when a buffer is returned to a pool. */
+void GstLibcameraSrcState::wakeup()
+{
+	GLibLocker lock(&lock_);
+
+	wakeup_ = true;
+	gst_libcamera_resume_task(src_->task);
+}
+
+static void
+gst_libcamera_src_buffer_notify(GstLibcameraSrcState *state)
+{
+	state->wakeup();
+}
+
 static bool
 gst_libcamera_src_open(GstLibcameraSrc *self)
 {
@@ -266,34 +371,15 @@ gst_libcamera_src_task_run(gpointer user_data)
 	GstLibcameraSrc *self = GST_LIBCAMERA_SRC(user_data);
 	GstLibcameraSrcState *state = self->state;
 
-	Request *request = state->cam_->createRequest();
-	auto wrap = std::make_unique<RequestWrap>(request);
-	for (GstPad *srcpad : state->srcpads_) {
-		GstLibcameraPool *pool = gst_libcamera_pad_get_pool(srcpad);
-		GstBuffer *buffer;
-		GstFlowReturn ret;
-
-		ret = gst_buffer_pool_acquire_buffer(GST_BUFFER_POOL(pool),
-						     &buffer, nullptr);
-		if (ret != GST_FLOW_OK) {
-			/*
-			 * RequestWrap does not take ownership, and we won't be
-			 * queueing this one due to lack of buffers.
-			 */
-			delete request;
-			request = nullptr;
-			break;
-		}
-
-		wrap->attachBuffer(buffer);
+	/* Events from now on are handled by the next iteration. */
+	{
+		GLibLocker lock(&state->lock_);
+		state->wakeup_ = false;
 	}
 
-	if (request) {
-		GLibLocker lock(GST_OBJECT(self));
-		GST_TRACE_OBJECT(self, "Requesting buffers");
-		state->cam_->queueRequest(request);
-		state->requests_.push(std::move(wrap));
-	}
+	/* Fill the pipeline up to the request limit or the available buffers. */
+	while (!state->queueRequest())
+		;
 
 	GstFlowReturn ret = GST_FLOW_OK;
 	gst_flow_combiner_reset(self->flow_combiner);
@@ -309,7 +395,7 @@ gst_libcamera_src_task_run(gpointer user_data)
 		 * needs to happen in lock step with the callback thread which may want
 		 * to resume the task.
 		 */
-		GLibLocker lock(GST_OBJECT(self));
+		GLibLocker lock(&state->lock_);
 		if (ret != GST_FLOW_OK) {
 			if (ret == GST_FLOW_EOS) {
 				g_autoptr(GstEvent) eos = gst_event_new_eos();
@@ -332,9 +418,120 @@ gst_libcamera_src_task_run(gpointer user_data)
 			}
 		}
 
-		if (do_pause)
-			gst_task_pause(self->task);
+		if (!do_pause || state->wakeup_)
+			return;
+
+		gst_task_pause(self->task);
+	}
+}
+
+/*
+ * Check that a buffer of a downstream pool can be imported for the stream:
+ * all its memories must be dmabufs that libcamera can capture to, and it must
+ * use the same layout as the stream.
+ */
+static bool
+gst_libcamera_src_buffer_is_compatible(GstBuffer *buffer, GstCaps *caps,
+				       const StreamConfiguration &stream_cfg)
+{
+	gsize size = 0;
+
+	for (guint i = 0; i < gst_buffer_n_memory(buffer); i++) {
+		GstMemory *mem = gst_buffer_peek_memory(buffer, i);
+		if (!gst_is_dmabuf_memory(mem) || mem->offset)
+			return false;
+
+		size += mem->size;
+	}
+
+	if (size < stream_cfg.frameSize)
+		return false;
+
+	/* Compressed formats have no layout to check. */
+	GstVideoInfo info;
+	if (!gst_video_info_from_caps(&info, caps))
+		return true;
+
+	if (static_cast<guint>(GST_VIDEO_INFO_PLANE_STRIDE(&info, 0)) != stream_cfg.stride)
+		return false;
+
+	GstVideoMeta *meta = gst_buffer_get_video_meta(buffer);
+	if (!meta)
+		return true;
+
+	for (guint i = 0; i < GST_VIDEO_INFO_N_PLANES(&info); i++) {
+		if (meta->stride[i] != GST_VIDEO_INFO_PLANE_STRIDE(&info, i) ||
+		    meta->offset[i] != GST_VIDEO_INFO_PLANE_OFFSET(&info, i))
+			return false;
 	}
+
+	return true;
+}
+
+/*
+ * Query the pool proposed by downstream in the ALLOCATION query, and configure
+ * it with enough buffers for the camera on top of the ones downstream needs.
+ * Return the activated pool if its buffers can be imported, or nullptr to
+ * fall back to the internal pool.
+ */
+static GstBufferPool *
+gst_libcamera_src_negotiate_pool(GstLibcameraSrc *self, GstPad *srcpad,
+				 const StreamConfiguration &stream_cfg)
+{
+	g_autoptr(GstCaps) caps = gst_pad_get_current_caps(srcpad);
+	if (!caps)
+		return nullptr;
+
+	g_autoptr(GstQuery) query = gst_query_new_allocation(caps, TRUE);
+	if (!gst_pad_peer_query(srcpad, query) ||
+	    !gst_query_get_n_allocation_pools(query))
+		return nullptr;
+
+	GstBufferPool *pool = nullptr;
+	guint size, min, max;
+	gst_query_parse_nth_allocation_pool(query, 0, &pool, &size, &min, &max);
+	if (!pool)
+		return nullptr;
+
+	min += stream_cfg.bufferCount;
+	size = std::max(size, stream_cfg.frameSize);
+	if (max && max < min) {
+		GST_INFO_OBJECT(self, "Downstream pool %" GST_PTR_FORMAT
+				" is too small, using internal pool", pool);
+		gst_object_unref(pool);
+		return nullptr;
+	}
+
+	GstStructure *config = gst_buffer_pool_get_config(pool);
+	gst_buffer_pool_config_set_params(config, caps, size, min, max);
+	if (!gst_buffer_pool_set_config(pool, config) ||
+	    !gst_buffer_pool_set_active(pool, TRUE)) {
+		GST_INFO_OBJECT(self, "Failed to configure downstream pool %"
+				GST_PTR_FORMAT ", using internal pool", pool);
+		gst_object_unref(pool);
+		return nullptr;
+	}
+
+	GstBuffer *buffer;
+	bool compatible = false;
+	if (gst_buffer_pool_acquire_buffer(pool, &buffer, nullptr) == GST_FLOW_OK) {
+		compatible = gst_libcamera_src_buffer_is_compatible(buffer, caps,
+								     stream_cfg);
+		gst_buffer_unref(buffer);
+	}
+
+	if (!compatible) {
+		GST_INFO_OBJECT(self, "Downstream pool %" GST_PTR_FORMAT
+				" can't be imported, using internal pool", pool);
+		gst_buffer_pool_set_active(pool, FALSE);
+		gst_object_unref(pool);
+		return nullptr;
+	}
+
+	GST_INFO_OBJECT(self, "Importing buffers from downstream pool %"
+			GST_PTR_FORMAT, pool);
+
+	return pool;
 }
 
 static void
@@ -349,6 +546,11 @@ gst_libcamera_src_task_enter(GstTask *task, [[maybe_unused]] GThread *thread,
 
 	GST_DEBUG_OBJECT(self, "Streaming thread has started");
 
+	{
+		GLibLocker lock(GST_OBJECT(self));
+		state->maxRequests_ = self->max_requests;
+	}
+
 	guint group_id = gst_util_group_id_next();
 	StreamRoles roles;
 	for (GstPad *srcpad : state->srcpads_) {
@@ -425,25 +627,42 @@ gst_libcamera_src_task_enter(GstTask *task, [[maybe_unused]] GThread *thread,
 		return;
 	}
 
-	self->allocator = gst_libcamera_allocator_new(state->cam_);
-	if (!self->allocator) {
-		GST_ELEMENT_ERROR(self, RESOURCE, NO_SPACE_LEFT,
-				  ("Failed to allocate memory"),
-				  ("gst_libcamera_allocator_new() failed."));
-		gst_task_stop(task);
-		return;
-	}
-
 	self->flow_combiner = gst_flow_combiner_new();
 	for (gsize i = 0; i < state->srcpads_.size(); i++) {
 		GstPad *srcpad = state->srcpads_[i];
 		const StreamConfiguration &stream_cfg = state->config_->at(i);
-		GstLibcameraPool *pool = gst_libcamera_pool_new(self->allocator,
-								stream_cfg.stream());
-		g_signal_connect_swapped(pool, "buffer-notify",
-					 G_CALLBACK(gst_libcamera_resume_task), task);
+		GstLibcameraPool *pool;
+
+		/*
+		 * Capture directly to the buffers of the downstream pool when
+		 * possible, and allocate buffers otherwise.
+		 */
+		GstBufferPool *downstream =
+			gst_libcamera_src_negotiate_pool(self, srcpad, stream_cfg);
+		if (downstream) {
+			pool = gst_libcamera_pool_new_imported(downstream,
+							       stream_cfg.stream());
+			gst_object_unref(downstream);
+		} else {
+			if (!self->allocator)
+				self->allocator = gst_libcamera_allocator_new(state->cam_);
+			if (!self->allocator) {
+				GST_ELEMENT_ERROR(self, RESOURCE, NO_SPACE_LEFT,
+						  ("Failed to allocate memory"),
+						  ("gst_libcamera_allocator_new() failed."));
+				gst_task_stop(task);
+				return;
+			}
 
+			pool = gst_libcamera_pool_new(self->allocator,
+						      stream_cfg.stream());
+		}
+
+		g_signal_connect_swapped(pool, "buffer-notify",
+					 G_CALLBACK(gst_libcamera_src_buffer_notify),
+					 state);
 		gst_libcamera_pad_set_pool(srcpad, pool);
+
 		gst_flow_combiner_add_pad(self->flow_combiner, srcpad);
 	}
 
@@ -479,8 +698,17 @@ gst_libcamera_src_task_leave([[maybe_unused]] GstTask *task,
 
 	state->cam_->stop();
 
-	for (GstPad *srcpad : state->srcpads_)
+	/*
+	 * Buffers still held downstream keep their pool alive, disconnect the
+	 * pools from the state before dropping them.
+	 */
+	for (GstPad *srcpad : state->srcpads_) {
+		g_autoptr(GstLibcameraPool) pool = gst_libcamera_pad_get_pool(srcpad);
+		if (pool)
+			g_signal_handlers_disconnect_by_data(pool, state);
+
 		gst_libcamera_pad_set_pool(srcpad, nullptr);
+	}
 
 	g_clear_object(&self->allocator);
 	g_clear_pointer(&self->flow_combiner,
@@ -519,6 +747,9 @@ gst_libcamera_src_set_property(GObject *object, guint prop_id,
 		g_free(self->camera_name);
 		self->camera_name = g_value_dup_string(value);
 		break;
+	case PROP_MAX_REQUESTS:
+		self->max_requests = g_value_get_uint(value);
+		break;
 	default:
 		G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
 		break;
@@ -536,6 +767,9 @@ gst_libcamera_src_get_property(GObject *object, guint prop_id, GValue *value,
 	case PROP_CAMERA_NAME:
 		g_value_set_string(value, self->camera_name);
 		break;
+	case PROP_MAX_REQUESTS:
+		g_value_set_uint(value, self->max_requests);
+		break;
 	default:
 		G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
 		break;
@@ -578,6 +812,15 @@ gst_libcamera_src_change_state(GstElement *element, GstStateChange transition)
 		 * before pad deactivation, so before chaining to the parent
 		 * change_state function.
 		 */
+		/*
+		 * Unblock the streaming thread if it waits for a buffer from a
+		 * downstream pool.
+		 */
+		for (GstPad *srcpad : self->state->srcpads_) {
+			g_autoptr(GstLibcameraPool) pool = gst_libcamera_pad_get_pool(srcpad);
+			if (pool)
+				gst_libcamera_pool_set_flushing(pool, true);
+		}
 		gst_task_join(self->task);
 		break;
 	case GST_STATE_CHANGE_READY_TO_NULL:
@@ -654,4 +897,13 @@ gst_libcamera_src_class_init(GstLibcameraSrcClass *klass)
 							     | G_PARAM_READWRITE
 							     | G_PARAM_STATIC_STRINGS));
 	g_object_class_install_property(object_class, PROP_CAMERA_NAME, spec);
+
+	spec = g_param_spec_uint("max-requests", "Maximum Requests",
+				 "Maximum number of requests in flight, 0 to queue a request for every available buffer",
+				 0, G_MAXUINT, 0,
+				 (GParamFlags)(GST_PARAM_MUTABLE_READY
+					       | G_PARAM_CONSTRUCT
+					       | G_PARAM_READWRITE
+					       | G_PARAM_STATIC_STRINGS));
+	g_object_class_install_property(object_class, PROP_MAX_REQUESTS, spec);
 }
@@ -9,7 +9,7 @@
 
 using namespace RPi;
 
-void Algorithm::Read([[maybe_unused]] boost::property_tree::ptree const &params)
+void Algorithm::Read([[maybe_unused]] TuningNode const &params)
 {
 }
 
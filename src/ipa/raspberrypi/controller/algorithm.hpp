@@ -17,7 +17,7 @@
 #include "logging.hpp"
 #include "controller.hpp"
 
-#include <boost/property_tree/ptree.hpp>
+#include "tuning.hpp"
 
 namespace RPi {
 
@@ -35,7 +35,7 @@ public:
 	virtual bool IsPaused() const { return paused_; }
 	virtual void Pause() { paused_ = true; }
 	virtual void Resume() { paused_ = false; }
-	virtual void Read(boost::property_tree::ptree const &params);
+	virtual void Read(TuningNode const &params);
 	virtual void Initialise();
 	virtual void SwitchMode(CameraMode const &camera_mode, Metadata *metadata);
 	virtual void Prepare(Metadata *image_metadata);
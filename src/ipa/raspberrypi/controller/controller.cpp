@@ -7,9 +7,7 @@
 
 #include "algorithm.hpp"
 #include "controller.hpp"
-
-#include <boost/property_tree/json_parser.hpp>
-#include <boost/property_tree/ptree.hpp>
+#include "tuning.hpp"
 
 using namespace RPi;
 
@@ -28,9 +26,9 @@ Controller::~Controller() {}
 void Controller::Read(char const *filename)
 {
 	RPI_LOG("Controller starting");
-	boost::property_tree::ptree root;
-	boost::property_tree::read_json(filename, root);
-	for (auto const &key_and_value : root) {
+	Tuning tuning;
+	tuning.Load(filename);
+	for (auto const &key_and_value : tuning.Root()) {
 		Algorithm *algo = CreateAlgorithm(key_and_value.first.c_str());
 		if (algo) {
 			algo->Read(key_and_value.second);
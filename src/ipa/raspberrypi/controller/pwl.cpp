@@ -12,7 +12,7 @@
 
 using namespace RPi;
 
-void Pwl::Read(boost::property_tree::ptree const &params)
+void Pwl::Read(TuningNode const &params)
 {
 	for (auto it = params.begin(); it != params.end(); it++) {
 		double x = it->second.get_value<double>();
@@ -24,7 +24,7 @@ using namespace RPi;
 
 #define PIPELINE_BITS 13 // seems to be a 13-bit pipeline
 
-void AgcMeteringMode::Read(boost::property_tree::ptree const &params)
+void AgcMeteringMode::Read(TuningNode const &params)
 {
 	int num = 0;
 	for (auto &p : params.get_child("weights")) {
@@ -38,7 +38,7 @@ void AgcMeteringMode::Read(boost::property_tree::ptree const &params)
 
 static std::string
 read_metering_modes(std::map<std::string, AgcMeteringMode> &metering_modes,
-		    boost::property_tree::ptree const &params)
+		    TuningNode const &params)
 {
 	std::string first;
 	for (auto &p : params) {
@@ -52,14 +52,14 @@ read_metering_modes(std::map<std::string, AgcMeteringMode> &metering_modes,
 }
 
 static int read_double_list(std::vector<double> &list,
-			    boost::property_tree::ptree const &params)
+			    TuningNode const &params)
 {
 	for (auto &p : params)
 		list.push_back(p.second.get_value<double>());
 	return list.size();
 }
 
-void AgcExposureMode::Read(boost::property_tree::ptree const &params)
+void AgcExposureMode::Read(TuningNode const &params)
 {
 	int num_shutters =
 		read_double_list(shutter, params.get_child("shutter"));
@@ -74,7 +74,7 @@ void AgcExposureMode::Read(boost::property_tree::ptree const &params)
 
 static std::string
 read_exposure_modes(std::map<std::string, AgcExposureMode> &exposure_modes,
-		    boost::property_tree::ptree const &params)
+		    TuningNode const &params)
 {
 	std::string first;
 	for (auto &p : params) {
@@ -87,7 +87,7 @@ read_exposure_modes(std::map<std::string, AgcExposureMode> &exposure_modes,
 	return first;
 }
 
-void AgcConstraint::Read(boost::property_tree::ptree const &params)
+void AgcConstraint::Read(TuningNode const &params)
 {
 	std::string bound_string = params.get<std::string>("bound", "");
 	transform(bound_string.begin(), bound_string.end(),
@@ -102,7 +102,7 @@ void AgcConstraint::Read(boost::property_tree::ptree const &params)
 }
 
 static AgcConstraintMode
-read_constraint_mode(boost::property_tree::ptree const &params)
+read_constraint_mode(TuningNode const &params)
 {
 	AgcConstraintMode mode;
 	for (auto &p : params) {
@@ -115,7 +115,7 @@ read_constraint_mode(boost::property_tree::ptree const &params)
 
 static std::string read_constraint_modes(
 	std::map<std::string, AgcConstraintMode> &constraint_modes,
-	boost::property_tree::ptree const &params)
+	TuningNode const &params)
 {
 	std::string first;
 	for (auto &p : params) {
@@ -126,7 +126,7 @@ static std::string read_constraint_modes(
 	return first;
 }
 
-void AgcConfig::Read(boost::property_tree::ptree const &params)
+void AgcConfig::Read(TuningNode const &params)
 {
 	RPI_LOG("AgcConfig");
 	default_metering_mode = read_metering_modes(
@@ -164,7 +164,7 @@ char const *Agc::Name() const
 	return NAME;
 }
 
-void Agc::Read(boost::property_tree::ptree const &params)
+void Agc::Read(TuningNode const &params)
 {
 	RPI_LOG("Agc");
 	config_.Read(params);
@@ -24,13 +24,13 @@ namespace RPi {
 
 struct AgcMeteringMode {
 	double weights[AGC_STATS_SIZE];
-	void Read(boost::property_tree::ptree const &params);
+	void Read(TuningNode const &params);
 };
 
 struct AgcExposureMode {
 	std::vector<double> shutter;
 	std::vector<double> gain;
-	void Read(boost::property_tree::ptree const &params);
+	void Read(TuningNode const &params);
 };
 
 struct AgcConstraint {
@@ -39,13 +39,13 @@ struct AgcConstraint {
 	double q_lo;
 	double q_hi;
 	Pwl Y_target;
-	void Read(boost::property_tree::ptree const &params);
+	void Read(TuningNode const &params);
 };
 
 typedef std::vector<AgcConstraint> AgcConstraintMode;
 
 struct AgcConfig {
-	void Read(boost::property_tree::ptree const &params);
+	void Read(TuningNode const &params);
 	std::map<std::string, AgcMeteringMode> metering_modes;
 	std::map<std::string, AgcExposureMode> exposure_modes;
 	std::map<std::string, AgcConstraintMode> constraint_modes;
@@ -67,7 +67,7 @@ class Agc : public AgcAlgorithm
 public:
 	Agc(Controller *controller);
 	char const *Name() const override;
-	void Read(boost::property_tree::ptree const &params) override;
+	void Read(TuningNode const &params) override;
 	void SetEv(double ev) override;
 	void SetFlickerPeriod(double flicker_period) override;
 	void SetFixedShutter(double fixed_shutter) override; // microseconds
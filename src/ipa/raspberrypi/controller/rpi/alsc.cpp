@@ -42,7 +42,7 @@ char const *Alsc::Name() const
 	return NAME;
 }
 
-static void generate_lut(double *lut, boost::property_tree::ptree const &params)
+static void generate_lut(double *lut, TuningNode const &params)
 {
 	double cstrength = params.get<double>("corner_strength", 2.0);
 	if (cstrength <= 1.0)
@@ -65,7 +65,7 @@ static void generate_lut(double *lut, boost::property_tree::ptree const &params)
 	}
 }
 
-static void read_lut(double *lut, boost::property_tree::ptree const &params)
+static void read_lut(double *lut, TuningNode const &params)
 {
 	int num = 0;
 	const int max_num = XY;
@@ -80,7 +80,7 @@ static void read_lut(double *lut, boost::property_tree::ptree const &params)
 }
 
 static void read_calibrations(std::vector<AlscCalibration> &calibrations,
-			      boost::property_tree::ptree const &params,
+			      TuningNode const &params,
 			      std::string const &name)
 {
 	if (params.get_child_optional(name)) {
@@ -93,8 +93,7 @@ static void read_calibrations(std::vector<AlscCalibration> &calibrations,
 					" must be in increasing ct order");
 			AlscCalibration calibration;
 			calibration.ct = last_ct = ct;
-			boost::property_tree::ptree const &table =
-				p.second.get_child("table");
+			TuningNode const &table = p.second.get_child("table");
 			int num = 0;
 			for (auto it = table.begin(); it != table.end(); it++) {
 				if (num == XY)
@@ -116,7 +115,7 @@ static void read_calibrations(std::vector<AlscCalibration> &calibrations,
 	}
 }
 
-void Alsc::Read(boost::property_tree::ptree const &params)
+void Alsc::Read(TuningNode const &params)
 {
 	RPI_LOG("Alsc");
 	config_.frame_period = params.get<uint16_t>("frame_period", 12);
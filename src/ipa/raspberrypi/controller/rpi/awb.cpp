@@ -19,20 +19,20 @@ using namespace RPi;
 
 const double Awb::RGB::INVALID = -1.0;
 
-void AwbMode::Read(boost::property_tree::ptree const &params)
+void AwbMode::Read(TuningNode const &params)
 {
 	ct_lo = params.get<double>("lo");
 	ct_hi = params.get<double>("hi");
 }
 
-void AwbPrior::Read(boost::property_tree::ptree const &params)
+void AwbPrior::Read(TuningNode const &params)
 {
 	lux = params.get<double>("lux");
 	prior.Read(params.get_child("prior"));
 }
 
 static void read_ct_curve(Pwl &ct_r, Pwl &ct_b,
-			  boost::property_tree::ptree const &params)
+			  TuningNode const &params)
 {
 	int num = 0;
 	for (auto it = params.begin(); it != params.end(); it++) {
@@ -53,7 +53,7 @@ static void read_ct_curve(Pwl &ct_r, Pwl &ct_b,
 			"AwbConfig: insufficient points in CT curve");
 }
 
-void AwbConfig::Read(boost::property_tree::ptree const &params)
+void AwbConfig::Read(TuningNode const &params)
 {
 	RPI_LOG("AwbConfig");
 	bayes = params.get<int>("bayes", 1);
@@ -138,7 +138,7 @@ char const *Awb::Name() const
 	return NAME;
 }
 
-void Awb::Read(boost::property_tree::ptree const &params)
+void Awb::Read(TuningNode const &params)
 {
 	config_.Read(params);
 }
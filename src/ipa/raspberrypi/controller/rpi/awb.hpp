@@ -19,20 +19,20 @@ namespace RPi {
 // Control algorithm to perform AWB calculations.
 
 struct AwbMode {
-	void Read(boost::property_tree::ptree const &params);
+	void Read(TuningNode const &params);
 	double ct_lo; // low CT value for search
 	double ct_hi; // high CT value for search
 };
 
 struct AwbPrior {
-	void Read(boost::property_tree::ptree const &params);
+	void Read(TuningNode const &params);
 	double lux; // lux level
 	Pwl prior; // maps CT to prior log likelihood for this lux level
 };
 
 struct AwbConfig {
 	AwbConfig() : default_mode(nullptr) {}
-	void Read(boost::property_tree::ptree const &params);
+	void Read(TuningNode const &params);
 	// Only repeat the AWB calculation every "this many" frames
 	uint16_t frame_period;
 	// number of initial frames for which speed taken as 1.0 (maximum)
@@ -81,7 +81,7 @@ public:
 	~Awb();
 	char const *Name() const override;
 	void Initialise() override;
-	void Read(boost::property_tree::ptree const &params) override;
+	void Read(TuningNode const &params) override;
 	void SetMode(std::string const &name) override;
 	void SetManualGains(double manual_r, double manual_b) override;
 	void Prepare(Metadata *image_metadata) override;
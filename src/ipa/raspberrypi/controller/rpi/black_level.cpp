@@ -27,7 +27,7 @@ char const *BlackLevel::Name() const
 	return NAME;
 }
 
-void BlackLevel::Read(boost::property_tree::ptree const &params)
+void BlackLevel::Read(TuningNode const &params)
 {
 	RPI_LOG(Name());
 	uint16_t black_level = params.get<uint16_t>(
@@ -18,7 +18,7 @@ class BlackLevel : public Algorithm
 public:
 	BlackLevel(Controller *controller);
 	char const *Name() const override;
-	void Read(boost::property_tree::ptree const &params) override;
+	void Read(TuningNode const &params) override;
 	void Prepare(Metadata *image_metadata) override;
 
 private:
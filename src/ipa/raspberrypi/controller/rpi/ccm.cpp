@@ -33,7 +33,7 @@ Matrix::Matrix(double m0, double m1, double m2, double m3, double m4, double m5,
 	m[0][0] = m0, m[0][1] = m1, m[0][2] = m2, m[1][0] = m3, m[1][1] = m4,
 	m[1][2] = m5, m[2][0] = m6, m[2][1] = m7, m[2][2] = m8;
 }
-void Matrix::Read(boost::property_tree::ptree const &params)
+void Matrix::Read(TuningNode const &params)
 {
 	double *ptr = (double *)m;
 	int n = 0;
@@ -54,7 +54,7 @@ char const *Ccm::Name() const
 	return NAME;
 }
 
-void Ccm::Read(boost::property_tree::ptree const &params)
+void Ccm::Read(TuningNode const &params)
 {
 	if (params.get_child_optional("saturation"))
 		config_.saturation.Read(params.get_child("saturation"));
@@ -21,7 +21,7 @@ struct Matrix {
 	       double m6, double m7, double m8);
 	Matrix();
 	double m[3][3];
-	void Read(boost::property_tree::ptree const &params);
+	void Read(TuningNode const &params);
 };
 static inline Matrix operator*(double d, Matrix const &m)
 {
@@ -63,7 +63,7 @@ class Ccm : public CcmAlgorithm
 public:
 	Ccm(Controller *controller = NULL);
 	char const *Name() const override;
-	void Read(boost::property_tree::ptree const &params) override;
+	void Read(TuningNode const &params) override;
 	void SetSaturation(double saturation) override;
 	void Initialise() override;
 	void Prepare(Metadata *image_metadata) override;
@@ -31,7 +31,7 @@ char const *Contrast::Name() const
 	return NAME;
 }
 
-void Contrast::Read(boost::property_tree::ptree const &params)
+void Contrast::Read(TuningNode const &params)
 {
 	// enable adaptive enhancement by default
 	config_.ce_enable = params.get<int>("ce_enable", 1);
@@ -33,7 +33,7 @@ class Contrast : public ContrastAlgorithm
 public:
 	Contrast(Controller *controller = NULL);
 	char const *Name() const override;
-	void Read(boost::property_tree::ptree const &params) override;
+	void Read(TuningNode const &params) override;
 	void SetBrightness(double brightness) override;
 	void SetContrast(double contrast) override;
 	void Initialise() override;
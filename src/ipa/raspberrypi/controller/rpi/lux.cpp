@@ -31,7 +31,7 @@ char const *Lux::Name() const
 	return NAME;
 }
 
-void Lux::Read(boost::property_tree::ptree const &params)
+void Lux::Read(TuningNode const &params)
 {
 	RPI_LOG(Name());
 	reference_shutter_speed_ =
@@ -21,7 +21,7 @@ class Lux : public Algorithm
 public:
 	Lux(Controller *controller);
 	char const *Name() const override;
-	void Read(boost::property_tree::ptree const &params) override;
+	void Read(TuningNode const &params) override;
 	void Prepare(Metadata *image_metadata) override;
 	void Process(StatisticsPtr &stats, Metadata *image_metadata) override;
 	void SetCurrentAperture(double aperture);
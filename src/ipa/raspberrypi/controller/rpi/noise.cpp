@@ -35,7 +35,7 @@ void Noise::SwitchMode(CameraMode const &camera_mode,
 	mode_factor_ = std::max(1.0, camera_mode.noise_factor);
 }
 
-void Noise::Read(boost::property_tree::ptree const &params)
+void Noise::Read(TuningNode const &params)
 {
 	RPI_LOG(Name());
 	reference_constant_ = params.get<double>("reference_constant");
@@ -17,7 +17,7 @@ class Sdn : public Algorithm
 public:
 	Sdn(Controller *controller = NULL);
 	char const *Name() const override;
-	void Read(boost::property_tree::ptree const &params) override;
+	void Read(TuningNode const &params) override;
 	void Initialise() override;
 	void Prepare(Metadata *image_metadata) override;
 
@@ -33,7 +33,7 @@ void Sharpen::SwitchMode(CameraMode const &camera_mode,
 	mode_factor_ = std::max(1.0, camera_mode.noise_factor);
 }
 
-void Sharpen::Read(boost::property_tree::ptree const &params)
+void Sharpen::Read(TuningNode const &params)
 {
 	RPI_LOG(Name());
 	threshold_ = params.get<double>("threshold", 1.0);
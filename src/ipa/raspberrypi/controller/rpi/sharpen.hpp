@@ -19,7 +19,7 @@ public:
 	Sharpen(Controller *controller);
 	char const *Name() const override;
 	void SwitchMode(CameraMode const &camera_mode, Metadata *metadata) override;
-	void Read(boost::property_tree::ptree const &params) override;
+	void Read(TuningNode const &params) override;
 	void SetStrength(double strength) override;
 	void Prepare(Metadata *image_metadata) override;
 
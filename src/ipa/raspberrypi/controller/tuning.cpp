@@ -0,0 +1,406 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/*
+ * Copyright (C) 2020, Google Inc.
+ *
+ * tuning.cpp - tuning file access
+ */
+
+#include <fcntl.h>
+#include <fstream>
+#include <iterator>
+#include <limits>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <boost/property_tree/json_parser.hpp>
+
+#include "logging.hpp"
+#include "tuning.hpp"
+
+using namespace RPi;
+
+// Compiled tuning files are produced from JSON tuning files by
+// utils/raspberrypi/compile-tuning.py. All values are stored in little-endian
+// order, and all offsets are relative to the start of the file. A file
+// contains, in order:
+//
+// - A header (TuningFileHeader) identifying the format and its version, with
+//   the total file size, the number of nodes, and an FNV-1a hash of the JSON
+//   source used to detect stale files.
+// - A table of nodes (TuningFileNode), starting with the root node. The
+//   children of a container node (a JSON object or array) are stored
+//   contiguously, after their parent. Array elements have empty keys.
+// - A table of NUL-terminated strings, holding the keys and the text of all
+//   values. Values that can be converted to numbers are flagged as such, and
+//   store their numerical value in the node.
+//
+// Any change to the layout requires bumping TUNING_VERSION.
+
+namespace {
+
+constexpr uint32_t TUNING_MAGIC = 0x54495052; // "RPIT"
+constexpr uint32_t TUNING_VERSION = 1;
+
+enum : uint32_t {
+	FLAG_CONTAINER = 1 << 0,
+	FLAG_NUMBER = 1 << 1,
+	FLAG_INTEGER = 1 << 2,
+};
+
+struct TuningFileHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t size;
+	uint32_t count;
+	uint64_t source_hash;
+};
+
+uint64_t fnv1a(std::string const &data)
+{
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	for (char c : data) {
+		hash ^= static_cast<uint8_t>(c);
+		hash *= 0x100000001b3ULL;
+	}
+	return hash;
+}
+
+} // namespace
+
+struct RPi::TuningFileNode {
+	uint32_t flags;
+	uint32_t key;
+	uint32_t data; // first child for containers, text for values
+	uint32_t count;
+	double value;
+};
+
+static_assert(sizeof(TuningFileHeader) == 24, "Invalid tuning file header size");
+static_assert(sizeof(TuningFileNode) == 24, "Invalid tuning file node size");
+
+namespace {
+
+// Check that all offsets stay within the file, so that corrupted files can't
+// make the algorithms read out of bounds, and that children always follow
+// their parent, so that files can't contain loops.
+bool validate(uint8_t const *base, size_t size)
+{
+	TuningFileHeader const *header =
+		reinterpret_cast<TuningFileHeader const *>(base);
+	uint64_t nodes = sizeof(TuningFileHeader);
+	uint64_t strings = nodes + uint64_t(header->count) * sizeof(TuningFileNode);
+
+	if (!header->count || strings >= size || base[size - 1] != '\0')
+		return false;
+
+	TuningFileNode const *node =
+		reinterpret_cast<TuningFileNode const *>(base + nodes);
+	if (!(node->flags & FLAG_CONTAINER))
+		return false;
+
+	for (uint64_t offset = nodes; offset < strings;
+	     offset += sizeof(TuningFileNode), node++) {
+		if (node->key < strings || node->key >= size)
+			return false;
+
+		if (!(node->flags & FLAG_CONTAINER)) {
+			if (node->data < strings || node->data >= size)
+				return false;
+			continue;
+		}
+
+		uint64_t end = node->data +
+			       uint64_t(node->count) * sizeof(TuningFileNode);
+		if (node->data <= offset ||
+		    (node->data - nodes) % sizeof(TuningFileNode) || end > strings)
+			return false;
+	}
+
+	return true;
+}
+
+TuningFileNode const *children(uint8_t const *base, TuningFileNode const *node)
+{
+	return reinterpret_cast<TuningFileNode const *>(base + node->data);
+}
+
+template<typename T>
+bool tree_value(boost::property_tree::ptree const *tree, T *value)
+{
+	boost::optional<T> v = tree->get_value_optional<T>();
+	if (!v)
+		return false;
+	*value = *v;
+	return true;
+}
+
+template<typename T>
+bool integer_value(TuningFileNode const *node, T *value)
+{
+	if (!node || !(node->flags & FLAG_INTEGER) ||
+	    node->value < std::numeric_limits<T>::min() ||
+	    node->value > std::numeric_limits<T>::max())
+		return false;
+	*value = static_cast<T>(node->value);
+	return true;
+}
+
+} // namespace
+
+TuningNode::TuningNode()
+	: tree_(nullptr), base_(nullptr), node_(nullptr)
+{
+}
+
+TuningNode::TuningNode(boost::property_tree::ptree const &tree)
+	: tree_(&tree), base_(nullptr), node_(nullptr)
+{
+}
+
+TuningNode::TuningNode(uint8_t const *base, TuningFileNode const *node)
+	: tree_(nullptr), base_(base), node_(node)
+{
+}
+
+TuningNode TuningNode::get_child(std::string const &key) const
+{
+	TuningNode child = Child(key);
+	if (!child.Valid())
+		throw std::runtime_error("Tuning: no node \"" + key + "\"");
+	return child;
+}
+
+std::optional<TuningNode>
+TuningNode::get_child_optional(std::string const &key) const
+{
+	TuningNode child = Child(key);
+	if (!child.Valid())
+		return std::nullopt;
+	return child;
+}
+
+TuningNode::const_iterator TuningNode::begin() const
+{
+	if (tree_)
+		return const_iterator(tree_->begin(), tree_->end());
+	if (!node_ || !(node_->flags & FLAG_CONTAINER))
+		return end();
+	TuningFileNode const *first = children(base_, node_);
+	return const_iterator(base_, first, first + node_->count);
+}
+
+TuningNode::const_iterator TuningNode::end() const
+{
+	if (tree_)
+		return const_iterator(tree_->end(), tree_->end());
+	TuningFileNode const *last = nullptr;
+	if (node_ && (node_->flags & FLAG_CONTAINER))
+		last = children(base_, node_) + node_->count;
+	return const_iterator(base_, last, last);
+}
+
+TuningNode TuningNode::Child(std::string const &key) const
+{
+	// Keys are matched literally, without splitting them into paths at
+	// dots, as tuning files use dots in algorithm names.
+	if (tree_) {
+		boost::property_tree::ptree::path_type path(key, '\0');
+		auto child = tree_->get_child_optional(path);
+		return child ? TuningNode(*child) : TuningNode();
+	}
+
+	if (!node_ || !(node_->flags & FLAG_CONTAINER))
+		return TuningNode();
+
+	TuningFileNode const *child = children(base_, node_);
+	for (uint32_t i = 0; i < node_->count; i++, child++) {
+		if (key == reinterpret_cast<char const *>(base_ + child->key))
+			return TuningNode(base_, child);
+	}
+
+	return TuningNode();
+}
+
+bool TuningNode::Value(double *value) const
+{
+	if (tree_)
+		return tree_value(tree_, value);
+	if (!node_ || !(node_->flags & FLAG_NUMBER))
+		return false;
+	*value = node_->value;
+	return true;
+}
+
+bool TuningNode::Value(int *value) const
+{
+	return tree_ ? tree_value(tree_, value) : integer_value(node_, value);
+}
+
+bool TuningNode::Value(uint16_t *value) const
+{
+	return tree_ ? tree_value(tree_, value) : integer_value(node_, value);
+}
+
+bool TuningNode::Value(uint32_t *value) const
+{
+	return tree_ ? tree_value(tree_, value) : integer_value(node_, value);
+}
+
+bool TuningNode::Value(std::string *value) const
+{
+	if (tree_)
+		return tree_value(tree_, value);
+	if (!node_)
+		return false;
+	// As in property trees, containers have an empty value.
+	if (node_->flags & FLAG_CONTAINER)
+		value->clear();
+	else
+		*value = reinterpret_cast<char const *>(base_ + node_->data);
+	return true;
+}
+
+TuningNode::const_iterator::const_iterator(
+	boost::property_tree::ptree::const_iterator it,
+	boost::property_tree::ptree::const_iterator end)
+	: it_(it), end_(end), base_(nullptr), node_(nullptr), last_(nullptr)
+{
+	Update();
+}
+
+TuningNode::const_iterator::const_iterator(uint8_t const *base,
+					   TuningFileNode const *node,
+					   TuningFileNode const *end)
+	: base_(base), node_(node), last_(end)
+{
+	Update();
+}
+
+TuningNode::const_iterator &TuningNode::const_iterator::operator++()
+{
+	if (base_)
+		node_++;
+	else
+		it_++;
+	Update();
+	return *this;
+}
+
+bool TuningNode::const_iterator::operator==(const_iterator const &other) const
+{
+	if (base_ || other.base_)
+		return node_ == other.node_;
+	return it_ == other.it_;
+}
+
+void TuningNode::const_iterator::Update()
+{
+	if (base_) {
+		if (node_ == last_)
+			return;
+		value_.first = reinterpret_cast<char const *>(base_ + node_->key);
+		value_.second = TuningNode(base_, node_);
+	} else if (it_ != end_) {
+		value_.first = it_->first;
+		value_.second = TuningNode(it_->second);
+	}
+}
+
+Tuning::Tuning()
+	: map_(nullptr), size_(0)
+{
+}
+
+Tuning::~Tuning()
+{
+	Unmap();
+}
+
+void Tuning::Load(char const *filename)
+{
+	Unmap();
+	tree_.clear();
+
+	// Compiled tuning files can be given directly.
+	if (Map(filename, nullptr))
+		return;
+
+	// Otherwise prefer a compiled file found next to the JSON file, as long
+	// as it was compiled from the same JSON source.
+	std::string name(filename);
+	std::string::size_type pos = name.rfind(".json");
+	std::string compiled = name.substr(0, pos) + ".bin";
+	if (pos != std::string::npos && pos + 5 == name.size() &&
+	    access(compiled.c_str(), R_OK) == 0) {
+		std::ifstream file(filename, std::ios::binary);
+		std::string source(std::istreambuf_iterator<char>(file), {});
+		uint64_t source_hash = fnv1a(source);
+
+		if (file && Map(compiled, &source_hash))
+			return;
+	}
+
+	RPI_LOG("Parsing JSON tuning file " << filename);
+	boost::property_tree::read_json(filename, tree_);
+}
+
+TuningNode Tuning::Root() const
+{
+	if (!map_)
+		return TuningNode(tree_);
+	uint8_t const *base = static_cast<uint8_t const *>(map_);
+	return TuningNode(base, reinterpret_cast<TuningFileNode const *>(
+					base + sizeof(TuningFileHeader)));
+}
+
+bool Tuning::Map(std::string const &filename, uint64_t const *source_hash)
+{
+	int fd = open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return false;
+
+	// Files that aren't compiled tuning files, such as JSON files, are
+	// skipped silently.
+	TuningFileHeader header;
+	struct stat st;
+	if (fstat(fd, &st) < 0 ||
+	    pread(fd, &header, sizeof(header), 0) != sizeof(header) ||
+	    header.magic != TUNING_MAGIC) {
+		close(fd);
+		return false;
+	}
+
+	if (header.version != TUNING_VERSION ||
+	    header.size != static_cast<uint64_t>(st.st_size) ||
+	    (source_hash && header.source_hash != *source_hash)) {
+		RPI_WARN("Ignoring " << filename
+				     << ": unsupported version or stale file");
+		close(fd);
+		return false;
+	}
+
+	void *map = mmap(nullptr, header.size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return false;
+
+	if (!validate(static_cast<uint8_t const *>(map), header.size)) {
+		RPI_WARN("Ignoring " << filename << ": file is corrupted");
+		munmap(map, header.size);
+		return false;
+	}
+
+	RPI_LOG("Using compiled tuning file " << filename);
+	map_ = map;
+	size_ = header.size;
+	return true;
+}
+
+void Tuning::Unmap()
+{
+	if (map_)
+		munmap(map_, size_);
+	map_ = nullptr;
+	size_ = 0;
+}
@@ -0,0 +1,143 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/*
+ * Copyright (C) 2020, Google Inc.
+ *
+ * tuning.hpp - tuning file access
+ */
+#pragma once
+
+#include <iterator>
+#include <optional>
+#include <stdint.h>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#include <boost/property_tree/ptree.hpp>
+
+namespace RPi {
+
+struct TuningFileNode;
+
+// A TuningNode gives read-only access to a node of a tuning file, either
+// parsed from JSON into a property tree, or compiled to binary form and
+// accessed in place (see utils/raspberrypi/compile-tuning.py). Its interface
+// mirrors the subset of boost::property_tree::ptree that the algorithms use,
+// with the same semantics, so that they don't need to care about the file
+// format. Nodes reference data owned by the Tuning object they come from, and
+// must not outlive it.
+
+class TuningNode
+{
+public:
+	class const_iterator;
+	typedef std::pair<std::string, TuningNode> value_type;
+
+	TuningNode();
+	explicit TuningNode(boost::property_tree::ptree const &tree);
+	TuningNode(uint8_t const *base, TuningFileNode const *node);
+
+	// Values can be retrieved as double, int, uint16_t, uint32_t or
+	// std::string. As with property trees, get_value() and get() throw when
+	// the value doesn't exist or can't be converted, while get() with a
+	// default value returns the default in those cases.
+	template<typename T> T get_value() const
+	{
+		T value;
+		if (!Value(&value))
+			throw std::runtime_error("Tuning: invalid value");
+		return value;
+	}
+	template<typename T> T get(std::string const &key) const
+	{
+		return get_child(key).get_value<T>();
+	}
+	template<typename T> T get(std::string const &key,
+				   T const &default_value) const
+	{
+		TuningNode child = Child(key);
+		T value;
+		if (!child.Valid() || !child.Value(&value))
+			return default_value;
+		return value;
+	}
+	TuningNode get_child(std::string const &key) const;
+	std::optional<TuningNode> get_child_optional(std::string const &key) const;
+
+	const_iterator begin() const;
+	const_iterator end() const;
+
+private:
+	bool Valid() const { return tree_ || node_; }
+	TuningNode Child(std::string const &key) const;
+	bool Value(double *value) const;
+	bool Value(int *value) const;
+	bool Value(uint16_t *value) const;
+	bool Value(uint32_t *value) const;
+	bool Value(std::string *value) const;
+
+	boost::property_tree::ptree const *tree_;
+	uint8_t const *base_;
+	TuningFileNode const *node_;
+};
+
+class TuningNode::const_iterator
+{
+public:
+	typedef std::forward_iterator_tag iterator_category;
+	typedef TuningNode::value_type value_type;
+	typedef std::ptrdiff_t difference_type;
+	typedef value_type const *pointer;
+	typedef value_type const &reference;
+
+	const_iterator(boost::property_tree::ptree::const_iterator it,
+		       boost::property_tree::ptree::const_iterator end);
+	const_iterator(uint8_t const *base, TuningFileNode const *node,
+		       TuningFileNode const *end);
+
+	reference operator*() const { return value_; }
+	pointer operator->() const { return &value_; }
+	const_iterator &operator++();
+	const_iterator operator++(int)
+	{
+		const_iterator it = *this;
+		++*this;
+		return it;
+	}
+	bool operator==(const_iterator const &other) const;
+	bool operator!=(const_iterator const &other) const
+	{
+		return !(*this == other);
+	}
+
+private:
+	void Update();
+
+	boost::property_tree::ptree::const_iterator it_, end_;
+	uint8_t const *base_;
+	TuningFileNode const *node_, *last_;
+	value_type value_;
+};
+
+// The Tuning class loads a tuning file and owns its content. Compiled tuning
+// files are used when available, and JSON files are parsed otherwise.
+
+class Tuning
+{
+public:
+	Tuning();
+	~Tuning();
+	void Load(char const *filename);
+	bool Compiled() const { return map_ != nullptr; }
+	TuningNode Root() const;
+
+private:
+	bool Map(std::string const &filename, uint64_t const *source_hash);
+	void Unmap();
+
+	boost::property_tree::ptree tree_;
+	void *map_;
+	size_t size_;
+};
+
+} // namespace RPi
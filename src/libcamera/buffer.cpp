@@ -285,6 +285,26 @@ int FrameBuffer::copyFrom(const FrameBuffer *src)
 	return 0;
 }
 
+/**
+ * \class FrameBufferMetadata
+ * \brief Update the metadata of a FrameBuffer
+ *
+ * The metadata of a FrameBuffer is read-only for applications, and is normally
+ * filled by the V4L2VideoDevice that dequeues the buffer. Pipeline handlers
+ * that produce frames without a video device use this class to fill the
+ * metadata of the buffers they complete.
+ */
+
+/**
+ * \brief Set the metadata of a buffer
+ * \param[in] buffer The buffer to update
+ * \param[in] metadata The new buffer metadata
+ */
+void FrameBufferMetadata::set(FrameBuffer *buffer, const FrameMetadata &metadata)
+{
+	buffer->metadata_ = metadata;
+}
+
 /**
  * \class MappedBuffer
  * \brief Provide an interface to support managing memory mapped buffers
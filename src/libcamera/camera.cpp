@@ -14,8 +14,10 @@
 #include <libcamera/request.h>
 #include <libcamera/stream.h>
 
+#include "libcamera/internal/camera_statistics.h"
 #include "libcamera/internal/log.h"
 #include "libcamera/internal/pipeline_handler.h"
+#include "libcamera/internal/tracer.h"
 #include "libcamera/internal/utils.h"
 
 /**
@@ -280,6 +282,7 @@ public:
 	std::string id_;
 	std::set<Stream *> streams_;
 	std::set<const Stream *> activeStreams_;
+	CameraStatisticsRecorder stats_;
 
 private:
 	bool disconnected_;
@@ -289,7 +292,7 @@ private:
 Camera::Private::Private(PipelineHandler *pipe, const std::string &id,
 			 const std::set<Stream *> &streams)
 	: pipe_(pipe->shared_from_this()), id_(id), streams_(streams),
-	  disconnected_(false), state_(CameraAvailable)
+	  stats_(streams), disconnected_(false), state_(CameraAvailable)
 {
 }
 
@@ -641,6 +644,9 @@ int Camera::release()
 	if (ret < 0)
 		return ret == -EACCES ? -EBUSY : ret;
 
+	p_->pipe_->invokeMethod(&PipelineHandler::releaseDevice,
+				ConnectionTypeBlocking, this);
+
 	p_->pipe_->unlock();
 
 	p_->setState(Private::CameraAvailable);
@@ -762,6 +768,11 @@ std::unique_ptr<CameraConfiguration> Camera::generateConfiguration(const StreamR
  * Upon return the StreamConfiguration entries in \a config are associated with
  * Stream instances which can be retrieved with StreamConfiguration::stream().
  *
+ * When the camera is reconfigured, buffers allocated for the previous
+ * configuration of a stream may remain valid for the new configuration. This
+ * is reported by Stream::buffersPreserved(), and allows applications to
+ * switch between compatible modes without freeing and reallocating buffers.
+ *
  * \return 0 on success or a negative error code otherwise
  * \retval -ENODEV The camera has been disconnected from the system
  * \retval -EACCES The camera is not in a state where it can be configured
@@ -797,7 +808,9 @@ int Camera::configure(CameraConfiguration *config)
 	if (ret)
 		return ret;
 
-	p_->activeStreams_.clear();
+	std::set<const Stream *> previousStreams;
+	std::swap(previousStreams, p_->activeStreams_);
+
 	for (const StreamConfiguration &cfg : *config) {
 		Stream *stream = cfg.stream();
 		if (!stream) {
@@ -807,6 +820,16 @@ int Camera::configure(CameraConfiguration *config)
 			return -EINVAL;
 		}
 
+		/*
+		 * Ask the pipeline handler if buffers suitable for the previous
+		 * configuration of the stream can be reused as-is.
+		 */
+		stream->buffersPreserved_ =
+			previousStreams.count(stream) &&
+			p_->pipe_->invokeMethod(&PipelineHandler::buffersCompatible,
+						ConnectionTypeBlocking, this,
+						stream->configuration_, cfg);
+
 		stream->configuration_ = cfg;
 		p_->activeStreams_.insert(stream);
 	}
@@ -897,6 +920,10 @@ int Camera::queueRequest(Request *request)
 		}
 	}
 
+	TRACE_EVENT(AsyncBegin, "Camera", "Request", traceId(request));
+
+	p_->stats_.requestQueued(request);
+
 	return p_->pipe_->invokeMethod(&PipelineHandler::queueRequest,
 				       ConnectionTypeQueued, this, request);
 }
@@ -925,6 +952,8 @@ int Camera::start()
 
 	LOG(Camera, Debug) << "Starting capture";
 
+	p_->stats_.reset();
+
 	ret = p_->pipe_->invokeMethod(&PipelineHandler::start,
 				      ConnectionTypeBlocking, this);
 	if (ret)
@@ -965,6 +994,24 @@ int Camera::stop()
 	return 0;
 }
 
+/**
+ * \brief Retrieve the camera runtime statistics
+ *
+ * The statistics are gathered while the camera is running, and are reset when
+ * the camera is started. They are retained after the camera is stopped until
+ * the next call to start().
+ *
+ * \context This function is \threadsafe. It doesn't block the camera manager
+ * thread, but the returned statistics may be slightly inconsistent when
+ * retrieved while the camera is running.
+ *
+ * \return A snapshot of the camera statistics
+ */
+CameraStatistics Camera::statistics() const
+{
+	return p_->stats_.snapshot();
+}
+
 /**
  * \brief Handle request completion and notify application
  * \param[in] request The request that has completed
@@ -975,8 +1022,22 @@ int Camera::stop()
  */
 void Camera::requestComplete(Request *request)
 {
+	p_->stats_.requestCompleted(request);
+
 	requestCompleted.emit(request);
 	delete request;
 }
 
+/**
+ * \brief Retrieve the camera statistics recorder
+ *
+ * This function is used by the pipeline handler to update the statistics.
+ *
+ * \return The camera statistics recorder
+ */
+CameraStatisticsRecorder *Camera::statisticsRecorder()
+{
+	return &p_->stats_;
+}
+
 } /* namespace libcamera */
@@ -13,6 +13,7 @@
 #include <libcamera/camera.h>
 #include <libcamera/event_dispatcher.h>
 
+#include "libcamera/internal/capability_cache.h"
 #include "libcamera/internal/device_enumerator.h"
 #include "libcamera/internal/event_dispatcher_poll.h"
 #include "libcamera/internal/ipa_manager.h"
@@ -155,6 +156,9 @@ void CameraManager::Private::createPipelineHandlers()
 		}
 	}
 
+	/* Write the capabilities enumerated by the pipeline handlers. */
+	CapabilityCache::flushAll();
+
 	enumerator_->devicesAdded.connect(this, &Private::createPipelineHandlers);
 }
 
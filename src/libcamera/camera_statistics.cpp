@@ -0,0 +1,527 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2020, Google Inc.
+ *
+ * camera_statistics.cpp - Camera runtime statistics
+ */
+
+#include "libcamera/internal/camera_statistics.h"
+
+#include <algorithm>
+#include <limits>
+#include <tuple>
+
+#include <libcamera/buffer.h>
+#include <libcamera/request.h>
+
+/**
+ * \file camera_statistics.h
+ * \brief Camera runtime statistics
+ */
+
+namespace libcamera {
+
+/**
+ * \struct CameraStatistics
+ * \brief Runtime statistics of a camera
+ *
+ * The CameraStatistics structure is a snapshot of the statistics gathered by
+ * a camera while it is running. It is retrieved with Camera::statistics(), and
+ * is reset when the camera is started.
+ *
+ * All durations are expressed in microseconds.
+ *
+ * \var CameraStatistics::requestsQueued
+ * \brief The number of requests queued by the application
+ *
+ * \var CameraStatistics::requestsCompleted
+ * \brief The number of requests completed successfully
+ *
+ * \var CameraStatistics::requestsCancelled
+ * \brief The number of requests cancelled
+ *
+ * \var CameraStatistics::requestsPending
+ * \brief The number of requests queued to the pipeline handler and not
+ * completed yet
+ *
+ * \var CameraStatistics::frameInterval
+ * \brief The histogram of intervals between the timestamps of consecutive
+ * completed requests
+ *
+ * The timestamp of a request is the timestamp of its first successfully
+ * completed buffer.
+ *
+ * \var CameraStatistics::requestLatency
+ * \brief The histogram of the times from queueing a request with
+ * Camera::queueRequest() to its completion
+ *
+ * \var CameraStatistics::ipaProcessingTime
+ * \brief The histogram of the times spent by the IPA processing events
+ *
+ * \var CameraStatistics::streams
+ * \brief The per-stream statistics
+ */
+
+/**
+ * \struct CameraStatistics::Histogram
+ * \brief A histogram of durations with log-linear buckets
+ *
+ * Each power of two range is split in kSubBuckets linear buckets, giving a
+ * relative precision of 1/kSubBuckets over the whole range of values. Values
+ * lower than kSubBuckets are counted exactly. The last bucket also counts all
+ * values larger than its lower bound.
+ *
+ * \var CameraStatistics::Histogram::kSubBuckets
+ * \brief The number of buckets per power of two
+ *
+ * \var CameraStatistics::Histogram::kNumBuckets
+ * \brief The number of buckets in the histogram
+ *
+ * \var CameraStatistics::Histogram::buckets
+ * \brief The number of values in each bucket
+ *
+ * \var CameraStatistics::Histogram::count
+ * \brief The total number of values
+ *
+ * \var CameraStatistics::Histogram::sum
+ * \brief The sum of all values
+ *
+ * \var CameraStatistics::Histogram::min
+ * \brief The smallest value, or 0 if the histogram is empty
+ *
+ * \var CameraStatistics::Histogram::max
+ * \brief The largest value, or 0 if the histogram is empty
+ */
+
+/**
+ * \brief Construct an empty histogram
+ */
+CameraStatistics::Histogram::Histogram()
+	: count(0), sum(0), min(0), max(0)
+{
+	buckets.fill(0);
+}
+
+/**
+ * \brief Compute the index of the bucket counting a value
+ * \param[in] value The value
+ * \return The bucket index
+ */
+unsigned int CameraStatistics::Histogram::bucketIndex(uint64_t value)
+{
+	static_assert(kSubBuckets == 8, "Sub-bucket shift must match kSubBuckets");
+
+	if (value < kSubBuckets)
+		return value;
+
+	/* The position of the most significant bit, at least 3. */
+	unsigned int msb = 63 - __builtin_clzll(value);
+	unsigned int sub = (value >> (msb - 3)) & (kSubBuckets - 1);
+	unsigned int index = (msb - 2) * kSubBuckets + sub;
+
+	return std::min(index, kNumBuckets - 1);
+}
+
+/**
+ * \brief Retrieve the lower bound of a bucket
+ * \param[in] index The bucket index
+ * \return The smallest value counted in the bucket
+ */
+uint64_t CameraStatistics::Histogram::bucketLowerBound(unsigned int index)
+{
+	if (index < kSubBuckets)
+		return index;
+
+	unsigned int msb = index / kSubBuckets + 2;
+	unsigned int sub = index % kSubBuckets;
+
+	return static_cast<uint64_t>(kSubBuckets + sub) << (msb - 3);
+}
+
+/**
+ * \brief Retrieve the upper bound of a bucket
+ * \param[in] index The bucket index
+ * \return The smallest value larger than the values counted in the bucket,
+ * or the largest 64-bit value for the last bucket
+ */
+uint64_t CameraStatistics::Histogram::bucketUpperBound(unsigned int index)
+{
+	if (index >= kNumBuckets - 1)
+		return std::numeric_limits<uint64_t>::max();
+
+	return bucketLowerBound(index + 1);
+}
+
+/**
+ * \brief Compute the mean of all values
+ * \return The mean value, or 0.0 if the histogram is empty
+ */
+double CameraStatistics::Histogram::mean() const
+{
+	return count ? static_cast<double>(sum) / count : 0.0;
+}
+
+/**
+ * \brief Estimate a percentile
+ * \param[in] p The percentile, between 0.0 and 100.0
+ *
+ * The percentile is estimated as the middle of the bucket it falls in, limited
+ * to the range of recorded values.
+ *
+ * \return The estimated percentile, or 0 if the histogram is empty
+ */
+uint64_t CameraStatistics::Histogram::percentile(double p) const
+{
+	if (!count)
+		return 0;
+
+	uint64_t rank = static_cast<uint64_t>(p / 100.0 * count);
+	uint64_t total = 0;
+
+	for (unsigned int i = 0; i < kNumBuckets; ++i) {
+		total += buckets[i];
+		if (total <= rank)
+			continue;
+
+		uint64_t lower = std::max(bucketLowerBound(i), min);
+		uint64_t upper = std::min(bucketUpperBound(i), max + 1);
+		return lower + (upper - lower) / 2;
+	}
+
+	return max;
+}
+
+/**
+ * \struct CameraStatistics::StreamStatistics
+ * \brief Runtime statistics of a stream
+ *
+ * \var CameraStatistics::StreamStatistics::frames
+ * \brief The number of buffers completed successfully
+ *
+ * \var CameraStatistics::StreamStatistics::errors
+ * \brief The number of buffers completed with an error
+ *
+ * \var CameraStatistics::StreamStatistics::sequenceGaps
+ * \brief The number of frames missing from the sequence of completed buffers
+ *
+ * \var CameraStatistics::StreamStatistics::queueDepth
+ * \brief The number of buffers queued to the pipeline handler and not
+ * completed yet
+ */
+
+/**
+ * \brief Construct empty camera statistics
+ */
+CameraStatistics::CameraStatistics()
+	: requestsQueued(0), requestsCompleted(0), requestsCancelled(0),
+	  requestsPending(0)
+{
+}
+
+/**
+ * \class AtomicHistogram
+ * \brief A histogram updated with atomic operations
+ *
+ * The AtomicHistogram records values in the buckets of a
+ * CameraStatistics::Histogram without locking. It supports a single writer
+ * and any number of concurrent readers. Readers may observe a histogram being
+ * updated, in which case the count, sum and buckets may be slightly out of
+ * sync.
+ */
+
+AtomicHistogram::AtomicHistogram()
+{
+	reset();
+}
+
+/**
+ * \brief Record a value
+ * \param[in] value The value
+ */
+void AtomicHistogram::record(uint64_t value)
+{
+	unsigned int index = CameraStatistics::Histogram::bucketIndex(value);
+
+	buckets_[index].fetch_add(1, std::memory_order_relaxed);
+	sum_.fetch_add(value, std::memory_order_relaxed);
+
+	if (value < min_.load(std::memory_order_relaxed))
+		min_.store(value, std::memory_order_relaxed);
+	if (value > max_.load(std::memory_order_relaxed))
+		max_.store(value, std::memory_order_relaxed);
+
+	count_.fetch_add(1, std::memory_order_release);
+}
+
+/**
+ * \brief Reset the histogram to an empty state
+ */
+void AtomicHistogram::reset()
+{
+	for (std::atomic<uint64_t> &bucket : buckets_)
+		bucket.store(0, std::memory_order_relaxed);
+
+	count_.store(0, std::memory_order_relaxed);
+	sum_.store(0, std::memory_order_relaxed);
+	min_.store(std::numeric_limits<uint64_t>::max(), std::memory_order_relaxed);
+	max_.store(0, std::memory_order_relaxed);
+}
+
+/**
+ * \brief Retrieve a snapshot of the histogram
+ * \return The histogram
+ */
+CameraStatistics::Histogram AtomicHistogram::snapshot() const
+{
+	CameraStatistics::Histogram histogram;
+
+	histogram.count = count_.load(std::memory_order_acquire);
+	if (!histogram.count)
+		return histogram;
+
+	for (unsigned int i = 0; i < buckets_.size(); ++i)
+		histogram.buckets[i] = buckets_[i].load(std::memory_order_relaxed);
+
+	histogram.sum = sum_.load(std::memory_order_relaxed);
+	histogram.min = min_.load(std::memory_order_relaxed);
+	histogram.max = max_.load(std::memory_order_relaxed);
+
+	return histogram;
+}
+
+/**
+ * \class CameraStatisticsRecorder
+ * \brief Gather the runtime statistics of a camera
+ *
+ * The CameraStatisticsRecorder is updated by the Camera and the
+ * PipelineHandler on the request processing path, using atomic operations
+ * for the counters and histograms. Updates happen in the camera manager
+ * thread, with the exception of requestQueued() that is called from the
+ * application thread and of ipaProcessed() that is called from the IPA thread.
+ * A snapshot of the statistics can be retrieved from any thread.
+ *
+ * The time at which requests are queued is needed to compute their latency.
+ * It is stored by the recorder, indexed by request, under a mutex that is only
+ * contended between the application and the camera manager thread.
+ */
+
+/**
+ * \brief Construct a statistics recorder for a camera
+ * \param[in] streams The streams of the camera
+ */
+CameraStatisticsRecorder::CameraStatisticsRecorder(const std::set<Stream *> &streams)
+	: lastTimestamp_(0)
+{
+	/*
+	 * The map is populated at construction time and never modified
+	 * afterwards, so it can be accessed from any thread without locking.
+	 */
+	for (const Stream *stream : streams)
+		streams_.emplace(std::piecewise_construct,
+				 std::forward_as_tuple(stream),
+				 std::forward_as_tuple());
+
+	reset();
+}
+
+/**
+ * \brief Reset all statistics
+ *
+ * This function shall only be called when the camera isn't running.
+ */
+void CameraStatisticsRecorder::reset()
+{
+	requestsQueued_.store(0, std::memory_order_relaxed);
+	requestsCompleted_.store(0, std::memory_order_relaxed);
+	requestsCancelled_.store(0, std::memory_order_relaxed);
+	requestsPending_.store(0, std::memory_order_relaxed);
+
+	frameInterval_.reset();
+	requestLatency_.reset();
+	ipaProcessingTime_.reset();
+
+	lastTimestamp_ = 0;
+
+	{
+		MutexLocker locker(mutex_);
+		queueTimes_.clear();
+	}
+
+	for (auto &it : streams_) {
+		StreamCounters &counters = it.second;
+		counters.frames.store(0, std::memory_order_relaxed);
+		counters.errors.store(0, std::memory_order_relaxed);
+		counters.sequenceGaps.store(0, std::memory_order_relaxed);
+		counters.queueDepth.store(0, std::memory_order_relaxed);
+		counters.lastSequence.store(-1, std::memory_order_relaxed);
+	}
+}
+
+/**
+ * \brief Record a request being queued to the pipeline handler
+ * \param[in] request The request
+ */
+void CameraStatisticsRecorder::requestQueued(const Request *request)
+{
+	utils::time_point now = utils::clock::now();
+
+	{
+		MutexLocker locker(mutex_);
+		queueTimes_[request] = now;
+	}
+
+	requestsQueued_.fetch_add(1, std::memory_order_relaxed);
+	requestsPending_.fetch_add(1, std::memory_order_relaxed);
+
+	for (const auto &it : request->buffers()) {
+		auto counters = streams_.find(it.first);
+		if (counters != streams_.end())
+			counters->second.queueDepth.fetch_add(1, std::memory_order_relaxed);
+	}
+}
+
+/**
+ * \brief Record a failure to queue a request to the device
+ * \param[in] request The request
+ *
+ * Revert the updates performed by requestQueued().
+ */
+void CameraStatisticsRecorder::requestQueueFailed(const Request *request)
+{
+	{
+		MutexLocker locker(mutex_);
+		queueTimes_.erase(request);
+	}
+
+	requestsPending_.fetch_sub(1, std::memory_order_relaxed);
+
+	for (const auto &it : request->buffers()) {
+		auto counters = streams_.find(it.first);
+		if (counters != streams_.end())
+			counters->second.queueDepth.fetch_sub(1, std::memory_order_relaxed);
+	}
+}
+
+/**
+ * \brief Record the completion of a buffer
+ * \param[in] stream The stream the buffer belongs to
+ * \param[in] buffer The buffer
+ */
+void CameraStatisticsRecorder::bufferCompleted(const Stream *stream,
+					       const FrameBuffer *buffer)
+{
+	auto it = streams_.find(stream);
+	if (it == streams_.end())
+		return;
+
+	StreamCounters &counters = it->second;
+	const FrameMetadata &metadata = buffer->metadata();
+
+	counters.queueDepth.fetch_sub(1, std::memory_order_relaxed);
+
+	switch (metadata.status) {
+	case FrameMetadata::FrameSuccess:
+		counters.frames.fetch_add(1, std::memory_order_relaxed);
+		break;
+	case FrameMetadata::FrameError:
+		counters.errors.fetch_add(1, std::memory_order_relaxed);
+		break;
+	case FrameMetadata::FrameCancelled:
+		return;
+	}
+
+	int64_t last = counters.lastSequence.load(std::memory_order_relaxed);
+	if (last >= 0 && metadata.sequence > last + 1)
+		counters.sequenceGaps.fetch_add(metadata.sequence - last - 1,
+						std::memory_order_relaxed);
+	counters.lastSequence.store(metadata.sequence, std::memory_order_relaxed);
+}
+
+/**
+ * \brief Record the completion of a request
+ * \param[in] request The request
+ */
+void CameraStatisticsRecorder::requestCompleted(const Request *request)
+{
+	utils::time_point queued{};
+
+	{
+		MutexLocker locker(mutex_);
+		auto it = queueTimes_.find(request);
+		if (it != queueTimes_.end()) {
+			queued = it->second;
+			queueTimes_.erase(it);
+		}
+	}
+
+	requestsPending_.fetch_sub(1, std::memory_order_relaxed);
+
+	if (request->status() == Request::RequestCancelled) {
+		requestsCancelled_.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+
+	requestsCompleted_.fetch_add(1, std::memory_order_relaxed);
+
+	if (queued != utils::time_point{}) {
+		utils::duration latency = utils::clock::now() - queued;
+		requestLatency_.record(std::chrono::duration_cast<std::chrono::microseconds>(latency).count());
+	}
+
+	uint64_t timestamp = 0;
+	for (const auto &it : request->buffers()) {
+		const FrameMetadata &metadata = it.second->metadata();
+		if (metadata.status == FrameMetadata::FrameSuccess) {
+			timestamp = metadata.timestamp;
+			break;
+		}
+	}
+
+	if (!timestamp)
+		return;
+
+	if (lastTimestamp_ && timestamp > lastTimestamp_)
+		frameInterval_.record((timestamp - lastTimestamp_) / 1000);
+	lastTimestamp_ = timestamp;
+}
+
+/**
+ * \brief Record the time spent by the IPA processing an event
+ * \param[in] duration The processing time
+ */
+void CameraStatisticsRecorder::ipaProcessed(const utils::duration &duration)
+{
+	ipaProcessingTime_.record(std::chrono::duration_cast<std::chrono::microseconds>(duration).count());
+}
+
+/**
+ * \brief Retrieve a snapshot of the statistics
+ * \return The camera statistics
+ */
+CameraStatistics CameraStatisticsRecorder::snapshot() const
+{
+	CameraStatistics stats;
+
+	stats.requestsQueued = requestsQueued_.load(std::memory_order_relaxed);
+	stats.requestsCompleted = requestsCompleted_.load(std::memory_order_relaxed);
+	stats.requestsCancelled = requestsCancelled_.load(std::memory_order_relaxed);
+	stats.requestsPending = requestsPending_.load(std::memory_order_relaxed);
+
+	stats.frameInterval = frameInterval_.snapshot();
+	stats.requestLatency = requestLatency_.snapshot();
+	stats.ipaProcessingTime = ipaProcessingTime_.snapshot();
+
+	for (const auto &it : streams_) {
+		const StreamCounters &counters = it.second;
+		CameraStatistics::StreamStatistics &stream = stats.streams[it.first];
+
+		stream.frames = counters.frames.load(std::memory_order_relaxed);
+		stream.errors = counters.errors.load(std::memory_order_relaxed);
+		stream.sequenceGaps = counters.sequenceGaps.load(std::memory_order_relaxed);
+		stream.queueDepth = counters.queueDepth.load(std::memory_order_relaxed);
+	}
+
+	return stats;
+}
+
+} /* namespace libcamera */
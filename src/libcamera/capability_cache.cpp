@@ -0,0 +1,393 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2020, Google Inc.
+ *
+ * capability_cache.cpp - Persistent cache of device capabilities
+ */
+
+#include "libcamera/internal/capability_cache.h"
+
+#include <errno.h>
+#include <iomanip>
+#include <set>
+#include <sstream>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <libcamera/span.h>
+
+#include "libcamera/internal/file.h"
+#include "libcamera/internal/log.h"
+#include "libcamera/internal/thread.h"
+#include "libcamera/internal/utils.h"
+
+/**
+ * \file capability_cache.h
+ * \brief Persistent cache of device capabilities
+ */
+
+namespace libcamera {
+
+LOG_DEFINE_CATEGORY(CapabilityCache)
+
+namespace {
+
+constexpr uint32_t kCacheMagic = 0x4343434c; /* "LCCC" */
+constexpr uint32_t kCacheVersion = 1;
+
+/*
+ * Caches with sections not written to their file yet. The mutex also protects
+ * the sections of all caches, as they can be flushed from any thread.
+ */
+struct DirtyCaches {
+	Mutex mutex;
+	std::set<CapabilityCache *> caches;
+};
+
+DirtyCaches &dirtyCaches()
+{
+	static DirtyCaches dirty;
+	return dirty;
+}
+
+} /* namespace */
+
+/**
+ * \class CapabilityCache
+ * \brief Persistent cache of the capabilities of a device
+ *
+ * Enumerating the capabilities of V4L2 devices, such as their controls and
+ * the formats and sizes they support, requires one ioctl per item. For
+ * sensors exposing many modes this amounts to hundreds of system calls, which
+ * are repeated every time a process starts using the camera.
+ *
+ * The CapabilityCache stores the result of such enumerations in a file, and
+ * makes them available to subsequent processes. The cache is opt-in, and is
+ * enabled by setting the LIBCAMERA_CAPABILITY_CACHE environment variable to
+ * the directory where cache files are stored, typically a subdirectory of
+ * XDG_RUNTIME_DIR. The directory is created if it doesn't exist.
+ *
+ * Each device has its own cache file, identified by a device \a id. The
+ * cache file records a \a key that describes the device and its driver, such
+ * as the driver name, bus information, and kernel and driver versions. The
+ * cached data is discarded when the key doesn't match, which makes
+ * validation cheap: it only requires computing the key and reading one file.
+ *
+ * The cache stores opaque named sections of binary data. Helper functions are
+ * provided to store and look up format enumeration results. Stored sections
+ * are only written to the cache file when the cache is flushed, which allows
+ * writing each file once after all devices have been enumerated, instead of
+ * once per section. The CameraManager flushes all caches with flushAll() when
+ * it has created the pipeline handlers, and caches are flushed when destroyed.
+ *
+ * Cached information reflects the state of the device when it was first
+ * enumerated, and is only refreshed when the key changes. Users shall thus
+ * only cache information that they would otherwise query once, and not
+ * information they need to track when the device configuration changes. For
+ * instance, control ranges depend on the device configuration, and are not
+ * cached.
+ */
+
+/**
+ * \brief Construct a cache for a device and load its cache file
+ * \param[in] id A unique and persistent identifier for the device
+ * \param[in] key A description of the device used to validate the cache
+ *
+ * If a cache file exists for the device \a id and its key matches \a key, its
+ * content is loaded. Otherwise the cache is initially empty. The cache shall
+ * only be constructed when caching is enabled, as reported by directory().
+ */
+CapabilityCache::CapabilityCache(const std::string &id, const std::string &key)
+	: key_(key), dirty_(false)
+{
+	/* Hash the identifier with FNV-1a to create a file name. */
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	for (char c : id) {
+		hash ^= static_cast<uint8_t>(c);
+		hash *= 0x100000001b3ULL;
+	}
+
+	std::ostringstream name;
+	name << directory() << "/" << std::hex << std::setw(16)
+	     << std::setfill('0') << hash << ".cache";
+	fileName_ = name.str();
+
+	load();
+}
+
+/**
+ * \brief Destroy the cache, writing the cache file if needed
+ */
+CapabilityCache::~CapabilityCache()
+{
+	flush();
+}
+
+/**
+ * \brief Retrieve the directory where cache files are stored
+ *
+ * The directory is set through the LIBCAMERA_CAPABILITY_CACHE environment
+ * variable, read when this function is first called.
+ *
+ * \return The cache directory, or an empty string if caching is disabled
+ */
+const std::string &CapabilityCache::directory()
+{
+	static const std::string dir = []() {
+		const char *env = utils::secure_getenv("LIBCAMERA_CAPABILITY_CACHE");
+		return std::string(env ? env : "");
+	}();
+
+	return dir;
+}
+
+/**
+ * \fn CapabilityCache::fileName()
+ * \brief Retrieve the name of the cache file
+ * \return The cache file name
+ */
+
+/**
+ * \brief Look up a cached section
+ * \param[in] name The section name
+ * \param[out] data The section data
+ * \return True if the section is present in the cache, false otherwise
+ */
+bool CapabilityCache::lookup(const std::string &name,
+			     std::vector<uint8_t> *data) const
+{
+	MutexLocker locker(dirtyCaches().mutex);
+
+	auto it = sections_.find(name);
+	if (it == sections_.end())
+		return false;
+
+	*data = it->second;
+	return true;
+}
+
+/**
+ * \brief Store a section in the cache
+ * \param[in] name The section name
+ * \param[in] data The section data
+ *
+ * The section replaces any existing section with the same \a name. The cache
+ * file is updated the next time the cache is flushed.
+ *
+ * \return 0 on success or a negative error code otherwise
+ */
+int CapabilityCache::store(const std::string &name, std::vector<uint8_t> data)
+{
+	DirtyCaches &dirty = dirtyCaches();
+	MutexLocker locker(dirty.mutex);
+
+	sections_[name] = std::move(data);
+	dirty_ = true;
+	dirty.caches.insert(this);
+
+	return 0;
+}
+
+/**
+ * \brief Write the sections stored since the last flush to the cache file
+ * \return 0 on success or a negative error code otherwise
+ */
+int CapabilityCache::flush()
+{
+	MutexLocker locker(dirtyCaches().mutex);
+	return flushLocked();
+}
+
+/**
+ * \brief Flush all caches that have sections not written to their file yet
+ *
+ * This function is meant to be called once all devices have been enumerated,
+ * to write each cache file once regardless of the number of sections stored.
+ */
+void CapabilityCache::flushAll()
+{
+	DirtyCaches &dirty = dirtyCaches();
+	MutexLocker locker(dirty.mutex);
+
+	std::set<CapabilityCache *> caches;
+	caches.swap(dirty.caches);
+
+	for (CapabilityCache *cache : caches)
+		cache->flushLocked();
+}
+
+/**
+ * \fn CapabilityCache::lookupFormats()
+ * \brief Look up cached format enumeration results
+ * \tparam Key The format key type, convertible to and from uint32_t
+ * \param[in] name The section name
+ * \param[out] formats The formats and their supported sizes
+ * \return True if valid formats were found in the cache, false otherwise
+ */
+
+/**
+ * \fn CapabilityCache::storeFormats()
+ * \brief Store format enumeration results in the cache
+ * \tparam Key The format key type, convertible to and from uint32_t
+ * \param[in] name The section name
+ * \param[in] formats The formats and their supported sizes
+ * \return 0 on success or a negative error code otherwise
+ */
+
+int CapabilityCache::load()
+{
+	File file(fileName_);
+	if (!file.exists())
+		return -ENOENT;
+
+	if (!file.open(File::ReadOnly))
+		return file.error();
+
+	Span<uint8_t> data = file.map(0, -1, File::MapPrivate);
+	if (data.empty())
+		return -EINVAL;
+
+	ByteStreamBuffer buffer(const_cast<const uint8_t *>(data.data()),
+				data.size());
+	std::map<std::string, std::vector<uint8_t>> sections;
+	uint32_t magic = 0;
+	uint32_t version = 0;
+	uint32_t size = 0;
+
+	buffer.read(&magic);
+	buffer.read(&version);
+	if (magic != kCacheMagic || version != kCacheVersion) {
+		LOG(CapabilityCache, Debug)
+			<< "Ignoring " << fileName_ << ": unsupported format";
+		return -EINVAL;
+	}
+
+	buffer.read(&size);
+	const char *key = buffer.read<char>(size);
+	if (!key || std::string(key, size) != key_) {
+		LOG(CapabilityCache, Debug)
+			<< "Ignoring " << fileName_ << ": stale key";
+		return -ESTALE;
+	}
+
+	uint32_t count = 0;
+	buffer.read(&count);
+
+	for (uint32_t i = 0; i < count; ++i) {
+		buffer.read(&size);
+		const char *name = buffer.read<char>(size);
+		if (!name)
+			break;
+
+		std::string section(name, size);
+
+		buffer.read(&size);
+		const uint8_t *content = buffer.read<uint8_t>(size);
+		if (!content)
+			break;
+
+		sections[section] = std::vector<uint8_t>(content, content + size);
+	}
+
+	if (buffer.overflow()) {
+		LOG(CapabilityCache, Warning)
+			<< "Ignoring " << fileName_ << ": file is corrupted";
+		return -EINVAL;
+	}
+
+	sections_ = std::move(sections);
+
+	LOG(CapabilityCache, Debug)
+		<< "Loaded " << sections_.size() << " sections from "
+		<< fileName_;
+
+	return 0;
+}
+
+int CapabilityCache::flushLocked()
+{
+	if (!dirty_)
+		return 0;
+
+	dirtyCaches().caches.erase(this);
+	dirty_ = false;
+
+	return save();
+}
+
+int CapabilityCache::save() const
+{
+	size_t size = sizeof(uint32_t) * 4 + key_.size();
+	for (const auto &section : sections_)
+		size += sizeof(uint32_t) * 2 + section.first.size()
+		      + section.second.size();
+
+	std::vector<uint8_t> data(size);
+	ByteStreamBuffer buffer(data.data(), data.size());
+
+	uint32_t value = kCacheMagic;
+	buffer.write(&value);
+	value = kCacheVersion;
+	buffer.write(&value);
+
+	value = key_.size();
+	buffer.write(&value);
+	buffer.write(Span<const char>(key_.data(), key_.size()));
+
+	value = sections_.size();
+	buffer.write(&value);
+
+	for (const auto &section : sections_) {
+		value = section.first.size();
+		buffer.write(&value);
+		buffer.write(Span<const char>(section.first.data(),
+					      section.first.size()));
+
+		value = section.second.size();
+		buffer.write(&value);
+		buffer.write(Span<const uint8_t>(section.second));
+	}
+
+	if (mkdir(directory().c_str(), 0700) < 0 && errno != EEXIST) {
+		int ret = -errno;
+		LOG(CapabilityCache, Error)
+			<< "Failed to create cache directory " << directory()
+			<< ": " << strerror(-ret);
+		return ret;
+	}
+
+	/*
+	 * Write to a temporary file and rename it, to guarantee that concurrent
+	 * readers only see complete cache files.
+	 */
+	std::string tmpName = fileName_ + "." + std::to_string(getpid());
+	unlink(tmpName.c_str());
+
+	File file(tmpName);
+	if (!file.open(File::WriteOnly)) {
+		LOG(CapabilityCache, Error)
+			<< "Failed to create " << tmpName << ": "
+			<< strerror(-file.error());
+		return file.error();
+	}
+
+	ssize_t ret = file.write(data);
+	file.close();
+
+	if (ret != static_cast<ssize_t>(data.size())) {
+		unlink(tmpName.c_str());
+		return ret < 0 ? ret : -EIO;
+	}
+
+	if (rename(tmpName.c_str(), fileName_.c_str()) < 0) {
+		ret = -errno;
+		unlink(tmpName.c_str());
+		return ret;
+	}
+
+	return 0;
+}
+
+} /* namespace libcamera */
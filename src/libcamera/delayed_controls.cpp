@@ -0,0 +1,299 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2020, Raspberry Pi (Trading) Ltd.
+ *
+ * delayed_controls.cpp - Helper to deal with controls that take effect with a delay
+ */
+
+#include "libcamera/internal/delayed_controls.h"
+
+#include <algorithm>
+
+#include "libcamera/internal/log.h"
+#include "libcamera/internal/utils.h"
+#include "libcamera/internal/v4l2_device.h"
+
+/**
+ * \file delayed_controls.h
+ * \brief Helper to deal with controls that take effect with a delay
+ */
+
+namespace libcamera {
+
+LOG_DEFINE_CATEGORY(DelayedControls)
+
+/**
+ * \class DelayedControls
+ * \brief Helper to deal with controls that take effect with a delay
+ *
+ * Some sensor controls take effect with a delay as the sensor needs time to
+ * adjust, for instance exposure and analog gain. This is a helper class to
+ * deal with such controls and the intended users are pipeline handlers.
+ *
+ * The idea is to extend the concept of the buffer pipeline depth the users
+ * needs to maintain (for example to reach full frame rate) to also cover
+ * controls. Just as with buffers, it's the user's responsibility to keep
+ * enough data queued to satisfy the requirements of the device.
+ *
+ * Controls are queued per frame with push(), and all controls queued together
+ * take effect on the same frame, regardless of their individual delays. The
+ * writes to the device are scheduled by applyControls(), which shall be called
+ * at the start of every frame with the frame sequence number, and batches all
+ * the controls due for that frame in a single call to
+ * V4L2Device::setControls(). The values in effect for a given frame can be
+ * retrieved with get().
+ *
+ * The class keeps a fixed size history of the control values indexed by
+ * frame. It doesn't perform any locking, and all its functions shall be
+ * called from the same thread.
+ */
+
+/**
+ * \brief Construct a DelayedControls instance
+ * \param[in] device The V4L2 device the controls have to be applied to
+ * \param[in] delays Map of the numerical V4L2 control ids to their associated
+ * delays (in frames)
+ *
+ * Only controls specified in \a delays are handled. If it's desired to mix
+ * delayed controls and controls that take effect immediately the immediate
+ * controls must be listed in the \a delays map with a delay value of 0.
+ */
+DelayedControls::DelayedControls(V4L2Device *device,
+				 const std::unordered_map<uint32_t, unsigned int> &delays)
+	: device_(device), maxDelay_(0), running_(false), firstSequence_(0),
+	  queueCount_(1), writeCount_(0)
+{
+	const ControlInfoMap &controls = device_->controls();
+	std::vector<uint32_t> ids;
+
+	for (const auto &[id, delay] : delays) {
+		if (controls.find(id) == controls.end()) {
+			LOG(DelayedControls, Error)
+				<< "Delay request for control id "
+				<< utils::hex(id)
+				<< " but control is not exposed by device "
+				<< device_->deviceNode();
+			continue;
+		}
+
+		LOG(DelayedControls, Debug)
+			<< "Set a delay of " << delay << " for control "
+			<< utils::hex(id);
+
+		controls_.push_back({ id, delay, {} });
+		ids.push_back(id);
+		maxDelay_ = std::max(maxDelay_, delay);
+	}
+
+	std::sort(controls_.begin(), controls_.end(),
+		  [](const Control &a, const Control &b) { return a.id < b.id; });
+
+	/* Start from the values currently programmed in the device. */
+	ControlList current = device_->getControls(ids);
+	for (Control &ctrl : controls_)
+		ctrl[0] = { current.get(ctrl.id), false };
+}
+
+/**
+ * \brief Reset state machine and write the latest values to the device
+ *
+ * Resets the state machine to a starting position based on the most recently
+ * queued control values, and writes all of them to the device. This shall be
+ * called before the device starts streaming, the values then take effect on
+ * the first frame.
+ *
+ * \return 0 on success or a negative error code otherwise
+ */
+int DelayedControls::reset()
+{
+	unsigned int latest = queueCount_ - 1;
+	ControlList controls(device_->controls());
+
+	for (Control &ctrl : controls_) {
+		Info info = ctrl[latest];
+		ctrl[0] = { info.value, false };
+
+		if (!info.value.isNone())
+			controls.set(ctrl.id, info.value);
+	}
+
+	running_ = false;
+	firstSequence_ = 0;
+	queueCount_ = 1;
+	writeCount_ = 0;
+
+	if (controls.empty())
+		return 0;
+
+	return device_->setControls(&controls);
+}
+
+/**
+ * \brief Push a set of controls on the queue
+ * \param[in] controls List of controls to add to the device queue
+ *
+ * Push a set of controls to the control queue. This increases the control
+ * queue depth by one. All controls in the set take effect on the same frame,
+ * and controls not part of the set keep their previous value.
+ *
+ * \return True if \a controls are accepted, or false otherwise
+ */
+bool DelayedControls::push(const ControlList &controls)
+{
+	/* Validate the whole set before queuing any of its controls. */
+	for (const auto &control : controls) {
+		auto it = std::find_if(controls_.begin(), controls_.end(),
+				       [&](const Control &ctrl) {
+					       return ctrl.id == control.first;
+				       });
+		if (it == controls_.end()) {
+			LOG(DelayedControls, Error)
+				<< "Unknown control " << utils::hex(control.first);
+			return false;
+		}
+	}
+
+	if (queueCount_ - writeCount_ >= kHistorySize - maxDelay_) {
+		LOG(DelayedControls, Error) << "Control queue overflow";
+		return false;
+	}
+
+	queue();
+
+	unsigned int index = queueCount_ - 1;
+	for (const auto &control : controls) {
+		for (Control &ctrl : controls_) {
+			if (ctrl.id != control.first)
+				continue;
+
+			ctrl[index] = { control.second, true };
+
+			LOG(DelayedControls, Debug)
+				<< "Queuing " << utils::hex(ctrl.id)
+				<< " to " << control.second.toString()
+				<< " at index " << index;
+			break;
+		}
+	}
+
+	return true;
+}
+
+/**
+ * \brief Read back controls in effect at a sequence number
+ * \param[in] sequence The sequence number to get controls for
+ *
+ * Read back what controls were in effect at a specific sequence number. The
+ * history is a ring buffer of limited size, allowing queries for sequence
+ * numbers that are at most a few frames older than the latest frame.
+ *
+ * \return The controls at \a sequence number
+ */
+ControlList DelayedControls::get(uint32_t sequence) const
+{
+	unsigned int adjusted = sequence - firstSequence_ + 1;
+	unsigned int index = adjusted > maxDelay_ ? adjusted - maxDelay_ : 0;
+
+	if (queueCount_ - index > kHistorySize)
+		LOG(DelayedControls, Warning)
+			<< "Controls for frame " << sequence
+			<< " are not available anymore";
+
+	ControlList out(device_->controls());
+	for (const Control &ctrl : controls_) {
+		const Info &info = ctrl[index];
+		if (info.value.isNone())
+			continue;
+
+		out.set(ctrl.id, info.value);
+
+		LOG(DelayedControls, Debug)
+			<< "Reading " << utils::hex(ctrl.id)
+			<< " to " << info.value.toString()
+			<< " at index " << index;
+	}
+
+	return out;
+}
+
+/**
+ * \brief Inform DelayedControls of the start of a new frame
+ * \param[in] sequence Sequence number of the frame that started
+ *
+ * Inform the state machine that a new frame has started and of its sequence
+ * number. Any user of these helpers is responsible to inform the helper about
+ * the start of any frame. This can be connected with ease to the start of an
+ * exposure (SOE) V4L2 event.
+ *
+ * All controls due to be written for the frame are applied to the device in a
+ * single batch. If frame start events have been missed, the most recent value
+ * queued in the skipped frames is written for each control.
+ *
+ * \return 0 on success or a negative error code otherwise
+ */
+int DelayedControls::applyControls(uint32_t sequence)
+{
+	LOG(DelayedControls, Debug) << "frame " << sequence << " started";
+
+	if (!running_) {
+		firstSequence_ = sequence;
+		running_ = true;
+	}
+
+	unsigned int previous = writeCount_;
+	writeCount_ = sequence - firstSequence_ + 1;
+
+	/*
+	 * Repeat the latest values if the user hasn't queued controls for the
+	 * frames written now.
+	 */
+	while (queueCount_ <= writeCount_)
+		queue();
+
+	/*
+	 * Peek ahead in the queue to write the values in time for their delay,
+	 * such that all controls queued together take effect on the same frame.
+	 */
+	ControlList out(device_->controls());
+	for (Control &ctrl : controls_) {
+		unsigned int offset = maxDelay_ - ctrl.delay;
+		unsigned int first = previous + 1 > offset ? previous + 1 - offset : 0;
+		unsigned int last = writeCount_ > offset ? writeCount_ - offset : 0;
+		bool updated = false;
+
+		for (unsigned int index = first; index <= last; ++index) {
+			Info &info = ctrl[index];
+			updated |= info.updated;
+			info.updated = false;
+		}
+
+		if (!updated)
+			continue;
+
+		const ControlValue &value = ctrl[last].value;
+		out.set(ctrl.id, value);
+
+		LOG(DelayedControls, Debug)
+			<< "Setting " << utils::hex(ctrl.id)
+			<< " to " << value.toString()
+			<< " at index " << last;
+	}
+
+	if (out.empty())
+		return 0;
+
+	return device_->setControls(&out);
+}
+
+/**
+ * \brief Queue a new frame with the values of the previous one
+ */
+void DelayedControls::queue()
+{
+	unsigned int index = queueCount_++;
+
+	for (Control &ctrl : controls_)
+		ctrl[index] = { ctrl[index - 1].value, false };
+}
+
+} /* namespace libcamera */
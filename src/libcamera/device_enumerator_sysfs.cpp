@@ -46,10 +46,16 @@ int DeviceEnumeratorSysfs::enumerate()
 			break;
 	}
 
+	/*
+	 * The media class directory is missing when no media device driver
+	 * has been loaded. This isn't an error, there is just no device to
+	 * enumerate, and cameras not backed by media devices can still be
+	 * used.
+	 */
 	if (!dir) {
-		LOG(DeviceEnumerator, Error)
+		LOG(DeviceEnumerator, Warning)
 			<< "No valid sysfs media device directory";
-		return -ENODEV;
+		return 0;
 	}
 
 	while ((ent = readdir(dir)) != nullptr) {
@@ -7,13 +7,14 @@
 
 #include "libcamera/internal/formats.h"
 
-#include <algorithm>
 #include <errno.h>
 
 #include <libcamera/formats.h>
 
 #include "libcamera/internal/log.h"
 
+#include "formats_info.h"
+
 /**
  * \file internal/formats.h
  * \brief Types and helper methods to handle libcamera image formats
@@ -141,522 +142,123 @@ LOG_DEFINE_CATEGORY(Formats)
 
 namespace {
 
-const PixelFormatInfo pixelFormatInfoInvalid{};
-
-const std::map<PixelFormat, PixelFormatInfo> pixelFormatInfo{
-	/* RGB formats. */
-	{ formats::RGB565, {
-		.name = "RGB565",
-		.format = formats::RGB565,
-		.v4l2Format = V4L2PixelFormat(V4L2_PIX_FMT_RGB565),
-		.bitsPerPixel = 16,
-		.colourEncoding = PixelFormatInfo::ColourEncodingRGB,
-		.packed = false,
-		.pixelsPerGroup = 1,
-		.planes = {{ { 3, 1 }, { 0, 0 }, { 0, 0 } }},
-	} },
-	{ formats::BGR888, {
-		.name = "BGR888",
-		.format = formats::BGR888,
-		.v4l2Format = V4L2PixelFormat(V4L2_PIX_FMT_RGB24),
-		.bitsPerPixel = 24,
-		.colourEncoding = PixelFormatInfo::ColourEncodingRGB,
-		.packed = false,
-		.pixelsPerGroup = 1,
-		.planes = {{ { 3, 1 }, { 0, 0 }, { 0, 0 } }},
-	} },
-	{ formats::RGB888, {
-		.name = "RGB888",
-		.format = formats::RGB888,
-		.v4l2Format = V4L2PixelFormat(V4L2_PIX_FMT_BGR24),
-		.bitsPerPixel = 24,
-		.colourEncoding = PixelFormatInfo::ColourEncodingRGB,
-		.packed = false,
-		.pixelsPerGroup = 1,
-		.planes = {{ { 3, 1 }, { 0, 0 }, { 0, 0 } }},
-	} },
-	{ formats::ABGR8888, {
-		.name = "ABGR8888",
-		.format = formats::ABGR8888,
-		.v4l2Format = V4L2PixelFormat(V4L2_PIX_FMT_RGBA32),
-		.bitsPerPixel = 32,
-		.colourEncoding = PixelFormatInfo::ColourEncodingRGB,
-		.packed = false,
-		.pixelsPerGroup = 1,
-		.planes = {{ { 4, 1 }, { 0, 0 }, { 0, 0 } }},
-	} },
-	{ formats::ARGB8888, {
-		.name = "ARGB8888",
-		.format = formats::ARGB8888,
-		.v4l2Format = V4L2PixelFormat(V4L2_PIX_FMT_ABGR32),
-		.bitsPerPixel = 32,
-		.colourEncoding = PixelFormatInfo::ColourEncodingRGB,
-		.packed = false,
-		.pixelsPerGroup = 1,
-		.planes = {{ { 4, 1 }, { 0, 0 }, { 0, 0 } }},
-	} },
-	{ formats::BGRA8888, {
-		.name = "BGRA8888",
-		.format = formats::BGRA8888,
-		.v4l2Format = V4L2PixelFormat(V4L2_PIX_FMT_ARGB32),
-		.bitsPerPixel = 32,
-		.colourEncoding = PixelFormatInfo::ColourEncodingRGB,
-		.packed = false,
-		.pixelsPerGroup = 1,
-		.planes = {{ { 4, 1 }, { 0, 0 }, { 0, 0 } }},
-	} },
-	{ formats::RGBA8888, {
-		.name = "RGBA8888",
-		.format = formats::RGBA8888,
-		.v4l2Format = V4L2PixelFormat(V4L2_PIX_FMT_BGRA32),
-		.bitsPerPixel = 32,
-		.colourEncoding = PixelFormatInfo::ColourEncodingRGB,
-		.packed = false,
-		.pixelsPerGroup = 1,
-		.planes = {{ { 4, 1 }, { 0, 0 }, { 0, 0 } }},
-	} },
-
-	/* YUV packed formats. */
-	{ formats::YUYV, {
-		.name = "YUYV",
-		.format = formats::YUYV,
-		.v4l2Format = V4L2PixelFormat(V4L2_PIX_FMT_YUYV),
-		.bitsPerPixel = 16,
-		.colourEncoding = PixelFormatInfo::ColourEncodingYUV,
-		.packed = false,
-		.pixelsPerGroup = 2,
-		.planes = {{ { 4, 1 }, { 0, 0 }, { 0, 0 } }},
-	} },
-	{ formats::YVYU, {
-		.name = "YVYU",
-		.format = formats::YVYU,
-		.v4l2Format = V4L2PixelFormat(V4L2_PIX_FMT_YVYU),
-		.bitsPerPixel = 16,
-		.colourEncoding = PixelFormatInfo::ColourEncodingYUV,
-		.packed = false,
-		.pixelsPerGroup = 2,
-		.planes = {{ { 4, 1 }, { 0, 0 }, { 0, 0 } }},
-	} },
-	{ formats::UYVY, {
-		.name = "UYVY",
-		.format = formats::UYVY,
-		.v4l2Format = V4L2PixelFormat(V4L2_PIX_FMT_UYVY),
-		.bitsPerPixel = 16,
-		.colourEncoding = PixelFormatInfo::ColourEncodingYUV,
-		.packed = false,
-		.pixelsPerGroup = 2,
-		.planes = {{ { 4, 1 }, { 0, 0 }, { 0, 0 } }},
-	} },
-	{ formats::VYUY, {
-		.name = "VYUY",
-		.format = formats::VYUY,
-		.v4l2Format = V4L2PixelFormat(V4L2_PIX_FMT_VYUY),
-		.bitsPerPixel = 16,
-		.colourEncoding = PixelFormatInfo::ColourEncodingYUV,
-		.packed = false,
-		.pixelsPerGroup = 2,
-		.planes = {{ { 4, 1 }, { 0, 0 }, { 0, 0 } }},
-	} },
-
-	/* YUV planar formats. */
-	{ formats::NV12, {
-		.name = "NV12",
-		.format = formats::NV12,
-		.v4l2Format = V4L2PixelFormat(V4L2_PIX_FMT_NV12),
-		.bitsPerPixel = 12,
-		.colourEncoding = PixelFormatInfo::ColourEncodingYUV,
-		.packed = false,
-		.pixelsPerGroup = 2,
-		.planes = {{ { 2, 1 }, { 2, 2 }, { 0, 0 } }},
-	} },
-	{ formats::NV21, {
-		.name = "NV21",
-		.format = formats::NV21,
-		.v4l2Format = V4L2PixelFormat(V4L2_PIX_FMT_NV21),
-		.bitsPerPixel = 12,
-		.colourEncoding = PixelFormatInfo::ColourEncodingYUV,
-		.packed = false,
-		.pixelsPerGroup = 2,
-		.planes = {{ { 2, 1 }, { 2, 2 }, { 0, 0 } }},
-	} },
-	{ formats::NV16, {
-		.name = "NV16",
-		.format = formats::NV16,
-		.v4l2Format = V4L2PixelFormat(V4L2_PIX_FMT_NV16),
-		.bitsPerPixel = 16,
-		.colourEncoding = PixelFormatInfo::ColourEncodingYUV,
-		.packed = false,
-		.pixelsPerGroup = 2,
-		.planes = {{ { 2, 1 }, { 2, 1 }, { 0, 0 } }},
-	} },
-	{ formats::NV61, {
-		.name = "NV61",
-		.format = formats::NV61,
-		.v4l2Format = V4L2PixelFormat(V4L2_PIX_FMT_NV61),
-		.bitsPerPixel = 16,
-		.colourEncoding = PixelFormatInfo::ColourEncodingYUV,
-		.packed = false,
-		.pixelsPerGroup = 2,
-		.planes = {{ { 2, 1 }, { 2, 1 }, { 0, 0 } }},
-	} },
-	{ formats::NV24, {
-		.name = "NV24",
-		.format = formats::NV24,
-		.v4l2Format = V4L2PixelFormat(V4L2_PIX_FMT_NV24),
-		.bitsPerPixel = 24,
-		.colourEncoding = PixelFormatInfo::ColourEncodingYUV,
-		.packed = false,
-		.pixelsPerGroup = 1,
-		.planes = {{ { 1, 1 }, { 2, 1 }, { 0, 0 } }},
-	} },
-	{ formats::NV42, {
-		.name = "NV42",
-		.format = formats::NV42,
-		.v4l2Format = V4L2PixelFormat(V4L2_PIX_FMT_NV42),
-		.bitsPerPixel = 24,
-		.colourEncoding = PixelFormatInfo::ColourEncodingYUV,
-		.packed = false,
-		.pixelsPerGroup = 1,
-		.planes = {{ { 1, 1 }, { 2, 1 }, { 0, 0 } }},
-	} },
-	{ formats::YUV420, {
-		.name = "YUV420",
-		.format = formats::YUV420,
-		.v4l2Format = V4L2PixelFormat(V4L2_PIX_FMT_YUV420),
-		.bitsPerPixel = 12,
-		.colourEncoding = PixelFormatInfo::ColourEncodingYUV,
-		.packed = false,
-		.pixelsPerGroup = 2,
-		.planes = {{ { 2, 1 }, { 1, 2 }, { 1, 2 } }},
-	} },
-	{ formats::YVU420, {
-		.name = "YVU420",
-		.format = formats::YVU420,
-		.v4l2Format = V4L2PixelFormat(V4L2_PIX_FMT_YVU420),
-		.bitsPerPixel = 12,
-		.colourEncoding = PixelFormatInfo::ColourEncodingYUV,
-		.packed = false,
-		.pixelsPerGroup = 2,
-		.planes = {{ { 2, 1 }, { 1, 2 }, { 1, 2 } }},
-	} },
-	{ formats::YUV422, {
-		.name = "YUV422",
-		.format = formats::YUV422,
-		.v4l2Format = V4L2PixelFormat(V4L2_PIX_FMT_YUV422P),
-		.bitsPerPixel = 16,
-		.colourEncoding = PixelFormatInfo::ColourEncodingYUV,
-		.packed = false,
-		.pixelsPerGroup = 2,
-		.planes = {{ { 2, 1 }, { 1, 1 }, { 1, 1 } }},
-	} },
-
-	/* Greyscale formats. */
-	{ formats::R8, {
-		.name = "R8",
-		.format = formats::R8,
-		.v4l2Format = V4L2PixelFormat(V4L2_PIX_FMT_GREY),
-		.bitsPerPixel = 8,
-		.colourEncoding = PixelFormatInfo::ColourEncodingYUV,
-		.packed = false,
-		.pixelsPerGroup = 1,
-		.planes = {{ { 1, 1 }, { 0, 0 }, { 0, 0 } }},
-	} },
-
-	/* Bayer formats. */
-	{ formats::SBGGR8, {
-		.name = "SBGGR8",
-		.format = formats::SBGGR8,
-		.v4l2Format = V4L2PixelFormat(V4L2_PIX_FMT_SBGGR8),
-		.bitsPerPixel = 8,
-		.colourEncoding = PixelFormatInfo::ColourEncodingRAW,
-		.packed = false,
-		.pixelsPerGroup = 2,
-		.planes = {{ { 2, 1 }, { 0, 0 }, { 0, 0 } }},
-	} },
-	{ formats::SGBRG8, {
-		.name = "SGBRG8",
-		.format = formats::SGBRG8,
-		.v4l2Format = V4L2PixelFormat(V4L2_PIX_FMT_SGBRG8),
-		.bitsPerPixel = 8,
-		.colourEncoding = PixelFormatInfo::ColourEncodingRAW,
-		.packed = false,
-		.pixelsPerGroup = 2,
-		.planes = {{ { 2, 1 }, { 0, 0 }, { 0, 0 } }},
-	} },
-	{ formats::SGRBG8, {
-		.name = "SGRBG8",
-		.format = formats::SGRBG8,
-		.v4l2Format = V4L2PixelFormat(V4L2_PIX_FMT_SGRBG8),
-		.bitsPerPixel = 8,
-		.colourEncoding = PixelFormatInfo::ColourEncodingRAW,
-		.packed = false,
-		.pixelsPerGroup = 2,
-		.planes = {{ { 2, 1 }, { 0, 0 }, { 0, 0 } }},
-	} },
-	{ formats::SRGGB8, {
-		.name = "SRGGB8",
-		.format = formats::SRGGB8,
-		.v4l2Format = V4L2PixelFormat(V4L2_PIX_FMT_SRGGB8),
-		.bitsPerPixel = 8,
-		.colourEncoding = PixelFormatInfo::ColourEncodingRAW,
-		.packed = false,
-		.pixelsPerGroup = 2,
-		.planes = {{ { 2, 1 }, { 0, 0 }, { 0, 0 } }},
-	} },
-	{ formats::SBGGR10, {
-		.name = "SBGGR10",
-		.format = formats::SBGGR10,
-		.v4l2Format = V4L2PixelFormat(V4L2_PIX_FMT_SBGGR10),
-		.bitsPerPixel = 10,
-		.colourEncoding = PixelFormatInfo::ColourEncodingRAW,
-		.packed = false,
-		.pixelsPerGroup = 2,
-		.planes = {{ { 4, 1 }, { 0, 0 }, { 0, 0 } }},
-	} },
-	{ formats::SGBRG10, {
-		.name = "SGBRG10",
-		.format = formats::SGBRG10,
-		.v4l2Format = V4L2PixelFormat(V4L2_PIX_FMT_SGBRG10),
-		.bitsPerPixel = 10,
-		.colourEncoding = PixelFormatInfo::ColourEncodingRAW,
-		.packed = false,
-		.pixelsPerGroup = 2,
-		.planes = {{ { 4, 1 }, { 0, 0 }, { 0, 0 } }},
-	} },
-	{ formats::SGRBG10, {
-		.name = "SGRBG10",
-		.format = formats::SGRBG10,
-		.v4l2Format = V4L2PixelFormat(V4L2_PIX_FMT_SGRBG10),
-		.bitsPerPixel = 10,
-		.colourEncoding = PixelFormatInfo::ColourEncodingRAW,
-		.packed = false,
-		.pixelsPerGroup = 2,
-		.planes = {{ { 4, 1 }, { 0, 0 }, { 0, 0 } }},
-	} },
-	{ formats::SRGGB10, {
-		.name = "SRGGB10",
-		.format = formats::SRGGB10,
-		.v4l2Format = V4L2PixelFormat(V4L2_PIX_FMT_SRGGB10),
-		.bitsPerPixel = 10,
-		.colourEncoding = PixelFormatInfo::ColourEncodingRAW,
-		.packed = false,
-		.pixelsPerGroup = 2,
-		.planes = {{ { 4, 1 }, { 0, 0 }, { 0, 0 } }},
-	} },
-	{ formats::SBGGR10_CSI2P, {
-		.name = "SBGGR10_CSI2P",
-		.format = formats::SBGGR10_CSI2P,
-		.v4l2Format = V4L2PixelFormat(V4L2_PIX_FMT_SBGGR10P),
-		.bitsPerPixel = 10,
-		.colourEncoding = PixelFormatInfo::ColourEncodingRAW,
-		.packed = true,
-		.pixelsPerGroup = 4,
-		.planes = {{ { 5, 1 }, { 0, 0 }, { 0, 0 } }},
-	} },
-	{ formats::SGBRG10_CSI2P, {
-		.name = "SGBRG10_CSI2P",
-		.format = formats::SGBRG10_CSI2P,
-		.v4l2Format = V4L2PixelFormat(V4L2_PIX_FMT_SGBRG10P),
-		.bitsPerPixel = 10,
-		.colourEncoding = PixelFormatInfo::ColourEncodingRAW,
-		.packed = true,
-		.pixelsPerGroup = 4,
-		.planes = {{ { 5, 1 }, { 0, 0 }, { 0, 0 } }},
-	} },
-	{ formats::SGRBG10_CSI2P, {
-		.name = "SGRBG10_CSI2P",
-		.format = formats::SGRBG10_CSI2P,
-		.v4l2Format = V4L2PixelFormat(V4L2_PIX_FMT_SGRBG10P),
-		.bitsPerPixel = 10,
-		.colourEncoding = PixelFormatInfo::ColourEncodingRAW,
-		.packed = true,
-		.pixelsPerGroup = 4,
-		.planes = {{ { 5, 1 }, { 0, 0 }, { 0, 0 } }},
-	} },
-	{ formats::SRGGB10_CSI2P, {
-		.name = "SRGGB10_CSI2P",
-		.format = formats::SRGGB10_CSI2P,
-		.v4l2Format = V4L2PixelFormat(V4L2_PIX_FMT_SRGGB10P),
-		.bitsPerPixel = 10,
-		.colourEncoding = PixelFormatInfo::ColourEncodingRAW,
-		.packed = true,
-		.pixelsPerGroup = 4,
-		.planes = {{ { 5, 1 }, { 0, 0 }, { 0, 0 } }},
-	} },
-	{ formats::SBGGR12, {
-		.name = "SBGGR12",
-		.format = formats::SBGGR12,
-		.v4l2Format = V4L2PixelFormat(V4L2_PIX_FMT_SBGGR12),
-		.bitsPerPixel = 12,
-		.colourEncoding = PixelFormatInfo::ColourEncodingRAW,
-		.packed = false,
-		.pixelsPerGroup = 2,
-		.planes = {{ { 4, 1 }, { 0, 0 }, { 0, 0 } }},
-	} },
-	{ formats::SGBRG12, {
-		.name = "SGBRG12",
-		.format = formats::SGBRG12,
-		.v4l2Format = V4L2PixelFormat(V4L2_PIX_FMT_SGBRG12),
-		.bitsPerPixel = 12,
-		.colourEncoding = PixelFormatInfo::ColourEncodingRAW,
-		.packed = false,
-		.pixelsPerGroup = 2,
-		.planes = {{ { 4, 1 }, { 0, 0 }, { 0, 0 } }},
-	} },
-	{ formats::SGRBG12, {
-		.name = "SGRBG12",
-		.format = formats::SGRBG12,
-		.v4l2Format = V4L2PixelFormat(V4L2_PIX_FMT_SGRBG12),
-		.bitsPerPixel = 12,
-		.colourEncoding = PixelFormatInfo::ColourEncodingRAW,
-		.packed = false,
-		.pixelsPerGroup = 2,
-		.planes = {{ { 4, 1 }, { 0, 0 }, { 0, 0 } }},
-	} },
-	{ formats::SRGGB12, {
-		.name = "SRGGB12",
-		.format = formats::SRGGB12,
-		.v4l2Format = V4L2PixelFormat(V4L2_PIX_FMT_SRGGB12),
-		.bitsPerPixel = 12,
-		.colourEncoding = PixelFormatInfo::ColourEncodingRAW,
-		.packed = false,
-		.pixelsPerGroup = 2,
-		.planes = {{ { 4, 1 }, { 0, 0 }, { 0, 0 } }},
-	} },
-	{ formats::SBGGR12_CSI2P, {
-		.name = "SBGGR12_CSI2P",
-		.format = formats::SBGGR12_CSI2P,
-		.v4l2Format = V4L2PixelFormat(V4L2_PIX_FMT_SBGGR12P),
-		.bitsPerPixel = 12,
-		.colourEncoding = PixelFormatInfo::ColourEncodingRAW,
-		.packed = true,
-		.pixelsPerGroup = 2,
-		.planes = {{ { 3, 1 }, { 0, 0 }, { 0, 0 } }},
-	} },
-	{ formats::SGBRG12_CSI2P, {
-		.name = "SGBRG12_CSI2P",
-		.format = formats::SGBRG12_CSI2P,
-		.v4l2Format = V4L2PixelFormat(V4L2_PIX_FMT_SGBRG12P),
-		.bitsPerPixel = 12,
-		.colourEncoding = PixelFormatInfo::ColourEncodingRAW,
-		.packed = true,
-		.pixelsPerGroup = 2,
-		.planes = {{ { 3, 1 }, { 0, 0 }, { 0, 0 } }},
-	} },
-	{ formats::SGRBG12_CSI2P, {
-		.name = "SGRBG12_CSI2P",
-		.format = formats::SGRBG12_CSI2P,
-		.v4l2Format = V4L2PixelFormat(V4L2_PIX_FMT_SGRBG12P),
-		.bitsPerPixel = 12,
-		.colourEncoding = PixelFormatInfo::ColourEncodingRAW,
-		.packed = true,
-		.pixelsPerGroup = 2,
-		.planes = {{ { 3, 1 }, { 0, 0 }, { 0, 0 } }},
-	} },
-	{ formats::SRGGB12_CSI2P, {
-		.name = "SRGGB12_CSI2P",
-		.format = formats::SRGGB12_CSI2P,
-		.v4l2Format = V4L2PixelFormat(V4L2_PIX_FMT_SRGGB12P),
-		.bitsPerPixel = 12,
-		.colourEncoding = PixelFormatInfo::ColourEncodingRAW,
-		.packed = true,
-		.pixelsPerGroup = 2,
-		.planes = {{ { 3, 1 }, { 0, 0 }, { 0, 0 } }},
-	} },
-	{ formats::SBGGR16, {
-		.name = "SBGGR16",
-		.format = formats::SBGGR16,
-		.v4l2Format = V4L2PixelFormat(V4L2_PIX_FMT_SBGGR16),
-		.bitsPerPixel = 16,
-		.colourEncoding = PixelFormatInfo::ColourEncodingRAW,
-		.packed = false,
-		.pixelsPerGroup = 2,
-		.planes = {{ { 4, 1 }, { 0, 0 }, { 0, 0 } }},
-	} },
-	{ formats::SGBRG16, {
-		.name = "SGBRG16",
-		.format = formats::SGBRG16,
-		.v4l2Format = V4L2PixelFormat(V4L2_PIX_FMT_SGBRG16),
-		.bitsPerPixel = 16,
-		.colourEncoding = PixelFormatInfo::ColourEncodingRAW,
-		.packed = false,
-		.pixelsPerGroup = 2,
-		.planes = {{ { 4, 1 }, { 0, 0 }, { 0, 0 } }},
-	} },
-	{ formats::SGRBG16, {
-		.name = "SGRBG16",
-		.format = formats::SGRBG16,
-		.v4l2Format = V4L2PixelFormat(V4L2_PIX_FMT_SGRBG16),
-		.bitsPerPixel = 16,
-		.colourEncoding = PixelFormatInfo::ColourEncodingRAW,
-		.packed = false,
-		.pixelsPerGroup = 2,
-		.planes = {{ { 4, 1 }, { 0, 0 }, { 0, 0 } }},
-	} },
-	{ formats::SRGGB16, {
-		.name = "SRGGB16",
-		.format = formats::SRGGB16,
-		.v4l2Format = V4L2PixelFormat(V4L2_PIX_FMT_SRGGB16),
-		.bitsPerPixel = 16,
-		.colourEncoding = PixelFormatInfo::ColourEncodingRAW,
-		.packed = false,
-		.pixelsPerGroup = 2,
-		.planes = {{ { 4, 1 }, { 0, 0 }, { 0, 0 } }},
-	} },
-	{ formats::SBGGR10_IPU3, {
-		.name = "SBGGR10_IPU3",
-		.format = formats::SBGGR10_IPU3,
-		.v4l2Format = V4L2PixelFormat(V4L2_PIX_FMT_IPU3_SBGGR10),
-		.bitsPerPixel = 10,
-		.colourEncoding = PixelFormatInfo::ColourEncodingRAW,
-		.packed = true,
-		/* \todo remember to double this in the ipu3 pipeline handler */
-		.pixelsPerGroup = 25,
-		.planes = {{ { 32, 1 }, { 0, 0 }, { 0, 0 } }},
-	} },
-	{ formats::SGBRG10_IPU3, {
-		.name = "SGBRG10_IPU3",
-		.format = formats::SGBRG10_IPU3,
-		.v4l2Format = V4L2PixelFormat(V4L2_PIX_FMT_IPU3_SGBRG10),
-		.bitsPerPixel = 10,
-		.colourEncoding = PixelFormatInfo::ColourEncodingRAW,
-		.packed = true,
-		.pixelsPerGroup = 25,
-		.planes = {{ { 32, 1 }, { 0, 0 }, { 0, 0 } }},
-	} },
-	{ formats::SGRBG10_IPU3, {
-		.name = "SGRBG10_IPU3",
-		.format = formats::SGRBG10_IPU3,
-		.v4l2Format = V4L2PixelFormat(V4L2_PIX_FMT_IPU3_SGRBG10),
-		.bitsPerPixel = 10,
-		.colourEncoding = PixelFormatInfo::ColourEncodingRAW,
-		.packed = true,
-		.pixelsPerGroup = 25,
-		.planes = {{ { 32, 1 }, { 0, 0 }, { 0, 0 } }},
-	} },
-	{ formats::SRGGB10_IPU3, {
-		.name = "SRGGB10_IPU3",
-		.format = formats::SRGGB10_IPU3,
-		.v4l2Format = V4L2PixelFormat(V4L2_PIX_FMT_IPU3_SRGGB10),
-		.bitsPerPixel = 10,
-		.colourEncoding = PixelFormatInfo::ColourEncodingRAW,
-		.packed = true,
-		.pixelsPerGroup = 25,
-		.planes = {{ { 32, 1 }, { 0, 0 }, { 0, 0 } }},
-	} },
-
-	/* Compressed formats. */
-	{ formats::MJPEG, {
-		.name = "MJPEG",
-		.format = formats::MJPEG,
-		.v4l2Format = V4L2PixelFormat(V4L2_PIX_FMT_MJPEG),
-		.bitsPerPixel = 0,
-		.colourEncoding = PixelFormatInfo::ColourEncodingYUV,
-		.packed = false,
-		.pixelsPerGroup = 1,
-		.planes = {{ { 1, 1 }, { 0, 0 }, { 0, 0 } }},
-	} },
-};
+constexpr PixelFormatInfo pixelFormatInfoInvalid{};
+
+/*
+ * The pixel format information table is generated from formats.yaml at build
+ * time, sorted by pixel format, along with indexes sorted by V4L2 pixel format
+ * and by name. All lookups are binary searches, and can be evaluated in
+ * constant expressions.
+ */
+
+constexpr bool pixelFormatLess(const PixelFormat &a, const PixelFormat &b)
+{
+	if (a.fourcc() != b.fourcc())
+		return a.fourcc() < b.fourcc();
+	return a.modifier() < b.modifier();
+}
+
+constexpr int compareNames(const char *a, const char *b)
+{
+	while (*a && *a == *b) {
+		a++;
+		b++;
+	}
+
+	return static_cast<unsigned char>(*a) - static_cast<unsigned char>(*b);
+}
+
+constexpr bool pixelFormatInfoSorted()
+{
+	for (unsigned int i = 1; i < pixelFormatInfo.size(); ++i) {
+		if (!pixelFormatLess(pixelFormatInfo[i - 1].format,
+				     pixelFormatInfo[i].format))
+			return false;
+
+		const PixelFormatInfo &prevV4L2 = pixelFormatInfo[pixelFormatInfoByV4L2[i - 1]];
+		const PixelFormatInfo &nextV4L2 = pixelFormatInfo[pixelFormatInfoByV4L2[i]];
+		if (prevV4L2.v4l2Format.fourcc() > nextV4L2.v4l2Format.fourcc())
+			return false;
+
+		const PixelFormatInfo &prevName = pixelFormatInfo[pixelFormatInfoByName[i - 1]];
+		const PixelFormatInfo &nextName = pixelFormatInfo[pixelFormatInfoByName[i]];
+		if (compareNames(prevName.name, nextName.name) >= 0)
+			return false;
+	}
+
+	return true;
+}
+
+static_assert(pixelFormatInfoSorted(),
+	      "The pixel format information table is not sorted");
+
+constexpr const PixelFormatInfo &findInfo(const PixelFormat &format)
+{
+	unsigned int first = 0;
+	unsigned int last = pixelFormatInfo.size();
+
+	while (first < last) {
+		unsigned int mid = (first + last) / 2;
+		if (pixelFormatLess(pixelFormatInfo[mid].format, format))
+			first = mid + 1;
+		else
+			last = mid;
+	}
+
+	if (first == pixelFormatInfo.size() ||
+	    pixelFormatLess(format, pixelFormatInfo[first].format))
+		return pixelFormatInfoInvalid;
+
+	return pixelFormatInfo[first];
+}
+
+constexpr const PixelFormatInfo &findInfo(const V4L2PixelFormat &format)
+{
+	unsigned int first = 0;
+	unsigned int last = pixelFormatInfoByV4L2.size();
+
+	while (first < last) {
+		unsigned int mid = (first + last) / 2;
+		const PixelFormatInfo &info = pixelFormatInfo[pixelFormatInfoByV4L2[mid]];
+		if (info.v4l2Format.fourcc() < format.fourcc())
+			first = mid + 1;
+		else
+			last = mid;
+	}
+
+	if (first == pixelFormatInfoByV4L2.size())
+		return pixelFormatInfoInvalid;
+
+	const PixelFormatInfo &info = pixelFormatInfo[pixelFormatInfoByV4L2[first]];
+	if (info.v4l2Format.fourcc() != format.fourcc())
+		return pixelFormatInfoInvalid;
+
+	return info;
+}
+
+constexpr const PixelFormatInfo &findInfo(const char *name)
+{
+	unsigned int first = 0;
+	unsigned int last = pixelFormatInfoByName.size();
+
+	while (first < last) {
+		unsigned int mid = (first + last) / 2;
+		const PixelFormatInfo &info = pixelFormatInfo[pixelFormatInfoByName[mid]];
+		if (compareNames(info.name, name) < 0)
+			first = mid + 1;
+		else
+			last = mid;
+	}
+
+	if (first == pixelFormatInfoByName.size())
+		return pixelFormatInfoInvalid;
+
+	const PixelFormatInfo &info = pixelFormatInfo[pixelFormatInfoByName[first]];
+	if (compareNames(info.name, name))
+		return pixelFormatInfoInvalid;
+
+	return info;
+}
 
 } /* namespace */
 
@@ -674,15 +276,13 @@ const std::map<PixelFormat, PixelFormatInfo> pixelFormatInfo{
  */
 const PixelFormatInfo &PixelFormatInfo::info(const PixelFormat &format)
 {
-	const auto iter = pixelFormatInfo.find(format);
-	if (iter == pixelFormatInfo.end()) {
+	const PixelFormatInfo &info = findInfo(format);
+	if (!info.isValid())
 		LOG(Formats, Warning)
 			<< "Unsupported pixel format 0x"
 			<< utils::hex(format.fourcc());
-		return pixelFormatInfoInvalid;
-	}
 
-	return iter->second;
+	return info;
 }
 
 /**
@@ -693,14 +293,7 @@ const PixelFormatInfo &PixelFormatInfo::info(const PixelFormat &format)
  */
 const PixelFormatInfo &PixelFormatInfo::info(const V4L2PixelFormat &format)
 {
-	const auto &info = std::find_if(pixelFormatInfo.begin(), pixelFormatInfo.end(),
-					[format](auto pair) {
-						return pair.second.v4l2Format == format;
-					});
-	if (info == pixelFormatInfo.end())
-		return pixelFormatInfoInvalid;
-
-	return info->second;
+	return findInfo(format);
 }
 
 /**
@@ -711,12 +304,7 @@ const PixelFormatInfo &PixelFormatInfo::info(const V4L2PixelFormat &format)
  */
 const PixelFormatInfo &PixelFormatInfo::info(const std::string &name)
 {
-	for (const auto &info : pixelFormatInfo) {
-		if (info.second.name == name)
-			return info.second;
-	}
-
-	return pixelFormatInfoInvalid;
+	return findInfo(name.c_str());
 }
 
 /**
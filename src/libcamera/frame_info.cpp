@@ -0,0 +1,256 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2020, Google Inc.
+ *
+ * frame_info.cpp - Per-frame information tracking for pipeline handlers
+ */
+
+#include "libcamera/internal/frame_info.h"
+
+#include <stdint.h>
+
+/**
+ * \file frame_info.h
+ * \brief Per-frame information tracking for pipeline handlers
+ */
+
+namespace libcamera {
+
+/**
+ * \class FrameInfoIndex
+ * \brief Fixed size hash index from object pointers to integer values
+ *
+ * The FrameInfoIndex is the lookup structure backing the FrameInfoTable. It
+ * maps pointers, such as requests and buffers, to small integer values using
+ * open addressing with linear probing. The storage is allocated at
+ * construction time, insertions and removals don't allocate memory, and all
+ * operations run in constant time on average.
+ */
+
+/**
+ * \brief Construct an index for up to \a size keys
+ * \param[in] size The maximum number of keys stored in the index
+ *
+ * The index is sized to keep its load factor at or below one half, which
+ * keeps probe sequences short.
+ */
+FrameInfoIndex::FrameInfoIndex(unsigned int size)
+	: count_(0)
+{
+	unsigned int capacity = 2;
+	while (capacity < size * 2)
+		capacity <<= 1;
+
+	entries_.resize(capacity, { nullptr, 0 });
+	mask_ = capacity - 1;
+}
+
+/**
+ * \brief Insert a key in the index
+ * \param[in] key The key
+ * \param[in] value The value associated with the \a key
+ * \return 0 on success or a negative error code otherwise
+ * \retval -EEXIST The key is already present in the index
+ * \retval -ENOSPC The index is full
+ */
+int FrameInfoIndex::insert(const void *key, unsigned int value)
+{
+	if (find(key) >= 0)
+		return -EEXIST;
+
+	if (count_ * 2 >= entries_.size())
+		return -ENOSPC;
+
+	unsigned int i = hash(key);
+	while (entries_[i].first)
+		i = (i + 1) & mask_;
+
+	entries_[i] = { key, value };
+	count_++;
+
+	return 0;
+}
+
+/**
+ * \brief Remove a key from the index
+ * \param[in] key The key
+ *
+ * Removing a key not present in the index has no effect.
+ */
+void FrameInfoIndex::remove(const void *key)
+{
+	unsigned int i = hash(key);
+	while (entries_[i].first != key) {
+		if (!entries_[i].first)
+			return;
+		i = (i + 1) & mask_;
+	}
+
+	entries_[i].first = nullptr;
+	count_--;
+
+	/*
+	 * Shift the following entries of the probe sequence back to fill the
+	 * hole, to keep all keys reachable without using tombstones.
+	 */
+	unsigned int j = i;
+	while (true) {
+		j = (j + 1) & mask_;
+		if (!entries_[j].first)
+			break;
+
+		unsigned int k = hash(entries_[j].first);
+		bool reachable = i <= j ? (i < k && k <= j) : (i < k || k <= j);
+		if (reachable)
+			continue;
+
+		entries_[i] = entries_[j];
+		entries_[j].first = nullptr;
+		i = j;
+	}
+}
+
+/**
+ * \brief Find the value associated with a key
+ * \param[in] key The key
+ * \return The value associated with \a key, or a negative error code if the
+ * key isn't present in the index
+ */
+int FrameInfoIndex::find(const void *key) const
+{
+	unsigned int i = hash(key);
+	while (entries_[i].first) {
+		if (entries_[i].first == key)
+			return entries_[i].second;
+		i = (i + 1) & mask_;
+	}
+
+	return -ENOENT;
+}
+
+/**
+ * \brief Remove all keys from the index
+ */
+void FrameInfoIndex::clear()
+{
+	for (auto &entry : entries_)
+		entry.first = nullptr;
+
+	count_ = 0;
+}
+
+unsigned int FrameInfoIndex::hash(const void *key) const
+{
+	/* Objects are at least 8 bytes aligned, drop the low order bits. */
+	uintptr_t value = reinterpret_cast<uintptr_t>(key) >> 3;
+	return static_cast<unsigned int>(value * 0x9e3779b97f4a7c15ULL >> 32) & mask_;
+}
+
+/**
+ * \class FrameInfoTable
+ * \brief Preallocated table of per-frame information
+ * \tparam Info The pipeline handler specific per-frame information type
+ *
+ * Pipeline handlers need to associate data with each frame in flight, such as
+ * the request it belongs to and the internal buffers used to capture it, and
+ * to retrieve that data when a buffer completes or the IPA reports on a frame.
+ * The FrameInfoTable stores one \a Info instance for each frame in flight, and
+ * provides constant time lookups by frame number, by request and by buffer.
+ *
+ * The table holds a fixed number of slots, set at construction time, and
+ * frame numbers are mapped to slots modulo the table depth. All storage is
+ * allocated when the table is constructed, and creating and destroying
+ * entries doesn't allocate memory. The table depth shall thus be large enough
+ * to cover the maximum number of frames in flight.
+ *
+ * Buffers are looked up by pointer, which covers both the buffers allocated by
+ * the pipeline handler and those provided by applications through requests.
+ *
+ * The \a Info type shall be default-constructible, it is reset to its default
+ * value when an entry is created.
+ */
+
+/**
+ * \fn FrameInfoTable::FrameInfoTable()
+ * \brief Construct a frame information table
+ * \param[in] depth The number of frames that can be tracked concurrently
+ * \param[in] buffersPerFrame The maximum number of buffers per frame
+ */
+
+/**
+ * \fn FrameInfoTable::create()
+ * \brief Create the information for a frame
+ * \param[in] frame The frame number
+ * \param[in] request The request the frame belongs to
+ *
+ * The information is default-initialized and can be looked up by \a frame
+ * number and by \a request.
+ *
+ * \return A pointer to the frame information, or nullptr if the slot for
+ * \a frame is still in use by an older frame
+ */
+
+/**
+ * \fn FrameInfoTable::addBuffer()
+ * \brief Associate a buffer with a frame
+ * \param[in] frame The frame number
+ * \param[in] buffer The buffer
+ *
+ * Buffers associated with a frame can be used to look up the frame
+ * information with find(const FrameBuffer *).
+ *
+ * \return 0 on success or a negative error code otherwise
+ * \retval -ENOENT The frame isn't tracked by the table
+ * \retval -EEXIST The buffer is already associated with a frame
+ */
+
+/**
+ * \fn FrameInfoTable::destroy()
+ * \brief Destroy the information for a frame
+ * \param[in] frame The frame number
+ *
+ * The frame slot is released along with the request and buffer associations.
+ *
+ * \return 0 on success or a negative error code otherwise
+ * \retval -ENOENT The frame isn't tracked by the table
+ */
+
+/**
+ * \fn FrameInfoTable::clear()
+ * \brief Destroy the information for all frames
+ */
+
+/**
+ * \fn FrameInfoTable::forEach()
+ * \brief Call a function for all the frames tracked by the table
+ * \param[in] func The function, called with a pointer to the frame information
+ */
+
+/**
+ * \fn FrameInfoTable::find(unsigned int frame)
+ * \brief Find the information for a frame by frame number
+ * \param[in] frame The frame number
+ * \return A pointer to the frame information, or nullptr if not found
+ */
+
+/**
+ * \fn FrameInfoTable::find(const Request *request)
+ * \brief Find the information for a frame by request
+ * \param[in] request The request
+ * \return A pointer to the frame information, or nullptr if not found
+ */
+
+/**
+ * \fn FrameInfoTable::find(const FrameBuffer *buffer)
+ * \brief Find the information for a frame by buffer
+ * \param[in] buffer The buffer
+ * \return A pointer to the frame information, or nullptr if not found
+ */
+
+/**
+ * \fn FrameInfoTable::depth()
+ * \brief Retrieve the number of frames that can be tracked concurrently
+ * \return The table depth
+ */
+
+} /* namespace libcamera */
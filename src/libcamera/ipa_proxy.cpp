@@ -43,7 +43,7 @@ LOG_DEFINE_CATEGORY(IPAProxy)
  * method implemented by the respective factories.
  */
 IPAProxy::IPAProxy(IPAModule *ipam)
-	: valid_(false), ipam_(ipam)
+	: valid_(false), stats_(nullptr), ipam_(ipam)
 {
 }
 
@@ -155,6 +155,21 @@ std::string IPAProxy::configurationFile(const std::string &name) const
  * shall not forward the call to the IPA.
  */
 
+/**
+ * \brief Set the statistics recorder of the camera the IPA is associated with
+ * \param[in] stats The camera statistics recorder
+ *
+ * This function is called by the pipeline handler base class when registering
+ * the camera. Proxies should report the time spent by the IPA processing
+ * events to the \a stats recorder. Proxies that need to dispatch the recorder
+ * to another thread should override this function, and call the base class
+ * implementation.
+ */
+void IPAProxy::setStatisticsRecorder(CameraStatisticsRecorder *stats)
+{
+	stats_ = stats;
+}
+
 /**
  * \brief Find a valid full path for a proxy worker for a given executable name
  * \param[in] file File name of proxy worker executable
@@ -229,6 +244,11 @@ std::string IPAProxy::resolvePath(const std::string &file) const
  * construction.
  */
 
+/**
+ * \var IPAProxy::stats_
+ * \brief The statistics recorder of the camera, may be null
+ */
+
 /**
  * \class IPAProxyFactory
  * \brief Registration of IPAProxy classes and creation of instances
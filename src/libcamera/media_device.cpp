@@ -452,6 +452,47 @@ int MediaDevice::disableLinks()
 	return 0;
 }
 
+/**
+ * \brief Allocate media requests
+ * \param[in] count The number of requests to allocate
+ * \param[out] requests Vector to store the allocated requests
+ *
+ * Allocate \a count requests with MEDIA_IOC_REQUEST_ALLOC and store them in
+ * \a requests. The media device shall be acquired, and the requests shall be
+ * destroyed before the device is released.
+ *
+ * \return The number of allocated requests on success or a negative error
+ * code otherwise
+ * \retval -EBADF The media device is not acquired
+ * \retval -ENOTTY The media device doesn't support requests
+ */
+int MediaDevice::allocateRequests(unsigned int count,
+				  std::vector<std::unique_ptr<MediaRequest>> *requests)
+{
+	if (fd_ == -1)
+		return -EBADF;
+
+	requests->clear();
+	requests->reserve(count);
+
+	for (unsigned int i = 0; i < count; ++i) {
+		int requestFd;
+
+		int ret = ioctl(fd_, MEDIA_IOC_REQUEST_ALLOC, &requestFd);
+		if (ret < 0) {
+			ret = -errno;
+			LOG(MediaDevice, Error)
+				<< "Failed to allocate request: " << strerror(-ret);
+			requests->clear();
+			return ret;
+		}
+
+		requests->emplace_back(new MediaRequest(requestFd, i));
+	}
+
+	return count;
+}
+
 /**
  * \var MediaDevice::disconnected
  * \brief Signal emitted when the media device is disconnected from the system
@@ -0,0 +1,282 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2020, Google Inc.
+ *
+ * media_request.cpp - Media Controller request
+ */
+
+#include "libcamera/internal/media_request.h"
+
+#include <errno.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+#include <linux/media.h>
+
+#include <libcamera/event_notifier.h>
+
+#include "libcamera/internal/media_device.h"
+
+/**
+ * \file media_request.h
+ * \brief Media Controller requests to apply parameters and buffers atomically
+ */
+
+namespace libcamera {
+
+LOG_DECLARE_CATEGORY(MediaDevice)
+
+/**
+ * \class MediaRequest
+ * \brief A Media Controller request
+ *
+ * The Media Controller request API allows grouping controls and buffers for
+ * multiple devices of a media graph in a request, and queuing them atomically.
+ * The driver applies all the controls stored in the request when it processes
+ * the buffers that are part of the same request, removing the need to time
+ * control writes against the start of frames in userspace.
+ *
+ * Requests are allocated from a MediaDevice with
+ * MediaDevice::allocateRequests(), usually through a MediaRequestPool. Controls
+ * are added to a request with V4L2Device::setControls() and buffers with
+ * V4L2VideoDevice::queueBuffer(), passing the request as an argument. The
+ * request is then queued to the driver with queue(). Once the driver has
+ * processed all the objects in the request, the request status changes to
+ * Complete and the completed signal is emitted. The controls applied to the
+ * request can then be read back with V4L2Device::getControls(). A completed
+ * request can be reused after being reinitialised with reinit().
+ */
+
+/**
+ * \enum MediaRequest::Status
+ * \brief The request status
+ * \var MediaRequest::Idle
+ * The request has been allocated or reinitialised and can be filled
+ * \var MediaRequest::Queued
+ * The request has been queued to the driver
+ * \var MediaRequest::Complete
+ * The driver has completed the request
+ */
+
+MediaRequest::MediaRequest(int fd, unsigned int index)
+	: fd_(fd), index_(index), status_(Idle)
+{
+	notifier_ = new EventNotifier(fd_, EventNotifier::Exception);
+	notifier_->activated.connect(this, &MediaRequest::requestCompleted);
+	notifier_->setEnabled(false);
+}
+
+MediaRequest::~MediaRequest()
+{
+	delete notifier_;
+	::close(fd_);
+}
+
+/**
+ * \fn MediaRequest::fd()
+ * \brief Retrieve the request file descriptor
+ *
+ * The file descriptor is passed to the V4L2 API to associate controls and
+ * buffers with the request.
+ *
+ * \return The request file descriptor
+ */
+
+/**
+ * \fn MediaRequest::index()
+ * \brief Retrieve the index of the request in its allocation
+ * \return The request index
+ */
+
+/**
+ * \fn MediaRequest::status()
+ * \brief Retrieve the request status
+ * \return The request status
+ */
+
+/**
+ * \brief Queue the request to the driver
+ *
+ * The request shall contain at least one buffer. Controls and buffers can't be
+ * added to the request after it has been queued.
+ *
+ * \return 0 on success or a negative error code otherwise
+ * \retval -EBUSY The request has already been queued
+ * \retval -ENOENT The request doesn't contain any buffer
+ */
+int MediaRequest::queue()
+{
+	if (status_ != Idle)
+		return -EBUSY;
+
+	if (::ioctl(fd_, MEDIA_REQUEST_IOC_QUEUE) < 0) {
+		int ret = -errno;
+		LOG(MediaDevice, Error)
+			<< "Failed to queue request: " << strerror(-ret);
+		return ret;
+	}
+
+	status_ = Queued;
+	notifier_->setEnabled(true);
+
+	return 0;
+}
+
+/**
+ * \brief Reinitialise a completed request for reuse
+ *
+ * Reinitialising a request removes all the controls and buffers it contains
+ * and sets its status back to Idle. Queued requests can't be reinitialised
+ * until they complete.
+ *
+ * \return 0 on success or a negative error code otherwise
+ * \retval -EBUSY The request is queued
+ */
+int MediaRequest::reinit()
+{
+	if (status_ == Queued)
+		return -EBUSY;
+
+	if (::ioctl(fd_, MEDIA_REQUEST_IOC_REINIT) < 0) {
+		int ret = -errno;
+		LOG(MediaDevice, Error)
+			<< "Failed to reinitialise request: " << strerror(-ret);
+		return ret;
+	}
+
+	status_ = Idle;
+
+	return 0;
+}
+
+/**
+ * \var MediaRequest::completed
+ * \brief Signal emitted when the driver completes the request
+ */
+
+std::string MediaRequest::logPrefix() const
+{
+	return "request " + std::to_string(index_);
+}
+
+void MediaRequest::requestCompleted([[maybe_unused]] EventNotifier *notifier)
+{
+	/* The request fd stays readable until it is reinitialised. */
+	notifier_->setEnabled(false);
+	status_ = Complete;
+
+	completed.emit(this);
+}
+
+/**
+ * \class MediaRequestPool
+ * \brief A pool of reusable media requests
+ *
+ * Allocating a media request requires a system call and creates a new file
+ * descriptor. The MediaRequestPool allocates a fixed number of requests
+ * upfront and recycles them, avoiding per-frame allocations. Pipeline handlers
+ * get() an idle request for each frame, fill and queue it, and put() it back
+ * into the pool once completed and the results have been read.
+ */
+
+MediaRequestPool::MediaRequestPool()
+{
+}
+
+/**
+ * \brief Allocate the pool requests
+ * \param[in] media The media device to allocate requests from
+ * \param[in] count The number of requests
+ *
+ * The media device shall be acquired. Requests previously allocated by the
+ * pool are released first.
+ *
+ * \return The number of requests allocated on success or a negative error
+ * code otherwise
+ * \retval -ENOTTY The media device doesn't support requests
+ */
+int MediaRequestPool::allocate(MediaDevice *media, unsigned int count)
+{
+	release();
+
+	int ret = media->allocateRequests(count, &requests_);
+	if (ret < 0)
+		return ret;
+
+	available_.reserve(requests_.size());
+	for (const std::unique_ptr<MediaRequest> &request : requests_) {
+		request->completed.connect(&requestCompleted,
+					   &Signal<MediaRequest *>::emit);
+		available_.push_back(request.get());
+	}
+
+	return ret;
+}
+
+/**
+ * \brief Free all the requests of the pool
+ *
+ * Requests still queued to the driver are released when the driver completes
+ * them, or when the device is closed.
+ */
+void MediaRequestPool::release()
+{
+	available_.clear();
+	requests_.clear();
+}
+
+/**
+ * \brief Take an idle request from the pool
+ * \return An idle request, or nullptr if all requests are in use
+ */
+MediaRequest *MediaRequestPool::get()
+{
+	if (available_.empty())
+		return nullptr;
+
+	MediaRequest *request = available_.back();
+	available_.pop_back();
+
+	return request;
+}
+
+/**
+ * \brief Return a request to the pool
+ * \param[in] request The request, obtained from get()
+ *
+ * The request is reinitialised before being made available again.
+ *
+ * \return 0 on success or a negative error code otherwise
+ */
+int MediaRequestPool::put(MediaRequest *request)
+{
+	if (request->status() != MediaRequest::Idle) {
+		int ret = request->reinit();
+		if (ret < 0)
+			return ret;
+	}
+
+	available_.push_back(request);
+
+	return 0;
+}
+
+/**
+ * \fn MediaRequestPool::size()
+ * \brief Retrieve the number of requests in the pool
+ * \return The number of requests allocated by the pool
+ */
+
+/**
+ * \fn MediaRequestPool::available()
+ * \brief Retrieve the number of idle requests in the pool
+ * \return The number of requests that can be obtained with get()
+ */
+
+/**
+ * \var MediaRequestPool::requestCompleted
+ * \brief Signal emitted when a request from the pool completes
+ */
+
+} /* namespace libcamera */
@@ -7,9 +7,11 @@
 #include <algorithm>
 #include <assert.h>
 #include <fcntl.h>
+#include <memory>
 #include <mutex>
 #include <queue>
 #include <sys/mman.h>
+#include <unordered_map>
 
 #include <libcamera/camera.h>
 #include <libcamera/control_ids.h>
@@ -24,6 +26,7 @@
 #include <linux/videodev2.h>
 
 #include "libcamera/internal/camera_sensor.h"
+#include "libcamera/internal/delayed_controls.h"
 #include "libcamera/internal/device_enumerator.h"
 #include "libcamera/internal/ipa_manager.h"
 #include "libcamera/internal/media_device.h"
@@ -33,7 +36,6 @@
 #include "libcamera/internal/v4l2_videodevice.h"
 
 #include "dma_heaps.h"
-#include "staggered_ctrl.h"
 
 namespace libcamera {
 
@@ -320,8 +322,7 @@ public:
 	RPi::DmaHeap dmaHeap_;
 	FileDescriptor lsTable_;
 
-	RPi::StaggeredCtrl staggeredCtrl_;
-	uint32_t expectedSequence_;
+	std::unique_ptr<DelayedControls> delayedCtrls_;
 	bool sensorMetadata_;
 
 	/*
@@ -815,13 +816,11 @@ int PipelineHandlerRPi::start(Camera *camera)
 
 	/*
 	 * Write the last set of gain and exposure values to the camera before
-	 * starting. First check that the staggered ctrl has been initialised
-	 * by configure().
+	 * starting. First check that the delayed controls have been
+	 * initialised by configure().
 	 */
-	ASSERT(data->staggeredCtrl_);
-	data->staggeredCtrl_.reset();
-	data->staggeredCtrl_.write();
-	data->expectedSequence_ = 0;
+	ASSERT(data->delayedCtrls_);
+	data->delayedCtrls_->reset();
 
 	data->state_ = RPiCameraData::State::Idle;
 
@@ -1098,7 +1097,7 @@ void RPiCameraData::frameStarted(uint32_t sequence)
 	LOG(RPI, Debug) << "frame start " << sequence;
 
 	/* Write any controls for the next frame as soon as we can. */
-	staggeredCtrl_.write();
+	delayedCtrls_->applyControls(sequence);
 }
 
 int RPiCameraData::loadIPA()
@@ -1164,21 +1163,25 @@ int RPiCameraData::configureIPA()
 
 	if (result.operation & RPI_IPA_CONFIG_STAGGERED_WRITE) {
 		/*
-		 * Setup our staggered control writer with the sensor default
+		 * Setup our delayed control writer with the sensor default
 		 * gain and exposure delays.
 		 */
-		if (!staggeredCtrl_) {
-			staggeredCtrl_.init(unicam_[Unicam::Image].dev(),
-					    { { V4L2_CID_ANALOGUE_GAIN, result.data[0] },
-					      { V4L2_CID_EXPOSURE, result.data[1] } });
+		if (!delayedCtrls_) {
+			std::unordered_map<uint32_t, unsigned int> delays = {
+				{ V4L2_CID_ANALOGUE_GAIN, result.data[0] },
+				{ V4L2_CID_EXPOSURE, result.data[1] },
+			};
+
+			delayedCtrls_ = std::make_unique<DelayedControls>(unicam_[Unicam::Image].dev(),
+									  delays);
 			sensorMetadata_ = result.data[2];
 		}
 	}
 
 	if (result.operation & RPI_IPA_CONFIG_SENSOR) {
 		const ControlList &ctrls = result.controls[0];
-		if (!staggeredCtrl_.set(ctrls))
-			LOG(RPI, Error) << "V4L2 staggered set failed";
+		if (!delayedCtrls_->push(ctrls))
+			LOG(RPI, Error) << "V4L2 delayed controls set failed";
 	}
 
 	return 0;
@@ -1194,8 +1197,8 @@ void RPiCameraData::queueFrameAction([[maybe_unused]] unsigned int frame,
 	switch (action.operation) {
 	case RPI_IPA_ACTION_V4L2_SET_STAGGERED: {
 		const ControlList &controls = action.controls[0];
-		if (!staggeredCtrl_.set(controls))
-			LOG(RPI, Error) << "V4L2 staggered set failed";
+		if (!delayedCtrls_->push(controls))
+			LOG(RPI, Error) << "V4L2 delayed controls set failed";
 		goto done;
 	}
 
@@ -1281,15 +1284,11 @@ void RPiCameraData::unicamBufferDequeue(FrameBuffer *buffer)
 	} else {
 		embeddedQueue_.push(buffer);
 
-		std::unordered_map<uint32_t, int32_t> ctrl;
-		int offset = buffer->metadata().sequence - expectedSequence_;
-		staggeredCtrl_.get(ctrl, offset);
-
-		expectedSequence_ = buffer->metadata().sequence + 1;
+		ControlList ctrl = delayedCtrls_->get(buffer->metadata().sequence);
 
 		/*
 		 * Sensor metadata is unavailable, so put the expected ctrl
-		 * values (accounting for the staggered delays) into the empty
+		 * values (accounting for the sensor delays) into the empty
 		 * metadata buffer.
 		 */
 		if (!sensorMetadata_) {
@@ -1298,8 +1297,8 @@ void RPiCameraData::unicamBufferDequeue(FrameBuffer *buffer)
 								       PROT_READ | PROT_WRITE,
 								       MAP_SHARED,
 								       fb.planes()[0].fd.fd(), 0));
-			mem[0] = ctrl[V4L2_CID_EXPOSURE];
-			mem[1] = ctrl[V4L2_CID_ANALOGUE_GAIN];
+			mem[0] = ctrl.get(V4L2_CID_EXPOSURE).get<int32_t>();
+			mem[1] = ctrl.get(V4L2_CID_ANALOGUE_GAIN).get<int32_t>();
 			munmap(mem, fb.planes()[0].length);
 		}
 	}
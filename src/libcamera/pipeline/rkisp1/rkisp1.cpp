@@ -23,6 +23,7 @@
 
 #include "libcamera/internal/camera_sensor.h"
 #include "libcamera/internal/device_enumerator.h"
+#include "libcamera/internal/frame_info.h"
 #include "libcamera/internal/ipa_manager.h"
 #include "libcamera/internal/log.h"
 #include "libcamera/internal/media_device.h"
@@ -38,7 +39,7 @@ namespace libcamera {
 LOG_DEFINE_CATEGORY(RkISP1)
 
 class PipelineHandlerRkISP1;
-class RkISP1ActionQueueBuffers;
+class RkISP1CameraData;
 
 enum RkISP1ActionType {
 	SetSensor,
@@ -74,7 +75,7 @@ public:
 
 private:
 	PipelineHandlerRkISP1 *pipe_;
-	std::map<unsigned int, RkISP1FrameInfo *> frameInfo_;
+	FrameInfoTable<RkISP1FrameInfo> frameInfo_;
 };
 
 class RkISP1Timeline : public Timeline
@@ -112,6 +113,44 @@ public:
 	}
 };
 
+class RkISP1ActionSetSensor : public FrameAction
+{
+public:
+	RkISP1ActionSetSensor(RkISP1CameraData *data)
+		: FrameAction(SetSensor), data_(data) {}
+
+	void setControls(const ControlList &controls)
+	{
+		controls_ = controls;
+	}
+
+	void mergeControls(const ControlList &controls)
+	{
+		for (const auto &ctrl : controls)
+			controls_.set(ctrl.first, ctrl.second);
+	}
+
+protected:
+	void run() override;
+
+private:
+	RkISP1CameraData *data_;
+	ControlList controls_;
+};
+
+class RkISP1ActionQueueBuffers : public FrameAction
+{
+public:
+	RkISP1ActionQueueBuffers(RkISP1CameraData *data)
+		: FrameAction(QueueBuffers), data_(data) {}
+
+protected:
+	void run() override;
+
+private:
+	RkISP1CameraData *data_;
+};
+
 class RkISP1CameraData : public CameraData
 {
 public:
@@ -119,6 +158,16 @@ public:
 		: CameraData(pipe), sensor_(nullptr), frame_(0),
 		  frameInfo_(pipe), video_(video)
 	{
+		/*
+		 * Preallocate the frame actions for all the frames the timeline
+		 * can track, they are reused for frames with the same index.
+		 */
+		setSensorActions_.reserve(Timeline::MAX_FRAMES);
+		queueBuffersActions_.reserve(Timeline::MAX_FRAMES);
+		for (unsigned int i = 0; i < Timeline::MAX_FRAMES; ++i) {
+			setSensorActions_.emplace_back(this);
+			queueBuffersActions_.emplace_back(this);
+		}
 	}
 
 	~RkISP1CameraData()
@@ -134,6 +183,8 @@ public:
 	std::vector<IPABuffer> ipaBuffers_;
 	RkISP1Frames frameInfo_;
 	RkISP1Timeline timeline_;
+	std::vector<RkISP1ActionSetSensor> setSensorActions_;
+	std::vector<RkISP1ActionQueueBuffers> queueBuffersActions_;
 
 	V4L2VideoDevice *video_;
 
@@ -224,7 +275,8 @@ private:
 };
 
 RkISP1Frames::RkISP1Frames(PipelineHandler *pipe)
-	: pipe_(static_cast<PipelineHandlerRkISP1 *>(pipe))
+	: pipe_(static_cast<PipelineHandlerRkISP1 *>(pipe)),
+	  frameInfo_(Timeline::MAX_FRAMES, 3)
 {
 }
 
@@ -249,10 +301,18 @@ RkISP1FrameInfo *RkISP1Frames::create(unsigned int frame, Request *request, Stre
 		return nullptr;
 	}
 
+	RkISP1FrameInfo *info = frameInfo_.create(frame, request);
+	if (!info) {
+		LOG(RkISP1, Error) << "Too many frames in flight";
+		return nullptr;
+	}
+
 	pipe_->availableParamBuffers_.pop();
 	pipe_->availableStatBuffers_.pop();
 
-	RkISP1FrameInfo *info = new RkISP1FrameInfo;
+	frameInfo_.addBuffer(frame, paramBuffer);
+	frameInfo_.addBuffer(frame, statBuffer);
+	frameInfo_.addBuffer(frame, videoBuffer);
 
 	info->frame = frame;
 	info->request = request;
@@ -263,8 +323,6 @@ RkISP1FrameInfo *RkISP1Frames::create(unsigned int frame, Request *request, Stre
 	info->paramDequeued = false;
 	info->metadataProcessed = false;
 
-	frameInfo_[frame] = info;
-
 	return info;
 }
 
@@ -277,124 +335,79 @@ int RkISP1Frames::destroy(unsigned int frame)
 	pipe_->availableParamBuffers_.push(info->paramBuffer);
 	pipe_->availableStatBuffers_.push(info->statBuffer);
 
-	frameInfo_.erase(info->frame);
-
-	delete info;
-
-	return 0;
+	return frameInfo_.destroy(frame);
 }
 
 void RkISP1Frames::clear()
 {
-	for (const auto &entry : frameInfo_) {
-		RkISP1FrameInfo *info = entry.second;
-
+	frameInfo_.forEach([&](RkISP1FrameInfo *info) {
 		pipe_->availableParamBuffers_.push(info->paramBuffer);
 		pipe_->availableStatBuffers_.push(info->statBuffer);
-
-		delete info;
-	}
+	});
 
 	frameInfo_.clear();
 }
 
 RkISP1FrameInfo *RkISP1Frames::find(unsigned int frame)
 {
-	auto itInfo = frameInfo_.find(frame);
-
-	if (itInfo != frameInfo_.end())
-		return itInfo->second;
+	RkISP1FrameInfo *info = frameInfo_.find(frame);
+	if (!info)
+		LOG(RkISP1, Error) << "Can't locate info from frame";
 
-	LOG(RkISP1, Error) << "Can't locate info from frame";
-	return nullptr;
+	return info;
 }
 
 RkISP1FrameInfo *RkISP1Frames::find(FrameBuffer *buffer)
 {
-	for (auto &itInfo : frameInfo_) {
-		RkISP1FrameInfo *info = itInfo.second;
-
-		if (info->paramBuffer == buffer ||
-		    info->statBuffer == buffer ||
-		    info->videoBuffer == buffer)
-			return info;
-	}
+	RkISP1FrameInfo *info = frameInfo_.find(buffer);
+	if (!info)
+		LOG(RkISP1, Error) << "Can't locate info from buffer";
 
-	LOG(RkISP1, Error) << "Can't locate info from buffer";
-	return nullptr;
+	return info;
 }
 
 RkISP1FrameInfo *RkISP1Frames::find(Request *request)
 {
-	for (auto &itInfo : frameInfo_) {
-		RkISP1FrameInfo *info = itInfo.second;
-
-		if (info->request == request)
-			return info;
-	}
+	RkISP1FrameInfo *info = frameInfo_.find(request);
+	if (!info)
+		LOG(RkISP1, Error) << "Can't locate info from request";
 
-	LOG(RkISP1, Error) << "Can't locate info from request";
-	return nullptr;
+	return info;
 }
 
-class RkISP1ActionSetSensor : public FrameAction
+void RkISP1ActionSetSensor::run()
 {
-public:
-	RkISP1ActionSetSensor(unsigned int frame, CameraSensor *sensor, const ControlList &controls)
-		: FrameAction(frame, SetSensor), sensor_(sensor), controls_(controls) {}
-
-protected:
-	void run() override
-	{
-		sensor_->setControls(&controls_);
-	}
-
-private:
-	CameraSensor *sensor_;
-	ControlList controls_;
-};
+	data_->sensor_->setControls(&controls_);
+}
 
-class RkISP1ActionQueueBuffers : public FrameAction
+void RkISP1ActionQueueBuffers::run()
 {
-public:
-	RkISP1ActionQueueBuffers(unsigned int frame, RkISP1CameraData *data,
-				 PipelineHandlerRkISP1 *pipe)
-		: FrameAction(frame, QueueBuffers), data_(data), pipe_(pipe)
-	{
-	}
+	PipelineHandlerRkISP1 *pipe = static_cast<PipelineHandlerRkISP1 *>(data_->pipe_);
 
-protected:
-	void run() override
-	{
-		RkISP1FrameInfo *info = data_->frameInfo_.find(frame());
-		if (!info)
-			LOG(RkISP1, Fatal) << "Frame not known";
+	RkISP1FrameInfo *info = data_->frameInfo_.find(frame());
+	if (!info)
+		LOG(RkISP1, Fatal) << "Frame not known";
 
-		/*
-		 * \todo: If parameters are not filled a better method to handle
-		 * the situation than queuing a buffer with unknown content
-		 * should be used.
-		 *
-		 * It seems excessive to keep an internal zeroed scratch
-		 * parameters buffer around as this should not happen unless the
-		 * devices is under too much load. Perhaps failing the request
-		 * and returning it to the application with an error code is
-		 * better than queue it to hardware?
-		 */
-		if (!info->paramFilled)
-			LOG(RkISP1, Error)
-				<< "Parameters not ready on time for frame "
-				<< frame();
-
-		pipe_->param_->queueBuffer(info->paramBuffer);
-		pipe_->stat_->queueBuffer(info->statBuffer);
-		pipe_->video_->queueBuffer(info->videoBuffer);
-	}
+	/*
+	 * \todo: If parameters are not filled a better method to handle
+	 * the situation than queuing a buffer with unknown content
+	 * should be used.
+	 *
+	 * It seems excessive to keep an internal zeroed scratch
+	 * parameters buffer around as this should not happen unless the
+	 * devices is under too much load. Perhaps failing the request
+	 * and returning it to the application with an error code is
+	 * better than queue it to hardware?
+	 */
+	if (!info->paramFilled)
+		LOG(RkISP1, Error)
+			<< "Parameters not ready on time for frame "
+			<< frame();
 
-private:
-	RkISP1CameraData *data_;
-	PipelineHandlerRkISP1 *pipe_;
-};
+	pipe->param_->queueBuffer(info->paramBuffer);
+	pipe->stat_->queueBuffer(info->statBuffer);
+	pipe->video_->queueBuffer(info->videoBuffer);
+}
 
 int RkISP1CameraData::loadIPA()
 {
@@ -416,9 +429,20 @@ void RkISP1CameraData::queueFrameAction(unsigned int frame,
 	switch (action.operation) {
 	case RKISP1_IPA_ACTION_V4L2_SET: {
 		const ControlList &controls = action.controls[0];
-		timeline_.scheduleAction(std::make_unique<RkISP1ActionSetSensor>(frame,
-										 sensor_,
-										 controls));
+		RkISP1ActionSetSensor &setSensor =
+			setSensorActions_[frame % Timeline::MAX_FRAMES];
+
+		if (setSensor.scheduled() && setSensor.frame() == frame) {
+			setSensor.mergeControls(controls);
+		} else {
+			if (setSensor.scheduled())
+				LOG(RkISP1, Warning)
+					<< "Sensor controls for frame "
+					<< setSensor.frame() << " not applied";
+			setSensor.setControls(controls);
+		}
+
+		timeline_.scheduleAction(&setSensor, frame);
 		break;
 	}
 	case RKISP1_IPA_ACTION_PARAM_FILLED: {
@@ -899,6 +923,13 @@ int PipelineHandlerRkISP1::queueRequestDevice(Camera *camera,
 	RkISP1CameraData *data = cameraData(camera);
 	Stream *stream = &data->stream_;
 
+	RkISP1ActionQueueBuffers &queueBuffers =
+		data->queueBuffersActions_[data->frame_ % Timeline::MAX_FRAMES];
+	if (queueBuffers.scheduled()) {
+		LOG(RkISP1, Error) << "Too many frames in flight";
+		return -EBUSY;
+	}
+
 	RkISP1FrameInfo *info = data->frameInfo_.create(data->frame_, request,
 							stream);
 	if (!info)
@@ -910,9 +941,7 @@ int PipelineHandlerRkISP1::queueRequestDevice(Camera *camera,
 	op.controls = { request->controls() };
 	data->ipa_->processEvent(op);
 
-	data->timeline_.scheduleAction(std::make_unique<RkISP1ActionQueueBuffers>(data->frame_,
-										  data,
-										  this));
+	data->timeline_.scheduleAction(&queueBuffers, data->frame_);
 
 	data->frame_++;
 
@@ -7,6 +7,8 @@
 
 #include "timeline.h"
 
+#include <algorithm>
+
 #include "libcamera/internal/log.h"
 
 /**
@@ -28,6 +30,12 @@ LOG_DEFINE_CATEGORY(Timeline)
  * The frame number describes the frame to which the action is associated. The
  * type is a numerical ID which identifies the action within the pipeline and
  * IPA protocol.
+ *
+ * Frame actions are owned by the pipeline handler and are not copied by the
+ * timeline. To avoid allocations at runtime, pipeline handlers should
+ * preallocate one action per type for each of the Timeline::MAX_FRAMES frames
+ * that can be in flight, and reuse them for frames with the same index modulo
+ * Timeline::MAX_FRAMES.
  */
 
 /**
@@ -57,11 +65,29 @@ LOG_DEFINE_CATEGORY(Timeline)
  *    FrameAction which contains an abstract description of what frame and
  *    what type of action it contains and turning that into an time point
  *    and make sure the action is executed at that time.
+ *
+ * Scheduled actions are stored in a fixed size table indexed by frame number
+ * and action type, the timeline thus doesn't allocate memory at runtime. A
+ * single timer is armed for the earliest deadline, and all actions due within
+ * a short window of that deadline are executed together.
+ */
+
+namespace {
+
+/*
+ * Actions whose deadlines are this close are executed together, to avoid
+ * rearming the timer for deadlines that can't be told apart by the scheduler.
  */
+constexpr std::chrono::microseconds kBatchWindow(500);
+
+} /* namespace */
 
 Timeline::Timeline()
-	: frameInterval_(0)
+	: pending_(0), historySize_(0), historyHead_(0), frameInterval_(0)
 {
+	delays_.fill({ 0, utils::duration::zero() });
+	actions_.fill(nullptr);
+
 	timer_.timeout.connect(this, &Timeline::timeout);
 }
 
@@ -76,31 +102,51 @@ void Timeline::reset()
 {
 	timer_.stop();
 
-	actions_.clear();
-	history_.clear();
+	for (FrameAction *&action : actions_) {
+		if (action)
+			action->scheduled_ = false;
+		action = nullptr;
+	}
+
+	pending_ = 0;
+	historySize_ = 0;
+	historyHead_ = 0;
 }
 
 /**
  * \brief Schedule an action on the timeline
  * \param[in] action FrameAction to schedule
+ * \param[in] frame The frame the action is associated with
  *
  * The act of scheduling an action to the timeline is the process of taking
  * the properties of the action (type, frame and time offsets) and translating
  * that to a time point using the current values for the action type timings
  * value recorded in the timeline. If an action is scheduled too late, execute
  * it immediately.
+ *
+ * The timeline stores a reference to the \a action until it is executed or
+ * the timeline is reset. Scheduling an action that is already scheduled moves
+ * it to the new \a frame.
  */
-void Timeline::scheduleAction(std::unique_ptr<FrameAction> action)
+void Timeline::scheduleAction(FrameAction *action, unsigned int frame)
 {
+	unsigned int type = action->type();
+	if (type >= MAX_ACTION_TYPES) {
+		LOG(Timeline, Error) << "Invalid action type " << type;
+		return;
+	}
+
 	unsigned int lastFrame;
 	utils::time_point lastTime;
 
-	if (history_.empty()) {
+	if (!historySize_) {
 		lastFrame = 0;
 		lastTime = std::chrono::steady_clock::now();
 	} else {
-		lastFrame = history_.back().first;
-		lastTime = history_.back().second;
+		const StartOfExposure &last =
+			history_[(historyHead_ + HISTORY_DEPTH - 1) % HISTORY_DEPTH];
+		lastFrame = last.frame;
+		lastTime = last.time;
 	}
 
 	/*
@@ -111,9 +157,34 @@ void Timeline::scheduleAction(std::unique_ptr<FrameAction> action)
 	 * (SOE) as the fixed offset. Lastly add the action time offset to the
 	 * time point.
 	 */
-	int frame = action->frame() - lastFrame + frameOffset(action->type());
-	utils::time_point deadline = lastTime + frame * frameInterval_
-		+ timeOffset(action->type());
+	int frames = static_cast<int>(frame - lastFrame) + frameOffset(type);
+	utils::time_point deadline = lastTime + frames * frameInterval_
+		+ timeOffset(type);
+
+	/* Release the slot, running the action it holds if it overran. */
+	FrameAction *&slot = actions_[(frame % MAX_FRAMES) * MAX_ACTION_TYPES + type];
+	if (action->scheduled_ && slot != action) {
+		auto it = std::find(actions_.begin(), actions_.end(), action);
+		*it = nullptr;
+		action->scheduled_ = false;
+		pending_--;
+	}
+
+	if (slot && slot != action) {
+		FrameAction *overrun = slot;
+
+		LOG(Timeline, Warning)
+			<< "Action for frame " << overrun->frame()
+			<< " overrun by frame " << frame << ", run now";
+
+		slot = nullptr;
+		overrun->scheduled_ = false;
+		pending_--;
+		overrun->run();
+	}
+
+	action->frame_ = frame;
+	action->deadline_ = deadline;
 
 	utils::time_point now = std::chrono::steady_clock::now();
 	if (deadline < now) {
@@ -121,84 +192,95 @@ void Timeline::scheduleAction(std::unique_ptr<FrameAction> action)
 			<< "Action scheduled too late "
 			<< utils::time_point_to_string(deadline)
 			<< ", run now " << utils::time_point_to_string(now);
+
+		if (slot) {
+			slot = nullptr;
+			action->scheduled_ = false;
+			pending_--;
+		}
+
 		action->run();
-	} else {
-		actions_.emplace(deadline, std::move(action));
-		updateDeadline();
+		return;
+	}
+
+	if (!slot) {
+		slot = action;
+		action->scheduled_ = true;
+		pending_++;
 	}
+
+	/* Only rearm the timer if the new deadline comes first. */
+	if (!timer_.isRunning() || deadline < timer_.deadline())
+		timer_.start(deadline);
 }
 
 void Timeline::notifyStartOfExposure(unsigned int frame, utils::time_point time)
 {
-	history_.push_back(std::make_pair(frame, time));
+	history_[historyHead_] = { frame, time };
+	historyHead_ = (historyHead_ + 1) % HISTORY_DEPTH;
+	if (historySize_ < HISTORY_DEPTH)
+		historySize_++;
 
-	if (history_.size() <= HISTORY_DEPTH / 2)
+	if (historySize_ <= HISTORY_DEPTH / 2)
 		return;
 
-	while (history_.size() > HISTORY_DEPTH)
-		history_.pop_front();
-
-	/* Update esitmated time between two start of exposures. */
-	utils::duration sumExposures(0);
-	unsigned int numExposures = 0;
-
-	utils::time_point lastTime;
-	for (auto it = history_.begin(); it != history_.end(); it++) {
-		if (it != history_.begin()) {
-			sumExposures += it->second - lastTime;
-			numExposures++;
-		}
-
-		lastTime = it->second;
-	}
-
-	frameInterval_ = sumExposures;
-	if (numExposures)
-		frameInterval_ /= numExposures;
+	/*
+	 * Update the estimated time between two start of exposures. The average
+	 * of the intervals over the history is the time elapsed between the
+	 * oldest and newest entries divided by the number of frames, which also
+	 * accounts for dropped frames.
+	 */
+	const StartOfExposure &oldest =
+		history_[(historyHead_ + HISTORY_DEPTH - historySize_) % HISTORY_DEPTH];
+	const StartOfExposure &newest =
+		history_[(historyHead_ + HISTORY_DEPTH - 1) % HISTORY_DEPTH];
+
+	unsigned int frames = newest.frame - oldest.frame;
+	if (frames)
+		frameInterval_ = (newest.time - oldest.time) / frames;
 }
 
 int Timeline::frameOffset(unsigned int type) const
 {
-	const auto it = delays_.find(type);
-	if (it == delays_.end()) {
+	if (type >= MAX_ACTION_TYPES) {
 		LOG(Timeline, Error)
 			<< "No frame offset set for action type " << type;
 		return 0;
 	}
 
-	return it->second.first;
+	return delays_[type].first;
 }
 
 utils::duration Timeline::timeOffset(unsigned int type) const
 {
-	const auto it = delays_.find(type);
-	if (it == delays_.end()) {
+	if (type >= MAX_ACTION_TYPES) {
 		LOG(Timeline, Error)
 			<< "No time offset set for action type " << type;
 		return utils::duration::zero();
 	}
 
-	return it->second.second;
+	return delays_[type].second;
 }
 
 void Timeline::setRawDelay(unsigned int type, int frame, utils::duration time)
 {
+	if (type >= MAX_ACTION_TYPES) {
+		LOG(Timeline, Error) << "Invalid action type " << type;
+		return;
+	}
+
 	delays_[type] = std::make_pair(frame, time);
 }
 
 void Timeline::updateDeadline()
 {
-	if (actions_.empty())
+	if (!pending_)
 		return;
 
-	const utils::time_point &deadline = actions_.begin()->first;
-
-	if (timer_.isRunning() && deadline >= timer_.deadline())
-		return;
-
-	if (deadline <= std::chrono::steady_clock::now()) {
-		timeout(&timer_);
-		return;
+	utils::time_point deadline = utils::time_point::max();
+	for (const FrameAction *action : actions_) {
+		if (action)
+			deadline = std::min(deadline, action->deadline_);
 	}
 
 	timer_.start(deadline);
@@ -206,20 +288,29 @@ void Timeline::updateDeadline()
 
 void Timeline::timeout([[maybe_unused]] Timer *timer)
 {
-	utils::time_point now = std::chrono::steady_clock::now();
-
-	for (auto it = actions_.begin(); it != actions_.end();) {
-		const utils::time_point &sched = it->first;
-
-		if (sched > now)
-			break;
+	utils::time_point limit = std::chrono::steady_clock::now() + kBatchWindow;
+	std::array<FrameAction *, MAX_FRAMES * MAX_ACTION_TYPES> due;
+	unsigned int count = 0;
+
+	/* Collect all the actions due and run them in deadline order. */
+	for (FrameAction *&action : actions_) {
+		if (!action || action->deadline_ > limit)
+			continue;
+
+		action->scheduled_ = false;
+		due[count++] = action;
+		action = nullptr;
+	}
 
-		FrameAction *action = it->second.get();
+	pending_ -= count;
 
-		action->run();
+	std::sort(due.begin(), due.begin() + count,
+		  [](const FrameAction *a, const FrameAction *b) {
+			  return a->deadline_ < b->deadline_;
+		  });
 
-		it = actions_.erase(it);
-	}
+	for (unsigned int i = 0; i < count; ++i)
+		due[i]->run();
 
 	updateDeadline();
 }
@@ -7,8 +7,8 @@
 #ifndef __LIBCAMERA_TIMELINE_H__
 #define __LIBCAMERA_TIMELINE_H__
 
-#include <list>
-#include <map>
+#include <array>
+#include <utility>
 
 #include <libcamera/timer.h>
 
@@ -19,29 +19,37 @@ namespace libcamera {
 class FrameAction
 {
 public:
-	FrameAction(unsigned int frame, unsigned int type)
-		: frame_(frame), type_(type) {}
+	FrameAction(unsigned int type)
+		: frame_(0), type_(type), scheduled_(false) {}
 
 	virtual ~FrameAction() {}
 
 	unsigned int frame() const { return frame_; }
 	unsigned int type() const { return type_; }
+	bool scheduled() const { return scheduled_; }
 
 	virtual void run() = 0;
 
 private:
+	friend class Timeline;
+
 	unsigned int frame_;
 	unsigned int type_;
+	bool scheduled_;
+	utils::time_point deadline_;
 };
 
 class Timeline
 {
 public:
+	static constexpr unsigned int MAX_FRAMES = 16;
+	static constexpr unsigned int MAX_ACTION_TYPES = 4;
+
 	Timeline();
 	virtual ~Timeline() {}
 
 	virtual void reset();
-	virtual void scheduleAction(std::unique_ptr<FrameAction> action);
+	virtual void scheduleAction(FrameAction *action, unsigned int frame);
 	virtual void notifyStartOfExposure(unsigned int frame, utils::time_point time);
 
 	utils::duration frameInterval() const { return frameInterval_; }
@@ -52,16 +60,25 @@ protected:
 
 	void setRawDelay(unsigned int type, int frame, utils::duration time);
 
-	std::map<unsigned int, std::pair<int, utils::duration>> delays_;
+	std::array<std::pair<int, utils::duration>, MAX_ACTION_TYPES> delays_;
 
 private:
 	static constexpr unsigned int HISTORY_DEPTH = 10;
 
+	struct StartOfExposure {
+		unsigned int frame;
+		utils::time_point time;
+	};
+
 	void timeout(Timer *timer);
 	void updateDeadline();
 
-	std::list<std::pair<unsigned int, utils::time_point>> history_;
-	std::multimap<utils::time_point, std::unique_ptr<FrameAction>> actions_;
+	std::array<FrameAction *, MAX_FRAMES * MAX_ACTION_TYPES> actions_;
+	unsigned int pending_;
+
+	std::array<StartOfExposure, HISTORY_DEPTH> history_;
+	unsigned int historySize_;
+	unsigned int historyHead_;
 	utils::duration frameInterval_;
 
 	Timer timer_;
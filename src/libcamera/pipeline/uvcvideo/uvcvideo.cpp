@@ -78,6 +78,7 @@ public:
 
 	int start(Camera *camera) override;
 	void stop(Camera *camera) override;
+	void releaseDevice(Camera *camera) override;
 
 	int queueRequestDevice(Camera *camera, Request *request) override;
 
@@ -210,6 +211,14 @@ int PipelineHandlerUVC::configure(Camera *camera, CameraConfiguration *config)
 	format.size = cfg.size;
 
 	ret = data->video_->setFormat(&format);
+	if (ret == -EBUSY) {
+		/*
+		 * The buffer queue kept by stop() prevents changing the
+		 * format, release it.
+		 */
+		data->video_->releaseBuffers();
+		ret = data->video_->setFormat(&format);
+	}
 	if (ret)
 		return ret;
 
@@ -228,6 +237,10 @@ int PipelineHandlerUVC::exportFrameBuffers(Camera *camera, Stream *stream,
 	UVCCameraData *data = cameraData(camera);
 	unsigned int count = stream->configuration().bufferCount;
 
+	/* Buffers can't be exported while the buffer queue is allocated. */
+	if (data->video_->bufferCount())
+		data->video_->releaseBuffers();
+
 	return data->video_->exportBuffers(count, buffers);
 }
 
@@ -235,10 +248,21 @@ int PipelineHandlerUVC::start(Camera *camera)
 {
 	UVCCameraData *data = cameraData(camera);
 	unsigned int count = data->stream_.configuration().bufferCount;
+	int ret;
 
-	int ret = data->video_->importBuffers(count);
-	if (ret < 0)
-		return ret;
+	/*
+	 * Reuse the buffer queue kept by stop() if its size hasn't changed.
+	 * This preserves the association between the application buffers and
+	 * V4L2 buffers, avoiding a costly reimport of the dmabufs.
+	 */
+	if (data->video_->bufferCount() != count) {
+		if (data->video_->bufferCount())
+			data->video_->releaseBuffers();
+
+		ret = data->video_->importBuffers(count);
+		if (ret < 0)
+			return ret;
+	}
 
 	ret = data->video_->streamOn();
 	if (ret < 0) {
@@ -252,7 +276,14 @@ int PipelineHandlerUVC::start(Camera *camera)
 void PipelineHandlerUVC::stop(Camera *camera)
 {
 	UVCCameraData *data = cameraData(camera);
+
+	/* Keep the buffer queue to speed up reconfiguration and restart. */
 	data->video_->streamOff();
+}
+
+void PipelineHandlerUVC::releaseDevice(Camera *camera)
+{
+	UVCCameraData *data = cameraData(camera);
 	data->video_->releaseBuffers();
 }
 
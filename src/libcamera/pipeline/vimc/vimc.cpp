@@ -94,6 +94,7 @@ public:
 
 	int start(Camera *camera) override;
 	void stop(Camera *camera) override;
+	void releaseDevice(Camera *camera) override;
 
 	int queueRequestDevice(Camera *camera, Request *request) override;
 
@@ -276,6 +277,14 @@ int PipelineHandlerVimc::configure(Camera *camera, CameraConfiguration *config)
 	format.size = cfg.size;
 
 	ret = data->video_->setFormat(&format);
+	if (ret == -EBUSY) {
+		/*
+		 * The buffer queue kept by stop() prevents changing the
+		 * format, release it.
+		 */
+		data->video_->releaseBuffers();
+		ret = data->video_->setFormat(&format);
+	}
 	if (ret)
 		return ret;
 
@@ -305,6 +314,10 @@ int PipelineHandlerVimc::exportFrameBuffers(Camera *camera, Stream *stream,
 	VimcCameraData *data = cameraData(camera);
 	unsigned int count = stream->configuration().bufferCount;
 
+	/* Buffers can't be exported while the buffer queue is allocated. */
+	if (data->video_->bufferCount())
+		data->video_->releaseBuffers();
+
 	return data->video_->exportBuffers(count, buffers);
 }
 
@@ -312,10 +325,21 @@ int PipelineHandlerVimc::start(Camera *camera)
 {
 	VimcCameraData *data = cameraData(camera);
 	unsigned int count = data->stream_.configuration().bufferCount;
+	int ret;
 
-	int ret = data->video_->importBuffers(count);
-	if (ret < 0)
-		return ret;
+	/*
+	 * Reuse the buffer queue kept by stop() if its size hasn't changed.
+	 * This preserves the association between the application buffers and
+	 * V4L2 buffers, avoiding a costly reimport of the dmabufs.
+	 */
+	if (data->video_->bufferCount() != count) {
+		if (data->video_->bufferCount())
+			data->video_->releaseBuffers();
+
+		ret = data->video_->importBuffers(count);
+		if (ret < 0)
+			return ret;
+	}
 
 	ret = data->ipa_->start();
 	if (ret) {
@@ -336,8 +360,15 @@ int PipelineHandlerVimc::start(Camera *camera)
 void PipelineHandlerVimc::stop(Camera *camera)
 {
 	VimcCameraData *data = cameraData(camera);
+
+	/* Keep the buffer queue to speed up reconfiguration and restart. */
 	data->video_->streamOff();
 	data->ipa_->stop();
+}
+
+void PipelineHandlerVimc::releaseDevice(Camera *camera)
+{
+	VimcCameraData *data = cameraData(camera);
 	data->video_->releaseBuffers();
 }
 
@@ -0,0 +1,225 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2020, Google Inc.
+ *
+ * frame_generator.cpp - Test pattern generator for the virtual pipeline handler
+ */
+
+#include "frame_generator.h"
+
+#include <array>
+#include <errno.h>
+#include <map>
+#include <string.h>
+
+#include <libcamera/formats.h>
+
+#include "libcamera/internal/formats.h"
+#include "libcamera/internal/log.h"
+#include "libcamera/internal/utils.h"
+
+namespace libcamera {
+
+LOG_DECLARE_CATEGORY(Virtual)
+
+/*
+ * The pattern is made of eight vertical colour bars that scroll horizontally
+ * by a few pixels every frame. As all lines of a plane are identical, a single
+ * line is rendered per plane and replicated, which keeps the cost of frame
+ * generation close to the cost of a memcpy() of the frame.
+ */
+struct FrameGenerator::Pattern {
+	enum Type {
+		RGB,
+		YUVPacked,
+		YUVSemiPlanar,
+	};
+
+	Type type;
+	/*
+	 * RGB: bytes per pixel, and offsets of the R, G, B and A components
+	 * (-1 when there is no alpha component).
+	 * YUVPacked: bytes per pair of pixels, and offsets of the Y0, U and V
+	 * components (the Y1 offset is Y0 + 2).
+	 * YUVSemiPlanar: bytes per pair of pixels in the chroma plane, and
+	 * offsets of the U and V components.
+	 */
+	unsigned int bpp;
+	std::array<int, 4> offsets;
+};
+
+namespace {
+
+struct Colour {
+	uint8_t r;
+	uint8_t g;
+	uint8_t b;
+	uint8_t y;
+	uint8_t u;
+	uint8_t v;
+};
+
+constexpr Colour rgb(uint8_t r, uint8_t g, uint8_t b)
+{
+	/* BT.601 limited range. */
+	return {
+		r, g, b,
+		static_cast<uint8_t>(16 + ((66 * r + 129 * g + 25 * b + 128) >> 8)),
+		static_cast<uint8_t>(128 + ((-38 * r - 74 * g + 112 * b + 128) >> 8)),
+		static_cast<uint8_t>(128 + ((112 * r - 94 * g - 18 * b + 128) >> 8)),
+	};
+}
+
+constexpr std::array<Colour, 8> bars = {
+	rgb(255, 255, 255),
+	rgb(255, 255, 0),
+	rgb(0, 255, 255),
+	rgb(0, 255, 0),
+	rgb(255, 0, 255),
+	rgb(255, 0, 0),
+	rgb(0, 0, 255),
+	rgb(0, 0, 0),
+};
+
+/* Number of pixels the pattern scrolls by every frame. */
+constexpr unsigned int kScrollStep = 4;
+
+using Pattern = FrameGenerator::Pattern;
+
+const std::map<PixelFormat, Pattern> patterns{
+	{ formats::RGB888, { Pattern::RGB, 3, { 2, 1, 0, -1 } } },
+	{ formats::BGR888, { Pattern::RGB, 3, { 0, 1, 2, -1 } } },
+	{ formats::XRGB8888, { Pattern::RGB, 4, { 2, 1, 0, -1 } } },
+	{ formats::XBGR8888, { Pattern::RGB, 4, { 0, 1, 2, -1 } } },
+	{ formats::ARGB8888, { Pattern::RGB, 4, { 2, 1, 0, 3 } } },
+	{ formats::ABGR8888, { Pattern::RGB, 4, { 0, 1, 2, 3 } } },
+	{ formats::YUYV, { Pattern::YUVPacked, 4, { 0, 1, 3 } } },
+	{ formats::YVYU, { Pattern::YUVPacked, 4, { 0, 3, 1 } } },
+	{ formats::UYVY, { Pattern::YUVPacked, 4, { 1, 0, 2 } } },
+	{ formats::VYUY, { Pattern::YUVPacked, 4, { 1, 2, 0 } } },
+	{ formats::NV12, { Pattern::YUVSemiPlanar, 2, { 0, 1 } } },
+	{ formats::NV21, { Pattern::YUVSemiPlanar, 2, { 1, 0 } } },
+	{ formats::NV16, { Pattern::YUVSemiPlanar, 2, { 0, 1 } } },
+	{ formats::NV61, { Pattern::YUVSemiPlanar, 2, { 1, 0 } } },
+};
+
+} /* namespace */
+
+FrameGenerator::FrameGenerator()
+	: pattern_(nullptr), info_(nullptr), strides_{}, planeSizes_{},
+	  frameSize_(0)
+{
+}
+
+std::vector<PixelFormat> FrameGenerator::formats()
+{
+	return utils::map_keys(patterns);
+}
+
+int FrameGenerator::configure(const PixelFormat &format, const Size &size)
+{
+	auto it = patterns.find(format);
+	if (it == patterns.end()) {
+		LOG(Virtual, Error)
+			<< "Unsupported pixel format " << format.toString();
+		return -EINVAL;
+	}
+
+	pattern_ = &it->second;
+	info_ = &PixelFormatInfo::info(format);
+	size_ = size;
+	frameSize_ = 0;
+
+	for (unsigned int i = 0; i < 3; i++) {
+		unsigned int vss = info_->planes[i].verticalSubSampling;
+		if (!vss) {
+			strides_[i] = 0;
+			planeSizes_[i] = 0;
+			continue;
+		}
+
+		strides_[i] = info_->stride(size.width, i);
+		planeSizes_[i] = strides_[i] * ((size.height + vss - 1) / vss);
+		frameSize_ += planeSizes_[i];
+	}
+
+	return 0;
+}
+
+int FrameGenerator::generate(Span<uint8_t> frame, unsigned int sequence)
+{
+	if (!pattern_ || frame.size() < frameSize_)
+		return -EINVAL;
+
+	unsigned int offset = (sequence * kScrollStep) % size_.width;
+	uint8_t *mem = frame.data();
+
+	for (unsigned int i = 0; i < 3 && planeSizes_[i]; i++) {
+		unsigned int stride = strides_[i];
+		unsigned int lines = planeSizes_[i] / stride;
+
+		fillLine(mem, i, offset);
+		for (unsigned int y = 1; y < lines; y++)
+			memcpy(mem + y * stride, mem, stride);
+
+		mem += planeSizes_[i];
+	}
+
+	return 0;
+}
+
+void FrameGenerator::fillLine(uint8_t *line, unsigned int plane,
+			      unsigned int offset) const
+{
+	const std::array<int, 4> &pos = pattern_->offsets;
+	unsigned int width = size_.width;
+
+	auto colour = [&](unsigned int x) -> const Colour & {
+		return bars[(x + offset) % width * bars.size() / width];
+	};
+
+	switch (pattern_->type) {
+	case Pattern::RGB:
+		for (unsigned int x = 0; x < width; x++) {
+			const Colour &c = colour(x);
+			uint8_t *pixel = line + x * pattern_->bpp;
+
+			pixel[pos[0]] = c.r;
+			pixel[pos[1]] = c.g;
+			pixel[pos[2]] = c.b;
+			if (pos[3] >= 0)
+				pixel[pos[3]] = 0xff;
+		}
+		break;
+
+	case Pattern::YUVPacked:
+		for (unsigned int x = 0; x < width; x += 2) {
+			const Colour &c = colour(x);
+			uint8_t *pixel = line + x / 2 * pattern_->bpp;
+
+			pixel[pos[0]] = c.y;
+			pixel[pos[0] + 2] = colour(x + 1).y;
+			pixel[pos[1]] = c.u;
+			pixel[pos[2]] = c.v;
+		}
+		break;
+
+	case Pattern::YUVSemiPlanar:
+		if (plane == 0) {
+			for (unsigned int x = 0; x < width; x++)
+				line[x] = colour(x).y;
+			break;
+		}
+
+		for (unsigned int x = 0; x < width; x += 2) {
+			const Colour &c = colour(x);
+			uint8_t *pixel = line + x / 2 * pattern_->bpp;
+
+			pixel[pos[0]] = c.u;
+			pixel[pos[1]] = c.v;
+		}
+		break;
+	}
+}
+
+} /* namespace libcamera */
@@ -0,0 +1,51 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2020, Google Inc.
+ *
+ * frame_generator.h - Test pattern generator for the virtual pipeline handler
+ */
+#ifndef __LIBCAMERA_PIPELINE_VIRTUAL_FRAME_GENERATOR_H__
+#define __LIBCAMERA_PIPELINE_VIRTUAL_FRAME_GENERATOR_H__
+
+#include <stdint.h>
+#include <vector>
+
+#include <libcamera/geometry.h>
+#include <libcamera/pixel_format.h>
+#include <libcamera/span.h>
+
+namespace libcamera {
+
+class PixelFormatInfo;
+
+class FrameGenerator
+{
+public:
+	struct Pattern;
+
+	FrameGenerator();
+
+	static std::vector<PixelFormat> formats();
+
+	int configure(const PixelFormat &format, const Size &size);
+	int generate(Span<uint8_t> frame, unsigned int sequence);
+
+	unsigned int stride() const { return strides_[0]; }
+	unsigned int frameSize() const { return frameSize_; }
+
+private:
+	void fillLine(uint8_t *line, unsigned int plane,
+		      unsigned int offset) const;
+
+	const Pattern *pattern_;
+	const PixelFormatInfo *info_;
+	Size size_;
+
+	unsigned int strides_[3];
+	unsigned int planeSizes_[3];
+	unsigned int frameSize_;
+};
+
+} /* namespace libcamera */
+
+#endif /* __LIBCAMERA_PIPELINE_VIRTUAL_FRAME_GENERATOR_H__ */
@@ -0,0 +1,673 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2020, Google Inc.
+ *
+ * virtual.cpp - Pipeline handler for software-only virtual cameras
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <errno.h>
+#include <map>
+#include <queue>
+#include <random>
+#include <sstream>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <libcamera/camera.h>
+#include <libcamera/camera_manager.h>
+#include <libcamera/file_descriptor.h>
+#include <libcamera/formats.h>
+#include <libcamera/property_ids.h>
+#include <libcamera/request.h>
+#include <libcamera/stream.h>
+#include <libcamera/timer.h>
+
+#include "libcamera/internal/buffer.h"
+#include "libcamera/internal/formats.h"
+#include "libcamera/internal/log.h"
+#include "libcamera/internal/pipeline_handler.h"
+#include "libcamera/internal/utils.h"
+
+#include "frame_generator.h"
+
+namespace libcamera {
+
+LOG_DEFINE_CATEGORY(Virtual)
+
+namespace {
+
+constexpr Size kMinSize{ 32, 32 };
+
+/*
+ * Description of a virtual camera, parsed from the LIBCAMERA_VIRTUAL_CAMERAS
+ * environment variable. The variable contains a semicolon-separated list of
+ * cameras, each described by a comma-separated list of key=value pairs:
+ *
+ * - id: the camera ID (defaults to "Virtual<n>")
+ * - size: the maximum frame size, as <width>x<height> (1920x1080)
+ * - formats: colon-separated list of pixel formats (all supported formats)
+ * - fps: the frame rate (30)
+ * - streams: the number of streams (1)
+ * - buffers: the number of buffers per stream (4)
+ * - jitter: maximum frame timing jitter, in microseconds (0)
+ * - drop: percentage of frames randomly dropped by the "sensor" (0)
+ * - seed: seed of the random generator for jitter and drops (0)
+ *
+ * A bare token without '=' is interpreted as a camera ID. For instance
+ *
+ * LIBCAMERA_VIRTUAL_CAMERAS="virt0;id=virt1,size=640x480,formats=YUYV,fps=60"
+ */
+struct VirtualCameraSpec {
+	std::string id;
+	Size size{ 1920, 1080 };
+	std::vector<PixelFormat> formats;
+	unsigned int fps = 30;
+	unsigned int streams = 1;
+	unsigned int buffers = 4;
+	unsigned int jitter = 0;
+	double drop = 0.0;
+	unsigned int seed = 0;
+};
+
+bool parseSpecValue(VirtualCameraSpec *spec, const std::string &key,
+		    const std::string &value)
+{
+	char *end;
+
+	if (key == "id") {
+		spec->id = value;
+		return !value.empty();
+	}
+
+	if (key == "size") {
+		unsigned long width = strtoul(value.c_str(), &end, 10);
+		if (*end != 'x')
+			return false;
+		unsigned long height = strtoul(end + 1, &end, 10);
+		if (*end != '\0')
+			return false;
+
+		spec->size = Size(width, height);
+		return spec->size.width >= kMinSize.width &&
+		       spec->size.height >= kMinSize.height;
+	}
+
+	if (key == "formats") {
+		std::istringstream stream(value);
+		std::string name;
+
+		spec->formats.clear();
+		while (std::getline(stream, name, ':')) {
+			const PixelFormatInfo &info = PixelFormatInfo::info(name);
+			const std::vector<PixelFormat> supported = FrameGenerator::formats();
+
+			if (std::find(supported.begin(), supported.end(),
+				      info.format) == supported.end()) {
+				LOG(Virtual, Error)
+					<< "Unsupported pixel format " << name;
+				return false;
+			}
+
+			spec->formats.push_back(info.format);
+		}
+
+		return !spec->formats.empty();
+	}
+
+	if (key == "drop") {
+		spec->drop = strtod(value.c_str(), &end);
+		return *end == '\0' && spec->drop >= 0.0 && spec->drop <= 100.0;
+	}
+
+	unsigned int *field;
+	if (key == "fps")
+		field = &spec->fps;
+	else if (key == "streams")
+		field = &spec->streams;
+	else if (key == "buffers")
+		field = &spec->buffers;
+	else if (key == "jitter")
+		field = &spec->jitter;
+	else if (key == "seed")
+		field = &spec->seed;
+	else
+		return false;
+
+	*field = strtoul(value.c_str(), &end, 10);
+	if (*end != '\0')
+		return false;
+
+	if (field == &spec->fps || field == &spec->streams ||
+	    field == &spec->buffers)
+		return *field != 0;
+
+	return true;
+}
+
+std::vector<VirtualCameraSpec> parseSpecs(const char *specs)
+{
+	std::vector<VirtualCameraSpec> cameras;
+	std::istringstream list(specs);
+	std::string camera;
+
+	while (std::getline(list, camera, ';')) {
+		if (camera.empty())
+			continue;
+
+		VirtualCameraSpec spec;
+		spec.id = "Virtual" + std::to_string(cameras.size());
+		spec.formats = FrameGenerator::formats();
+
+		std::istringstream items(camera);
+		std::string item;
+		bool valid = true;
+
+		while (std::getline(items, item, ',')) {
+			size_t pos = item.find('=');
+			if (pos == std::string::npos) {
+				spec.id = item;
+				continue;
+			}
+
+			std::string key = item.substr(0, pos);
+			std::string value = item.substr(pos + 1);
+
+			if (!parseSpecValue(&spec, key, value)) {
+				LOG(Virtual, Error)
+					<< "Invalid virtual camera parameter '"
+					<< item << "'";
+				valid = false;
+				break;
+			}
+		}
+
+		if (valid)
+			cameras.push_back(std::move(spec));
+	}
+
+	return cameras;
+}
+
+} /* namespace */
+
+class VirtualCameraData : public CameraData
+{
+public:
+	struct VirtualStream {
+		Stream stream;
+		FrameGenerator generator;
+	};
+
+	VirtualCameraData(PipelineHandler *pipe, const VirtualCameraSpec &spec);
+
+	int mapBuffer(const FrameBuffer *buffer);
+	void start();
+	void stop();
+	void cancelRequest(Request *request);
+
+	VirtualCameraSpec spec_;
+	std::vector<VirtualStream> streams_;
+	std::queue<Request *> pendingRequests_;
+	bool running_;
+
+private:
+	void scheduleFrame();
+	void frameTimeout(Timer *timer);
+	void completeFrame(Request *request, unsigned int sequence,
+			   uint64_t timestamp);
+
+	Timer frameTimer_;
+	utils::duration frameInterval_;
+	utils::time_point nextFrame_;
+	unsigned int sequence_;
+
+	std::map<const FrameBuffer *, MappedFrameBuffer> mappedBuffers_;
+
+	std::minstd_rand random_;
+	std::uniform_int_distribution<int> jitter_;
+	std::bernoulli_distribution drop_;
+};
+
+class VirtualCameraConfiguration : public CameraConfiguration
+{
+public:
+	VirtualCameraConfiguration(VirtualCameraData *data);
+
+	Status validate() override;
+
+private:
+	VirtualCameraData *data_;
+};
+
+class PipelineHandlerVirtual : public PipelineHandler
+{
+public:
+	PipelineHandlerVirtual(CameraManager *manager);
+
+	CameraConfiguration *generateConfiguration(Camera *camera,
+		const StreamRoles &roles) override;
+	int configure(Camera *camera, CameraConfiguration *config) override;
+	bool buffersCompatible(Camera *camera,
+			       const StreamConfiguration &previous,
+			       const StreamConfiguration &current) override;
+
+	int exportFrameBuffers(Camera *camera, Stream *stream,
+			       std::vector<std::unique_ptr<FrameBuffer>> *buffers) override;
+
+	int start(Camera *camera) override;
+	void stop(Camera *camera) override;
+
+	int queueRequestDevice(Camera *camera, Request *request) override;
+
+	bool match(DeviceEnumerator *enumerator) override;
+
+private:
+	VirtualCameraData *cameraData(const Camera *camera)
+	{
+		return static_cast<VirtualCameraData *>(
+			PipelineHandler::cameraData(camera));
+	}
+};
+
+VirtualCameraData::VirtualCameraData(PipelineHandler *pipe,
+				     const VirtualCameraSpec &spec)
+	: CameraData(pipe), spec_(spec), streams_(spec.streams),
+	  running_(false),
+	  frameInterval_(std::chrono::nanoseconds(1000000000 / spec.fps)),
+	  sequence_(0), random_(spec.seed),
+	  jitter_(-static_cast<int>(spec.jitter), spec.jitter),
+	  drop_(spec.drop / 100.0)
+{
+	frameTimer_.timeout.connect(this, &VirtualCameraData::frameTimeout);
+
+	properties_ = ControlList(properties::properties);
+	properties_.set(properties::Location, properties::CameraLocationExternal);
+	properties_.set(properties::PixelArraySize, spec_.size);
+	properties_.set(properties::PixelArrayActiveAreas,
+			{ Rectangle(0, 0, spec_.size) });
+}
+
+int VirtualCameraData::mapBuffer(const FrameBuffer *buffer)
+{
+	if (mappedBuffers_.count(buffer))
+		return 0;
+
+	MappedFrameBuffer map(buffer, PROT_READ | PROT_WRITE);
+	if (!map.isValid())
+		return map.error();
+
+	mappedBuffers_.emplace(buffer, std::move(map));
+	return 0;
+}
+
+void VirtualCameraData::start()
+{
+	running_ = true;
+	sequence_ = 0;
+	nextFrame_ = utils::clock::now();
+
+	scheduleFrame();
+}
+
+void VirtualCameraData::stop()
+{
+	running_ = false;
+	frameTimer_.stop();
+
+	while (!pendingRequests_.empty()) {
+		Request *request = pendingRequests_.front();
+		pendingRequests_.pop();
+		cancelRequest(request);
+	}
+
+	mappedBuffers_.clear();
+}
+
+void VirtualCameraData::cancelRequest(Request *request)
+{
+	for (auto it : request->buffers()) {
+		FrameBuffer *buffer = it.second;
+		FrameMetadata metadata = buffer->metadata();
+
+		metadata.status = FrameMetadata::FrameCancelled;
+		FrameBufferMetadata::set(buffer, metadata);
+		pipe_->completeBuffer(camera_, request, buffer);
+	}
+
+	pipe_->completeRequest(camera_, request);
+}
+
+void VirtualCameraData::scheduleFrame()
+{
+	nextFrame_ += frameInterval_;
+
+	utils::time_point deadline = nextFrame_;
+	if (spec_.jitter)
+		deadline += std::chrono::microseconds(jitter_(random_));
+
+	frameTimer_.start(deadline);
+}
+
+void VirtualCameraData::frameTimeout([[maybe_unused]] Timer *timer)
+{
+	utils::time_point now = utils::clock::now();
+	unsigned int sequence = sequence_++;
+
+	/*
+	 * If the event loop has been stalled for more than a frame interval,
+	 * behave like a real sensor and skip the frames that were missed,
+	 * creating a gap in the sequence numbers.
+	 */
+	while (nextFrame_ + frameInterval_ < now) {
+		nextFrame_ += frameInterval_;
+		sequence_++;
+	}
+
+	scheduleFrame();
+
+	if (spec_.drop > 0.0 && drop_(random_)) {
+		LOG(Virtual, Debug) << "Dropping frame " << sequence;
+		return;
+	}
+
+	/* As with a real sensor, frames are lost if no buffer is queued. */
+	if (pendingRequests_.empty())
+		return;
+
+	Request *request = pendingRequests_.front();
+	pendingRequests_.pop();
+
+	uint64_t timestamp = std::chrono::duration_cast<std::chrono::nanoseconds>(
+		now.time_since_epoch()).count();
+
+	completeFrame(request, sequence, timestamp);
+}
+
+void VirtualCameraData::completeFrame(Request *request, unsigned int sequence,
+				      uint64_t timestamp)
+{
+	for (VirtualStream &vstream : streams_) {
+		FrameBuffer *buffer = request->findBuffer(&vstream.stream);
+		if (!buffer)
+			continue;
+
+		const MappedFrameBuffer &map = mappedBuffers_.at(buffer);
+		FrameMetadata metadata;
+
+		int ret = vstream.generator.generate(map.maps()[0], sequence);
+
+		metadata.status = ret ? FrameMetadata::FrameError
+				      : FrameMetadata::FrameSuccess;
+		metadata.sequence = sequence;
+		metadata.timestamp = timestamp;
+		metadata.planes.resize(buffer->planes().size());
+		metadata.planes[0].bytesused = ret ? 0 : vstream.generator.frameSize();
+		FrameBufferMetadata::set(buffer, metadata);
+
+		pipe_->completeBuffer(camera_, request, buffer);
+	}
+
+	pipe_->completeRequest(camera_, request);
+}
+
+VirtualCameraConfiguration::VirtualCameraConfiguration(VirtualCameraData *data)
+	: CameraConfiguration(), data_(data)
+{
+}
+
+CameraConfiguration::Status VirtualCameraConfiguration::validate()
+{
+	const VirtualCameraSpec &spec = data_->spec_;
+	Status status = Valid;
+
+	if (config_.empty())
+		return Invalid;
+
+	/* Cap the number of entries to the available streams. */
+	if (config_.size() > spec.streams) {
+		config_.resize(spec.streams);
+		status = Adjusted;
+	}
+
+	for (StreamConfiguration &cfg : config_) {
+		if (std::find(spec.formats.begin(), spec.formats.end(),
+			      cfg.pixelFormat) == spec.formats.end()) {
+			LOG(Virtual, Debug)
+				<< "Adjusting format to "
+				<< spec.formats[0].toString();
+			cfg.pixelFormat = spec.formats[0];
+			status = Adjusted;
+		}
+
+		/* Keep sizes even to accommodate chroma subsampling. */
+		const Size size = cfg.size;
+
+		cfg.size.width = std::clamp(cfg.size.width, kMinSize.width,
+					    spec.size.width) & ~1U;
+		cfg.size.height = std::clamp(cfg.size.height, kMinSize.height,
+					     spec.size.height) & ~1U;
+
+		if (cfg.size != size) {
+			LOG(Virtual, Debug)
+				<< "Adjusting size to " << cfg.size.toString();
+			status = Adjusted;
+		}
+
+		cfg.bufferCount = spec.buffers;
+
+		FrameGenerator generator;
+		int ret = generator.configure(cfg.pixelFormat, cfg.size);
+		if (ret)
+			return Invalid;
+
+		cfg.stride = generator.stride();
+		cfg.frameSize = generator.frameSize();
+	}
+
+	return status;
+}
+
+PipelineHandlerVirtual::PipelineHandlerVirtual(CameraManager *manager)
+	: PipelineHandler(manager)
+{
+}
+
+CameraConfiguration *PipelineHandlerVirtual::generateConfiguration(Camera *camera,
+	const StreamRoles &roles)
+{
+	VirtualCameraData *data = cameraData(camera);
+	const VirtualCameraSpec &spec = data->spec_;
+	CameraConfiguration *config = new VirtualCameraConfiguration(data);
+
+	if (roles.empty())
+		return config;
+
+	std::map<PixelFormat, std::vector<SizeRange>> formats;
+	for (const PixelFormat &format : spec.formats)
+		formats[format] = { SizeRange{ kMinSize, spec.size } };
+
+	for (unsigned int i = 0; i < roles.size(); i++) {
+		StreamConfiguration cfg(formats);
+
+		cfg.pixelFormat = spec.formats[0];
+		cfg.size = spec.size;
+		cfg.bufferCount = spec.buffers;
+
+		config->addConfiguration(cfg);
+	}
+
+	config->validate();
+
+	return config;
+}
+
+int PipelineHandlerVirtual::configure(Camera *camera, CameraConfiguration *config)
+{
+	VirtualCameraData *data = cameraData(camera);
+
+	for (unsigned int i = 0; i < config->size(); i++) {
+		StreamConfiguration &cfg = config->at(i);
+		VirtualCameraData::VirtualStream &vstream = data->streams_[i];
+
+		int ret = vstream.generator.configure(cfg.pixelFormat, cfg.size);
+		if (ret)
+			return ret;
+
+		cfg.setStream(&vstream.stream);
+	}
+
+	return 0;
+}
+
+bool PipelineHandlerVirtual::buffersCompatible([[maybe_unused]] Camera *camera,
+					       const StreamConfiguration &previous,
+					       const StreamConfiguration &current)
+{
+	/*
+	 * Buffers are single-plane memfds of the frame size, they can be
+	 * reused for any format that fits.
+	 */
+	return current.frameSize <= previous.frameSize;
+}
+
+int PipelineHandlerVirtual::exportFrameBuffers([[maybe_unused]] Camera *camera,
+					       Stream *stream,
+					       std::vector<std::unique_ptr<FrameBuffer>> *buffers)
+{
+	const StreamConfiguration &cfg = stream->configuration();
+
+	for (unsigned int i = 0; i < cfg.bufferCount; i++) {
+		int fd = memfd_create("libcamera-virtual", MFD_CLOEXEC);
+		if (fd < 0) {
+			int ret = -errno;
+			LOG(Virtual, Error)
+				<< "Failed to allocate buffer: " << strerror(-ret);
+			buffers->clear();
+			return ret;
+		}
+
+		if (ftruncate(fd, cfg.frameSize) < 0) {
+			int ret = -errno;
+			LOG(Virtual, Error)
+				<< "Failed to size buffer: " << strerror(-ret);
+			close(fd);
+			buffers->clear();
+			return ret;
+		}
+
+		FrameBuffer::Plane plane;
+		plane.fd = FileDescriptor(std::move(fd));
+		plane.length = cfg.frameSize;
+
+		buffers->push_back(std::make_unique<FrameBuffer>(
+			std::vector<FrameBuffer::Plane>{ plane }, i));
+	}
+
+	return cfg.bufferCount;
+}
+
+int PipelineHandlerVirtual::start(Camera *camera)
+{
+	VirtualCameraData *data = cameraData(camera);
+
+	data->start();
+
+	return 0;
+}
+
+void PipelineHandlerVirtual::stop(Camera *camera)
+{
+	VirtualCameraData *data = cameraData(camera);
+
+	data->stop();
+}
+
+int PipelineHandlerVirtual::queueRequestDevice(Camera *camera, Request *request)
+{
+	VirtualCameraData *data = cameraData(camera);
+
+	/*
+	 * Requests are queued to the pipeline handler asynchronously, and may
+	 * thus reach us after the camera has been stopped. Their buffers are
+	 * not mapped anymore, cancel them right away.
+	 */
+	if (!data->running_) {
+		data->cancelRequest(request);
+		return 0;
+	}
+
+	for (auto it : request->buffers()) {
+		const Stream *stream = it.first;
+		FrameBuffer *buffer = it.second;
+
+		auto match = std::find_if(data->streams_.begin(), data->streams_.end(),
+					  [&](const VirtualCameraData::VirtualStream &s) {
+						  return &s.stream == stream;
+					  });
+		if (match == data->streams_.end()) {
+			LOG(Virtual, Error)
+				<< "Attempt to queue request with invalid stream";
+			return -ENOENT;
+		}
+
+		if (buffer->planes()[0].length < match->generator.frameSize()) {
+			LOG(Virtual, Error) << "Buffer too small";
+			return -EINVAL;
+		}
+
+		int ret = data->mapBuffer(buffer);
+		if (ret) {
+			LOG(Virtual, Error)
+				<< "Failed to map buffer: " << strerror(-ret);
+			return ret;
+		}
+	}
+
+	data->pendingRequests_.push(request);
+
+	return 0;
+}
+
+bool PipelineHandlerVirtual::match([[maybe_unused]] DeviceEnumerator *enumerator)
+{
+	const char *specs = utils::secure_getenv("LIBCAMERA_VIRTUAL_CAMERAS");
+	if (!specs)
+		return false;
+
+	bool registered = false;
+
+	for (const VirtualCameraSpec &spec : parseSpecs(specs)) {
+		/*
+		 * The handler is matched repeatedly, including on hotplug
+		 * events. Only create the cameras that don't exist yet.
+		 */
+		if (manager_->get(spec.id))
+			continue;
+
+		std::unique_ptr<VirtualCameraData> data =
+			std::make_unique<VirtualCameraData>(this, spec);
+
+		std::set<Stream *> streams;
+		for (VirtualCameraData::VirtualStream &vstream : data->streams_)
+			streams.insert(&vstream.stream);
+
+		LOG(Virtual, Info)
+			<< "Registering virtual camera '" << spec.id << "' ("
+			<< spec.size.toString() << ", " << spec.fps << " fps, "
+			<< spec.streams << " stream(s))";
+
+		std::shared_ptr<Camera> camera =
+			Camera::create(this, spec.id, streams);
+		registerCamera(std::move(camera), std::move(data));
+		registered = true;
+	}
+
+	return registered;
+}
+
+REGISTER_PIPELINE_HANDLER(PipelineHandlerVirtual);
+
+} /* namespace libcamera */
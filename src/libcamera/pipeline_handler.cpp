@@ -13,9 +13,12 @@
 #include <libcamera/camera.h>
 #include <libcamera/camera_manager.h>
 
+#include "libcamera/internal/camera_statistics.h"
 #include "libcamera/internal/device_enumerator.h"
+#include "libcamera/internal/formats.h"
 #include "libcamera/internal/log.h"
 #include "libcamera/internal/media_device.h"
+#include "libcamera/internal/tracer.h"
 #include "libcamera/internal/utils.h"
 
 /**
@@ -323,6 +326,47 @@ const ControlList &PipelineHandler::properties(const Camera *camera) const
  * \return 0 on success or a negative error code otherwise
  */
 
+/**
+ * \brief Check if buffers remain usable across a stream reconfiguration
+ * \param[in] camera The camera
+ * \param[in] previous The stream configuration before reconfiguration
+ * \param[in] current The stream configuration after reconfiguration
+ *
+ * This method is called by the Camera class after a successful configure()
+ * for every stream that was already part of the previous configuration. It
+ * reports whether buffers suitable for the \a previous stream configuration,
+ * and in particular buffers allocated with exportFrameBuffers() for it, can
+ * be used unchanged with the \a current configuration. Applications are then
+ * notified through Stream::buffersPreserved() that they don't need to
+ * reallocate buffers, which speeds up mode switches significantly.
+ *
+ * The default implementation considers buffers compatible when both frame
+ * sizes are known, the number of planes of the pixel formats match, and the
+ * \a current frame size doesn't exceed the \a previous one. Pipeline handlers
+ * that place additional constraints on buffers, or that don't report the
+ * frame size accurately, shall override this method.
+ *
+ * \context This function is called from the CameraManager thread.
+ *
+ * \return True if buffers for the \a previous configuration can be used with
+ * the \a current configuration, false otherwise
+ */
+bool PipelineHandler::buffersCompatible([[maybe_unused]] Camera *camera,
+					const StreamConfiguration &previous,
+					const StreamConfiguration &current)
+{
+	if (!previous.frameSize || !current.frameSize)
+		return false;
+
+	const PixelFormatInfo &previousInfo = PixelFormatInfo::info(previous.pixelFormat);
+	const PixelFormatInfo &currentInfo = PixelFormatInfo::info(current.pixelFormat);
+	if (!previousInfo.isValid() || !currentInfo.isValid() ||
+	    previousInfo.numPlanes() != currentInfo.numPlanes())
+		return false;
+
+	return current.frameSize <= previous.frameSize;
+}
+
 /**
  * \fn PipelineHandler::exportFrameBuffers()
  * \brief Allocate and export buffers for \a stream
@@ -373,6 +417,22 @@ const ControlList &PipelineHandler::properties(const Camera *camera) const
  * \context This function is called from the CameraManager thread.
  */
 
+/**
+ * \brief Release resources held for a camera
+ * \param[in] camera The camera being released
+ *
+ * This method is called by Camera::release() when the application releases
+ * the \a camera. Pipeline handlers that keep device resources, such as V4L2
+ * buffer queues, allocated across stop() and configure() to speed up
+ * reconfiguration shall release them here. The default implementation does
+ * nothing.
+ *
+ * \context This function is called from the CameraManager thread.
+ */
+void PipelineHandler::releaseDevice([[maybe_unused]] Camera *camera)
+{
+}
+
 /**
  * \fn PipelineHandler::queueRequest()
  * \brief Queue a request to the camera
@@ -396,9 +456,15 @@ int PipelineHandler::queueRequest(Camera *camera, Request *request)
 	CameraData *data = cameraData(camera);
 	data->queuedRequests_.push_back(request);
 
-	int ret = queueRequestDevice(camera, request);
-	if (ret)
+	int ret;
+	{
+		TRACE_SCOPE("Pipeline", "queueRequestDevice", traceId(request));
+		ret = queueRequestDevice(camera, request);
+	}
+	if (ret) {
 		data->queuedRequests_.remove(request);
+		camera->statisticsRecorder()->requestQueueFailed(request);
+	}
 
 	return ret;
 }
@@ -441,6 +507,13 @@ int PipelineHandler::queueRequest(Camera *camera, Request *request)
 bool PipelineHandler::completeBuffer(Camera *camera, Request *request,
 				     FrameBuffer *buffer)
 {
+	for (const auto &it : request->buffers()) {
+		if (it.second == buffer) {
+			camera->statisticsRecorder()->bufferCompleted(it.first, buffer);
+			break;
+		}
+	}
+
 	camera->bufferCompleted.emit(request, buffer);
 	return request->completeBuffer(buffer);
 }
@@ -473,6 +546,8 @@ void PipelineHandler::completeRequest(Camera *camera, Request *request)
 
 		ASSERT(!req->hasPendingBuffers());
 		data->queuedRequests_.pop_front();
+
+		TRACE_EVENT(AsyncEnd, "Camera", "Request", traceId(req));
 		camera->requestComplete(req);
 	}
 }
@@ -493,16 +568,15 @@ void PipelineHandler::registerCamera(std::shared_ptr<Camera> camera,
 				     std::unique_ptr<CameraData> data)
 {
 	data->camera_ = camera.get();
+	if (data->ipa_)
+		data->ipa_->setStatisticsRecorder(camera->statisticsRecorder());
 	cameraData_[camera.get()] = std::move(data);
 	cameras_.push_back(camera);
 
-	if (mediaDevices_.empty())
-		LOG(Pipeline, Fatal)
-			<< "Registering camera with no media devices!";
-
 	/*
 	 * Walk the entity list and map the devnums of all capture video nodes
-	 * to the camera.
+	 * to the camera. Cameras that are not backed by any media device, such
+	 * as virtual cameras, are registered without devnums.
 	 */
 	std::vector<dev_t> devnums;
 	for (const std::shared_ptr<MediaDevice> &media : mediaDevices_) {
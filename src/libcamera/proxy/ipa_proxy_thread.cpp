@@ -10,11 +10,13 @@
 #include <libcamera/ipa/ipa_interface.h>
 #include <libcamera/ipa/ipa_module_info.h>
 
+#include "libcamera/internal/camera_statistics.h"
 #include "libcamera/internal/ipa_context_wrapper.h"
 #include "libcamera/internal/ipa_module.h"
 #include "libcamera/internal/ipa_proxy.h"
 #include "libcamera/internal/log.h"
 #include "libcamera/internal/thread.h"
+#include "libcamera/internal/tracer.h"
 
 namespace libcamera {
 
@@ -38,6 +40,8 @@ public:
 	void unmapBuffers(const std::vector<unsigned int> &ids) override;
 	void processEvent(const IPAOperationData &event) override;
 
+	void setStatisticsRecorder(CameraStatisticsRecorder *stats) override;
+
 private:
 	void queueFrameAction(unsigned int frame, const IPAOperationData &data);
 
@@ -45,11 +49,21 @@ private:
 	class ThreadProxy : public Object
 	{
 	public:
+		ThreadProxy()
+			: ipa_(nullptr), stats_(nullptr)
+		{
+		}
+
 		void setIPA(IPAInterface *ipa)
 		{
 			ipa_ = ipa;
 		}
 
+		void setStatisticsRecorder(CameraStatisticsRecorder *stats)
+		{
+			stats_ = stats;
+		}
+
 		int start()
 		{
 			return ipa_->start();
@@ -62,11 +76,17 @@ private:
 
 		void processEvent(const IPAOperationData &event)
 		{
+			TRACE_SCOPE("IPA", "processEvent", event.operation);
+
+			utils::time_point start = utils::clock::now();
 			ipa_->processEvent(event);
+			if (stats_)
+				stats_->ipaProcessed(utils::clock::now() - start);
 		}
 
 	private:
 		IPAInterface *ipa_;
+		CameraStatisticsRecorder *stats_;
 	};
 
 	bool running_;
@@ -162,8 +182,17 @@ void IPAProxyThread::processEvent(const IPAOperationData &event)
 			    event);
 }
 
+void IPAProxyThread::setStatisticsRecorder(CameraStatisticsRecorder *stats)
+{
+	IPAProxy::setStatisticsRecorder(stats);
+
+	/* The IPA thread isn't running yet, no need to synchronize. */
+	proxy_.setStatisticsRecorder(stats);
+}
+
 void IPAProxyThread::queueFrameAction(unsigned int frame, const IPAOperationData &data)
 {
+	TRACE_EVENT(Instant, "IPA", "queueFrameAction", data.operation);
 	IPAInterface::queueFrameAction.emit(frame, data);
 }
 
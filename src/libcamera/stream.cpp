@@ -423,6 +423,7 @@ std::string StreamConfiguration::toString() const
  * \brief Construct a stream with default parameters
  */
 Stream::Stream()
+	: buffersPreserved_(false)
 {
 }
 
@@ -441,4 +442,34 @@ Stream::Stream()
  * next call to Camera::configure() regardless of if it includes the stream.
  */
 
+/**
+ * \fn Stream::buffersPreserved()
+ * \brief Check if buffers remain valid across the last reconfiguration
+ *
+ * Reconfiguring a camera usually requires applications to free the buffers
+ * they have allocated for a stream and to allocate new ones, which is costly.
+ * When the new stream configuration is compatible with the previous one, for
+ * instance when switching between modes that use the same format and size, or
+ * when the new frame size is smaller, the pipeline handler may allow buffers
+ * to be reused unchanged.
+ *
+ * This method reports whether buffers that were valid for the stream before
+ * the last successful call to Camera::configure() are still valid for the
+ * active configuration. This includes buffers allocated with a
+ * FrameBufferAllocator, which then don't need to be freed and reallocated.
+ * The value is always false after the first configuration that includes the
+ * stream.
+ *
+ * \return True if buffers for the previous configuration remain valid, false
+ * otherwise
+ */
+
+/**
+ * \var Stream::buffersPreserved_
+ * \brief Tell if buffers are preserved across the last reconfiguration
+ *
+ * The value is set by Camera::configure() for every stream in the new
+ * configuration.
+ */
+
 } /* namespace libcamera */
@@ -0,0 +1,482 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2020, Google Inc.
+ *
+ * tracer.cpp - Lightweight event tracing
+ */
+
+#include "libcamera/internal/tracer.h"
+
+#include <algorithm>
+#include <array>
+#include <fstream>
+#include <iomanip>
+#include <unistd.h>
+
+#include "libcamera/internal/log.h"
+#include "libcamera/internal/utils.h"
+
+/**
+ * \file tracer.h
+ * \brief Lightweight event tracing
+ *
+ * The tracer records timestamped events at key points of the capture pipeline,
+ * from the application queueing a request to the request completing, to help
+ * locating where time is spent when frames are late. Events are stored in
+ * per-thread ring buffers without locking, and can be exported in the Chrome
+ * trace event JSON format for inspection in a trace viewer such as
+ * chrome://tracing or Perfetto.
+ *
+ * Tracing is disabled by default, in which case a trace point only costs a
+ * single test of a global flag. It is enabled by setting the
+ * LIBCAMERA_TRACE_FILE environment variable to the name of the file the trace
+ * shall be written to when the process exits. The trace can also be dumped on
+ * demand with Tracer::dump().
+ */
+
+namespace libcamera {
+
+LOG_DEFINE_CATEGORY(Tracer)
+
+namespace {
+
+struct TraceEvent {
+	uint64_t timestamp;
+	uint64_t id;
+	const char *category;
+	const char *name;
+	Tracer::EventType type;
+};
+
+} /* namespace */
+
+/*
+ * The per-thread event ring buffer. Events are written by the owning thread
+ * only, and read concurrently by Tracer::dump().
+ *
+ * Each slot is protected by a sequence lock. The slot sequence number is odd
+ * while the owning thread writes the event with absolute index i, and set to
+ * 2 * (i + 1) once the event is complete. Readers check the sequence number
+ * before and after copying the event, and drop events that have been
+ * overwritten or are being written. All slot fields are atomic, accessed with
+ * relaxed ordering and synchronised by the sequence number, to make the
+ * concurrent accesses well defined.
+ *
+ * Buffers are recycled when their thread exits. The tid and the index of the
+ * first event of the current owner are only modified when a thread acquires
+ * the buffer, and are protected by the tracer mutex.
+ */
+class TraceBuffer
+{
+public:
+	static constexpr unsigned int kSize = 8192;
+
+	TraceBuffer(pid_t tid)
+		: tid_(tid), start_(0), head_(0)
+	{
+		for (Slot &slot : slots_)
+			slot.seq.store(0, std::memory_order_relaxed);
+	}
+
+	void record(const TraceEvent &event)
+	{
+		uint64_t head = head_.load(std::memory_order_relaxed);
+		Slot &slot = slots_[head % kSize];
+
+		slot.seq.store(2 * head + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+
+		slot.timestamp.store(event.timestamp, std::memory_order_relaxed);
+		slot.id.store(event.id, std::memory_order_relaxed);
+		slot.category.store(event.category, std::memory_order_relaxed);
+		slot.name.store(event.name, std::memory_order_relaxed);
+		slot.type.store(event.type, std::memory_order_relaxed);
+
+		slot.seq.store(2 * head + 2, std::memory_order_release);
+		head_.store(head + 1, std::memory_order_release);
+	}
+
+	std::vector<TraceEvent> snapshot() const;
+
+	void reset(pid_t tid)
+	{
+		tid_ = tid;
+		start_ = head_.load(std::memory_order_relaxed);
+	}
+
+	pid_t tid() const { return tid_; }
+
+private:
+	struct Slot {
+		std::atomic<uint64_t> seq;
+		std::atomic<uint64_t> timestamp;
+		std::atomic<uint64_t> id;
+		std::atomic<const char *> category;
+		std::atomic<const char *> name;
+		std::atomic<Tracer::EventType> type;
+	};
+
+	pid_t tid_;
+	uint64_t start_;
+	std::atomic<uint64_t> head_;
+	std::array<Slot, kSize> slots_;
+};
+
+std::vector<TraceEvent> TraceBuffer::snapshot() const
+{
+	uint64_t head = head_.load(std::memory_order_acquire);
+	uint64_t tail = std::max(start_, head > kSize ? head - kSize : 0);
+
+	std::vector<TraceEvent> events;
+	events.reserve(head - tail);
+
+	for (uint64_t i = tail; i < head; ++i) {
+		const Slot &slot = slots_[i % kSize];
+
+		uint64_t seq = slot.seq.load(std::memory_order_acquire);
+		if (seq != 2 * i + 2)
+			continue;
+
+		TraceEvent event;
+		event.timestamp = slot.timestamp.load(std::memory_order_relaxed);
+		event.id = slot.id.load(std::memory_order_relaxed);
+		event.category = slot.category.load(std::memory_order_relaxed);
+		event.name = slot.name.load(std::memory_order_relaxed);
+		event.type = slot.type.load(std::memory_order_relaxed);
+
+		/*
+		 * Drop the event if the owning thread has started overwriting
+		 * it while it was copied.
+		 */
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (slot.seq.load(std::memory_order_relaxed) != seq)
+			continue;
+
+		events.push_back(event);
+	}
+
+	return events;
+}
+
+/*
+ * The buffer of the current thread, returned to the tracer for reuse by
+ * other threads when the thread exits.
+ */
+class Tracer::ThreadBuffer
+{
+public:
+	~ThreadBuffer()
+	{
+		if (buffer)
+			Tracer::instance()->releaseBuffer(buffer);
+	}
+
+	TraceBuffer *buffer = nullptr;
+};
+
+thread_local Tracer::ThreadBuffer Tracer::currentBuffer_;
+
+namespace {
+
+const char *phase(Tracer::EventType type)
+{
+	switch (type) {
+	case Tracer::Instant:
+		return "i";
+	case Tracer::Begin:
+		return "B";
+	case Tracer::End:
+		return "E";
+	case Tracer::AsyncBegin:
+		return "b";
+	case Tracer::AsyncEnd:
+		return "e";
+	}
+
+	return "i";
+}
+
+} /* namespace */
+
+/**
+ * \class Tracer
+ * \brief Record and export trace events
+ *
+ * The Tracer is a singleton that stores trace events recorded by all threads.
+ * Trace points shouldn't call the Tracer directly, but use the TRACE_EVENT()
+ * and TRACE_SCOPE() macros that skip recording when tracing is disabled.
+ */
+
+/**
+ * \enum Tracer::EventType
+ * \brief The type of a trace event
+ * \var Tracer::Instant
+ * \brief An event without a duration
+ * \var Tracer::Begin
+ * \brief The beginning of a duration on the current thread
+ * \var Tracer::End
+ * \brief The end of a duration on the current thread
+ * \var Tracer::AsyncBegin
+ * \brief The beginning of an operation identified by its id, which may end
+ * in a different thread
+ * \var Tracer::AsyncEnd
+ * \brief The end of an operation identified by its id
+ */
+
+std::atomic<bool> Tracer::enabled_{ false };
+
+Tracer::Tracer()
+{
+	const char *file = utils::secure_getenv("LIBCAMERA_TRACE_FILE");
+	if (!file)
+		return;
+
+	file_ = file;
+	enable();
+}
+
+Tracer::~Tracer()
+{
+	disable();
+
+	if (file_.empty())
+		return;
+
+	/*
+	 * Only write the trace if events have been recorded, to avoid
+	 * processes that inherit the environment, such as the IPA proxy
+	 * workers, overwriting the file with an empty trace.
+	 */
+	MutexLocker locker(mutex_);
+	if (buffers_.empty())
+		return;
+	locker.unlock();
+
+	/*
+	 * The logger may already have been destroyed, open the file directly
+	 * instead of calling dump(const std::string &) which logs errors.
+	 */
+	std::ofstream file(file_, std::ios::out | std::ios::trunc);
+	if (file.is_open())
+		dump(file);
+}
+
+/**
+ * \brief Retrieve the tracer instance
+ *
+ * The tracer is created on first use, and enables tracing if the
+ * LIBCAMERA_TRACE_FILE environment variable is set.
+ *
+ * \return The tracer instance
+ */
+Tracer *Tracer::instance()
+{
+	static Tracer instance;
+	return &instance;
+}
+
+/**
+ * \fn Tracer::enabled()
+ * \brief Check if tracing is enabled
+ * \return True if tracing is enabled, false otherwise
+ */
+
+/*
+ * Create the tracer at library load time to enable tracing from the
+ * environment before any trace point is reached.
+ */
+static Tracer *tracerInit = Tracer::instance();
+
+/**
+ * \brief Enable recording of trace events
+ */
+void Tracer::enable()
+{
+	enabled_.store(true, std::memory_order_relaxed);
+}
+
+/**
+ * \brief Disable recording of trace events
+ *
+ * Events already recorded are kept and can still be dumped.
+ */
+void Tracer::disable()
+{
+	enabled_.store(false, std::memory_order_relaxed);
+}
+
+TraceBuffer *Tracer::threadBuffer()
+{
+	if (currentBuffer_.buffer)
+		return currentBuffer_.buffer;
+
+	/*
+	 * Buffers are owned by the tracer and outlive their thread, to allow
+	 * dumping events recorded by threads that have exited. They are
+	 * recycled for new threads, to bound memory usage when threads are
+	 * created and destroyed repeatedly. The events of an exited thread are
+	 * thus kept until its buffer is reused.
+	 */
+	MutexLocker locker(mutex_);
+
+	TraceBuffer *buffer;
+	if (!freeBuffers_.empty()) {
+		buffer = freeBuffers_.back();
+		freeBuffers_.pop_back();
+		buffer->reset(Thread::currentId());
+	} else {
+		buffers_.push_back(std::make_unique<TraceBuffer>(Thread::currentId()));
+		buffer = buffers_.back().get();
+	}
+
+	currentBuffer_.buffer = buffer;
+
+	return buffer;
+}
+
+void Tracer::releaseBuffer(TraceBuffer *buffer)
+{
+	MutexLocker locker(mutex_);
+	freeBuffers_.push_back(buffer);
+}
+
+/**
+ * \brief Record a trace event
+ * \param[in] type The event type
+ * \param[in] category The event category
+ * \param[in] name The event name
+ * \param[in] id An identifier for the object the event relates to
+ *
+ * The \a category and \a name strings are stored by pointer and must outlive
+ * the tracer, they should thus be string literals. The \a id is used to match
+ * asynchronous begin and end events, and is otherwise exported as an event
+ * argument. Requests are identified by their address.
+ *
+ * The event is recorded in the ring buffer of the calling thread, overwriting
+ * the oldest event when the buffer is full.
+ */
+void Tracer::record(EventType type, const char *category, const char *name,
+		    uint64_t id)
+{
+	TraceEvent event;
+	event.timestamp = std::chrono::duration_cast<std::chrono::nanoseconds>(
+		utils::clock::now().time_since_epoch()).count();
+	event.id = id;
+	event.category = category;
+	event.name = name;
+	event.type = type;
+
+	threadBuffer()->record(event);
+}
+
+/**
+ * \brief Write the recorded events to a stream
+ * \param[in] stream The output stream
+ *
+ * Write all events recorded so far to \a stream in the Chrome trace event
+ * JSON format. This function may be called while events are being recorded.
+ */
+void Tracer::dump(std::ostream &stream)
+{
+	std::vector<std::pair<pid_t, std::vector<TraceEvent>>> events;
+
+	{
+		MutexLocker locker(mutex_);
+		for (const std::unique_ptr<TraceBuffer> &buffer : buffers_)
+			events.emplace_back(buffer->tid(), buffer->snapshot());
+	}
+
+	pid_t pid = getpid();
+	bool first = true;
+
+	stream << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+
+	for (const auto &thread : events) {
+		for (const TraceEvent &event : thread.second) {
+			stream << (first ? "" : ",") << "\n{"
+			       << "\"name\":\"" << event.name << "\","
+			       << "\"cat\":\"" << event.category << "\","
+			       << "\"ph\":\"" << phase(event.type) << "\","
+			       << "\"ts\":" << event.timestamp / 1000 << "."
+			       << std::setfill('0') << std::setw(3)
+			       << event.timestamp % 1000 << ","
+			       << "\"pid\":" << pid << ","
+			       << "\"tid\":" << thread.first;
+
+			if (event.type == AsyncBegin || event.type == AsyncEnd)
+				stream << ",\"id\":\"0x" << std::hex << event.id
+				       << std::dec << "\"";
+			else if (event.type == Instant)
+				stream << ",\"s\":\"t\"";
+
+			stream << ",\"args\":{\"id\":" << event.id << "}}";
+			first = false;
+		}
+	}
+
+	stream << "\n]}" << std::endl;
+}
+
+/**
+ * \brief Write the recorded events to a file
+ * \param[in] path The path to the output file
+ *
+ * The file is truncated if it exists.
+ *
+ * \return 0 on success or a negative error code otherwise
+ */
+int Tracer::dump(const std::string &path)
+{
+	std::ofstream file(path, std::ios::out | std::ios::trunc);
+	if (!file.is_open()) {
+		LOG(Tracer, Error) << "Failed to open trace file " << path;
+		return -EIO;
+	}
+
+	dump(file);
+
+	return 0;
+}
+
+/**
+ * \class TraceScope
+ * \brief Record the duration of a scope
+ *
+ * The TraceScope records a Tracer::Begin event when constructed and a
+ * matching Tracer::End event when destroyed. It should be instantiated through
+ * the TRACE_SCOPE() macro.
+ */
+
+/**
+ * \fn TraceScope::TraceScope()
+ * \brief Record the beginning of a scope
+ * \param[in] category The event category
+ * \param[in] name The event name
+ * \param[in] id An identifier for the object the event relates to
+ */
+
+/**
+ * \def TRACE_EVENT(type, category, name, id)
+ * \brief Record a trace event if tracing is enabled
+ * \param[in] type The event type, a Tracer::EventType without namespace
+ * \param[in] category The event category
+ * \param[in] name The event name
+ * \param[in] id An identifier for the object the event relates to
+ */
+
+/**
+ * \def TRACE_SCOPE(category, name, id)
+ * \brief Record the duration of the current scope if tracing is enabled
+ * \param[in] category The event category
+ * \param[in] name The event name
+ * \param[in] id An identifier for the object the event relates to
+ */
+
+/**
+ * \fn traceId()
+ * \brief Convert a pointer to a trace event identifier
+ * \param[in] ptr The pointer
+ * \return The identifier
+ */
+
+} /* namespace libcamera */
@@ -8,15 +8,20 @@
 #include "libcamera/internal/v4l2_device.h"
 
 #include <fcntl.h>
+#include <fstream>
 #include <iomanip>
 #include <limits.h>
+#include <sstream>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/ioctl.h>
 #include <sys/syscall.h>
+#include <sys/utsname.h>
 #include <unistd.h>
 
+#include "libcamera/internal/capability_cache.h"
 #include "libcamera/internal/log.h"
+#include "libcamera/internal/media_request.h"
 #include "libcamera/internal/sysfs.h"
 #include "libcamera/internal/utils.h"
 #include "libcamera/internal/v4l2_controls.h"
@@ -89,6 +94,16 @@ int V4L2Device::open(unsigned int flags)
 
 	fd_ = ret;
 
+	if (!CapabilityCache::directory().empty()) {
+		char *path = realpath(sysfs::charDevPath(deviceNode_).c_str(), nullptr);
+		if (path) {
+			std::string id{ path };
+			free(path);
+
+			cache_ = std::make_unique<CapabilityCache>(id, capabilityKey(id));
+		}
+	}
+
 	listControls();
 
 	return 0;
@@ -134,6 +149,8 @@ void V4L2Device::close()
 		LOG(V4L2, Error) << "Failed to close V4L2 device: "
 				 << strerror(errno);
 	fd_ = -1;
+
+	cache_.reset();
 }
 
 /**
@@ -151,10 +168,15 @@ void V4L2Device::close()
 /**
  * \brief Read controls from the device
  * \param[in] ids The list of controls to read, specified by their ID
+ * \param[in] request The media request to read the controls from (optional)
  *
  * This method reads the value of all controls contained in \a ids, and returns
  * their values as a ControlList.
  *
+ * When a \a request is specified, the values stored in the request are read
+ * instead of the current device values. For completed requests, this returns
+ * the values that were in effect when the driver processed the request.
+ *
  * If any control in \a ids is not supported by the device, is disabled (i.e.
  * has the V4L2_CTRL_FLAG_DISABLED flag set), or if any other error occurs
  * during validation of the requested controls, no control is read and this
@@ -163,7 +185,8 @@ void V4L2Device::close()
  * \return The control values in a ControlList on success, or an empty list on
  * error
  */
-ControlList V4L2Device::getControls(const std::vector<uint32_t> &ids)
+ControlList V4L2Device::getControls(const std::vector<uint32_t> &ids,
+				    MediaRequest *request)
 {
 	unsigned int count = ids.size();
 	if (count == 0)
@@ -228,6 +251,11 @@ ControlList V4L2Device::getControls(const std::vector<uint32_t> &ids)
 	v4l2ExtCtrls.controls = v4l2Ctrls;
 	v4l2ExtCtrls.count = count;
 
+	if (request) {
+		v4l2ExtCtrls.which = V4L2_CTRL_WHICH_REQUEST_VAL;
+		v4l2ExtCtrls.request_fd = request->fd();
+	}
+
 	int ret = ioctl(VIDIOC_G_EXT_CTRLS, &v4l2ExtCtrls);
 	if (ret) {
 		unsigned int errorIdx = v4l2ExtCtrls.error_idx;
@@ -254,11 +282,16 @@ ControlList V4L2Device::getControls(const std::vector<uint32_t> &ids)
 /**
  * \brief Write controls to the device
  * \param[in] ctrls The list of controls to write
+ * \param[in] request The media request to store the controls in (optional)
  *
  * This method writes the value of all controls contained in \a ctrls, and
  * stores the values actually applied to the device in the corresponding
  * \a ctrls entry.
  *
+ * When a \a request is specified, the controls are stored in the request
+ * instead of being applied immediately. The driver applies them atomically
+ * with the buffers of the request when it processes the request.
+ *
  * If any control in \a ctrls is not supported by the device, is disabled (i.e.
  * has the V4L2_CTRL_FLAG_DISABLED flag set), is read-only, if any other error
  * occurs during validation of the requested controls, no control is written and
@@ -273,7 +306,7 @@ ControlList V4L2Device::getControls(const std::vector<uint32_t> &ids)
  * \retval -EINVAL One of the control is not supported or not accessible
  * \retval i The index of the control that failed
  */
-int V4L2Device::setControls(ControlList *ctrls)
+int V4L2Device::setControls(ControlList *ctrls, MediaRequest *request)
 {
 	unsigned int count = ctrls->size();
 	if (count == 0)
@@ -330,6 +363,11 @@ int V4L2Device::setControls(ControlList *ctrls)
 	v4l2ExtCtrls.controls = v4l2Ctrls;
 	v4l2ExtCtrls.count = count;
 
+	if (request) {
+		v4l2ExtCtrls.which = V4L2_CTRL_WHICH_REQUEST_VAL;
+		v4l2ExtCtrls.request_fd = request->fd();
+	}
+
 	int ret = ioctl(VIDIOC_S_EXT_CTRLS, &v4l2ExtCtrls);
 	if (ret) {
 		unsigned int errorIdx = v4l2ExtCtrls.error_idx;
@@ -381,6 +419,17 @@ std::string V4L2Device::devicePath() const
 	return path;
 }
 
+/**
+ * \fn V4L2Device::capabilityCache()
+ * \brief Retrieve the capability cache for the device
+ *
+ * The capability cache is created when the device is opened, if caching is
+ * enabled. Derived classes use it to store the results of enumerations that
+ * are otherwise performed with one ioctl per item.
+ *
+ * \return The capability cache, or nullptr if caching is disabled
+ */
+
 /**
  * \brief Perform an IOCTL system call on the device node
  * \param[in] request The IOCTL request code
@@ -411,6 +460,46 @@ int V4L2Device::ioctl(unsigned long request, void *argp)
  * \return The V4L2 device file descriptor, -1 if the device node is not open
  */
 
+/*
+ * \brief Compute the key describing the device for the capability cache
+ * \param[in] id The sysfs path of the device node
+ *
+ * The key identifies the device node, the driver and its version, as well as
+ * the running kernel. A change in any of them invalidates the cached
+ * capabilities.
+ */
+std::string V4L2Device::capabilityKey(const std::string &id)
+{
+	std::ostringstream key;
+
+	struct utsname uts;
+	if (!uname(&uts))
+		key << uts.release << " " << uts.version << "\n";
+
+	key << id << "\n";
+
+	for (const char *attr : { "/name", "/device/driver/module/srcversion" }) {
+		std::ifstream file(id + attr);
+		std::string line;
+		if (std::getline(file, line))
+			key << line << "\n";
+	}
+
+	char *driver = realpath((id + "/device/driver").c_str(), nullptr);
+	if (driver) {
+		key << driver << "\n";
+		free(driver);
+	}
+
+	/* Subdevices don't support VIDIOC_QUERYCAP, ignore errors. */
+	struct v4l2_capability caps = {};
+	if (!ioctl(VIDIOC_QUERYCAP, &caps))
+		key << caps.driver << " " << caps.card << " " << caps.bus_info
+		    << " " << caps.version << "\n";
+
+	return key.str();
+}
+
 /*
  * \brief List and store information about all controls supported by the
  * V4L2 device
@@ -19,6 +19,7 @@
 
 #include <libcamera/geometry.h>
 
+#include "libcamera/internal/capability_cache.h"
 #include "libcamera/internal/log.h"
 #include "libcamera/internal/media_device.h"
 #include "libcamera/internal/media_object.h"
@@ -354,6 +355,29 @@ V4L2Subdevice::Formats V4L2Subdevice::formats(unsigned int pad)
 		return {};
 	}
 
+	CapabilityCache *cache = capabilityCache();
+	std::string section = "pad-" + std::to_string(pad);
+
+	/*
+	 * The media bus codes of Bayer sensors depend on the flips, as they
+	 * change the Bayer order. Include the flips in the section name.
+	 */
+	if (cache) {
+		std::vector<uint32_t> ids;
+		for (uint32_t id : { V4L2_CID_HFLIP, V4L2_CID_VFLIP }) {
+			if (controls().find(id) != controls().end())
+				ids.push_back(id);
+		}
+
+		ControlList flips = getControls(ids);
+		for (const auto &ctrl : flips)
+			section += "-" + std::to_string(ctrl.first) + "=" +
+				   std::to_string(ctrl.second.get<int32_t>());
+	}
+
+	if (cache && cache->lookupFormats(section, &formats))
+		return formats;
+
 	for (unsigned int code : enumPadCodes(pad)) {
 		std::vector<SizeRange> sizes = enumPadSizes(pad, code);
 		if (sizes.empty())
@@ -368,6 +392,9 @@ V4L2Subdevice::Formats V4L2Subdevice::formats(unsigned int pad)
 		}
 	}
 
+	if (cache && !formats.empty())
+		cache->storeFormats(section, formats);
+
 	return formats;
 }
 
@@ -26,6 +26,7 @@
 #include "libcamera/internal/log.h"
 #include "libcamera/internal/media_device.h"
 #include "libcamera/internal/media_object.h"
+#include "libcamera/internal/tracer.h"
 #include "libcamera/internal/utils.h"
 
 /**
@@ -251,6 +252,12 @@ void V4L2BufferCache::put(unsigned int index)
 	cache_[index].free = true;
 }
 
+/**
+ * \fn V4L2BufferCache::size()
+ * \brief Retrieve the number of entries in the cache
+ * \return The number of V4L2 buffers tracked by the cache
+ */
+
 V4L2BufferCache::Entry::Entry()
 	: free(true), lastUsed(0)
 {
@@ -472,7 +479,8 @@ const std::string V4L2DeviceFormat::toString() const
  */
 V4L2VideoDevice::V4L2VideoDevice(const std::string &deviceNode)
 	: V4L2Device(deviceNode), cache_(nullptr), fdBufferNotifier_(nullptr),
-	  fdEventNotifier_(nullptr), frameStartEnabled_(false)
+	  fdEventNotifier_(nullptr), frameStartEnabled_(false),
+	  supportsRequests_(false)
 {
 	/*
 	 * We default to an MMAP based CAPTURE video device, however this will
@@ -755,10 +763,47 @@ int V4L2VideoDevice::tryFormat(V4L2DeviceFormat *format)
  * Apply the supplied \a format to the video device, and return the actually
  * applied format parameters, as \ref V4L2VideoDevice::getFormat would do.
  *
+ * The format can't be changed while buffers are allocated or imported. In that
+ * case the function succeeds without reapplying the format if \a format
+ * matches the current format, and returns -EBUSY otherwise. This allows
+ * keeping buffers allocated across reconfigurations that don't change the
+ * format.
+ *
  * \return 0 on success or a negative error code otherwise
+ * \retval -EBUSY The format differs from the current format and buffers are
+ * allocated
  */
 int V4L2VideoDevice::setFormat(V4L2DeviceFormat *format)
 {
+	/*
+	 * Drivers refuse format changes while buffers are allocated. Skip
+	 * setting the format when it doesn't change, to allow keeping buffers
+	 * allocated across reconfigurations, and fail early otherwise.
+	 */
+	if (cache_) {
+		V4L2DeviceFormat current = {};
+		int ret = getFormat(&current);
+		if (ret)
+			return ret;
+
+		bool changed = current.fourcc != format->fourcc ||
+			       current.size != format->size;
+		for (unsigned int i = 0; i < format->planesCount && !changed; ++i) {
+			if (format->planes[i].bpl &&
+			    format->planes[i].bpl != current.planes[i].bpl)
+				changed = true;
+		}
+
+		if (changed) {
+			LOG(V4L2, Debug)
+				<< "Can't change format with buffers allocated";
+			return -EBUSY;
+		}
+
+		*format = current;
+		return 0;
+	}
+
 	if (caps_.isMeta())
 		return trySetFormatMeta(format, true);
 	else if (caps_.isMultiplanar())
@@ -1132,6 +1177,9 @@ int V4L2VideoDevice::requestBuffers(unsigned int count,
 		return -ENOMEM;
 	}
 
+	if (count)
+		supportsRequests_ = rb.capabilities & V4L2_BUF_CAP_SUPPORTS_REQUESTS;
+
 	LOG(V4L2, Debug) << rb.count << " buffers requested.";
 
 	return 0;
@@ -1368,21 +1416,54 @@ int V4L2VideoDevice::releaseBuffers()
 	return requestBuffers(0, memoryType_);
 }
 
+/**
+ * \brief Retrieve the number of buffers allocated or imported
+ *
+ * Buffers exported with exportBuffers() are not counted, as they don't use the
+ * driver's internal buffer management. Pipeline handlers can use this function
+ * to keep imported buffers across stop and start cycles, and only import them
+ * again when the number of buffers changes.
+ *
+ * \return The number of buffers allocated with allocateBuffers() or imported
+ * with importBuffers(), or 0 if no buffer is allocated or imported
+ */
+unsigned int V4L2VideoDevice::bufferCount() const
+{
+	return cache_ ? cache_->size() : 0;
+}
+
+/**
+ * \fn V4L2VideoDevice::supportsRequests()
+ * \brief Check if the video device supports media requests
+ *
+ * The information is only available once buffers have been allocated or
+ * imported.
+ *
+ * \return True if buffers can be queued with media requests, false otherwise
+ */
+
 /**
  * \brief Queue a buffer to the video device
  * \param[in] buffer The buffer to be queued
+ * \param[in] request The media request to add the buffer to (optional)
  *
  * For capture video devices the \a buffer will be filled with data by the
  * device. For output video devices the \a buffer shall contain valid data and
  * will be processed by the device. Once the device has finished processing the
  * buffer, it will be available for dequeue.
  *
+ * When a \a request is specified, the buffer is added to the request and is
+ * only queued to the device when the request is queued. Once a buffer has been
+ * queued with a request, all buffers shall be queued with requests until the
+ * device stops streaming. This requires support for requests as reported by
+ * supportsRequests().
+ *
  * The best available V4L2 buffer is picked for \a buffer using the V4L2 buffer
  * cache.
  *
  * \return 0 on success or a negative error code otherwise
  */
-int V4L2VideoDevice::queueBuffer(FrameBuffer *buffer)
+int V4L2VideoDevice::queueBuffer(FrameBuffer *buffer, MediaRequest *request)
 {
 	struct v4l2_plane v4l2Planes[VIDEO_MAX_PLANES] = {};
 	struct v4l2_buffer buf = {};
@@ -1434,8 +1515,15 @@ int V4L2VideoDevice::queueBuffer(FrameBuffer *buffer)
 		buf.timestamp.tv_usec = (metadata.timestamp / 1000) % 1000000;
 	}
 
+	if (request) {
+		buf.flags |= V4L2_BUF_FLAG_REQUEST_FD;
+		buf.request_fd = request->fd();
+	}
+
 	LOG(V4L2, Debug) << "Queueing buffer " << buf.index;
 
+	TRACE_EVENT(Instant, "V4L2", "QBUF", traceId(buffer->request()));
+
 	ret = ioctl(VIDIOC_QBUF, &buf);
 	if (ret < 0) {
 		LOG(V4L2, Error)
@@ -1511,6 +1599,8 @@ FrameBuffer *V4L2VideoDevice::dequeueBuffer()
 	FrameBuffer *buffer = it->second;
 	queuedBuffers_.erase(it);
 
+	TRACE_EVENT(Instant, "V4L2", "DQBUF", traceId(buffer->request()));
+
 	if (queuedBuffers_.empty())
 		fdBufferNotifier_->setEnabled(false);
 
@@ -1639,10 +1729,15 @@ int V4L2VideoDevice::streamOff()
 		return ret;
 	}
 
-	/* Send back all queued buffers. */
+	/*
+	 * Send back all queued buffers, and mark their V4L2 buffers as free,
+	 * as the buffer queue may be reused after stopping.
+	 */
 	for (auto it : queuedBuffers_) {
 		FrameBuffer *buffer = it.second;
 
+		cache_->put(it.first);
+
 		buffer->metadata_.status = FrameMetadata::FrameCancelled;
 		bufferReady.emit(buffer);
 	}
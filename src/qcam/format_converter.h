@@ -13,6 +13,8 @@
 
 #include <libcamera/pixel_format.h>
 
+#include "../cam/pixel_converter.h"
+
 class QImage;
 
 class FormatConverter
@@ -23,37 +25,8 @@ public:
 	void convert(const unsigned char *src, size_t size, QImage *dst);
 
 private:
-	enum FormatFamily {
-		MJPEG,
-		NV,
-		RGB,
-		YUV,
-	};
-
-	void convertNV(const unsigned char *src, unsigned char *dst);
-	void convertRGB(const unsigned char *src, unsigned char *dst);
-	void convertYUV(const unsigned char *src, unsigned char *dst);
-
 	libcamera::PixelFormat format_;
-	unsigned int width_;
-	unsigned int height_;
-
-	enum FormatFamily formatFamily_;
-
-	/* NV parameters */
-	unsigned int horzSubSample_;
-	unsigned int vertSubSample_;
-	bool nvSwap_;
-
-	/* RGB parameters */
-	unsigned int bpp_;
-	unsigned int r_pos_;
-	unsigned int g_pos_;
-	unsigned int b_pos_;
-
-	/* YUV parameters */
-	unsigned int y_pos_;
-	unsigned int cb_pos_;
+	PixelConverter converter_;
 };
 
 #endif /* __QCAM_FORMAT_CONVERTER_H__ */
@@ -27,8 +27,6 @@
 #include <libcamera/camera_manager.h>
 #include <libcamera/version.h>
 
-#include "dng_writer.h"
-
 using namespace libcamera;
 
 #if QT_VERSION < QT_VERSION_CHECK(5, 14, 0)
@@ -647,9 +645,13 @@ void MainWindow::processRaw(FrameBuffer *buffer,
 
 	if (!filename.isEmpty()) {
 		const MappedBuffer &mapped = mappedBuffers_[buffer];
-		DNGWriter::write(filename.toStdString().c_str(), camera_.get(),
-				 rawStream_->configuration(), metadata, buffer,
-				 mapped.memory);
+
+		if (!dngWriter_)
+			dngWriter_ = std::make_unique<DNGWriter>();
+
+		dngWriter_->write(filename.toStdString().c_str(), camera_.get(),
+				  rawStream_->configuration(), metadata, buffer,
+				  mapped.memory);
 	}
 #endif
 
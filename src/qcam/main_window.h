@@ -24,6 +24,7 @@
 #include <libcamera/framebuffer_allocator.h>
 #include <libcamera/stream.h>
 
+#include "../cam/dng_writer.h"
 #include "../cam/stream_options.h"
 #include "viewfinder.h"
 
@@ -120,6 +121,9 @@ private:
 
 	std::unique_ptr<CameraConfiguration> config_;
 	std::map<FrameBuffer *, MappedBuffer> mappedBuffers_;
+#ifdef HAVE_DNG
+	std::unique_ptr<DNGWriter> dngWriter_;
+#endif
 
 	/* Capture state, buffers queue and statistics */
 	bool isCapturing_;
@@ -8,6 +8,10 @@
 #include "v4l2_camera.h"
 
 #include <errno.h>
+#include <limits.h>
+#include <linux/futex.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
 #include <unistd.h>
 
 #include "libcamera/internal/log.h"
@@ -16,9 +20,23 @@ using namespace libcamera;
 
 LOG_DECLARE_CATEGORY(V4L2Compat);
 
+namespace {
+
+int futex(std::atomic<uint32_t> *word, int op, uint32_t value)
+{
+	static_assert(sizeof(*word) == sizeof(uint32_t),
+		      "Futex word must be 32-bit");
+
+	return syscall(SYS_futex, reinterpret_cast<uint32_t *>(word), op,
+		       value, nullptr, nullptr, 0);
+}
+
+} /* namespace */
+
 V4L2Camera::V4L2Camera(std::shared_ptr<Camera> camera)
 	: camera_(camera), isRunning_(false), bufferAllocator_(nullptr),
-	  efd_(-1), bufferAvailableCount_(0)
+	  completedHead_(0), completedTail_(0), bufferEvents_(0),
+	  bufferWaiters_(0), efd_(-1)
 {
 	camera_->requestCompleted.connect(this, &V4L2Camera::requestComplete);
 }
@@ -65,42 +83,68 @@ void V4L2Camera::unbind()
 	efd_ = -1;
 }
 
+/*
+ * Retrieve the completed buffers that haven't been dequeued yet, without
+ * dequeuing them. This shall only be called by the consumer.
+ */
 std::vector<V4L2Camera::Buffer> V4L2Camera::completedBuffers()
 {
 	std::vector<Buffer> v;
 
-	bufferLock_.lock();
-	for (std::unique_ptr<Buffer> &metadata : completedBuffers_)
-		v.push_back(*metadata.get());
-	completedBuffers_.clear();
-	bufferLock_.unlock();
+	unsigned int head = completedHead_.load(std::memory_order_acquire);
+	for (unsigned int i = completedTail_.load(std::memory_order_relaxed);
+	     i != head; ++i)
+		v.push_back(completedBuffers_[i % kMaxCompletedBuffers]);
 
 	return v;
 }
 
+/*
+ * Dequeue the oldest completed buffer. This shall only be called by the
+ * consumer.
+ */
+bool V4L2Camera::dequeueBuffer(Buffer *buffer)
+{
+	unsigned int tail = completedTail_.load(std::memory_order_relaxed);
+	if (tail == completedHead_.load(std::memory_order_acquire))
+		return false;
+
+	*buffer = completedBuffers_[tail % kMaxCompletedBuffers];
+	completedTail_.store(tail + 1, std::memory_order_release);
+
+	return true;
+}
+
 void V4L2Camera::requestComplete(Request *request)
 {
 	if (request->status() == Request::RequestCancelled)
 		return;
 
+	unsigned int head = completedHead_.load(std::memory_order_relaxed);
+	if (head - completedTail_.load(std::memory_order_acquire) >= kMaxCompletedBuffers) {
+		LOG(V4L2Compat, Error) << "Completed buffers overflow";
+		return;
+	}
+
 	/* We only have one stream at the moment. */
-	bufferLock_.lock();
 	FrameBuffer *buffer = request->buffers().begin()->second;
-	std::unique_ptr<Buffer> metadata =
-		std::make_unique<Buffer>(request->cookie(), buffer->metadata());
-	completedBuffers_.push_back(std::move(metadata));
-	bufferLock_.unlock();
+	completedBuffers_[head % kMaxCompletedBuffers] =
+		Buffer(request->cookie(), buffer->metadata());
+	completedHead_.store(head + 1, std::memory_order_release);
 
 	uint64_t data = 1;
 	int ret = ::write(efd_, &data, sizeof(data));
 	if (ret != sizeof(data))
 		LOG(V4L2Compat, Error) << "Failed to signal eventfd POLLIN";
 
-	{
-		MutexLocker locker(bufferMutex_);
-		bufferAvailableCount_++;
-	}
-	bufferCV_.notify_all();
+	wakeWaiters();
+}
+
+void V4L2Camera::wakeWaiters()
+{
+	bufferEvents_.fetch_add(1);
+	if (bufferWaiters_.load())
+		futex(&bufferEvents_, FUTEX_WAKE_PRIVATE, INT_MAX);
 }
 
 int V4L2Camera::configure(StreamConfiguration *streamConfigOut,
@@ -161,24 +205,69 @@ int V4L2Camera::allocBuffers([[maybe_unused]] unsigned int count)
 	return bufferAllocator_->allocate(stream);
 }
 
+/*
+ * Import the dmabuf \a fd as the buffer at \a index. The FrameBuffer is
+ * reused when the same dmabuf is queued again at the same index, to avoid
+ * duplicating the file descriptor for every frame and to keep the V4L2
+ * buffer cache of the pipeline handler effective.
+ */
+int V4L2Camera::importBuffer(unsigned int index, int fd, unsigned int length)
+{
+	struct stat st;
+	if (fstat(fd, &st) < 0)
+		return -EBADF;
+
+	if (importedBuffers_.size() <= index)
+		importedBuffers_.resize(index + 1);
+
+	ImportedBuffer &imported = importedBuffers_[index];
+	if (imported.buffer && imported.dev == st.st_dev &&
+	    imported.ino == st.st_ino)
+		return 0;
+
+	FrameBuffer::Plane plane;
+	plane.fd = FileDescriptor(fd);
+	if (!plane.fd.isValid())
+		return -EBADF;
+
+	plane.length = length;
+
+	imported.dev = st.st_dev;
+	imported.ino = st.st_ino;
+	imported.buffer = std::make_unique<FrameBuffer>(std::vector<FrameBuffer::Plane>{ plane });
+
+	return 0;
+}
+
 void V4L2Camera::freeBuffers()
 {
 	pendingRequests_.clear();
+	importedBuffers_.clear();
 
 	Stream *stream = config_->at(0).stream();
 	bufferAllocator_->free(stream);
 }
 
-FileDescriptor V4L2Camera::getBufferFd(unsigned int index)
+FrameBuffer *V4L2Camera::frameBuffer(unsigned int index)
 {
+	if (!importedBuffers_.empty())
+		return index < importedBuffers_.size()
+		       ? importedBuffers_[index].buffer.get() : nullptr;
+
 	Stream *stream = config_->at(0).stream();
 	const std::vector<std::unique_ptr<FrameBuffer>> &buffers =
 		bufferAllocator_->buffers(stream);
 
-	if (buffers.size() <= index)
+	return index < buffers.size() ? buffers[index].get() : nullptr;
+}
+
+FileDescriptor V4L2Camera::getBufferFd(unsigned int index)
+{
+	FrameBuffer *buffer = frameBuffer(index);
+	if (!buffer)
 		return FileDescriptor();
 
-	return buffers[index]->planes()[0].fd;
+	return buffer->planes()[0].fd;
 }
 
 int V4L2Camera::streamOn()
@@ -215,11 +304,11 @@ int V4L2Camera::streamOff()
 	if (ret < 0)
 		return ret == -EACCES ? -EBUSY : ret;
 
-	{
-		MutexLocker locker(bufferMutex_);
-		isRunning_ = false;
-	}
-	bufferCV_.notify_all();
+	/* Drop the buffers that haven't been dequeued. */
+	completedTail_.store(completedHead_.load());
+
+	isRunning_ = false;
+	wakeWaiters();
 
 	return 0;
 }
@@ -234,7 +323,12 @@ int V4L2Camera::qbuf(unsigned int index)
 	}
 
 	Stream *stream = config_->at(0).stream();
-	FrameBuffer *buffer = bufferAllocator_->buffers(stream)[index].get();
+	FrameBuffer *buffer = frameBuffer(index);
+	if (!buffer) {
+		LOG(V4L2Compat, Error) << "No buffer at index " << index;
+		return -EINVAL;
+	}
+
 	int ret = request->addBuffer(stream, buffer);
 	if (ret < 0) {
 		LOG(V4L2Compat, Error) << "Can't set buffer for request";
@@ -255,24 +349,28 @@ int V4L2Camera::qbuf(unsigned int index)
 	return 0;
 }
 
+/*
+ * Wait until a completed buffer is available or the stream is stopped. The
+ * bufferEvents_ value is sampled before checking the conditions, the futex
+ * wait then returns immediately if an event occurred in the meantime.
+ */
 void V4L2Camera::waitForBufferAvailable()
 {
-	MutexLocker locker(bufferMutex_);
-	bufferCV_.wait(locker, [&] {
-			       return bufferAvailableCount_ >= 1 || !isRunning_;
-		       });
-	if (isRunning_)
-		bufferAvailableCount_--;
+	while (true) {
+		uint32_t events = bufferEvents_.load();
+		if (isBufferAvailable() || !isRunning_)
+			return;
+
+		bufferWaiters_.fetch_add(1);
+		futex(&bufferEvents_, FUTEX_WAIT_PRIVATE, events);
+		bufferWaiters_.fetch_sub(1);
+	}
 }
 
 bool V4L2Camera::isBufferAvailable()
 {
-	MutexLocker locker(bufferMutex_);
-	if (bufferAvailableCount_ < 1)
-		return false;
-
-	bufferAvailableCount_--;
-	return true;
+	return completedTail_.load(std::memory_order_relaxed) !=
+	       completedHead_.load(std::memory_order_acquire);
 }
 
 bool V4L2Camera::isRunning()
@@ -8,9 +8,13 @@
 #ifndef __V4L2_CAMERA_H__
 #define __V4L2_CAMERA_H__
 
+#include <array>
+#include <atomic>
 #include <deque>
-#include <mutex>
+#include <linux/videodev2.h>
+#include <sys/types.h>
 #include <utility>
+#include <vector>
 
 #include <libcamera/buffer.h>
 #include <libcamera/camera.h>
@@ -25,6 +29,11 @@ class V4L2Camera
 {
 public:
 	struct Buffer {
+		Buffer()
+			: index(0)
+		{
+		}
+
 		Buffer(unsigned int index, const FrameMetadata &data)
 			: index(index), data(data)
 		{
@@ -43,6 +52,7 @@ public:
 	void unbind();
 
 	std::vector<Buffer> completedBuffers();
+	bool dequeueBuffer(Buffer *buffer);
 
 	int configure(StreamConfiguration *streamConfigOut,
 		      const Size &size, const PixelFormat &pixelformat,
@@ -52,6 +62,7 @@ public:
 				  StreamConfiguration *streamConfigOut);
 
 	int allocBuffers(unsigned int count);
+	int importBuffer(unsigned int index, int fd, unsigned int length);
 	void freeBuffers();
 	FileDescriptor getBufferFd(unsigned int index);
 
@@ -66,24 +77,43 @@ public:
 	bool isRunning();
 
 private:
+	struct ImportedBuffer {
+		dev_t dev;
+		ino_t ino;
+		std::unique_ptr<FrameBuffer> buffer;
+	};
+
 	void requestComplete(Request *request);
+	void wakeWaiters();
+	FrameBuffer *frameBuffer(unsigned int index);
 
 	std::shared_ptr<Camera> camera_;
 	std::unique_ptr<CameraConfiguration> config_;
 
-	bool isRunning_;
+	std::atomic<bool> isRunning_;
 
-	std::mutex bufferLock_;
 	FrameBufferAllocator *bufferAllocator_;
+	std::vector<ImportedBuffer> importedBuffers_;
 
 	std::deque<std::unique_ptr<Request>> pendingRequests_;
-	std::deque<std::unique_ptr<Buffer>> completedBuffers_;
 
-	int efd_;
+	/*
+	 * Completed buffers are stored in a single-producer, single-consumer
+	 * ring. The producer is the camera's request completion handler, and
+	 * consumers are serialized by the proxy. Waiters sleep on the
+	 * bufferEvents_ futex, incremented when a buffer completes or the
+	 * stream stops.
+	 */
+	static constexpr unsigned int kMaxCompletedBuffers = VIDEO_MAX_FRAME;
+
+	std::array<Buffer, kMaxCompletedBuffers> completedBuffers_;
+	std::atomic<unsigned int> completedHead_;
+	std::atomic<unsigned int> completedTail_;
+
+	std::atomic<uint32_t> bufferEvents_;
+	std::atomic<unsigned int> bufferWaiters_;
 
-	Mutex bufferMutex_;
-	std::condition_variable bufferCV_;
-	unsigned int bufferAvailableCount_;
+	std::atomic<int> efd_;
 };
 
 #endif /* __V4L2_CAMERA_H__ */
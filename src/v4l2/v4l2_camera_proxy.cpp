@@ -10,6 +10,7 @@
 #include <algorithm>
 #include <array>
 #include <errno.h>
+#include <fcntl.h>
 #include <linux/videodev2.h>
 #include <set>
 #include <string.h>
@@ -36,7 +37,8 @@ LOG_DECLARE_CATEGORY(V4L2Compat);
 
 V4L2CameraProxy::V4L2CameraProxy(unsigned int index,
 				 std::shared_ptr<Camera> camera)
-	: refcount_(0), index_(index), bufferCount_(0), currentBuf_(0),
+	: refcount_(0), index_(index), bufferCount_(0), memory_(V4L2_MEMORY_MMAP),
+	  readIO_(false), lastFrame_(-1), copying_(0),
 	  vcam_(std::make_unique<V4L2Camera>(camera)), owner_(nullptr)
 {
 	querycap(camera);
@@ -47,6 +49,7 @@ int V4L2CameraProxy::open(V4L2CameraFile *file)
 	LOG(V4L2Compat, Debug) << "Servicing open fd = " << file->efd();
 
 	MutexLocker locker(proxyMutex_);
+	MutexLocker bufferLocker(bufferMutex_);
 
 	if (refcount_++) {
 		files_.insert(file);
@@ -81,9 +84,24 @@ void V4L2CameraProxy::close(V4L2CameraFile *file)
 	LOG(V4L2Compat, Debug) << "Servicing close fd = " << file->efd();
 
 	MutexLocker locker(proxyMutex_);
+	MutexLocker bufferLocker(bufferMutex_);
 
 	files_.erase(file);
 
+	/*
+	 * When the owner closes, stop streaming and free the buffers, as vb2
+	 * does when releasing the queue, before another file can take over.
+	 */
+	if (owner_ == file)
+		stopReadIO();
+
+	auto reader = readers_.find(file);
+	if (reader != readers_.end()) {
+		if (reader->second.buffer >= 0)
+			releaseBuffer(reader->second.buffer);
+		readers_.erase(reader);
+	}
+
 	release(file);
 
 	if (--refcount_ > 0)
@@ -98,9 +116,11 @@ void *V4L2CameraProxy::mmap(void *addr, size_t length, int prot, int flags,
 	LOG(V4L2Compat, Debug) << "Servicing mmap";
 
 	MutexLocker locker(proxyMutex_);
+	MutexLocker bufferLocker(bufferMutex_);
 
 	/* \todo Validate prot and flags properly. */
-	if (prot != (PROT_READ | PROT_WRITE)) {
+	if (prot != (PROT_READ | PROT_WRITE) || memory_ != V4L2_MEMORY_MMAP ||
+	    readIO_) {
 		errno = EINVAL;
 		return MAP_FAILED;
 	}
@@ -134,6 +154,7 @@ int V4L2CameraProxy::munmap(void *addr, size_t length)
 	LOG(V4L2Compat, Debug) << "Servicing munmap";
 
 	MutexLocker locker(proxyMutex_);
+	MutexLocker bufferLocker(bufferMutex_);
 
 	auto iter = mmaps_.find(addr);
 	if (iter == mmaps_.end() || length != sizeimage_) {
@@ -145,12 +166,55 @@ int V4L2CameraProxy::munmap(void *addr, size_t length)
 		LOG(V4L2Compat, Error) << "Failed to unmap " << addr
 				       << " with length " << length;
 
-	buffers_[iter->second].flags &= ~V4L2_BUF_FLAG_MAPPED;
+	/* The buffers may have been freed when the owner closed. */
+	if (iter->second < buffers_.size())
+		buffers_[iter->second].flags &= ~V4L2_BUF_FLAG_MAPPED;
 	mmaps_.erase(iter);
 
 	return 0;
 }
 
+ssize_t V4L2CameraProxy::read(V4L2CameraFile *file, void *buf, size_t count)
+{
+	LOG(V4L2Compat, Debug) << "Servicing read fd = " << file->efd();
+
+	ssize_t ret;
+
+	do {
+		MutexLocker locker(proxyMutex_);
+		MutexLocker bufferLocker(bufferMutex_);
+
+		/* The first file to read() without an owner starts streaming. */
+		if (!owner_) {
+			ret = startReadIO(file);
+			if (ret < 0)
+				break;
+		}
+
+		locker.unlock();
+
+		if (owner_ == file) {
+			ret = readIO_ ? readOwned(file, buf, count, &bufferLocker)
+				      : -EBUSY;
+			break;
+		}
+
+		/*
+		 * readShared() returns -ENODEV when the owner released the
+		 * camera while waiting for a frame. Retry, to start streaming
+		 * from this file.
+		 */
+		ret = readShared(file, buf, count, &bufferLocker);
+	} while (ret == -ENODEV);
+
+	if (ret < 0) {
+		errno = -ret;
+		return -1;
+	}
+
+	return ret;
+}
+
 bool V4L2CameraProxy::validateBufferType(uint32_t type)
 {
 	return type == V4L2_BUF_TYPE_VIDEO_CAPTURE;
@@ -158,7 +222,8 @@ bool V4L2CameraProxy::validateBufferType(uint32_t type)
 
 bool V4L2CameraProxy::validateMemoryType(uint32_t memory)
 {
-	return memory == V4L2_MEMORY_MMAP;
+	return memory == V4L2_MEMORY_MMAP || memory == V4L2_MEMORY_DMABUF ||
+	       memory == V4L2_MEMORY_USERPTR;
 }
 
 void V4L2CameraProxy::setFmtFromConfig(const StreamConfiguration &streamConfig)
@@ -196,36 +261,41 @@ void V4L2CameraProxy::querycap(std::shared_ptr<Camera> camera)
 	capabilities_.version = KERNEL_VERSION(5, 2, 0);
 	capabilities_.device_caps = V4L2_CAP_VIDEO_CAPTURE
 				  | V4L2_CAP_STREAMING
+				  | V4L2_CAP_READWRITE
 				  | V4L2_CAP_EXT_PIX_FORMAT;
 	capabilities_.capabilities = capabilities_.device_caps
 				   | V4L2_CAP_DEVICE_CAPS;
 	memset(capabilities_.reserved, 0, sizeof(capabilities_.reserved));
 }
 
+void V4L2CameraProxy::updateBuffer(const V4L2Camera::Buffer &buffer)
+{
+	const FrameMetadata &fmd = buffer.data;
+	struct v4l2_buffer &buf = buffers_[buffer.index];
+
+	switch (fmd.status) {
+	case FrameMetadata::FrameSuccess:
+		buf.bytesused = fmd.planes[0].bytesused;
+		buf.field = V4L2_FIELD_NONE;
+		buf.timestamp.tv_sec = fmd.timestamp / 1000000000;
+		buf.timestamp.tv_usec = fmd.timestamp / 1000 % 1000000;
+		buf.sequence = fmd.sequence;
+
+		buf.flags |= V4L2_BUF_FLAG_DONE;
+		break;
+	case FrameMetadata::FrameError:
+		buf.flags |= V4L2_BUF_FLAG_ERROR;
+		break;
+	default:
+		break;
+	}
+}
+
 void V4L2CameraProxy::updateBuffers()
 {
 	std::vector<V4L2Camera::Buffer> completedBuffers = vcam_->completedBuffers();
-	for (const V4L2Camera::Buffer &buffer : completedBuffers) {
-		const FrameMetadata &fmd = buffer.data;
-		struct v4l2_buffer &buf = buffers_[buffer.index];
-
-		switch (fmd.status) {
-		case FrameMetadata::FrameSuccess:
-			buf.bytesused = fmd.planes[0].bytesused;
-			buf.field = V4L2_FIELD_NONE;
-			buf.timestamp.tv_sec = fmd.timestamp / 1000000000;
-			buf.timestamp.tv_usec = fmd.timestamp % 1000000;
-			buf.sequence = fmd.sequence;
-
-			buf.flags |= V4L2_BUF_FLAG_DONE;
-			break;
-		case FrameMetadata::FrameError:
-			buf.flags |= V4L2_BUF_FLAG_ERROR;
-			break;
-		default:
-			break;
-		}
-	}
+	for (const V4L2Camera::Buffer &buffer : completedBuffers)
+		updateBuffer(buffer);
 }
 
 int V4L2CameraProxy::vidioc_querycap(struct v4l2_capability *arg)
@@ -442,15 +512,440 @@ int V4L2CameraProxy::vidioc_s_input(V4L2CameraFile *file, int *arg)
 	return 0;
 }
 
+int V4L2CameraProxy::allocBuffers(uint32_t memory, unsigned int count)
+{
+	if (bufferCount_ > 0)
+		freeBuffers();
+
+	Size size(v4l2PixFormat_.width, v4l2PixFormat_.height);
+	V4L2PixelFormat v4l2Format = V4L2PixelFormat(v4l2PixFormat_.pixelformat);
+	int ret = vcam_->configure(&streamConfig_, size,
+				   PixelFormatInfo::info(v4l2Format).format,
+				   count);
+	if (ret < 0)
+		return -EINVAL;
+
+	setFmtFromConfig(streamConfig_);
+
+	bufferCount_ = streamConfig_.bufferCount;
+	memory_ = memory;
+
+	/*
+	 * DMABUF buffers are imported when queued, while USERPTR buffers
+	 * are captured to libcamera buffers as no dmabuf can be created
+	 * from user memory.
+	 */
+	if (memory_ != V4L2_MEMORY_DMABUF) {
+		ret = vcam_->allocBuffers(bufferCount_);
+		if (ret < 0) {
+			freeBuffers();
+			return ret;
+		}
+	}
+
+	if (memory_ == V4L2_MEMORY_USERPTR) {
+		ret = mapBuffers();
+		if (ret < 0) {
+			freeBuffers();
+			return ret;
+		}
+	}
+
+	buffers_.resize(bufferCount_);
+	for (unsigned int i = 0; i < bufferCount_; i++) {
+		struct v4l2_buffer buf = {};
+		buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+		buf.length = v4l2PixFormat_.sizeimage;
+		buf.memory = memory_;
+		if (memory_ == V4L2_MEMORY_MMAP)
+			buf.m.offset = i * v4l2PixFormat_.sizeimage;
+		buf.index = i;
+		buf.flags = V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC;
+
+		buffers_[i] = buf;
+	}
+
+	bufferUsers_.assign(bufferCount_, 0);
+	queuePending_.assign(bufferCount_, false);
+
+	return bufferCount_;
+}
+
+int V4L2CameraProxy::mapBuffers()
+{
+	for (unsigned int i = 0; i < bufferCount_; i++) {
+		FileDescriptor fd = vcam_->getBufferFd(i);
+		void *map = MAP_FAILED;
+		if (fd.isValid())
+			map = V4L2CompatManager::instance()->fops().mmap(nullptr, sizeimage_,
+									 PROT_READ, MAP_SHARED,
+									 fd.fd(), 0);
+		if (map == MAP_FAILED) {
+			int ret = fd.isValid() ? -errno : -EINVAL;
+
+			for (void *mapped : mappedBuffers_)
+				V4L2CompatManager::instance()->fops().munmap(mapped, sizeimage_);
+			mappedBuffers_.clear();
+
+			return ret;
+		}
+
+		mappedBuffers_.push_back(map);
+	}
+
+	return 0;
+}
+
 void V4L2CameraProxy::freeBuffers()
 {
 	LOG(V4L2Compat, Debug) << "Freeing libcamera bufs";
 
+	resetReaders();
+
+	for (void *map : mappedBuffers_)
+		V4L2CompatManager::instance()->fops().munmap(map, sizeimage_);
+	mappedBuffers_.clear();
+
 	vcam_->freeBuffers();
 	buffers_.clear();
+	bufferUsers_.clear();
+	queuePending_.clear();
 	bufferCount_ = 0;
 }
 
+/*
+ * Dequeue the next completed buffer and return its index, waiting for it if
+ * the file is blocking. The buffer lock is released while waiting, to let
+ * other threads queue buffers and issue configuration ioctls in the meantime.
+ */
+int V4L2CameraProxy::dequeueBuffer(V4L2CameraFile *file, MutexLocker *locker)
+{
+	V4L2Camera::Buffer completed;
+	while (!vcam_->dequeueBuffer(&completed)) {
+		if (file->nonBlocking())
+			return -EAGAIN;
+
+		locker->unlock();
+		vcam_->waitForBufferAvailable();
+		locker->lock();
+
+		/*
+		 * We need to check here again in case stream was turned off
+		 * while we were blocked on waitForBufferAvailable().
+		 */
+		if (!vcam_->isRunning())
+			return -EINVAL;
+	}
+
+	uint64_t data;
+	int ret = V4L2CompatManager::instance()->fops().read(file->efd(), &data,
+							     sizeof(data));
+	if (ret != sizeof(data))
+		LOG(V4L2Compat, Error) << "Failed to clear eventfd POLLIN";
+
+	if (completed.index >= bufferCount_)
+		return -EINVAL;
+
+	updateBuffer(completed);
+	buffers_[completed.index].flags &= ~V4L2_BUF_FLAG_QUEUED;
+
+	shareBuffer(completed.index);
+
+	return completed.index;
+}
+
+/*
+ * Queue the buffer at \a index to the camera. Buffers still used by readers
+ * are queued when released by the last reader.
+ */
+int V4L2CameraProxy::queueBuffer(unsigned int index)
+{
+	if (lastFrame_ == static_cast<int>(index))
+		lastFrame_ = -1;
+
+	if (!bufferUsers_[index]) {
+		int ret = vcam_->qbuf(index);
+		if (ret < 0)
+			return ret;
+	} else {
+		queuePending_[index] = true;
+	}
+
+	buffers_[index].flags &= ~V4L2_BUF_FLAG_ERROR;
+	buffers_[index].flags |= V4L2_BUF_FLAG_QUEUED;
+
+	return 0;
+}
+
+/*
+ * Share a frame dequeued by the owner with the other files. The files waiting
+ * in read() are given the buffer, to make sure they get the frame even if the
+ * owner queues it back before they wake up.
+ */
+void V4L2CameraProxy::shareBuffer(unsigned int index)
+{
+	if (!(buffers_[index].flags & V4L2_BUF_FLAG_DONE))
+		return;
+
+	lastFrame_ = index;
+
+	for (auto &[file, reader] : readers_) {
+		if (!reader.waiting)
+			continue;
+
+		reader.buffer = index;
+		reader.waiting = false;
+		bufferUsers_[index]++;
+	}
+
+	frameShared_.notify_all();
+}
+
+void V4L2CameraProxy::releaseBuffer(unsigned int index)
+{
+	if (--bufferUsers_[index] || !queuePending_[index])
+		return;
+
+	queuePending_[index] = false;
+
+	int ret = vcam_->qbuf(index);
+	if (ret < 0)
+		LOG(V4L2Compat, Error) << "Failed to queue buffer " << index;
+}
+
+/*
+ * Drop all references to the buffers, when stopping or freeing them. This must
+ * be called with the buffer mutex held, and waits for the readers to complete
+ * their copies.
+ */
+void V4L2CameraProxy::resetReaders()
+{
+	copyDone_.wait(bufferMutex_, [&] { return !copying_; });
+
+	for (auto &[file, reader] : readers_) {
+		reader.buffer = -1;
+		reader.started = false;
+	}
+
+	std::fill(bufferUsers_.begin(), bufferUsers_.end(), 0);
+	std::fill(queuePending_.begin(), queuePending_.end(), false);
+	lastFrame_ = -1;
+
+	frameShared_.notify_all();
+}
+
+/*
+ * read() without an owner makes the file the owner, and streams to an
+ * internal ring of buffers, which are copied to the user buffer and queued
+ * back as soon as they have been read.
+ */
+int V4L2CameraProxy::startReadIO(V4L2CameraFile *file)
+{
+	if (file->priority() < maxPriority())
+		return -EBUSY;
+
+	int ret = allocBuffers(V4L2_MEMORY_MMAP, kReadBufferCount);
+	if (ret < 0)
+		return ret;
+
+	ret = mapBuffers();
+	if (ret < 0) {
+		freeBuffers();
+		return ret;
+	}
+
+	acquire(file);
+	readIO_ = true;
+
+	for (unsigned int i = 0; i < bufferCount_; i++) {
+		ret = queueBuffer(i);
+		if (ret < 0) {
+			stopReadIO();
+			return ret;
+		}
+	}
+
+	ret = vcam_->streamOn();
+	if (ret < 0) {
+		stopReadIO();
+		return ret;
+	}
+
+	LOG(V4L2Compat, Debug) << "Started read() streaming with "
+			       << bufferCount_ << " buffers";
+
+	return 0;
+}
+
+/* Stop streaming, free the buffers and release the owner. */
+void V4L2CameraProxy::stopReadIO()
+{
+	vcam_->streamOff();
+	freeBuffers();
+
+	readIO_ = false;
+	release(owner_);
+}
+
+ssize_t V4L2CameraProxy::readOwned(V4L2CameraFile *file, void *buf, size_t count,
+				   MutexLocker *locker)
+{
+	Reader &reader = readers_[file];
+
+	while (reader.buffer < 0) {
+		int ret = dequeueBuffer(file, locker);
+		if (ret < 0)
+			return ret;
+
+		struct v4l2_buffer &frame = buffers_[ret];
+		if ((frame.flags & V4L2_BUF_FLAG_DONE) && frame.bytesused) {
+			frame.flags &= ~V4L2_BUF_FLAG_DONE;
+			reader.buffer = ret;
+			reader.offset = 0;
+			break;
+		}
+
+		/* Skip the frames that failed to capture. */
+		ret = queueBuffer(ret);
+		if (ret < 0)
+			return ret;
+	}
+
+	unsigned int index = reader.buffer;
+	const struct v4l2_buffer &frame = buffers_[index];
+	size_t bytes = std::min<size_t>(count, frame.bytesused - reader.offset);
+
+	memcpy(buf, static_cast<uint8_t *>(mappedBuffers_[index]) + reader.offset,
+	       bytes);
+	reader.offset += bytes;
+
+	/* Queue the buffer back once the whole frame has been read. */
+	if (reader.offset == frame.bytesused) {
+		reader.buffer = -1;
+
+		int ret = queueBuffer(index);
+		if (ret < 0)
+			return ret;
+	}
+
+	return bytes;
+}
+
+/*
+ * Read the next frame dequeued by the owner, or the last frame it still holds
+ * if not read yet. The frame is copied with the buffer lock released, while a
+ * reference to the buffer prevents the owner from queueing it back. A frame
+ * larger than the user buffer is copied to the reader's staging buffer, and
+ * returned over multiple calls, to avoid holding the camera buffer until the
+ * reader completes the frame.
+ */
+ssize_t V4L2CameraProxy::readShared(V4L2CameraFile *file, void *buf, size_t count,
+				    MutexLocker *locker)
+{
+	Reader &reader = readers_[file];
+
+	if (reader.offset < reader.staging.size()) {
+		size_t bytes = std::min<size_t>(count, reader.staging.size() - reader.offset);
+		const uint8_t *data = reader.staging.data() + reader.offset;
+
+		locker->unlock();
+		memcpy(buf, data, bytes);
+		locker->lock();
+
+		reader.offset += bytes;
+		if (reader.offset == reader.staging.size()) {
+			reader.staging.clear();
+			reader.offset = 0;
+		}
+
+		return bytes;
+	}
+
+	while (reader.buffer < 0) {
+		if (lastFrame_ >= 0 &&
+		    (!reader.started || buffers_[lastFrame_].sequence != reader.sequence)) {
+			reader.buffer = lastFrame_;
+			bufferUsers_[lastFrame_]++;
+			break;
+		}
+
+		if (file->nonBlocking())
+			return -EAGAIN;
+
+		reader.waiting = true;
+		frameShared_.wait(*locker);
+		reader.waiting = false;
+
+		if (!owner_)
+			return -ENODEV;
+	}
+
+	unsigned int index = reader.buffer;
+	size_t size = buffers_[index].bytesused;
+	uint32_t sequence = buffers_[index].sequence;
+	reader.buffer = -1;
+
+	/*
+	 * Imported dmabufs may change every time they're queued, map them for
+	 * the duration of the copy only.
+	 */
+	const void *data = nullptr;
+	void *map = MAP_FAILED;
+	ssize_t ret = 0;
+
+	if (memory_ == V4L2_MEMORY_DMABUF) {
+		FileDescriptor fd = vcam_->getBufferFd(index);
+		if (fd.isValid() && size)
+			map = V4L2CompatManager::instance()->fops().mmap(nullptr, size,
+									 PROT_READ, MAP_SHARED,
+									 fd.fd(), 0);
+		if (map == MAP_FAILED)
+			ret = fd.isValid() && size ? -errno : -EINVAL;
+		data = map;
+	} else {
+		if (mappedBuffers_.empty())
+			ret = mapBuffers();
+		if (!ret)
+			data = mappedBuffers_[index];
+	}
+
+	if (ret < 0) {
+		releaseBuffer(index);
+		return ret;
+	}
+
+	uint8_t *dst = static_cast<uint8_t *>(buf);
+	if (count < size) {
+		reader.staging.resize(size);
+		dst = reader.staging.data();
+	}
+
+	copying_++;
+	locker->unlock();
+
+	memcpy(dst, data, size);
+	if (map != MAP_FAILED)
+		V4L2CompatManager::instance()->fops().munmap(map, size);
+	if (dst != buf)
+		memcpy(buf, dst, count);
+
+	locker->lock();
+	copying_--;
+	copyDone_.notify_all();
+
+	releaseBuffer(index);
+
+	reader.sequence = sequence;
+	reader.started = true;
+
+	if (count >= size)
+		return size;
+
+	reader.offset = count;
+
+	return count;
+}
+
 int V4L2CameraProxy::vidioc_reqbufs(V4L2CameraFile *file, struct v4l2_requestbuffers *arg)
 {
 	LOG(V4L2Compat, Debug) << "Servicing vidioc_reqbufs fd = " << file->efd();
@@ -467,7 +962,9 @@ int V4L2CameraProxy::vidioc_reqbufs(V4L2CameraFile *file, struct v4l2_requestbuf
 	if (!hasOwnership(file) && owner_)
 		return -EBUSY;
 
-	arg->capabilities = V4L2_BUF_CAP_SUPPORTS_MMAP;
+	arg->capabilities = V4L2_BUF_CAP_SUPPORTS_MMAP
+			  | V4L2_BUF_CAP_SUPPORTS_DMABUF
+			  | V4L2_BUF_CAP_SUPPORTS_USERPTR;
 	memset(arg->reserved, 0, sizeof(arg->reserved));
 
 	if (arg->count == 0) {
@@ -484,40 +981,13 @@ int V4L2CameraProxy::vidioc_reqbufs(V4L2CameraFile *file, struct v4l2_requestbuf
 		return 0;
 	}
 
-	if (bufferCount_ > 0)
-		freeBuffers();
-
-	Size size(v4l2PixFormat_.width, v4l2PixFormat_.height);
-	V4L2PixelFormat v4l2Format = V4L2PixelFormat(v4l2PixFormat_.pixelformat);
-	int ret = vcam_->configure(&streamConfig_, size,
-				   PixelFormatInfo::info(v4l2Format).format,
-				   arg->count);
-	if (ret < 0)
-		return -EINVAL;
-
-	setFmtFromConfig(streamConfig_);
-
-	arg->count = streamConfig_.bufferCount;
-	bufferCount_ = arg->count;
-
-	ret = vcam_->allocBuffers(arg->count);
+	int ret = allocBuffers(arg->memory, arg->count);
 	if (ret < 0) {
 		arg->count = 0;
 		return ret;
 	}
 
-	buffers_.resize(arg->count);
-	for (unsigned int i = 0; i < arg->count; i++) {
-		struct v4l2_buffer buf = {};
-		buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-		buf.length = v4l2PixFormat_.sizeimage;
-		buf.memory = V4L2_MEMORY_MMAP;
-		buf.m.offset = i * v4l2PixFormat_.sizeimage;
-		buf.index = i;
-		buf.flags = V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC;
-
-		buffers_[i] = buf;
-	}
+	arg->count = ret;
 
 	LOG(V4L2Compat, Debug) << "Allocated " << arg->count << " buffers";
 
@@ -544,6 +1014,32 @@ int V4L2CameraProxy::vidioc_querybuf(V4L2CameraFile *file, struct v4l2_buffer *a
 	return 0;
 }
 
+int V4L2CameraProxy::vidioc_expbuf(V4L2CameraFile *file, struct v4l2_exportbuffer *arg)
+{
+	LOG(V4L2Compat, Debug) << "Servicing vidioc_expbuf fd = " << file->efd();
+
+	if (!validateBufferType(arg->type) ||
+	    memory_ != V4L2_MEMORY_MMAP ||
+	    arg->index >= bufferCount_ || arg->plane != 0)
+		return -EINVAL;
+
+	if (arg->flags & ~(O_CLOEXEC | O_ACCMODE))
+		return -EINVAL;
+
+	FileDescriptor fd = vcam_->getBufferFd(arg->index);
+	if (!fd.isValid())
+		return -EINVAL;
+
+	int ret = fcntl(fd.fd(), arg->flags & O_CLOEXEC ? F_DUPFD_CLOEXEC : F_DUPFD, 0);
+	if (ret < 0)
+		return -errno;
+
+	arg->fd = ret;
+	memset(arg->reserved, 0, sizeof(arg->reserved));
+
+	return 0;
+}
+
 int V4L2CameraProxy::vidioc_qbuf(V4L2CameraFile *file, struct v4l2_buffer *arg)
 {
 	LOG(V4L2Compat, Debug) << "Servicing vidioc_qbuf, index = "
@@ -559,16 +1055,35 @@ int V4L2CameraProxy::vidioc_qbuf(V4L2CameraFile *file, struct v4l2_buffer *arg)
 		return -EBUSY;
 
 	if (!validateBufferType(arg->type) ||
-	    !validateMemoryType(arg->memory) ||
+	    arg->memory != memory_ ||
 	    arg->index >= bufferCount_)
 		return -EINVAL;
 
-	int ret = vcam_->qbuf(arg->index);
+	struct v4l2_buffer &buf = buffers_[arg->index];
+
+	if (memory_ == V4L2_MEMORY_DMABUF) {
+		unsigned int length = arg->length ? arg->length : sizeimage_;
+		if (length < sizeimage_)
+			return -EINVAL;
+
+		int ret = vcam_->importBuffer(arg->index, arg->m.fd, length);
+		if (ret < 0)
+			return ret;
+
+		buf.m.fd = arg->m.fd;
+		buf.length = length;
+	} else if (memory_ == V4L2_MEMORY_USERPTR) {
+		if (!arg->m.userptr || arg->length < sizeimage_)
+			return -EINVAL;
+
+		buf.m.userptr = arg->m.userptr;
+		buf.length = arg->length;
+	}
+
+	int ret = queueBuffer(arg->index);
 	if (ret < 0)
 		return ret;
 
-	buffers_[arg->index].flags |= V4L2_BUF_FLAG_QUEUED;
-
 	arg->flags = buffers_[arg->index].flags;
 
 	return ret;
@@ -589,38 +1104,24 @@ int V4L2CameraProxy::vidioc_dqbuf(V4L2CameraFile *file, struct v4l2_buffer *arg,
 		return -EINVAL;
 
 	if (!validateBufferType(arg->type) ||
-	    !validateMemoryType(arg->memory))
+	    arg->memory != memory_)
 		return -EINVAL;
 
-	if (!file->nonBlocking()) {
-		locker->unlock();
-		vcam_->waitForBufferAvailable();
-		locker->lock();
-	} else if (!vcam_->isBufferAvailable())
-		return -EAGAIN;
-
-	/*
-	 * We need to check here again in case stream was turned off while we
-	 * were blocked on waitForBufferAvailable().
-	 */
-	if (!vcam_->isRunning())
-		return -EINVAL;
+	int index = dequeueBuffer(file, locker);
+	if (index < 0)
+		return index;
 
-	updateBuffers();
+	struct v4l2_buffer &buf = buffers_[index];
 
-	struct v4l2_buffer &buf = buffers_[currentBuf_];
+	if (memory_ == V4L2_MEMORY_USERPTR && (buf.flags & V4L2_BUF_FLAG_DONE))
+		memcpy(reinterpret_cast<void *>(buf.m.userptr),
+		       mappedBuffers_[index], buf.bytesused);
 
-	buf.flags &= ~(V4L2_BUF_FLAG_QUEUED | V4L2_BUF_FLAG_DONE);
-	buf.length = sizeimage_;
+	buf.flags &= ~V4L2_BUF_FLAG_DONE;
+	if (memory_ == V4L2_MEMORY_MMAP)
+		buf.length = sizeimage_;
 	*arg = buf;
 
-	currentBuf_ = (currentBuf_ + 1) % bufferCount_;
-
-	uint64_t data;
-	int ret = ::read(file->efd(), &data, sizeof(data));
-	if (ret != sizeof(data))
-		LOG(V4L2Compat, Error) << "Failed to clear eventfd POLLIN";
-
 	return 0;
 }
 
@@ -643,8 +1144,6 @@ int V4L2CameraProxy::vidioc_streamon(V4L2CameraFile *file, int *arg)
 	if (vcam_->isRunning())
 		return 0;
 
-	currentBuf_ = 0;
-
 	return vcam_->streamOn();
 }
 
@@ -666,6 +1165,8 @@ int V4L2CameraProxy::vidioc_streamoff(V4L2CameraFile *file, int *arg)
 	for (struct v4l2_buffer &buf : buffers_)
 		buf.flags &= ~(V4L2_BUF_FLAG_QUEUED | V4L2_BUF_FLAG_DONE);
 
+	resetReaders();
+
 	return ret;
 }
 
@@ -683,6 +1184,7 @@ const std::set<unsigned long> V4L2CameraProxy::supportedIoctls_ = {
 	VIDIOC_S_INPUT,
 	VIDIOC_REQBUFS,
 	VIDIOC_QUERYBUF,
+	VIDIOC_EXPBUF,
 	VIDIOC_QBUF,
 	VIDIOC_DQBUF,
 	VIDIOC_STREAMON,
@@ -691,8 +1193,6 @@ const std::set<unsigned long> V4L2CameraProxy::supportedIoctls_ = {
 
 int V4L2CameraProxy::ioctl(V4L2CameraFile *file, unsigned long request, void *arg)
 {
-	MutexLocker locker(proxyMutex_);
-
 	if (!arg && (_IOC_DIR(request) & _IOC_WRITE)) {
 		errno = EFAULT;
 		return -1;
@@ -708,6 +1208,35 @@ int V4L2CameraProxy::ioctl(V4L2CameraFile *file, unsigned long request, void *ar
 		return -1;
 	}
 
+	/*
+	 * The buffer ioctls are only serialized with the buffer lock, which is
+	 * released while waiting for buffers. They are thus not blocked by
+	 * the configuration ioctls that don't modify the buffers state.
+	 */
+	bool bufferIoctl = request == VIDIOC_QUERYBUF ||
+			   request == VIDIOC_EXPBUF ||
+			   request == VIDIOC_QBUF ||
+			   request == VIDIOC_DQBUF;
+	bool modifiesBuffers = request == VIDIOC_S_FMT ||
+			       request == VIDIOC_REQBUFS ||
+			       request == VIDIOC_STREAMON ||
+			       request == VIDIOC_STREAMOFF;
+
+	MutexLocker locker(proxyMutex_, std::defer_lock);
+	if (!bufferIoctl)
+		locker.lock();
+
+	MutexLocker bufferLocker(bufferMutex_, std::defer_lock);
+	if (bufferIoctl || modifiesBuffers)
+		bufferLocker.lock();
+
+	/* The buffers are managed internally while streaming with read(). */
+	if (readIO_ && request != VIDIOC_QUERYBUF &&
+	    (bufferIoctl || modifiesBuffers)) {
+		errno = EBUSY;
+		return -1;
+	}
+
 	int ret;
 	switch (request) {
 	case VIDIOC_QUERYCAP:
@@ -749,11 +1278,14 @@ int V4L2CameraProxy::ioctl(V4L2CameraFile *file, unsigned long request, void *ar
 	case VIDIOC_QUERYBUF:
 		ret = vidioc_querybuf(file, static_cast<struct v4l2_buffer *>(arg));
 		break;
+	case VIDIOC_EXPBUF:
+		ret = vidioc_expbuf(file, static_cast<struct v4l2_exportbuffer *>(arg));
+		break;
 	case VIDIOC_QBUF:
 		ret = vidioc_qbuf(file, static_cast<struct v4l2_buffer *>(arg));
 		break;
 	case VIDIOC_DQBUF:
-		ret = vidioc_dqbuf(file, static_cast<struct v4l2_buffer *>(arg), &locker);
+		ret = vidioc_dqbuf(file, static_cast<struct v4l2_buffer *>(arg), &bufferLocker);
 		break;
 	case VIDIOC_STREAMON:
 		ret = vidioc_streamon(file, static_cast<int *>(arg));
@@ -813,4 +1345,7 @@ void V4L2CameraProxy::release(V4L2CameraFile *file)
 	vcam_->unbind();
 
 	owner_ = nullptr;
+
+	/* Let the files waiting for frames in read() take over. */
+	frameShared_.notify_all();
 }
@@ -8,6 +8,7 @@
 #ifndef __V4L2_CAMERA_PROXY_H__
 #define __V4L2_CAMERA_PROXY_H__
 
+#include <condition_variable>
 #include <linux/videodev2.h>
 #include <map>
 #include <memory>
@@ -33,18 +34,57 @@ public:
 	void close(V4L2CameraFile *file);
 	void *mmap(void *addr, size_t length, int prot, int flags, off64_t offset);
 	int munmap(void *addr, size_t length);
+	ssize_t read(V4L2CameraFile *file, void *buf, size_t count);
 
 	int ioctl(V4L2CameraFile *file, unsigned long request, void *arg);
 
 private:
+	/*
+	 * Files reading frames with read(). The owner reads the buffers it
+	 * dequeues, possibly in multiple calls. Other files share the buffers
+	 * dequeued by the owner. Frames that don't fit in their read() buffer
+	 * are staged, and the remainder returned by the next calls.
+	 */
+	struct Reader {
+		Reader()
+			: buffer(-1), offset(0), sequence(0), started(false),
+			  waiting(false)
+		{
+		}
+
+		int buffer;
+		unsigned int offset;
+		uint32_t sequence;
+		bool started;
+		bool waiting;
+		std::vector<uint8_t> staging;
+	};
+
+	static constexpr unsigned int kReadBufferCount = 4;
+
 	bool validateBufferType(uint32_t type);
 	bool validateMemoryType(uint32_t memory);
 	void setFmtFromConfig(const StreamConfiguration &streamConfig);
 	void querycap(std::shared_ptr<Camera> camera);
 	int tryFormat(struct v4l2_format *arg);
 	enum v4l2_priority maxPriority();
+	void updateBuffer(const V4L2Camera::Buffer &buffer);
 	void updateBuffers();
+	int allocBuffers(uint32_t memory, unsigned int count);
+	int mapBuffers();
 	void freeBuffers();
+	int dequeueBuffer(V4L2CameraFile *file, MutexLocker *locker);
+	int queueBuffer(unsigned int index);
+	void shareBuffer(unsigned int index);
+	void releaseBuffer(unsigned int index);
+	void resetReaders();
+
+	int startReadIO(V4L2CameraFile *file);
+	void stopReadIO();
+	ssize_t readOwned(V4L2CameraFile *file, void *buf, size_t count,
+			  MutexLocker *locker);
+	ssize_t readShared(V4L2CameraFile *file, void *buf, size_t count,
+			   MutexLocker *locker);
 
 	int vidioc_querycap(struct v4l2_capability *arg);
 	int vidioc_enum_framesizes(V4L2CameraFile *file, struct v4l2_frmsizeenum *arg);
@@ -59,6 +99,7 @@ private:
 	int vidioc_s_input(V4L2CameraFile *file, int *arg);
 	int vidioc_reqbufs(V4L2CameraFile *file, struct v4l2_requestbuffers *arg);
 	int vidioc_querybuf(V4L2CameraFile *file, struct v4l2_buffer *arg);
+	int vidioc_expbuf(V4L2CameraFile *file, struct v4l2_exportbuffer *arg);
 	int vidioc_qbuf(V4L2CameraFile *file, struct v4l2_buffer *arg);
 	int vidioc_dqbuf(V4L2CameraFile *file, struct v4l2_buffer *arg, MutexLocker *locker);
 	int vidioc_streamon(V4L2CameraFile *file, int *arg);
@@ -75,8 +116,8 @@ private:
 
 	StreamConfiguration streamConfig_;
 	unsigned int bufferCount_;
-	unsigned int currentBuf_;
 	unsigned int sizeimage_;
+	uint32_t memory_;
 
 	struct v4l2_capability capabilities_;
 	struct v4l2_pix_format v4l2PixFormat_;
@@ -84,6 +125,32 @@ private:
 	std::vector<struct v4l2_buffer> buffers_;
 	std::map<void *, unsigned int> mmaps_;
 
+	/*
+	 * The libcamera buffers are mapped here for USERPTR memory, copied to
+	 * the user memory when dequeued, and for read().
+	 */
+	std::vector<void *> mappedBuffers_;
+
+	/*
+	 * Frames dequeued by the owner are shared with the other files that
+	 * read(). lastFrame_ is the most recent frame still held by the owner,
+	 * and buffers used by readers are only queued back to the camera when
+	 * released by the last reader.
+	 */
+	bool readIO_;
+	std::map<V4L2CameraFile *, Reader> readers_;
+	int lastFrame_;
+	std::vector<unsigned int> bufferUsers_;
+	std::vector<bool> queuePending_;
+	std::condition_variable frameShared_;
+
+	/*
+	 * Readers copy shared frames with the buffer mutex released. The
+	 * buffers are only freed or reset once all copies have completed.
+	 */
+	unsigned int copying_;
+	std::condition_variable_any copyDone_;
+
 	std::set<V4L2CameraFile *> files_;
 
 	std::unique_ptr<V4L2Camera> vcam_;
@@ -99,8 +166,15 @@ private:
 	 */
 	V4L2CameraFile *owner_;
 
-	/* This mutex is to serialize access to the proxy. */
+	/*
+	 * The proxy mutex serializes configuration ioctls and file operations.
+	 * The buffer mutex protects the buffers state, and serializes the
+	 * buffer ioctls with each other and with the operations that modify
+	 * the buffers state. When both are needed, the proxy mutex shall be
+	 * locked first.
+	 */
 	Mutex proxyMutex_;
+	Mutex bufferMutex_;
 };
 
 #endif /* __V4L2_CAMERA_PROXY_H__ */
@@ -10,6 +10,7 @@
 #include <dlfcn.h>
 #include <fcntl.h>
 #include <map>
+#include <mutex>
 #include <stdarg.h>
 #include <string.h>
 #include <sys/eventfd.h>
@@ -39,7 +40,7 @@ void get_symbol(T &func, const char *name)
 } /* namespace */
 
 V4L2CompatManager::V4L2CompatManager()
-	: cm_(nullptr)
+	: cm_(nullptr), fileCount_(0)
 {
 	get_symbol(fops_.openat, "openat64");
 	get_symbol(fops_.dup, "dup");
@@ -47,6 +48,7 @@ V4L2CompatManager::V4L2CompatManager()
 	get_symbol(fops_.ioctl, "ioctl");
 	get_symbol(fops_.mmap, "mmap64");
 	get_symbol(fops_.munmap, "munmap");
+	get_symbol(fops_.read, "read");
 }
 
 V4L2CompatManager::~V4L2CompatManager()
@@ -99,6 +101,11 @@ V4L2CompatManager *V4L2CompatManager::instance()
 
 std::shared_ptr<V4L2CameraFile> V4L2CompatManager::cameraFile(int fd)
 {
+	if (!fileCount_.load(std::memory_order_acquire))
+		return nullptr;
+
+	std::shared_lock<std::shared_mutex> locker(mutex_);
+
 	auto file = files_.find(fd);
 	if (file == files_.end())
 		return nullptr;
@@ -139,6 +146,8 @@ int V4L2CompatManager::openat(int dirfd, const char *path, int oflag, mode_t mod
 	    major(statbuf.st_rdev) != 81)
 		return fd;
 
+	std::unique_lock<std::shared_mutex> locker(mutex_);
+
 	if (!cm_)
 		start();
 
@@ -148,6 +157,9 @@ int V4L2CompatManager::openat(int dirfd, const char *path, int oflag, mode_t mod
 		return fd;
 	}
 
+	V4L2CameraProxy *proxy = proxies_[ret].get();
+	locker.unlock();
+
 	fops_.close(fd);
 
 	int efd = eventfd(0, EFD_SEMAPHORE |
@@ -156,8 +168,11 @@ int V4L2CompatManager::openat(int dirfd, const char *path, int oflag, mode_t mod
 	if (efd < 0)
 		return efd;
 
-	V4L2CameraProxy *proxy = proxies_[ret].get();
-	files_.emplace(efd, std::make_shared<V4L2CameraFile>(efd, oflag & O_NONBLOCK, proxy));
+	auto file = std::make_shared<V4L2CameraFile>(efd, oflag & O_NONBLOCK, proxy);
+
+	locker.lock();
+	files_.emplace(efd, std::move(file));
+	fileCount_.store(files_.size(), std::memory_order_release);
 
 	return efd;
 }
@@ -168,18 +183,35 @@ int V4L2CompatManager::dup(int oldfd)
 	if (newfd < 0)
 		return newfd;
 
-	auto file = files_.find(oldfd);
-	if (file != files_.end())
-		files_[newfd] = file->second;
+	std::shared_ptr<V4L2CameraFile> file = cameraFile(oldfd);
+	if (!file)
+		return newfd;
+
+	std::unique_lock<std::shared_mutex> locker(mutex_);
+	files_[newfd] = file;
+	fileCount_.store(files_.size(), std::memory_order_release);
 
 	return newfd;
 }
 
 int V4L2CompatManager::close(int fd)
 {
-	auto file = files_.find(fd);
-	if (file != files_.end())
-		files_.erase(file);
+	/*
+	 * Release the file after unlocking, as closing the last reference
+	 * to it calls into the proxy.
+	 */
+	std::shared_ptr<V4L2CameraFile> file;
+
+	if (fileCount_.load(std::memory_order_acquire)) {
+		std::unique_lock<std::shared_mutex> locker(mutex_);
+
+		auto iter = files_.find(fd);
+		if (iter != files_.end()) {
+			file = std::move(iter->second);
+			files_.erase(iter);
+			fileCount_.store(files_.size(), std::memory_order_release);
+		}
+	}
 
 	/* We still need to close the eventfd. */
 	return fops_.close(fd);
@@ -200,27 +232,45 @@ void *V4L2CompatManager::mmap(void *addr, size_t length, int prot, int flags,
 	 * Map to V4L2CameraProxy directly to prevent adding more references
 	 * to V4L2CameraFile.
 	 */
+	std::unique_lock<std::shared_mutex> locker(mutex_);
 	mmaps_[map] = file->proxy();
 	return map;
 }
 
 int V4L2CompatManager::munmap(void *addr, size_t length)
 {
-	auto device = mmaps_.find(addr);
-	if (device == mmaps_.end())
-		return fops_.munmap(addr, length);
+	V4L2CameraProxy *proxy = nullptr;
+
+	{
+		std::shared_lock<std::shared_mutex> locker(mutex_);
+
+		auto device = mmaps_.find(addr);
+		if (device != mmaps_.end())
+			proxy = device->second;
+	}
 
-	V4L2CameraProxy *proxy = device->second;
+	if (!proxy)
+		return fops_.munmap(addr, length);
 
 	int ret = proxy->munmap(addr, length);
 	if (ret < 0)
 		return ret;
 
-	mmaps_.erase(device);
+	std::unique_lock<std::shared_mutex> locker(mutex_);
+	mmaps_.erase(addr);
 
 	return 0;
 }
 
+ssize_t V4L2CompatManager::read(int fd, void *buf, size_t count)
+{
+	std::shared_ptr<V4L2CameraFile> file = cameraFile(fd);
+	if (!file)
+		return fops_.read(fd, buf, count);
+
+	return file->proxy()->read(file.get(), buf, count);
+}
+
 int V4L2CompatManager::ioctl(int fd, unsigned long request, void *arg)
 {
 	std::shared_ptr<V4L2CameraFile> file = cameraFile(fd);
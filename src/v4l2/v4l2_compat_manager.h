@@ -8,9 +8,11 @@
 #ifndef __V4L2_COMPAT_MANAGER_H__
 #define __V4L2_COMPAT_MANAGER_H__
 
+#include <atomic>
 #include <fcntl.h>
 #include <map>
 #include <memory>
+#include <shared_mutex>
 #include <sys/mman.h>
 #include <sys/types.h>
 #include <vector>
@@ -33,6 +35,7 @@ public:
 		using mmap_func_t = void *(*)(void *addr, size_t length, int prot,
 					      int flags, int fd, off64_t offset);
 		using munmap_func_t = int (*)(void *addr, size_t length);
+		using read_func_t = ssize_t (*)(int fd, void *buf, size_t count);
 
 		openat_func_t openat;
 		dup_func_t dup;
@@ -40,6 +43,7 @@ public:
 		ioctl_func_t ioctl;
 		mmap_func_t mmap;
 		munmap_func_t munmap;
+		read_func_t read;
 	};
 
 	static V4L2CompatManager *instance();
@@ -53,6 +57,7 @@ public:
 	void *mmap(void *addr, size_t length, int prot, int flags,
 		   int fd, off64_t offset);
 	int munmap(void *addr, size_t length);
+	ssize_t read(int fd, void *buf, size_t count);
 	int ioctl(int fd, unsigned long request, void *arg);
 
 private:
@@ -68,7 +73,16 @@ private:
 	CameraManager *cm_;
 
 	std::vector<std::unique_ptr<V4L2CameraProxy>> proxies_;
+
+	/*
+	 * The files and mappings are looked up for every intercepted call,
+	 * including reads of unrelated files, and are thus protected by a
+	 * shared mutex. The atomic file count lets lookups skip the lock
+	 * altogether when no camera is open.
+	 */
+	std::shared_mutex mutex_;
 	std::map<int, std::shared_ptr<V4L2CameraFile>> files_;
+	std::atomic<unsigned int> fileCount_;
 	std::map<void *, V4L2CameraProxy *> mmaps_;
 };
 
@@ -0,0 +1,82 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2020, Google Inc.
+ *
+ * camera-statistics.cpp - Camera statistics histogram test
+ */
+
+#include <iostream>
+
+#include "libcamera/internal/camera_statistics.h"
+
+#include "test.h"
+
+using namespace std;
+using namespace libcamera;
+
+class CameraStatisticsTest : public Test
+{
+protected:
+	int run()
+	{
+		using Histogram = CameraStatistics::Histogram;
+
+		/* Check that bucket bounds are contiguous and match indices. */
+		for (unsigned int i = 0; i < Histogram::kNumBuckets - 1; ++i) {
+			uint64_t lower = Histogram::bucketLowerBound(i);
+			uint64_t upper = Histogram::bucketUpperBound(i);
+
+			if (upper != Histogram::bucketLowerBound(i + 1) ||
+			    Histogram::bucketIndex(lower) != i ||
+			    Histogram::bucketIndex(upper - 1) != i) {
+				cout << "Invalid bounds for bucket " << i << endl;
+				return TestFail;
+			}
+		}
+
+		if (Histogram::bucketIndex(UINT64_MAX) != Histogram::kNumBuckets - 1) {
+			cout << "Large values not counted in last bucket" << endl;
+			return TestFail;
+		}
+
+		AtomicHistogram atomic;
+		Histogram histogram = atomic.snapshot();
+		if (histogram.count || histogram.min || histogram.percentile(50)) {
+			cout << "Histogram not empty" << endl;
+			return TestFail;
+		}
+
+		/* 90 values of 33ms and 10 values of 66ms. */
+		for (unsigned int i = 0; i < 90; ++i)
+			atomic.record(33333);
+		for (unsigned int i = 0; i < 10; ++i)
+			atomic.record(66666);
+
+		histogram = atomic.snapshot();
+
+		if (histogram.count != 100 || histogram.min != 33333 ||
+		    histogram.max != 66666 || histogram.sum != 3666630) {
+			cout << "Invalid histogram summary" << endl;
+			return TestFail;
+		}
+
+		/* Percentiles must be accurate within the bucket precision. */
+		uint64_t p50 = histogram.percentile(50);
+		uint64_t p99 = histogram.percentile(99);
+		if (p50 < 33333 || p50 > 33333 * 9 / 8 ||
+		    p99 < 66666 * 7 / 8 || p99 > 66666) {
+			cout << "Invalid percentiles " << p50 << " " << p99 << endl;
+			return TestFail;
+		}
+
+		atomic.reset();
+		if (atomic.snapshot().count) {
+			cout << "Histogram not reset" << endl;
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+};
+
+TEST_REGISTER(CameraStatisticsTest)
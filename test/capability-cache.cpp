@@ -0,0 +1,259 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2020, Google Inc.
+ *
+ * capability-cache.cpp - CapabilityCache tests
+ */
+
+#include <chrono>
+#include <dirent.h>
+#include <iostream>
+#include <map>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "libcamera/internal/capability_cache.h"
+#include "libcamera/internal/device_enumerator.h"
+#include "libcamera/internal/file.h"
+#include "libcamera/internal/media_device.h"
+#include "libcamera/internal/v4l2_subdevice.h"
+
+#include "test.h"
+
+using namespace std;
+using namespace libcamera;
+
+class CapabilityCacheTest : public Test
+{
+protected:
+	int init() override
+	{
+		char dir[] = "/tmp/libcamera.cache.XXXXXX";
+		if (!mkdtemp(dir)) {
+			cerr << "Failed to create temporary directory" << endl;
+			return TestFail;
+		}
+
+		dir_ = dir;
+		setenv("LIBCAMERA_CAPABILITY_CACHE", dir_.c_str(), 1);
+
+		if (CapabilityCache::directory() != dir_) {
+			cerr << "Cache directory not set" << endl;
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+
+	int testCache()
+	{
+		const std::map<unsigned int, std::vector<SizeRange>> formats = {
+			{ 0x2001, { SizeRange({ 640, 480 }, { 4096, 3072 }, 2, 2) } },
+			{ 0x2002, { SizeRange({ 1920, 1080 }), SizeRange({ 1280, 720 }) } },
+		};
+		const std::vector<uint8_t> raw = { 1, 2, 3, 4, 5 };
+		std::string fileName;
+
+		/* Store data in the cache. */
+		{
+			CapabilityCache cache("device", "key-1");
+			fileName = cache.fileName();
+
+			std::vector<uint8_t> data;
+			if (cache.lookup("raw", &data)) {
+				cerr << "Empty cache returned data" << endl;
+				return TestFail;
+			}
+
+			if (cache.storeFormats("formats", formats) ||
+			    cache.store("raw", raw)) {
+				cerr << "Failed to store data in the cache" << endl;
+				return TestFail;
+			}
+
+			/* Writes are deferred until the cache is flushed. */
+			if (File::exists(fileName)) {
+				cerr << "Cache file written before flush" << endl;
+				return TestFail;
+			}
+
+			CapabilityCache::flushAll();
+
+			if (!File::exists(fileName)) {
+				cerr << "Cache file not written by flush" << endl;
+				return TestFail;
+			}
+		}
+
+		/* Destroying a cache flushes it. */
+		{
+			std::string otherName;
+
+			{
+				CapabilityCache cache("other-device", "key-1");
+				otherName = cache.fileName();
+				cache.store("raw", raw);
+			}
+
+			if (!File::exists(otherName)) {
+				cerr << "Cache file not written on destruction" << endl;
+				return TestFail;
+			}
+		}
+
+		/* Load it back with a matching key. */
+		{
+			CapabilityCache cache("device", "key-1");
+
+			std::map<unsigned int, std::vector<SizeRange>> cached;
+			if (!cache.lookupFormats("formats", &cached) ||
+			    cached != formats) {
+				cerr << "Failed to retrieve cached formats" << endl;
+				return TestFail;
+			}
+
+			std::vector<uint8_t> data;
+			if (!cache.lookup("raw", &data) || data != raw) {
+				cerr << "Failed to retrieve cached data" << endl;
+				return TestFail;
+			}
+
+			/* Sections of the wrong type must be rejected. */
+			if (cache.lookupFormats("raw", &cached)) {
+				cerr << "Invalid formats section accepted" << endl;
+				return TestFail;
+			}
+		}
+
+		/* A different key invalidates the cache. */
+		{
+			CapabilityCache cache("device", "key-2");
+
+			std::vector<uint8_t> data;
+			if (cache.lookup("raw", &data)) {
+				cerr << "Stale cache data returned" << endl;
+				return TestFail;
+			}
+		}
+
+		/* The cache file must not have been modified. */
+		{
+			CapabilityCache cache("device", "key-1");
+
+			std::vector<uint8_t> data;
+			if (!cache.lookup("raw", &data)) {
+				cerr << "Cache data lost" << endl;
+				return TestFail;
+			}
+		}
+
+		/*
+		 * A corrupted file must be ignored. Overwrite the size of the last
+		 * section, which makes it extend past the end of the file.
+		 */
+		File file(fileName);
+		if (!file.open(File::ReadWrite) ||
+		    file.seek(file.size() - raw.size() - 4) < 0) {
+			cerr << "Failed to open cache file" << endl;
+			return TestFail;
+		}
+
+		uint8_t garbage[4] = { 0xff, 0xff, 0xff, 0xff };
+		file.write(garbage);
+		file.close();
+
+		{
+			CapabilityCache cache("device", "key-1");
+
+			std::vector<uint8_t> data;
+			if (cache.lookup("raw", &data)) {
+				cerr << "Corrupted cache data returned" << endl;
+				return TestFail;
+			}
+		}
+
+		return TestPass;
+	}
+
+	/*
+	 * Compare the time needed to open a sensor subdevice and enumerate its
+	 * formats with a cold and a warm cache. This requires the vimc driver
+	 * and is skipped otherwise.
+	 */
+	int testTiming()
+	{
+		std::unique_ptr<DeviceEnumerator> enumerator = DeviceEnumerator::create();
+		if (!enumerator || enumerator->enumerate())
+			return TestSkip;
+
+		DeviceMatch dm("vimc");
+		dm.add("Sensor A");
+
+		std::shared_ptr<MediaDevice> media = enumerator->search(dm);
+		if (!media)
+			return TestSkip;
+
+		MediaEntity *entity = media->getEntityByName("Sensor A");
+		V4L2Subdevice::Formats reference;
+
+		for (const char *pass : { "cold", "warm" }) {
+			auto start = std::chrono::steady_clock::now();
+
+			V4L2Subdevice sensor(entity);
+			if (sensor.open()) {
+				cerr << "Failed to open sensor subdevice" << endl;
+				return TestFail;
+			}
+
+			V4L2Subdevice::Formats formats = sensor.formats(0);
+
+			auto end = std::chrono::steady_clock::now();
+			std::chrono::duration<double, std::milli> duration = end - start;
+			cout << "Open and enumerate with " << pass << " cache: "
+			     << duration.count() << "ms" << endl;
+
+			if (reference.empty()) {
+				reference = formats;
+			} else if (formats != reference) {
+				cerr << "Cached formats differ from enumeration" << endl;
+				return TestFail;
+			}
+		}
+
+		return TestPass;
+	}
+
+	int run() override
+	{
+		if (testCache() != TestPass)
+			return TestFail;
+
+		if (testTiming() == TestFail)
+			return TestFail;
+
+		return TestPass;
+	}
+
+	void cleanup() override
+	{
+		if (dir_.empty())
+			return;
+
+		DIR *dir = opendir(dir_.c_str());
+		if (dir) {
+			struct dirent *ent;
+			while ((ent = readdir(dir)) != nullptr) {
+				if (ent->d_name[0] != '.')
+					unlink((dir_ + "/" + ent->d_name).c_str());
+			}
+			closedir(dir);
+		}
+
+		rmdir(dir_.c_str());
+	}
+
+private:
+	std::string dir_;
+};
+
+TEST_REGISTER(CapabilityCacheTest)
@@ -0,0 +1,334 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2020, Google Inc.
+ *
+ * delayed-controls.cpp - Delayed controls test
+ */
+
+#include <iostream>
+
+#include "libcamera/internal/delayed_controls.h"
+#include "libcamera/internal/device_enumerator.h"
+#include "libcamera/internal/media_device.h"
+#include "libcamera/internal/v4l2_videodevice.h"
+
+#include "test.h"
+
+using namespace std;
+using namespace libcamera;
+
+class DelayedControlsTest : public Test
+{
+public:
+	DelayedControlsTest()
+		: dev_(nullptr)
+	{
+	}
+
+protected:
+	int init() override
+	{
+		enumerator_ = DeviceEnumerator::create();
+		if (!enumerator_) {
+			cerr << "Failed to create device enumerator" << endl;
+			return TestFail;
+		}
+
+		if (enumerator_->enumerate()) {
+			cerr << "Failed to enumerate media devices" << endl;
+			return TestFail;
+		}
+
+		DeviceMatch dm("vivid");
+		dm.add("vivid-000-vid-cap");
+
+		media_ = enumerator_->search(dm);
+		if (!media_) {
+			cerr << "vivid video device not found" << endl;
+			return TestSkip;
+		}
+
+		dev_ = V4L2VideoDevice::fromEntityName(media_.get(), "vivid-000-vid-cap");
+		if (dev_->open()) {
+			cerr << "Failed to open video device" << endl;
+			return TestFail;
+		}
+
+		const ControlInfoMap &infoMap = dev_->controls();
+
+		/* Make sure the controls we require are present. */
+		if (infoMap.empty()) {
+			cerr << "Failed to enumerate controls" << endl;
+			return TestFail;
+		}
+
+		if (infoMap.find(V4L2_CID_BRIGHTNESS) == infoMap.end() ||
+		    infoMap.find(V4L2_CID_CONTRAST) == infoMap.end()) {
+			cerr << "Missing controls" << endl;
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+
+	int singleControlNoDelay()
+	{
+		DelayedControls delayed(dev_, { { V4L2_CID_BRIGHTNESS, 0 } });
+		ControlList ctrls;
+
+		/* Reset control to value not used in test. */
+		ctrls.set(V4L2_CID_BRIGHTNESS, 1);
+		delayed.push(ctrls);
+		delayed.reset();
+
+		/* Test control without delay are set at once. */
+		for (int32_t i = 0; i < 100; i++) {
+			int32_t value = 100 + i;
+
+			ctrls.set(V4L2_CID_BRIGHTNESS, value);
+			delayed.push(ctrls);
+
+			delayed.applyControls(i);
+
+			ControlList result = delayed.get(i);
+			int32_t brightness = result.get(V4L2_CID_BRIGHTNESS).get<int32_t>();
+			if (brightness != value) {
+				cerr << "Failed single control without delay"
+				     << " frame " << i
+				     << " expected " << value
+				     << " got " << brightness
+				     << endl;
+				return TestFail;
+			}
+		}
+
+		return TestPass;
+	}
+
+	int singleControlWithDelay()
+	{
+		DelayedControls delayed(dev_, { { V4L2_CID_BRIGHTNESS, 1 } });
+		ControlList ctrls;
+
+		/* Reset control to value that will be first in test. */
+		int32_t expected = 4;
+		ctrls.set(V4L2_CID_BRIGHTNESS, expected);
+		delayed.push(ctrls);
+		delayed.reset();
+
+		/* Test single control with delay. */
+		for (int32_t i = 0; i < 100; i++) {
+			int32_t value = 10 + i;
+
+			ctrls.set(V4L2_CID_BRIGHTNESS, value);
+			delayed.push(ctrls);
+
+			delayed.applyControls(i);
+
+			ControlList result = delayed.get(i);
+			int32_t brightness = result.get(V4L2_CID_BRIGHTNESS).get<int32_t>();
+			if (brightness != expected) {
+				cerr << "Failed single control with delay"
+				     << " frame " << i
+				     << " expected " << expected
+				     << " got " << brightness
+				     << endl;
+				return TestFail;
+			}
+
+			/* The value is written one frame ahead of its use. */
+			ControlList current = dev_->getControls({ V4L2_CID_BRIGHTNESS });
+			if (current.get(V4L2_CID_BRIGHTNESS).get<int32_t>() != value) {
+				cerr << "Control not written to the device at frame "
+				     << i << endl;
+				return TestFail;
+			}
+
+			expected = value;
+		}
+
+		return TestPass;
+	}
+
+	int dualControlsWithDelay()
+	{
+		DelayedControls delayed(dev_, { { V4L2_CID_BRIGHTNESS, 1 },
+						{ V4L2_CID_CONTRAST, 2 } });
+		ControlList ctrls;
+
+		/* Reset control to value that will be first two frames in test. */
+		int32_t expected = 200;
+		ctrls.set(V4L2_CID_BRIGHTNESS, expected);
+		ctrls.set(V4L2_CID_CONTRAST, expected + 1);
+		delayed.push(ctrls);
+		delayed.reset();
+
+		/* Test dual control with delay, both values shall match. */
+		for (int32_t i = 0; i < 100; i++) {
+			int32_t value = 10 + i;
+
+			ctrls.set(V4L2_CID_BRIGHTNESS, value);
+			ctrls.set(V4L2_CID_CONTRAST, value + 1);
+			delayed.push(ctrls);
+
+			delayed.applyControls(i);
+
+			ControlList result = delayed.get(i);
+			int32_t brightness = result.get(V4L2_CID_BRIGHTNESS).get<int32_t>();
+			int32_t contrast = result.get(V4L2_CID_CONTRAST).get<int32_t>();
+			if (brightness != expected || contrast != expected + 1) {
+				cerr << "Failed dual controls"
+				     << " frame " << i
+				     << " brightness " << brightness
+				     << " contrast " << contrast
+				     << " expected " << expected
+				     << endl;
+				return TestFail;
+			}
+
+			expected = i < 1 ? expected : value - 1;
+		}
+
+		return TestPass;
+	}
+
+	int dualControlsMultiQueue()
+	{
+		DelayedControls delayed(dev_, { { V4L2_CID_BRIGHTNESS, 1 },
+						{ V4L2_CID_CONTRAST, 2 } });
+		ControlList ctrls;
+
+		/* Reset control to value that will be first two frames in test. */
+		int32_t expected = 100;
+		ctrls.set(V4L2_CID_BRIGHTNESS, expected);
+		ctrls.set(V4L2_CID_CONTRAST, expected);
+		delayed.push(ctrls);
+		delayed.reset();
+
+		/*
+		 * Queue all controls before any fake frame start. Note we
+		 * can't queue up more then the delayed controls history size
+		 * which is 16. Where one spot is used by the reset control.
+		 */
+		for (int32_t i = 0; i < 8; i++) {
+			int32_t value = 10 + i;
+
+			ctrls.set(V4L2_CID_BRIGHTNESS, value);
+			ctrls.set(V4L2_CID_CONTRAST, value);
+			delayed.push(ctrls);
+		}
+
+		/* Process all queued controls. */
+		for (int32_t i = 0; i < 16; i++) {
+			int32_t value = 10 + i;
+
+			delayed.applyControls(i);
+
+			ControlList result = delayed.get(i);
+			int32_t brightness = result.get(V4L2_CID_BRIGHTNESS).get<int32_t>();
+			int32_t contrast = result.get(V4L2_CID_CONTRAST).get<int32_t>();
+			if (brightness != expected || contrast != expected) {
+				cerr << "Failed multi queue"
+				     << " frame " << i
+				     << " brightness " << brightness
+				     << " contrast " << contrast
+				     << " expected " << expected
+				     << endl;
+				return TestFail;
+			}
+
+			expected = i < 1 ? expected : std::min(value - 1, 17);
+		}
+
+		return TestPass;
+	}
+
+	int missedFrameStart()
+	{
+		DelayedControls delayed(dev_, { { V4L2_CID_BRIGHTNESS, 1 },
+						{ V4L2_CID_CONTRAST, 2 } });
+		ControlList ctrls;
+
+		ctrls.set(V4L2_CID_BRIGHTNESS, 50);
+		ctrls.set(V4L2_CID_CONTRAST, 50);
+		delayed.push(ctrls);
+		delayed.reset();
+
+		/*
+		 * Queue controls for four frames and skip the frame start
+		 * events for the middle ones. The values queued for the
+		 * skipped frames shall still reach the device.
+		 */
+		for (int32_t i = 0; i < 4; i++) {
+			ctrls.set(V4L2_CID_BRIGHTNESS, 60 + i);
+			ctrls.set(V4L2_CID_CONTRAST, 60 + i);
+			delayed.push(ctrls);
+		}
+
+		delayed.applyControls(0);
+		delayed.applyControls(3);
+
+		ControlList current = dev_->getControls({ V4L2_CID_BRIGHTNESS,
+							  V4L2_CID_CONTRAST });
+		int32_t brightness = current.get(V4L2_CID_BRIGHTNESS).get<int32_t>();
+		int32_t contrast = current.get(V4L2_CID_CONTRAST).get<int32_t>();
+		if (brightness != 62 || contrast != 63) {
+			cerr << "Failed missed frame start, brightness "
+			     << brightness << " contrast " << contrast << endl;
+			return TestFail;
+		}
+
+		ControlList result = delayed.get(3);
+		if (result.get(V4L2_CID_BRIGHTNESS).get<int32_t>() != 61 ||
+		    result.get(V4L2_CID_CONTRAST).get<int32_t>() != 61) {
+			cerr << "Failed missed frame start readback" << endl;
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+
+	int run() override
+	{
+		int ret;
+
+		/* Test single control without delay. */
+		ret = singleControlNoDelay();
+		if (ret)
+			return ret;
+
+		/* Test single control with delay. */
+		ret = singleControlWithDelay();
+		if (ret)
+			return ret;
+
+		/* Test dual controls with different delays. */
+		ret = dualControlsWithDelay();
+		if (ret)
+			return ret;
+
+		/* Test control values produced faster than consumed. */
+		ret = dualControlsMultiQueue();
+		if (ret)
+			return ret;
+
+		/* Test missed frame start events. */
+		ret = missedFrameStart();
+		if (ret)
+			return ret;
+
+		return TestPass;
+	}
+
+	void cleanup() override
+	{
+		delete dev_;
+	}
+
+private:
+	std::unique_ptr<DeviceEnumerator> enumerator_;
+	std::shared_ptr<MediaDevice> media_;
+	V4L2VideoDevice *dev_;
+};
+
+TEST_REGISTER(DelayedControlsTest)
@@ -0,0 +1,174 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2020, Google Inc.
+ *
+ * frame-info.cpp - FrameInfoTable tests
+ */
+
+#include <iostream>
+#include <memory>
+#include <vector>
+
+#include <libcamera/buffer.h>
+#include <libcamera/request.h>
+
+#include "libcamera/internal/frame_info.h"
+
+#include "test.h"
+
+using namespace std;
+using namespace libcamera;
+
+struct TestFrameInfo {
+	unsigned int frame;
+	bool done;
+};
+
+class FrameInfoTest : public Test
+{
+protected:
+	static constexpr unsigned int Depth = 8;
+	static constexpr unsigned int BuffersPerFrame = 2;
+
+	int init() override
+	{
+		for (unsigned int i = 0; i < Depth * 2; ++i) {
+			requests_.emplace_back(make_unique<Request>(nullptr, i));
+			for (unsigned int j = 0; j < BuffersPerFrame; ++j)
+				buffers_.emplace_back(make_unique<FrameBuffer>(vector<FrameBuffer::Plane>{}));
+		}
+
+		return TestPass;
+	}
+
+	int createFrame(FrameInfoTable<TestFrameInfo> &table, unsigned int frame)
+	{
+		unsigned int index = frame % requests_.size();
+
+		TestFrameInfo *info = table.create(frame, requests_[index].get());
+		if (!info) {
+			cerr << "Failed to create frame " << frame << endl;
+			return TestFail;
+		}
+
+		if (info->frame != 0 || info->done) {
+			cerr << "Frame " << frame << " info not reset" << endl;
+			return TestFail;
+		}
+
+		info->frame = frame;
+
+		for (unsigned int j = 0; j < BuffersPerFrame; ++j) {
+			FrameBuffer *buffer = buffers_[index * BuffersPerFrame + j].get();
+			if (table.addBuffer(frame, buffer) < 0) {
+				cerr << "Failed to add buffer to frame " << frame << endl;
+				return TestFail;
+			}
+		}
+
+		return TestPass;
+	}
+
+	int checkFrame(FrameInfoTable<TestFrameInfo> &table, unsigned int frame,
+		       bool present)
+	{
+		unsigned int index = frame % requests_.size();
+		vector<TestFrameInfo *> infos;
+
+		infos.push_back(table.find(frame));
+		infos.push_back(table.find(requests_[index].get()));
+		for (unsigned int j = 0; j < BuffersPerFrame; ++j)
+			infos.push_back(table.find(buffers_[index * BuffersPerFrame + j].get()));
+
+		for (TestFrameInfo *info : infos) {
+			if (!present && info) {
+				cerr << "Frame " << frame << " still present" << endl;
+				return TestFail;
+			}
+
+			if (present && (!info || info->frame != frame)) {
+				cerr << "Frame " << frame << " lookup failed" << endl;
+				return TestFail;
+			}
+		}
+
+		return TestPass;
+	}
+
+	int run() override
+	{
+		FrameInfoTable<TestFrameInfo> table(Depth, BuffersPerFrame);
+
+		/* Fill the table and look all frames up. */
+		for (unsigned int frame = 0; frame < Depth; ++frame) {
+			if (createFrame(table, frame) != TestPass)
+				return TestFail;
+		}
+
+		for (unsigned int frame = 0; frame < Depth; ++frame) {
+			if (checkFrame(table, frame, true) != TestPass)
+				return TestFail;
+		}
+
+		/* A frame mapping to a slot in use must be rejected. */
+		if (table.create(Depth, requests_[Depth].get())) {
+			cerr << "Frame created in a slot in use" << endl;
+			return TestFail;
+		}
+
+		/*
+		 * Cycle through frames in a sliding window, destroying the oldest
+		 * frame before creating a new one, to exercise index removals.
+		 */
+		for (unsigned int frame = Depth; frame < Depth * 10; ++frame) {
+			if (table.destroy(frame - Depth) < 0) {
+				cerr << "Failed to destroy frame " << frame - Depth << endl;
+				return TestFail;
+			}
+
+			if (checkFrame(table, frame - Depth, false) != TestPass)
+				return TestFail;
+
+			if (createFrame(table, frame) != TestPass)
+				return TestFail;
+
+			for (unsigned int f = frame - Depth + 1; f <= frame; ++f) {
+				if (checkFrame(table, f, true) != TestPass)
+					return TestFail;
+			}
+		}
+
+		/* Iterate over all frames and clear the table. */
+		unsigned int count = 0;
+		table.forEach([&](TestFrameInfo *info) {
+			info->done = true;
+			count++;
+		});
+
+		if (count != Depth) {
+			cerr << "Iterated over " << count << " frames, expected "
+			     << Depth << endl;
+			return TestFail;
+		}
+
+		table.clear();
+
+		for (unsigned int frame = Depth * 9; frame < Depth * 10; ++frame) {
+			if (checkFrame(table, frame, false) != TestPass)
+				return TestFail;
+		}
+
+		if (table.destroy(Depth * 9) != -ENOENT) {
+			cerr << "Destroyed a frame not in the table" << endl;
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+
+private:
+	vector<unique_ptr<Request>> requests_;
+	vector<unique_ptr<FrameBuffer>> buffers_;
+};
+
+TEST_REGISTER(FrameInfoTest)
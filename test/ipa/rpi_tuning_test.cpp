@@ -0,0 +1,213 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2020, Google Inc.
+ *
+ * rpi_tuning_test.cpp - Raspberry Pi compiled tuning files test
+ */
+
+#include <fstream>
+#include <iostream>
+#include <stdlib.h>
+#include <string>
+#include <unistd.h>
+
+#include "tuning.hpp"
+
+#include "test.h"
+
+using namespace std;
+using namespace RPi;
+
+class RPiTuningTest : public Test
+{
+protected:
+	/*
+	 * Compare a node parsed from JSON with the same node read from a
+	 * compiled file, including the conversion of values to all supported
+	 * types.
+	 */
+	template<typename T>
+	bool compareValue(const TuningNode &json, const TuningNode &compiled)
+	{
+		T jsonValue{}, compiledValue{};
+		bool jsonValid = true, compiledValid = true;
+
+		try {
+			jsonValue = json.get_value<T>();
+		} catch (const std::exception &) {
+			jsonValid = false;
+		}
+
+		try {
+			compiledValue = compiled.get_value<T>();
+		} catch (const std::exception &) {
+			compiledValid = false;
+		}
+
+		return jsonValid == compiledValid && jsonValue == compiledValue;
+	}
+
+	bool compare(const TuningNode &json, const TuningNode &compiled,
+		     const string &path)
+	{
+		if (!compareValue<string>(json, compiled) ||
+		    !compareValue<double>(json, compiled) ||
+		    !compareValue<int>(json, compiled) ||
+		    !compareValue<uint16_t>(json, compiled) ||
+		    !compareValue<uint32_t>(json, compiled)) {
+			cerr << "Value mismatch at " << path << endl;
+			return false;
+		}
+
+		auto it = json.begin();
+		auto ct = compiled.begin();
+
+		for (; it != json.end() && ct != compiled.end(); ++it, ++ct) {
+			const string child = path + "/" + it->first;
+
+			if (it->first != ct->first) {
+				cerr << "Key mismatch at " << child << endl;
+				return false;
+			}
+
+			if (!compare(it->second, ct->second, child))
+				return false;
+
+			if (it->first.empty())
+				continue;
+
+			/* Lookups by key must find the first matching child. */
+			if (!compare(json.get_child(it->first),
+				     compiled.get_child(it->first), child))
+				return false;
+		}
+
+		if (it != json.end() || ct != compiled.end()) {
+			cerr << "Children count mismatch at " << path << endl;
+			return false;
+		}
+
+		return true;
+	}
+
+	int init() override
+	{
+		char dir[] = "/tmp/libcamera.tuning.XXXXXX";
+		if (!mkdtemp(dir)) {
+			cerr << "Failed to create temporary directory" << endl;
+			return TestFail;
+		}
+
+		dir_ = dir;
+		return TestPass;
+	}
+
+	int testCompiled(const string &name)
+	{
+		const string json = string(RPI_TUNING_SOURCE_DIR "/") + name + ".json";
+		const string compiled = string(RPI_TUNING_BUILD_DIR "/") + name + ".bin";
+
+		Tuning jsonTuning;
+		jsonTuning.Load(json.c_str());
+		if (jsonTuning.Compiled()) {
+			cerr << "Unexpected compiled file for " << json << endl;
+			return TestFail;
+		}
+
+		Tuning compiledTuning;
+		compiledTuning.Load(compiled.c_str());
+		if (!compiledTuning.Compiled()) {
+			cerr << "Failed to load " << compiled << endl;
+			return TestFail;
+		}
+
+		if (!compare(jsonTuning.Root(), compiledTuning.Root(), name))
+			return TestFail;
+
+		/* Missing keys must be reported identically. */
+		for (const Tuning *tuning : { &jsonTuning, &compiledTuning }) {
+			TuningNode root = tuning->Root();
+			if (root.get_child_optional("rpi.missing") ||
+			    root.get<double>("rpi.missing", 42.0) != 42.0) {
+				cerr << "Missing key found" << endl;
+				return TestFail;
+			}
+		}
+
+		return TestPass;
+	}
+
+	int testLookup()
+	{
+		const string json = dir_ + "/imx477.json";
+		const string compiled = dir_ + "/imx477.bin";
+
+		copy(RPI_TUNING_SOURCE_DIR "/imx477.json", json);
+		copy(RPI_TUNING_BUILD_DIR "/imx477.bin", compiled);
+
+		/* A compiled file next to the JSON file is used. */
+		Tuning tuning;
+		tuning.Load(json.c_str());
+		if (!tuning.Compiled()) {
+			cerr << "Compiled file not used" << endl;
+			return TestFail;
+		}
+
+		/* But not when the JSON file has been modified. */
+		ofstream(json, ios::app) << "\n";
+
+		tuning.Load(json.c_str());
+		if (tuning.Compiled()) {
+			cerr << "Stale compiled file used" << endl;
+			return TestFail;
+		}
+
+		/* Nor when the compiled file is corrupted. */
+		copy(RPI_TUNING_SOURCE_DIR "/imx477.json", json);
+
+		fstream file(compiled, ios::in | ios::out | ios::binary);
+		file.seekp(24 + 8);
+		file.write("\xff\xff\xff\xff", 4);
+		file.close();
+
+		tuning.Load(json.c_str());
+		if (tuning.Compiled()) {
+			cerr << "Corrupted compiled file used" << endl;
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+
+	int run() override
+	{
+		for (const char *name : { "imx219", "imx477", "ov5647", "uncalibrated" }) {
+			if (testCompiled(name) != TestPass)
+				return TestFail;
+		}
+
+		return testLookup();
+	}
+
+	void cleanup() override
+	{
+		if (dir_.empty())
+			return;
+
+		unlink((dir_ + "/imx477.json").c_str());
+		unlink((dir_ + "/imx477.bin").c_str());
+		rmdir(dir_.c_str());
+	}
+
+private:
+	static void copy(const string &from, const string &to)
+	{
+		ifstream in(from, ios::binary);
+		ofstream out(to, ios::binary | ios::trunc);
+		out << in.rdbuf();
+	}
+
+	string dir_;
+};
+
+TEST_REGISTER(RPiTuningTest)
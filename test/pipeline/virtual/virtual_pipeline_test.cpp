@@ -0,0 +1,244 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2020, Google Inc.
+ *
+ * virtual_pipeline_test.cpp - Virtual pipeline handler test
+ */
+
+#include <atomic>
+#include <iostream>
+#include <map>
+#include <sys/mman.h>
+
+#include <libcamera/formats.h>
+
+#include "libcamera/internal/buffer.h"
+
+#include "camera_test.h"
+#include "test.h"
+
+using namespace std;
+
+namespace {
+
+/*
+ * Capture from a two-stream virtual camera and verify that frames are
+ * delivered on all streams with increasing sequence numbers, correct payload
+ * sizes and a test pattern that matches the frame sequence number.
+ *
+ * The camera is described by the LIBCAMERA_VIRTUAL_CAMERAS environment
+ * variable, set by the test runner.
+ */
+class VirtualPipelineTest : public CameraTest, public Test
+{
+public:
+	VirtualPipelineTest()
+		: CameraTest("virtual-test")
+	{
+	}
+
+protected:
+	void requestComplete(Request *request)
+	{
+		if (request->status() != Request::RequestComplete)
+			return;
+
+		for (auto it : request->buffers()) {
+			const Stream *stream = it.first;
+			FrameBuffer *buffer = it.second;
+			const FrameMetadata &metadata = buffer->metadata();
+
+			if (metadata.status != FrameMetadata::FrameSuccess) {
+				cout << "Buffer completed with error" << endl;
+				error_ = true;
+				continue;
+			}
+
+			if (metadata.planes[0].bytesused != stream->configuration().frameSize) {
+				cout << "Invalid bytesused " << metadata.planes[0].bytesused
+				     << endl;
+				error_ = true;
+			}
+
+			auto seq = lastSequence_.find(stream);
+			if (seq != lastSequence_.end() && metadata.sequence <= seq->second) {
+				cout << "Non-increasing sequence " << metadata.sequence
+				     << endl;
+				error_ = true;
+			}
+			lastSequence_[stream] = metadata.sequence;
+
+			checkPattern(stream, buffer);
+
+			completed_[stream]++;
+		}
+
+		/*
+		 * Requests complete in the camera manager thread, don't requeue
+		 * them once the main thread has started stopping the camera.
+		 */
+		if (stopping_)
+			return;
+
+		const Request::BufferMap buffers = request->buffers();
+
+		request = camera_->createRequest();
+		for (auto it : buffers)
+			request->addBuffer(it.first, it.second);
+		camera_->queueRequest(request);
+	}
+
+	void checkPattern(const Stream *stream, const FrameBuffer *buffer)
+	{
+		const StreamConfiguration &cfg = stream->configuration();
+		if (cfg.pixelFormat != formats::NV12)
+			return;
+
+		MappedFrameBuffer map(buffer, PROT_READ);
+		if (!map.isValid()) {
+			cout << "Failed to map buffer" << endl;
+			error_ = true;
+			return;
+		}
+
+		/*
+		 * The pattern is made of eight colour bars scrolling by four
+		 * pixels per frame, starting with white (Y = 235).
+		 */
+		unsigned int offset = buffer->metadata().sequence * 4 % cfg.size.width;
+		unsigned int bar = offset * 8 / cfg.size.width;
+		static const uint8_t luma[] = { 235, 210, 170, 145, 106, 81, 41, 16 };
+
+		uint8_t y = map.maps()[0][0];
+		if (y != luma[bar]) {
+			cout << "Invalid pattern, got Y=" << static_cast<int>(y)
+			     << " expected " << static_cast<int>(luma[bar]) << endl;
+			error_ = true;
+		}
+	}
+
+	int init() override
+	{
+		if (status_ != TestPass)
+			return status_;
+
+		config_ = camera_->generateConfiguration({ StreamRole::Viewfinder,
+							   StreamRole::VideoRecording });
+		if (!config_ || config_->size() != 2) {
+			cout << "Failed to generate default configuration" << endl;
+			return TestFail;
+		}
+
+		config_->at(0).pixelFormat = formats::NV12;
+		config_->at(0).size = { 640, 480 };
+		config_->at(1).pixelFormat = formats::YUYV;
+		config_->at(1).size = { 320, 240 };
+
+		if (config_->validate() != CameraConfiguration::Valid) {
+			cout << "Failed to validate configuration" << endl;
+			return TestFail;
+		}
+
+		allocator_ = new FrameBufferAllocator(camera_);
+
+		return TestPass;
+	}
+
+	void cleanup() override
+	{
+		delete allocator_;
+	}
+
+	int run() override
+	{
+		if (camera_->acquire()) {
+			cout << "Failed to acquire the camera" << endl;
+			return TestFail;
+		}
+
+		if (camera_->configure(config_.get())) {
+			cout << "Failed to configure the camera" << endl;
+			return TestFail;
+		}
+
+		Stream *stream0 = config_->at(0).stream();
+		Stream *stream1 = config_->at(1).stream();
+
+		if (allocator_->allocate(stream0) < 0 ||
+		    allocator_->allocate(stream1) < 0) {
+			cout << "Failed to allocate buffers" << endl;
+			return TestFail;
+		}
+
+		const std::vector<std::unique_ptr<FrameBuffer>> &buffers0 =
+			allocator_->buffers(stream0);
+		const std::vector<std::unique_ptr<FrameBuffer>> &buffers1 =
+			allocator_->buffers(stream1);
+
+		std::vector<Request *> requests;
+		for (unsigned int i = 0; i < buffers0.size(); i++) {
+			Request *request = camera_->createRequest();
+			if (request->addBuffer(stream0, buffers0[i].get()) ||
+			    request->addBuffer(stream1, buffers1[i].get())) {
+				cout << "Failed to add buffers to request" << endl;
+				return TestFail;
+			}
+
+			requests.push_back(request);
+		}
+
+		error_ = false;
+		stopping_ = false;
+		camera_->requestCompleted.connect(this, &VirtualPipelineTest::requestComplete);
+
+		if (camera_->start()) {
+			cout << "Failed to start camera" << endl;
+			return TestFail;
+		}
+
+		for (Request *request : requests) {
+			if (camera_->queueRequest(request)) {
+				cout << "Failed to queue request" << endl;
+				return TestFail;
+			}
+		}
+
+		EventDispatcher *dispatcher = cm_->eventDispatcher();
+
+		Timer timer;
+		timer.start(500);
+		while (timer.isRunning())
+			dispatcher->processEvents();
+
+		stopping_ = true;
+		if (camera_->stop()) {
+			cout << "Failed to stop camera" << endl;
+			return TestFail;
+		}
+
+		if (error_)
+			return TestFail;
+
+		/* The camera runs at 60fps, expect at least 15 frames. */
+		if (completed_[stream0] < 15 || completed_[stream0] != completed_[stream1]) {
+			cout << "Failed to capture enough frames (got "
+			     << completed_[stream0] << " and "
+			     << completed_[stream1] << ")" << endl;
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+
+	std::unique_ptr<CameraConfiguration> config_;
+	FrameBufferAllocator *allocator_;
+
+	std::map<const Stream *, unsigned int> completed_;
+	std::map<const Stream *, unsigned int> lastSequence_;
+	bool error_;
+	std::atomic<bool> stopping_;
+};
+
+} /* namespace */
+
+TEST_REGISTER(VirtualPipelineTest)
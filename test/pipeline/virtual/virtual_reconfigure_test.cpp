@@ -0,0 +1,241 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2020, Google Inc.
+ *
+ * virtual_reconfigure_test.cpp - Reconfiguration with preserved buffers test
+ */
+
+#include <iostream>
+
+#include <libcamera/formats.h>
+
+#include "camera_test.h"
+#include "test.h"
+
+using namespace std;
+
+namespace {
+
+/*
+ * Reconfigure a virtual camera between compatible and incompatible modes, and
+ * verify that Stream::buffersPreserved() reports correctly whether buffers
+ * allocated for the previous configuration can be reused, by capturing with
+ * them when they are reported as valid.
+ */
+class VirtualReconfigureTest : public CameraTest, public Test
+{
+public:
+	VirtualReconfigureTest()
+		: CameraTest("virtual-test")
+	{
+	}
+
+protected:
+	void requestComplete(Request *request)
+	{
+		if (request->status() != Request::RequestComplete)
+			return;
+
+		for (auto it : request->buffers()) {
+			const Stream *stream = it.first;
+			const FrameMetadata &metadata = it.second->metadata();
+
+			if (metadata.status != FrameMetadata::FrameSuccess ||
+			    metadata.planes[0].bytesused != stream->configuration().frameSize) {
+				cout << "Buffer completed with error" << endl;
+				error_ = true;
+			}
+		}
+
+		completed_++;
+
+		const Request::BufferMap buffers = request->buffers();
+
+		request = camera_->createRequest();
+		for (auto it : buffers)
+			request->addBuffer(it.first, it.second);
+		camera_->queueRequest(request);
+	}
+
+	int configure(const std::vector<std::pair<PixelFormat, Size>> &modes,
+		      const std::vector<bool> &preserved)
+	{
+		StreamRoles roles(modes.size(), StreamRole::Viewfinder);
+
+		config_ = camera_->generateConfiguration(roles);
+		if (!config_ || config_->size() != modes.size()) {
+			cout << "Failed to generate configuration" << endl;
+			return TestFail;
+		}
+
+		for (unsigned int i = 0; i < modes.size(); i++) {
+			config_->at(i).pixelFormat = modes[i].first;
+			config_->at(i).size = modes[i].second;
+		}
+
+		if (config_->validate() != CameraConfiguration::Valid) {
+			cout << "Failed to validate configuration" << endl;
+			return TestFail;
+		}
+
+		if (camera_->configure(config_.get())) {
+			cout << "Failed to configure the camera" << endl;
+			return TestFail;
+		}
+
+		for (unsigned int i = 0; i < modes.size(); i++) {
+			Stream *stream = config_->at(i).stream();
+
+			if (stream->buffersPreserved() != preserved[i]) {
+				cout << "Stream " << i << " buffers "
+				     << (preserved[i] ? "not " : "")
+				     << "preserved for "
+				     << config_->at(i).toString() << endl;
+				return TestFail;
+			}
+
+			if (stream->buffersPreserved())
+				continue;
+
+			allocator_->free(stream);
+			if (allocator_->allocate(stream) < 0) {
+				cout << "Failed to allocate buffers" << endl;
+				return TestFail;
+			}
+		}
+
+		return TestPass;
+	}
+
+	int capture()
+	{
+		const std::vector<std::unique_ptr<FrameBuffer>> &buffers =
+			allocator_->buffers(config_->at(0).stream());
+
+		std::vector<Request *> requests;
+		for (unsigned int i = 0; i < buffers.size(); i++) {
+			Request *request = camera_->createRequest();
+
+			for (const StreamConfiguration &cfg : *config_) {
+				Stream *stream = cfg.stream();
+				FrameBuffer *buffer = allocator_->buffers(stream)[i].get();
+
+				if (request->addBuffer(stream, buffer)) {
+					cout << "Failed to add buffer to request" << endl;
+					return TestFail;
+				}
+			}
+
+			requests.push_back(request);
+		}
+
+		error_ = false;
+		completed_ = 0;
+
+		if (camera_->start()) {
+			cout << "Failed to start camera" << endl;
+			return TestFail;
+		}
+
+		for (Request *request : requests) {
+			if (camera_->queueRequest(request)) {
+				cout << "Failed to queue request" << endl;
+				return TestFail;
+			}
+		}
+
+		EventDispatcher *dispatcher = cm_->eventDispatcher();
+
+		Timer timer;
+		timer.start(200);
+		while (timer.isRunning())
+			dispatcher->processEvents();
+
+		if (camera_->stop()) {
+			cout << "Failed to stop camera" << endl;
+			return TestFail;
+		}
+
+		/* The camera runs at 60fps, expect at least 5 frames. */
+		if (error_ || completed_ < 5) {
+			cout << "Capture failed (" << completed_ << " frames)"
+			     << endl;
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+
+	int init() override
+	{
+		if (status_ != TestPass)
+			return status_;
+
+		allocator_ = new FrameBufferAllocator(camera_);
+
+		return TestPass;
+	}
+
+	void cleanup() override
+	{
+		delete allocator_;
+	}
+
+	int run() override
+	{
+		static const Size vga{ 640, 480 };
+		static const Size qvga{ 320, 240 };
+
+		if (camera_->acquire()) {
+			cout << "Failed to acquire the camera" << endl;
+			return TestFail;
+		}
+
+		camera_->requestCompleted.connect(this, &VirtualReconfigureTest::requestComplete);
+
+		/* Buffers are never preserved on the first configuration. */
+		if (configure({ { formats::NV12, vga } }, { false }) || capture())
+			return TestFail;
+
+		/* Switching to an identical mode preserves buffers. */
+		if (configure({ { formats::NV12, vga } }, { true }) || capture())
+			return TestFail;
+
+		/* So does switching to a smaller frame size. */
+		if (configure({ { formats::NV12, qvga } }, { true }) || capture())
+			return TestFail;
+
+		/* Buffers are compared against the previous configuration. */
+		if (configure({ { formats::YUYV, vga } }, { false }) || capture())
+			return TestFail;
+
+		/*
+		 * Virtual camera buffers are single-plane, NV12 frames fit in
+		 * buffers allocated for YUYV frames of the same size.
+		 */
+		if (configure({ { formats::NV12, vga } }, { true }) || capture())
+			return TestFail;
+
+		/* Streams not part of the previous configuration need buffers. */
+		if (configure({ { formats::NV12, vga }, { formats::YUYV, qvga } },
+			      { true, false }) || capture())
+			return TestFail;
+
+		if (camera_->release()) {
+			cout << "Failed to release the camera" << endl;
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+
+	std::unique_ptr<CameraConfiguration> config_;
+	FrameBufferAllocator *allocator_;
+
+	unsigned int completed_;
+	bool error_;
+};
+
+} /* namespace */
+
+TEST_REGISTER(VirtualReconfigureTest)
@@ -0,0 +1,188 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2020, Google Inc.
+ *
+ * pixel-converter.cpp - PixelConverter test
+ */
+
+#include <algorithm>
+#include <iostream>
+#include <random>
+#include <stdint.h>
+#include <vector>
+
+#include <libcamera/formats.h>
+
+#include "pixel_converter.h"
+
+#include "test.h"
+
+using namespace std;
+using namespace libcamera;
+
+class PixelConverterTest : public Test
+{
+protected:
+	vector<uint8_t> convert(PixelConverter &converter,
+				const vector<uint8_t> &input)
+	{
+		vector<uint8_t> output(converter.outputSize());
+		if (converter.convert(input, output))
+			return {};
+
+		return output;
+	}
+
+	vector<uint8_t> randomFrame(size_t size)
+	{
+		vector<uint8_t> frame(size);
+		for (size_t i = 0; i < size; i += 4) {
+			uint32_t value = random_();
+			for (size_t j = i; j < min(i + 4, size); j++, value >>= 8)
+				frame[j] = value;
+		}
+
+		return frame;
+	}
+
+	int testKnownValues()
+	{
+		PixelConverter converter;
+
+		/* Black and white NV12 pixels with a saturated red chroma. */
+		if (converter.configure(formats::NV12, { 2, 2 }, 0,
+					formats::ARGB8888)) {
+			cout << "Failed to configure NV12 conversion" << endl;
+			return TestFail;
+		}
+
+		vector<uint8_t> nv12 = { 16, 235, 16, 235, 128, 255 };
+		vector<uint8_t> expected = {
+			0, 0, 203, 0xff, 255, 152, 255, 0xff,
+			0, 0, 203, 0xff, 255, 152, 255, 0xff,
+		};
+
+		if (convert(converter, nv12) != expected) {
+			cout << "Invalid NV12 conversion" << endl;
+			return TestFail;
+		}
+
+		/* 10-bit CSI-2 packed samples. */
+		if (converter.configure(formats::SBGGR10_CSI2P, { 4, 1 }, 0,
+					formats::SBGGR10)) {
+			cout << "Failed to configure CSI-2 unpacking" << endl;
+			return TestFail;
+		}
+
+		vector<uint8_t> packed = { 0xff, 0x00, 0x80, 0x01, 0b11100100 };
+		vector<uint8_t> unpacked = convert(converter, packed);
+		const uint16_t *samples = reinterpret_cast<const uint16_t *>(unpacked.data());
+
+		if (unpacked.size() != 8 || samples[0] != 0x3fc ||
+		    samples[1] != 0x001 || samples[2] != 0x202 ||
+		    samples[3] != 0x007) {
+			cout << "Invalid CSI-2 unpacking" << endl;
+			return TestFail;
+		}
+
+		if (!converter.configure(formats::NV12, { 640, 480 }, 0,
+					 formats::NV21) ||
+		    !converter.configure(formats::NV12, { 640, 480 }, 320,
+					 formats::ARGB8888)) {
+			cout << "Invalid configuration accepted" << endl;
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+
+	/*
+	 * Compare the output of all supported implementations, and of
+	 * multiple threads, against the single-threaded generic output.
+	 */
+	int testImplementations(const PixelFormat &input, const Size &size,
+				unsigned int stride)
+	{
+		PixelConverter reference;
+		reference.setImplementation(PixelConverter::Generic);
+		reference.setThreads(1);
+
+		vector<uint8_t> frame;
+
+		for (const PixelFormat &output : PixelConverter::outputFormats(input)) {
+			if (reference.configure(input, size, stride, output)) {
+				cout << "Failed to configure " << input.toString()
+				     << " to " << output.toString() << endl;
+				return TestFail;
+			}
+
+			if (frame.empty())
+				frame = randomFrame(reference.inputSize());
+
+			vector<uint8_t> expected = convert(reference, frame);
+
+			for (PixelConverter::Implementation implementation :
+			     { PixelConverter::Generic, PixelConverter::SSE2,
+			       PixelConverter::AVX2, PixelConverter::NEON }) {
+				if (!PixelConverter::isSupported(implementation))
+					continue;
+
+				PixelConverter converter;
+				converter.setImplementation(implementation);
+				converter.setThreads(4);
+				converter.configure(input, size, stride, output);
+
+				if (convert(converter, frame) != expected) {
+					cout << "Implementation " << implementation
+					     << " differs for " << input.toString()
+					     << " to " << output.toString()
+					     << " at " << size.toString() << endl;
+					return TestFail;
+				}
+			}
+		}
+
+		return TestPass;
+	}
+
+	int run() override
+	{
+		int ret = testKnownValues();
+		if (ret != TestPass)
+			return ret;
+
+		static const vector<PixelFormat> inputs = {
+			formats::NV12, formats::NV21, formats::NV16,
+			formats::NV61, formats::NV24, formats::NV42,
+			formats::YUYV, formats::YVYU, formats::UYVY,
+			formats::VYUY, formats::RGB888, formats::BGR888,
+			formats::ARGB8888, formats::RGBA8888,
+			formats::SBGGR10_CSI2P, formats::SRGGB12_CSI2P,
+			formats::SGRBG10_IPU3,
+		};
+
+		for (const PixelFormat &input : inputs) {
+			if (PixelConverter::outputFormats(input).empty()) {
+				cout << "No conversion for " << input.toString() << endl;
+				return TestFail;
+			}
+
+			/* Widths that exercise the kernels tails. */
+			ret = testImplementations(input, { 94, 6 }, 0);
+			if (ret != TestPass)
+				return ret;
+
+			/* Padded lines, and enough pixels for several stripes. */
+			ret = testImplementations(input, { 1024, 520 }, 1024 * 4 + 64);
+			if (ret != TestPass)
+				return ret;
+		}
+
+		return TestPass;
+	}
+
+private:
+	mt19937 random_;
+};
+
+TEST_REGISTER(PixelConverterTest)
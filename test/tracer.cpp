@@ -0,0 +1,178 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2020, Google Inc.
+ *
+ * tracer.cpp - Tracer test
+ */
+
+#include <atomic>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#include "libcamera/internal/tracer.h"
+
+#include "test.h"
+
+using namespace std;
+using namespace libcamera;
+
+class TracerTest : public Test
+{
+protected:
+	static unsigned int count(const string &str, const string &pattern)
+	{
+		unsigned int n = 0;
+
+		for (size_t pos = str.find(pattern); pos != string::npos;
+		     pos = str.find(pattern, pos + 1))
+			n++;
+
+		return n;
+	}
+
+	int run()
+	{
+		Tracer *tracer = Tracer::instance();
+
+		/* Events must not be recorded when tracing is disabled. */
+		tracer->disable();
+		TRACE_EVENT(Instant, "Test", "disabled", 0);
+
+		tracer->enable();
+
+		{
+			TRACE_SCOPE("Test", "scope", 1);
+			TRACE_EVENT(AsyncBegin, "Test", "async", 0x1234);
+		}
+
+		/* Record from a second thread, overflowing its ring buffer. */
+		std::thread thread([]() {
+			for (unsigned int i = 0; i < 20000; ++i)
+				TRACE_EVENT(Instant, "Test", "overflow", i);
+			TRACE_EVENT(AsyncEnd, "Test", "async", 0x1234);
+		});
+		thread.join();
+
+		tracer->disable();
+
+		stringstream ss;
+		tracer->dump(ss);
+		string trace = ss.str();
+
+		if (trace.find("\"traceEvents\":[") == string::npos ||
+		    trace.substr(trace.size() - 4) != "\n]}\n") {
+			cout << "Invalid trace format" << endl;
+			return TestFail;
+		}
+
+		if (count(trace, "\"name\":\"disabled\"")) {
+			cout << "Event recorded while tracing was disabled" << endl;
+			return TestFail;
+		}
+
+		if (count(trace, "\"name\":\"scope\",\"cat\":\"Test\",\"ph\":\"B\"") != 1 ||
+		    count(trace, "\"name\":\"scope\",\"cat\":\"Test\",\"ph\":\"E\"") != 1) {
+			cout << "Invalid scope events" << endl;
+			return TestFail;
+		}
+
+		if (count(trace, "\"id\":\"0x1234\"") != 2) {
+			cout << "Invalid async events" << endl;
+			return TestFail;
+		}
+
+		/*
+		 * The second thread's ring buffer holds 8192 events, including
+		 * the async end event.
+		 */
+		unsigned int overflow = count(trace, "\"name\":\"overflow\"");
+		if (overflow != 8191) {
+			cout << "Invalid number of overflow events " << overflow
+			     << endl;
+			return TestFail;
+		}
+
+		if (count(trace, "\"args\":{\"id\":19999}") != 1) {
+			cout << "Most recent event missing" << endl;
+			return TestFail;
+		}
+
+		if (testRecycling() != TestPass)
+			return TestFail;
+
+		return testConcurrentDump();
+	}
+
+	/*
+	 * Buffers of exited threads are reused by new threads, which discards
+	 * the events they contain. Only the last thread's event must remain.
+	 */
+	int testRecycling()
+	{
+		Tracer *tracer = Tracer::instance();
+
+		tracer->enable();
+
+		for (unsigned int i = 0; i < 100; ++i) {
+			std::thread thread([i]() {
+				TRACE_EVENT(Instant, "Test", "churn", 100000 + i);
+			});
+			thread.join();
+		}
+
+		tracer->disable();
+
+		stringstream ss;
+		tracer->dump(ss);
+		string trace = ss.str();
+
+		if (count(trace, "\"name\":\"churn\"") != 1 ||
+		    count(trace, "\"args\":{\"id\":100099}") != 1) {
+			cout << "Thread buffers not recycled" << endl;
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+
+	/* Dump the trace while a thread records events. */
+	int testConcurrentDump()
+	{
+		Tracer *tracer = Tracer::instance();
+		std::atomic<bool> done{ false };
+
+		tracer->enable();
+
+		std::thread thread([&done]() {
+			for (unsigned int i = 0; i < 200000; ++i)
+				TRACE_EVENT(Instant, "Test", "concurrent", i);
+			done = true;
+		});
+
+		unsigned int dumps = 0;
+		while (!done || !dumps) {
+			stringstream ss;
+			tracer->dump(ss);
+			string trace = ss.str();
+
+			unsigned int events = count(trace, "\"name\":");
+			if (count(trace, "\"cat\":\"Test\"") != events ||
+			    count(trace, "\"name\":\"concurrent\"") > 8192) {
+				cout << "Invalid events in concurrent dump" << endl;
+				thread.join();
+				return TestFail;
+			}
+
+			dumps++;
+		}
+
+		thread.join();
+		tracer->disable();
+
+		return TestPass;
+	}
+};
+
+TEST_REGISTER(TracerTest)
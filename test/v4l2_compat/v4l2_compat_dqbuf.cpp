@@ -0,0 +1,216 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2020, Google Inc.
+ *
+ * v4l2_compat_dqbuf.cpp - V4L2 compatibility layer DQBUF latency test
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <linux/videodev2.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <thread>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+
+#include <libcamera/camera_manager.h>
+
+#include "v4l2_camera_file.h"
+#include "v4l2_camera_proxy.h"
+
+#include "test.h"
+
+using namespace std;
+using namespace libcamera;
+
+/*
+ * Capture frames with blocking DQBUF calls while another thread continuously
+ * issues configuration ioctls on the same file, and measure the latency
+ * between frame completion and DQBUF return. The configuration ioctls must
+ * make progress while DQBUF waits for frames.
+ *
+ * The camera is described by the LIBCAMERA_VIRTUAL_CAMERAS environment
+ * variable, set by the test runner.
+ */
+class V4L2CompatDqbufTest : public Test
+{
+protected:
+	static constexpr unsigned int kNumFrames = 60;
+
+	int init() override
+	{
+		cm_ = new CameraManager();
+
+		if (cm_->start()) {
+			cout << "Failed to start camera manager" << endl;
+			return TestFail;
+		}
+
+		shared_ptr<Camera> camera = cm_->get("v4l2-compat-test");
+		if (!camera) {
+			cout << "Virtual camera not available" << endl;
+			return TestSkip;
+		}
+
+		proxy_ = make_unique<V4L2CameraProxy>(0, camera);
+
+		efd_ = eventfd(0, EFD_SEMAPHORE);
+		if (efd_ < 0) {
+			cout << "Failed to create eventfd" << endl;
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+
+	int ioctl(V4L2CameraFile *file, unsigned long request, void *arg)
+	{
+		int ret = proxy_->ioctl(file, request, arg);
+		return ret < 0 ? -errno : ret;
+	}
+
+	int run() override
+	{
+		V4L2CameraFile file(efd_, false, proxy_.get());
+
+		struct v4l2_requestbuffers reqbufs = {};
+		reqbufs.count = 4;
+		reqbufs.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+		reqbufs.memory = V4L2_MEMORY_MMAP;
+		if (ioctl(&file, VIDIOC_REQBUFS, &reqbufs) || !reqbufs.count) {
+			cout << "Failed to request buffers" << endl;
+			return TestFail;
+		}
+
+		for (unsigned int i = 0; i < reqbufs.count; ++i) {
+			struct v4l2_buffer buf = {};
+			buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+			buf.memory = V4L2_MEMORY_MMAP;
+			buf.index = i;
+			if (ioctl(&file, VIDIOC_QBUF, &buf)) {
+				cout << "Failed to queue buffer " << i << endl;
+				return TestFail;
+			}
+		}
+
+		int type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+		if (ioctl(&file, VIDIOC_STREAMON, &type)) {
+			cout << "Failed to start streaming" << endl;
+			return TestFail;
+		}
+
+		/* Load the proxy with configuration ioctls from another thread. */
+		atomic<bool> stop{ false };
+		atomic<unsigned int> configIoctls{ 0 };
+		atomic<bool> configError{ false };
+
+		thread loader([&]() {
+			while (!stop) {
+				struct v4l2_format fmt = {};
+				fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+				struct v4l2_capability cap = {};
+				struct v4l2_fmtdesc fmtdesc = {};
+				fmtdesc.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+
+				if (ioctl(&file, VIDIOC_G_FMT, &fmt) ||
+				    ioctl(&file, VIDIOC_TRY_FMT, &fmt) ||
+				    ioctl(&file, VIDIOC_QUERYCAP, &cap) ||
+				    ioctl(&file, VIDIOC_ENUM_FMT, &fmtdesc))
+					configError = true;
+
+				configIoctls++;
+			}
+		});
+
+		vector<uint64_t> latencies;
+		int status = TestPass;
+
+		for (unsigned int i = 0; i < kNumFrames; ++i) {
+			struct v4l2_buffer buf = {};
+			buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+			buf.memory = V4L2_MEMORY_MMAP;
+
+			if (ioctl(&file, VIDIOC_DQBUF, &buf)) {
+				cout << "Failed to dequeue buffer" << endl;
+				status = TestFail;
+				break;
+			}
+
+			struct timespec now;
+			clock_gettime(CLOCK_MONOTONIC, &now);
+
+			uint64_t done = now.tv_sec * 1000000ULL + now.tv_nsec / 1000;
+			uint64_t timestamp = buf.timestamp.tv_sec * 1000000ULL
+					   + buf.timestamp.tv_usec;
+			latencies.push_back(done - timestamp);
+
+			if (ioctl(&file, VIDIOC_QBUF, &buf)) {
+				cout << "Failed to requeue buffer" << endl;
+				status = TestFail;
+				break;
+			}
+		}
+
+		stop = true;
+		loader.join();
+
+		if (ioctl(&file, VIDIOC_STREAMOFF, &type)) {
+			cout << "Failed to stop streaming" << endl;
+			return TestFail;
+		}
+
+		reqbufs.count = 0;
+		if (ioctl(&file, VIDIOC_REQBUFS, &reqbufs)) {
+			cout << "Failed to free buffers" << endl;
+			return TestFail;
+		}
+
+		if (status != TestPass)
+			return status;
+
+		if (configError) {
+			cout << "Configuration ioctl failed" << endl;
+			return TestFail;
+		}
+
+		/*
+		 * The configuration ioctls must not have been starved by
+		 * DQBUF waiting for frames.
+		 */
+		if (configIoctls < kNumFrames) {
+			cout << "Configuration ioctls starved (" << configIoctls
+			     << " in " << kNumFrames << " frames)" << endl;
+			return TestFail;
+		}
+
+		sort(latencies.begin(), latencies.end());
+		cout << "DQBUF latency (us): median "
+		     << latencies[latencies.size() / 2]
+		     << ", p95 " << latencies[latencies.size() * 95 / 100]
+		     << ", max " << latencies.back()
+		     << " with " << configIoctls << " configuration ioctl loops"
+		     << endl;
+
+		return TestPass;
+	}
+
+	void cleanup() override
+	{
+		proxy_.reset();
+
+		if (efd_ >= 0)
+			::close(efd_);
+
+		delete cm_;
+	}
+
+private:
+	CameraManager *cm_ = nullptr;
+	unique_ptr<V4L2CameraProxy> proxy_;
+	int efd_ = -1;
+};
+
+TEST_REGISTER(V4L2CompatDqbufTest)
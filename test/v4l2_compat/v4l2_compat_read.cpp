@@ -0,0 +1,304 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2020, Google Inc.
+ *
+ * v4l2_compat_read.cpp - V4L2 compatibility layer read() and multi-open test
+ */
+
+#include <atomic>
+#include <errno.h>
+#include <iostream>
+#include <linux/videodev2.h>
+#include <memory>
+#include <sys/eventfd.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include <libcamera/camera_manager.h>
+
+#include "v4l2_camera_file.h"
+#include "v4l2_camera_proxy.h"
+
+#include "test.h"
+
+using namespace std;
+using namespace libcamera;
+
+/*
+ * Capture frames with read(), and share the frames captured by the owner of
+ * the camera, using either read() or streaming I/O, with a second file
+ * reading from another thread.
+ *
+ * The camera is described by the LIBCAMERA_VIRTUAL_CAMERAS environment
+ * variable, set by the test runner.
+ */
+class V4L2CompatReadTest : public Test
+{
+protected:
+	static constexpr unsigned int kNumFrames = 30;
+
+	class Monitor
+	{
+	public:
+		Monitor(V4L2CameraProxy *proxy, int efd, size_t frameSize)
+			: file_(efd, false, proxy), frameSize_(frameSize),
+			  stop_(false), frames_(0), errors_(0)
+		{
+			thread_ = thread(&Monitor::run, this);
+		}
+
+		~Monitor()
+		{
+			stop();
+		}
+
+		/*
+		 * The monitor stops once the owner releases the camera, after
+		 * taking it over to read one more frame.
+		 */
+		void stop()
+		{
+			stop_ = true;
+			if (thread_.joinable())
+				thread_.join();
+		}
+
+		unsigned int frames() const { return frames_; }
+		unsigned int errors() const { return errors_; }
+
+	private:
+		void run()
+		{
+			vector<uint8_t> frame(frameSize_);
+
+			while (!stop_) {
+				ssize_t ret = file_.proxy()->read(&file_, frame.data(),
+								  frame.size());
+				if (ret != static_cast<ssize_t>(frameSize_))
+					errors_++;
+				else
+					frames_++;
+			}
+		}
+
+		V4L2CameraFile file_;
+		size_t frameSize_;
+		thread thread_;
+
+		atomic<bool> stop_;
+		atomic<unsigned int> frames_;
+		atomic<unsigned int> errors_;
+	};
+
+	int init() override
+	{
+		cm_ = new CameraManager();
+
+		if (cm_->start()) {
+			cout << "Failed to start camera manager" << endl;
+			return TestFail;
+		}
+
+		shared_ptr<Camera> camera = cm_->get("v4l2-compat-test");
+		if (!camera) {
+			cout << "Virtual camera not available" << endl;
+			return TestSkip;
+		}
+
+		proxy_ = make_unique<V4L2CameraProxy>(0, camera);
+
+		for (int &efd : efds_) {
+			efd = eventfd(0, EFD_SEMAPHORE);
+			if (efd < 0) {
+				cout << "Failed to create eventfd" << endl;
+				return TestFail;
+			}
+		}
+
+		return TestPass;
+	}
+
+	int ioctl(V4L2CameraFile *file, unsigned long request, void *arg)
+	{
+		int ret = proxy_->ioctl(file, request, arg);
+		return ret < 0 ? -errno : ret;
+	}
+
+	int testReadOwner()
+	{
+		auto file = make_unique<V4L2CameraFile>(efds_[0], false, proxy_.get());
+
+		struct v4l2_capability cap = {};
+		if (ioctl(file.get(), VIDIOC_QUERYCAP, &cap) ||
+		    !(cap.device_caps & V4L2_CAP_READWRITE)) {
+			cout << "read() I/O not reported" << endl;
+			return TestFail;
+		}
+
+		struct v4l2_format fmt = {};
+		fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+		if (ioctl(file.get(), VIDIOC_G_FMT, &fmt)) {
+			cout << "Failed to get format" << endl;
+			return TestFail;
+		}
+
+		size_t frameSize = fmt.fmt.pix.sizeimage;
+		vector<uint8_t> frame(frameSize);
+
+		/* Start streaming, before the monitor attaches. */
+		if (proxy_->read(file.get(), frame.data(), frame.size()) !=
+		    static_cast<ssize_t>(frameSize)) {
+			cout << "Failed to read first frame" << endl;
+			return TestFail;
+		}
+
+		struct v4l2_requestbuffers reqbufs = {};
+		reqbufs.count = 4;
+		reqbufs.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+		reqbufs.memory = V4L2_MEMORY_MMAP;
+		if (ioctl(file.get(), VIDIOC_REQBUFS, &reqbufs) != -EBUSY) {
+			cout << "Streaming I/O allowed during read() I/O" << endl;
+			return TestFail;
+		}
+
+		Monitor monitor(proxy_.get(), efds_[1], frameSize);
+
+		for (unsigned int i = 0; i < kNumFrames; ++i) {
+			/* Read every other frame in small chunks. */
+			size_t chunk = i % 2 ? 4096 : frameSize;
+			size_t size = 0;
+
+			while (size < frameSize) {
+				ssize_t ret = proxy_->read(file.get(), frame.data() + size,
+							   min(chunk, frameSize - size));
+				if (ret <= 0) {
+					cout << "Failed to read frame " << i << endl;
+					return TestFail;
+				}
+
+				size += ret;
+			}
+		}
+
+		/* Closing the owner lets the monitor take over. */
+		file.reset();
+		monitor.stop();
+
+		if (monitor.errors() || monitor.frames() < kNumFrames / 2) {
+			cout << "Monitor read " << monitor.frames() << " frames with "
+			     << monitor.errors() << " errors during read() I/O"
+			     << endl;
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+
+	int testStreamingOwner()
+	{
+		V4L2CameraFile file(efds_[2], false, proxy_.get());
+
+		struct v4l2_requestbuffers reqbufs = {};
+		reqbufs.count = 4;
+		reqbufs.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+		reqbufs.memory = V4L2_MEMORY_MMAP;
+		if (ioctl(&file, VIDIOC_REQBUFS, &reqbufs) || !reqbufs.count) {
+			cout << "Failed to request buffers" << endl;
+			return TestFail;
+		}
+
+		for (unsigned int i = 0; i < reqbufs.count; ++i) {
+			struct v4l2_buffer buf = {};
+			buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+			buf.memory = V4L2_MEMORY_MMAP;
+			buf.index = i;
+			if (ioctl(&file, VIDIOC_QBUF, &buf)) {
+				cout << "Failed to queue buffer " << i << endl;
+				return TestFail;
+			}
+		}
+
+		int type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+		if (ioctl(&file, VIDIOC_STREAMON, &type)) {
+			cout << "Failed to start streaming" << endl;
+			return TestFail;
+		}
+
+		struct v4l2_format fmt = {};
+		fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+		ioctl(&file, VIDIOC_G_FMT, &fmt);
+
+		Monitor monitor(proxy_.get(), efds_[3], fmt.fmt.pix.sizeimage);
+
+		for (unsigned int i = 0; i < kNumFrames; ++i) {
+			struct v4l2_buffer buf = {};
+			buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+			buf.memory = V4L2_MEMORY_MMAP;
+
+			if (ioctl(&file, VIDIOC_DQBUF, &buf)) {
+				cout << "Failed to dequeue buffer" << endl;
+				return TestFail;
+			}
+
+			if (ioctl(&file, VIDIOC_QBUF, &buf)) {
+				cout << "Failed to requeue buffer" << endl;
+				return TestFail;
+			}
+		}
+
+		if (ioctl(&file, VIDIOC_STREAMOFF, &type)) {
+			cout << "Failed to stop streaming" << endl;
+			return TestFail;
+		}
+
+		reqbufs.count = 0;
+		if (ioctl(&file, VIDIOC_REQBUFS, &reqbufs)) {
+			cout << "Failed to free buffers" << endl;
+			return TestFail;
+		}
+
+		monitor.stop();
+
+		if (monitor.errors() || monitor.frames() < kNumFrames / 2) {
+			cout << "Monitor read " << monitor.frames() << " frames with "
+			     << monitor.errors() << " errors during streaming I/O"
+			     << endl;
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+
+	int run() override
+	{
+		int ret = testReadOwner();
+		if (ret != TestPass)
+			return ret;
+
+		ret = testStreamingOwner();
+		if (ret != TestPass)
+			return ret;
+
+		return TestPass;
+	}
+
+	void cleanup() override
+	{
+		proxy_.reset();
+
+		for (int efd : efds_) {
+			if (efd >= 0)
+				::close(efd);
+		}
+
+		delete cm_;
+	}
+
+private:
+	CameraManager *cm_ = nullptr;
+	unique_ptr<V4L2CameraProxy> proxy_;
+	int efds_[4] = { -1, -1, -1, -1 };
+};
+
+TEST_REGISTER(V4L2CompatReadTest)
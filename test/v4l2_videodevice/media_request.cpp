@@ -0,0 +1,195 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2020, Google Inc.
+ *
+ * media_request.cpp - Test capture with media requests
+ */
+
+#include <iostream>
+#include <map>
+#include <set>
+
+#include <libcamera/event_dispatcher.h>
+#include <libcamera/timer.h>
+
+#include "libcamera/internal/media_request.h"
+#include "libcamera/internal/thread.h"
+
+#include "v4l2_videodevice_test.h"
+
+using namespace std;
+
+class MediaRequestTest : public V4L2VideoDeviceTest
+{
+public:
+	MediaRequestTest()
+		: V4L2VideoDeviceTest("vivid", "vivid-000-vid-cap"), frames_(0),
+		  value_(0), failed_(false)
+	{
+	}
+
+protected:
+	void bufferComplete(FrameBuffer *buffer)
+	{
+		completedBuffers_.insert(buffer);
+		requeue(buffer);
+	}
+
+	void requestComplete(MediaRequest *request)
+	{
+		FrameBuffer *buffer = requestBuffers_[request];
+		int32_t expected = requestValues_[request];
+
+		/* The controls stored in the request shall match the frame. */
+		ControlList ctrls = capture_->getControls({ V4L2_CID_BRIGHTNESS },
+							  request);
+		int32_t brightness = ctrls.get(V4L2_CID_BRIGHTNESS).get<int32_t>();
+		if (brightness != expected) {
+			cerr << "Request " << request->index() << " brightness "
+			     << brightness << ", expected " << expected << endl;
+			failed_ = true;
+		}
+
+		requestBuffers_.erase(request);
+		requestValues_.erase(request);
+
+		if (pool_.put(request) < 0) {
+			cerr << "Failed to recycle request" << endl;
+			failed_ = true;
+		}
+
+		frames_++;
+		completedRequests_.insert(buffer);
+		requeue(buffer);
+	}
+
+	/* Requeue a buffer when both the buffer and its request completed. */
+	void requeue(FrameBuffer *buffer)
+	{
+		if (!completedBuffers_.count(buffer) ||
+		    !completedRequests_.count(buffer))
+			return;
+
+		completedBuffers_.erase(buffer);
+		completedRequests_.erase(buffer);
+
+		if (queue(buffer))
+			failed_ = true;
+	}
+
+	int queue(FrameBuffer *buffer)
+	{
+		MediaRequest *request = pool_.get();
+		if (!request) {
+			cerr << "Request pool exhausted" << endl;
+			return TestFail;
+		}
+
+		int32_t value = value_++ % 256;
+		ControlList ctrls(capture_->controls());
+		ctrls.set(V4L2_CID_BRIGHTNESS, value);
+
+		if (capture_->setControls(&ctrls, request)) {
+			cerr << "Failed to set controls in request" << endl;
+			return TestFail;
+		}
+
+		if (capture_->queueBuffer(buffer, request)) {
+			cerr << "Failed to queue buffer in request" << endl;
+			return TestFail;
+		}
+
+		requestBuffers_[request] = buffer;
+		requestValues_[request] = value;
+
+		if (request->queue()) {
+			cerr << "Failed to queue request" << endl;
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+
+	int run() override
+	{
+		const unsigned int bufferCount = 8;
+
+		EventDispatcher *dispatcher = Thread::current()->eventDispatcher();
+		Timer timeout;
+		int ret;
+
+		ret = capture_->allocateBuffers(bufferCount, &buffers_);
+		if (ret < 0) {
+			cerr << "Failed to allocate buffers" << endl;
+			return TestFail;
+		}
+
+		if (!capture_->supportsRequests()) {
+			cerr << "Video device doesn't support requests" << endl;
+			return TestSkip;
+		}
+
+		if (!media_->acquire()) {
+			cerr << "Failed to acquire media device" << endl;
+			return TestFail;
+		}
+
+		ret = pool_.allocate(media_.get(), bufferCount);
+		if (ret != static_cast<int>(bufferCount)) {
+			cerr << "Failed to allocate requests" << endl;
+			media_->release();
+			return TestFail;
+		}
+
+		pool_.requestCompleted.connect(this, &MediaRequestTest::requestComplete);
+		capture_->bufferReady.connect(this, &MediaRequestTest::bufferComplete);
+
+		for (const std::unique_ptr<FrameBuffer> &buffer : buffers_) {
+			if (queue(buffer.get()))
+				return TestFail;
+		}
+
+		if (pool_.available()) {
+			cerr << "Requests not taken from the pool" << endl;
+			return TestFail;
+		}
+
+		ret = capture_->streamOn();
+		if (ret)
+			return TestFail;
+
+		timeout.start(10000);
+		while (timeout.isRunning()) {
+			dispatcher->processEvents();
+			if (frames_ > 30 || failed_)
+				break;
+		}
+
+		capture_->streamOff();
+		pool_.release();
+		media_->release();
+
+		if (failed_)
+			return TestFail;
+
+		if (frames_ < 30) {
+			cerr << "Failed to capture 30 frames within timeout" << endl;
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+
+private:
+	MediaRequestPool pool_;
+	std::map<MediaRequest *, FrameBuffer *> requestBuffers_;
+	std::map<MediaRequest *, int32_t> requestValues_;
+	std::set<FrameBuffer *> completedBuffers_;
+	std::set<FrameBuffer *> completedRequests_;
+
+	unsigned int frames_;
+	int32_t value_;
+	bool failed_;
+};
+
+TEST_REGISTER(MediaRequestTest);
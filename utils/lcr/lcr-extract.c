@@ -0,0 +1,456 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * lcr-extract - List and extract frames from cam raw container files
+ *
+ * Copyright (C) 2020, Google Inc.
+ */
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "raw_container.h"
+
+struct container {
+	int fd;
+	uint64_t size;
+	struct lcr_header header;
+	struct lcr_stream *streams;
+	struct lcr_control *controls;
+	struct lcr_index *index;
+	uint64_t num_frames;
+};
+
+static void usage(const char *argv0)
+{
+	printf("Usage: %s [options] input-file\n", basename(argv0));
+	printf("List and extract frames from a cam raw container file\n\n");
+	printf("Options:\n");
+	printf("  -f first    Skip frames with a lower sequence number\n");
+	printf("  -h          Display this help message\n");
+	printf("  -l          List frames and their metadata\n");
+	printf("  -n count    Process at most count frames\n");
+	printf("  -o pattern  Write frames to files. The first '#' character in the\n");
+	printf("              pattern is expanded to the stream name and sequence\n");
+	printf("              number, frames are concatenated otherwise\n");
+	printf("  -s stream   Only process frames from the stream index\n");
+}
+
+static int read_at(int fd, void *data, size_t size, uint64_t offset)
+{
+	uint8_t *buf = data;
+
+	while (size) {
+		ssize_t ret = pread(fd, buf, size, offset);
+		if (ret == -1) {
+			if (errno == EINTR)
+				continue;
+			return -errno;
+		}
+		if (ret == 0)
+			return -ENODATA;
+
+		buf += ret;
+		size -= ret;
+		offset += ret;
+	}
+
+	return 0;
+}
+
+static int load_index(struct container *c)
+{
+	struct lcr_trailer trailer;
+	uint64_t offset;
+	size_t allocated = 0;
+	int ret;
+
+	if (c->size >= c->header.header_size + sizeof(trailer)) {
+		ret = read_at(c->fd, &trailer, sizeof(trailer),
+			      c->size - sizeof(trailer));
+		if (ret < 0)
+			return ret;
+
+		if (!memcmp(trailer.magic, LCR_TRAILER_MAGIC, sizeof(trailer.magic)) &&
+		    trailer.index_offset + trailer.num_entries * sizeof(*c->index)
+		    <= c->size - sizeof(trailer)) {
+			c->num_frames = trailer.num_entries;
+			c->index = calloc(c->num_frames ? c->num_frames : 1,
+					  sizeof(*c->index));
+			if (!c->index)
+				return -ENOMEM;
+
+			return read_at(c->fd, c->index,
+				       c->num_frames * sizeof(*c->index),
+				       trailer.index_offset);
+		}
+	}
+
+	/* The recording was interrupted, walk the frame records. */
+	fprintf(stderr, "No index found, scanning frames\n");
+
+	for (offset = c->header.header_size; offset < c->size; ) {
+		struct lcr_frame frame;
+
+		ret = read_at(c->fd, &frame, sizeof(frame), offset);
+		if (ret < 0 || frame.magic != LCR_FRAME_MAGIC ||
+		    !frame.record_size || offset + frame.record_size > c->size)
+			break;
+
+		if (c->num_frames == allocated) {
+			struct lcr_index *index;
+
+			allocated = allocated ? allocated * 2 : 256;
+			index = realloc(c->index, allocated * sizeof(*index));
+			if (!index)
+				return -ENOMEM;
+			c->index = index;
+		}
+
+		c->index[c->num_frames].offset = offset;
+		c->index[c->num_frames].timestamp = frame.timestamp;
+		c->index[c->num_frames].stream = frame.stream;
+		c->index[c->num_frames].sequence = frame.sequence;
+		c->num_frames++;
+
+		offset += frame.record_size;
+	}
+
+	return 0;
+}
+
+static int open_container(struct container *c, const char *filename)
+{
+	struct stat st;
+	size_t size;
+	int ret;
+
+	memset(c, 0, sizeof(*c));
+
+	c->fd = open(filename, O_RDONLY);
+	if (c->fd == -1) {
+		ret = -errno;
+		fprintf(stderr, "Failed to open input file '%s': %s\n",
+			filename, strerror(-ret));
+		return ret;
+	}
+
+	if (fstat(c->fd, &st) == -1)
+		return -errno;
+	c->size = st.st_size;
+
+	ret = read_at(c->fd, &c->header, sizeof(c->header), 0);
+	if (ret < 0 ||
+	    memcmp(c->header.magic, LCR_HEADER_MAGIC, sizeof(c->header.magic)) ||
+	    c->header.version != LCR_VERSION) {
+		fprintf(stderr, "'%s' is not a raw container file\n", filename);
+		return -EINVAL;
+	}
+
+	size = c->header.num_streams * sizeof(*c->streams);
+	c->streams = malloc(size ? size : 1);
+	if (!c->streams)
+		return -ENOMEM;
+
+	ret = read_at(c->fd, c->streams, size, sizeof(c->header));
+	if (ret < 0)
+		return ret;
+
+	size = c->header.num_controls * sizeof(*c->controls);
+	c->controls = malloc(size ? size : 1);
+	if (!c->controls)
+		return -ENOMEM;
+
+	ret = read_at(c->fd, c->controls, size,
+		      sizeof(c->header) +
+		      c->header.num_streams * sizeof(*c->streams));
+	if (ret < 0)
+		return ret;
+
+	return load_index(c);
+}
+
+static void close_container(struct container *c)
+{
+	free(c->streams);
+	free(c->controls);
+	free(c->index);
+	if (c->fd != -1)
+		close(c->fd);
+}
+
+static const char *control_name(const struct container *c, uint32_t id)
+{
+	unsigned int i;
+
+	for (i = 0; i < c->header.num_controls; i++) {
+		if (c->controls[i].id == id)
+			return c->controls[i].name;
+	}
+
+	return NULL;
+}
+
+static void print_metadata(const struct container *c, const uint8_t *data,
+			   size_t size)
+{
+	size_t offset = 0;
+
+	while (offset + sizeof(struct lcr_metadata) <= size) {
+		struct lcr_metadata entry;
+		const uint8_t *value;
+		const char *name;
+		size_t element;
+		unsigned int i;
+
+		memcpy(&entry, data + offset, sizeof(entry));
+		value = data + offset + sizeof(entry);
+
+		switch (entry.type) {
+		case 1: /* bool */
+		case 2: /* byte */
+			element = 1;
+			break;
+		case 4: /* int64 */
+			element = 8;
+			break;
+		default:
+			element = 4;
+			break;
+		}
+
+		if (offset + sizeof(entry) + entry.count * element > size)
+			break;
+
+		name = control_name(c, entry.id);
+		if (name)
+			printf(" %s=", name);
+		else
+			printf(" 0x%08x=", entry.id);
+
+		for (i = 0; i < entry.count; i++, value += element) {
+			int32_t i32;
+			int64_t i64;
+			float f;
+
+			if (i)
+				printf(",");
+
+			switch (entry.type) {
+			case 1:
+			case 2:
+				printf("%u", *value);
+				break;
+			case 3:
+				memcpy(&i32, value, sizeof(i32));
+				printf("%d", i32);
+				break;
+			case 4:
+				memcpy(&i64, value, sizeof(i64));
+				printf("%" PRId64, i64);
+				break;
+			case 5:
+				memcpy(&f, value, sizeof(f));
+				printf("%g", f);
+				break;
+			default:
+				printf("?");
+				break;
+			}
+		}
+
+		offset += sizeof(entry) + ((entry.count * element + 3) & ~3);
+	}
+}
+
+static int write_frame(const struct container *c, const struct lcr_index *entry,
+		       const struct lcr_frame *frame, const char *pattern,
+		       int *concat_fd)
+{
+	const struct lcr_stream *stream = &c->streams[entry->stream];
+	uint64_t offset = entry->offset + c->header.alignment;
+	const char *hash = strchr(pattern, '#');
+	uint8_t *data = NULL;
+	char *filename = NULL;
+	unsigned int i;
+	int fd = *concat_fd;
+	int ret = 0;
+
+	if (hash) {
+		if (asprintf(&filename, "%.*s%s-%06u%s", (int)(hash - pattern),
+			     pattern, stream->name, frame->sequence, hash + 1) < 0)
+			return -ENOMEM;
+
+		fd = open(filename, O_WRONLY | O_TRUNC | O_CREAT, 0644);
+	} else if (fd == -1) {
+		fd = open(pattern, O_WRONLY | O_TRUNC | O_CREAT, 0644);
+		*concat_fd = fd;
+	}
+
+	if (fd == -1) {
+		ret = -errno;
+		fprintf(stderr, "Failed to open output file '%s': %s\n",
+			filename ? filename : pattern, strerror(-ret));
+		free(filename);
+		return ret;
+	}
+
+	for (i = 0; i < frame->num_planes && i < LCR_MAX_PLANES; i++) {
+		uint32_t size = frame->bytesused[i];
+
+		data = realloc(data, size ? size : 1);
+		if (!data) {
+			ret = -ENOMEM;
+			break;
+		}
+
+		ret = read_at(c->fd, data, size, offset);
+		if (ret < 0) {
+			fprintf(stderr, "Failed to read frame data: %s\n",
+				strerror(-ret));
+			break;
+		}
+
+		if (write(fd, data, size) != (ssize_t)size) {
+			ret = -errno;
+			fprintf(stderr, "Failed to write output data: %s\n",
+				strerror(-ret));
+			break;
+		}
+
+		offset += ((uint64_t)size + c->header.alignment - 1)
+			/ c->header.alignment * c->header.alignment;
+	}
+
+	free(data);
+	if (hash) {
+		close(fd);
+		free(filename);
+	}
+
+	return ret;
+}
+
+int main(int argc, char *argv[])
+{
+	const char *pattern = NULL;
+	unsigned long first = 0;
+	unsigned long count = ~0UL;
+	long stream_filter = -1;
+	struct container c;
+	uint8_t *record;
+	int concat_fd = -1;
+	bool list = false;
+	uint64_t i;
+	int opt;
+	int ret;
+
+	while ((opt = getopt(argc, argv, "f:hln:o:s:")) != -1) {
+		switch (opt) {
+		case 'f':
+			first = strtoul(optarg, NULL, 0);
+			break;
+		case 'l':
+			list = true;
+			break;
+		case 'n':
+			count = strtoul(optarg, NULL, 0);
+			break;
+		case 'o':
+			pattern = optarg;
+			break;
+		case 's':
+			stream_filter = strtol(optarg, NULL, 0);
+			break;
+		case 'h':
+		default:
+			usage(argv[0]);
+			return opt == 'h' ? 0 : 1;
+		}
+	}
+
+	if (optind != argc - 1) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	ret = open_container(&c, argv[optind]);
+	if (ret < 0) {
+		close_container(&c);
+		return 1;
+	}
+
+	for (i = 0; i < c.header.num_streams; i++) {
+		const struct lcr_stream *s = &c.streams[i];
+
+		printf("stream %" PRIu64 " '%s': %ux%u %.4s stride %u\n", i,
+		       s->name, s->width, s->height, (const char *)&s->fourcc,
+		       s->stride);
+	}
+	printf("%" PRIu64 " frames\n", c.num_frames);
+
+	record = malloc(c.header.alignment);
+	if (!record) {
+		close_container(&c);
+		return 1;
+	}
+
+	for (i = 0; i < c.num_frames && count; i++) {
+		const struct lcr_index *entry = &c.index[i];
+		const struct lcr_frame *frame = (const struct lcr_frame *)record;
+
+		if (entry->stream >= c.header.num_streams ||
+		    (stream_filter >= 0 && entry->stream != stream_filter) ||
+		    entry->sequence < first)
+			continue;
+
+		ret = read_at(c.fd, record, c.header.alignment, entry->offset);
+		if (ret < 0 || frame->magic != LCR_FRAME_MAGIC) {
+			fprintf(stderr, "Invalid frame record at offset %" PRIu64 "\n",
+				entry->offset);
+			ret = -EINVAL;
+			break;
+		}
+
+		if (list) {
+			unsigned int p;
+
+			printf("%" PRIu64 ".%06" PRIu64 " %s seq: %06u bytesused:",
+			       frame->timestamp / 1000000000,
+			       frame->timestamp / 1000 % 1000000,
+			       c.streams[entry->stream].name, frame->sequence);
+			for (p = 0; p < frame->num_planes && p < LCR_MAX_PLANES; p++)
+				printf("%s%u", p ? "/" : " ", frame->bytesused[p]);
+
+			print_metadata(&c, record + sizeof(*frame),
+				       frame->metadata_size < c.header.alignment - sizeof(*frame)
+				       ? frame->metadata_size
+				       : c.header.alignment - sizeof(*frame));
+			printf("\n");
+		}
+
+		if (pattern) {
+			ret = write_frame(&c, entry, frame, pattern, &concat_fd);
+			if (ret < 0)
+				break;
+		}
+
+		count--;
+	}
+
+	free(record);
+	if (concat_fd != -1)
+		close(concat_fd);
+	close_container(&c);
+
+	return ret < 0 ? 1 : 0;
+}
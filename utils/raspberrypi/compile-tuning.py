@@ -0,0 +1,177 @@
+#!/usr/bin/env python3
+# SPDX-License-Identifier: BSD-2-Clause
+# Copyright (C) 2020, Google Inc.
+#
+# compile-tuning.py - Compile Raspberry Pi JSON tuning files to binary form
+#
+# The binary tuning file is loaded by the IPA with a single mmap() and
+# accessed in place, avoiding the cost of parsing JSON when the camera is
+# opened. The format is described in src/ipa/raspberrypi/controller/tuning.cpp
+# and must be kept in sync with the reader.
+
+import argparse
+import json
+import re
+import struct
+import sys
+
+MAGIC = 0x54495052  # "RPIT"
+VERSION = 1
+
+HEADER = struct.Struct('<IIIIQ')
+NODE = struct.Struct('<IIIId')
+
+FLAG_CONTAINER = 1 << 0
+FLAG_NUMBER = 1 << 1
+FLAG_INTEGER = 1 << 2
+
+# Values are stored as text, and JSON doesn't distinguish numbers from strings
+# when read by the IPA. Any value that can be extracted from a stream as a
+# number is thus flagged as such, regardless of its JSON type.
+number_regex = re.compile(r'\s*[+-]?([0-9]+\.?[0-9]*|\.[0-9]+)([eE][+-]?[0-9]+)?\s*')
+integer_regex = re.compile(r'\s*[+-]?[0-9]+\s*')
+
+
+class Literal(str):
+    """A number, stored with its original JSON text"""
+    pass
+
+
+class Container(list):
+    """An object or array, stored as a list of (key, value) pairs"""
+    pass
+
+
+def fnv1a(data):
+    value = 0xcbf29ce484222325
+    for byte in data:
+        value ^= byte
+        value = (value * 0x100000001b3) & 0xffffffffffffffff
+    return value
+
+
+def text(value):
+    if isinstance(value, str):
+        return value
+    if value is None:
+        return 'null'
+    return 'true' if value else 'false'
+
+
+class Compiler(object):
+    def __init__(self):
+        # Each node is a [flags, key, data, count, value] list, with the key
+        # and data strings resolved to offsets when the file is written.
+        self.nodes = []
+        self.strings = {}
+
+    def string(self, s):
+        if s not in self.strings:
+            self.strings[s] = None
+        return s
+
+    def fill(self, index, key, value):
+        node = self.nodes[index]
+        node[1] = self.string(key)
+
+        if isinstance(value, Container):
+            # Containers store their children contiguously, right after all
+            # the nodes allocated so far. Children are thus always located
+            # after their parent, which the reader relies on to reject loops.
+            first = len(self.nodes)
+            for _ in range(len(value)):
+                self.nodes.append([0, None, None, 0, 0.0])
+
+            node[0] = FLAG_CONTAINER
+            node[2] = first
+            node[3] = len(value)
+
+            for i, (child_key, child_value) in enumerate(value):
+                self.fill(first + i, child_key, child_value)
+        else:
+            value = text(value)
+            node[2] = self.string(value)
+
+            if number_regex.fullmatch(value):
+                node[0] |= FLAG_NUMBER
+                node[4] = float(value)
+            if integer_regex.fullmatch(value):
+                node[0] |= FLAG_INTEGER
+
+    def compile(self, root, source):
+        self.nodes.append([0, None, None, 0, 0.0])
+        self.fill(0, '', root)
+
+        nodes_offset = HEADER.size
+        strings_offset = nodes_offset + len(self.nodes) * NODE.size
+
+        strings = bytearray()
+        for s in self.strings:
+            self.strings[s] = strings_offset + len(strings)
+            strings += s.encode('utf-8') + b'\0'
+
+        size = strings_offset + len(strings)
+
+        data = bytearray(HEADER.pack(MAGIC, VERSION, size, len(self.nodes),
+                                     fnv1a(source)))
+
+        for flags, key, node_data, count, value in self.nodes:
+            if flags & FLAG_CONTAINER:
+                node_data = nodes_offset + node_data * NODE.size
+            else:
+                node_data = self.strings[node_data]
+
+            data += NODE.pack(flags, self.strings[key], node_data, count, value)
+
+        data += strings
+        return data
+
+
+def load(source):
+    # Objects and arrays are both represented as lists of (key, value) pairs,
+    # with empty keys for array elements. This preserves the order and
+    # duplicated keys, as the IPA's JSON parser does.
+    def convert(value):
+        if isinstance(value, list) and not isinstance(value, Container):
+            return Container([('', convert(v)) for v in value])
+        return value
+
+    def object_pairs(pairs):
+        return Container([(k, convert(v)) for k, v in pairs])
+
+    root = json.loads(source.decode('utf-8'),
+                      object_pairs_hook=object_pairs,
+                      parse_float=Literal, parse_int=Literal)
+    return convert(root)
+
+
+def main(argv):
+    parser = argparse.ArgumentParser(description='Compile a Raspberry Pi tuning file to binary form')
+    parser.add_argument('-o', dest='output', metavar='file', type=str, required=True,
+                        help='Output file name')
+    parser.add_argument('input', type=str,
+                        help='Input JSON tuning file')
+    args = parser.parse_args(argv[1:])
+
+    source = open(args.input, 'rb').read()
+
+    try:
+        root = load(source)
+    except ValueError as e:
+        print(f'{args.input}: {e}', file=sys.stderr)
+        return 1
+
+    if not isinstance(root, Container):
+        print(f'{args.input}: root must be an object', file=sys.stderr)
+        return 1
+
+    data = Compiler().compile(root, source)
+
+    with open(args.output, 'wb') as output:
+        output.write(data)
+
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main(sys.argv))